@@ -0,0 +1,1525 @@
+/*
+ * Workload benchmarks for Hash Blocks.
+ *
+ * Generates synthetic name sets (uniform, Zipfian lookups and census-like
+ * prefixes), loads them into Hash Blocks tables and into two baseline
+ * structures (a plain chained hash table and a 26-ary trie), and reports
+ * insert throughput, hit and miss lookup latency percentiles, bytes per key
+ * and peak RSS as CSV or JSON, so results can be compared between versions.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o benchmark.exe benchmark.c hashblocks.c
+ */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  // clock_gettime under -std=c17
+#endif
+#include "hashblocks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
+
+// Peak RSS comes from the process memory counters on Windows and getrusage elsewhere
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Length of each key slot in a workload (names are at most KEY_MAX_LENGTH characters)
+#define KEY_STRIDE 16
+#define KEY_MAX_LENGTH 12
+
+// Default number of keys loaded and of lookups timed per workload
+#define DEFAULT_KEYS 100000
+#define DEFAULT_QUERIES 100000
+
+// Exponent of the Zipfian lookup distribution (the usual YCSB setting)
+#define ZIPF_EXPONENT 0.99
+
+// Initial bucket count of the baseline hash table; it doubles at load factor 1
+#define BASELINE_MIN_BUCKETS 1024
+
+// Largest number of names searched per edit budget by the fuzzy benchmark (-e)
+#define FUZZY_QUERIES 1000
+
+// Length of each key slot of the kernel benchmark (-k); keys are at most 24 characters
+#define KERNEL_STRIDE 32
+
+// Number of passes per kernel measurement (-k); the fastest pass is reported
+#define KERNEL_ROUNDS 3
+
+// Names loaded by the concurrency benchmark (-t), and names its writers churn
+#define CONCURRENCY_NAMES 100000
+#define CONCURRENCY_CHURN 4096
+
+// Length of each name slot of the concurrency benchmark
+#define CONCURRENCY_STRIDE 16
+
+// Most reader threads of the concurrency benchmark; the library reads wait-free
+// from 128 threads at a time and sends further ones through the writer locks
+#define CONCURRENCY_MAX_READERS 128
+
+// Structure under test, driven through the same five operations
+typedef struct BenchStructure {
+    const char *name;                                  // Name used in the results
+    void* (*create)(void);                             // Creates an empty structure
+    int (*insert)(void *structure, const char *name);  // Returns 0 on success
+    int (*seal)(void *structure);                      // Runs once after the inserts (may be NULL); returns 0 on success
+    int (*lookup)(void *structure, const char *name);  // Returns non-zero if found
+    size_t (*memory)(void *structure);                 // Estimated heap bytes in use
+    void (*destroy)(void *structure);                  // Frees the structure
+} BenchStructure;
+
+// Shared state of the threads started by the concurrency benchmark (-t)
+typedef struct ConcurrencyRun {
+    HashTable *table;         // HASH_TABLE_CONCURRENT table under test
+    const char *stable;       // Names that stay in the table, CONCURRENCY_STRIDE bytes apart
+    size_t stable_count;      // Number of stable names
+    const char *churn;        // Names the writers insert and remove over and over
+    size_t churn_count;       // Number of churn names
+    _Atomic int stop;         // Set when the threads should finish
+    _Atomic size_t lookups;   // Lookups completed by all readers
+    _Atomic size_t writes;    // Inserts and removes completed by all writers
+    _Atomic size_t errors;    // Missing stable names, wrong hits and failed writes
+} ConcurrencyRun;
+
+// Argument of one concurrency benchmark thread
+typedef struct ConcurrencyWorker {
+    ConcurrencyRun *run;      // Shared state
+    unsigned int id;          // Index among the threads of the same kind
+    unsigned int count;       // Number of threads of the same kind
+} ConcurrencyWorker;
+
+// Key set and query streams of one workload
+typedef struct Workload {
+    const char *name;   // Name used in the results
+    char *keys;         // Distinct keys to insert, KEY_STRIDE bytes each
+    size_t key_count;
+    char **hits;        // Query stream of inserted keys
+    char *misses;       // Query stream of keys that were never inserted, KEY_STRIDE bytes each
+    size_t queries;     // Length of both query streams
+} Workload;
+
+// One row of results
+typedef struct BenchResult {
+    const char *workload;
+    const char *structure;
+    size_t keys;
+    size_t queries;
+    double insert_ns;        // Mean insert time per key
+    double hit_ns[4];        // Hit latency percentiles (p50, p90, p99, p99.9)
+    double miss_ns[4];       // Miss latency percentiles (p50, p90, p99, p99.9)
+    size_t hit_count;        // Hits found (must equal queries)
+    size_t miss_count;       // Misses found (must be 0)
+    double bytes_per_key;    // Estimated heap bytes per key
+    size_t peak_rss;         // Process peak resident set size in bytes after the run
+} BenchResult;
+
+// Entry of the baseline hash table; the uppercase name follows the header
+typedef struct BaselineEntry {
+    struct BaselineEntry *next;
+    uint64_t hash;
+    char name[];
+} BaselineEntry;
+
+// Baseline: a plain chained hash table with FNV-1a hashing
+typedef struct BaselineHash {
+    BaselineEntry **buckets;
+    size_t bucket_count;  // Always a power of two
+    size_t count;
+    size_t bytes;         // Estimated heap bytes of the buckets and entries
+} BaselineHash;
+
+// Node of the baseline trie, one child per letter
+typedef struct TrieNode {
+    struct TrieNode *children[26];
+    int terminal;  // Number of names ending at this node
+} TrieNode;
+
+// Baseline: a 26-ary trie
+typedef struct BaselineTrie {
+    TrieNode *root;
+    size_t bytes;  // Estimated heap bytes of the nodes
+} BaselineTrie;
+
+static const double percentiles[4] = { 0.50, 0.90, 0.99, 0.999 };
+
+// Approximate frequencies per 100,000 people of common US surnames (2010 census)
+// and first names (1990 census), used to give census keys realistic prefixes.
+typedef struct CensusName {
+    const char *name;
+    unsigned int frequency;
+} CensusName;
+
+static const CensusName census_names[] = {
+    { "Smith", 828 }, { "Johnson", 655 }, { "Williams", 550 }, { "Brown", 484 },
+    { "Jones", 482 }, { "Garcia", 416 }, { "Miller", 402 }, { "Davis", 380 },
+    { "Rodriguez", 353 }, { "Martinez", 350 }, { "Hernandez", 344 }, { "Lopez", 290 },
+    { "Gonzalez", 284 }, { "Wilson", 273 }, { "Anderson", 267 }, { "Thomas", 263 },
+    { "Taylor", 260 }, { "Moore", 241 }, { "Jackson", 238 }, { "Martin", 235 },
+    { "Lee", 230 }, { "Perez", 220 }, { "Thompson", 219 }, { "White", 218 },
+    { "Harris", 204 }, { "Sanchez", 201 }, { "Clark", 185 }, { "Ramirez", 180 },
+    { "Lewis", 176 }, { "Robinson", 174 }, { "Walker", 171 }, { "Young", 164 },
+    { "Allen", 163 }, { "King", 161 }, { "Wright", 159 }, { "Scott", 150 },
+    { "Torres", 148 }, { "Nguyen", 148 }, { "Hill", 146 }, { "Flores", 146 },
+    { "James", 1659 }, { "John", 1636 }, { "Robert", 1572 }, { "Michael", 1315 },
+    { "William", 1226 }, { "David", 1182 }, { "Richard", 852 }, { "Charles", 762 },
+    { "Joseph", 702 }, { "Christopher", 518 }, { "Daniel", 487 }, { "Paul", 474 },
+    { "Mark", 470 }, { "Donald", 466 }, { "George", 463 }, { "Kenneth", 413 },
+    { "Mary", 1315 }, { "Patricia", 537 }, { "Linda", 518 }, { "Barbara", 490 },
+    { "Elizabeth", 469 }, { "Jennifer", 466 }, { "Maria", 414 }, { "Susan", 397 },
+    { "Margaret", 384 }, { "Dorothy", 364 }, { "Lisa", 352 }, { "Nancy", 342 },
+    { "Karen", 334 }, { "Betty", 332 }, { "Helen", 330 }, { "Sandra", 314 },
+};
+
+#define CENSUS_NAME_COUNT (sizeof(census_names) / sizeof(census_names[0]))
+
+/**
+ * Advances a xorshift generator, so every run produces the same workloads.
+ *
+ * @param state The generator state.
+ * @return The next pseudo-random value.
+ */
+static uint32_t next_random(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ *
+ * @return The current time in nanoseconds.
+ */
+static double clock_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (double)(now.QuadPart / frequency.QuadPart) * 1e9 +
+           (double)(now.QuadPart % frequency.QuadPart) * 1e9 / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Returns the peak resident set size of the process.
+ *
+ * @return The peak RSS in bytes, or 0 if the platform does not report it.
+ */
+static size_t peak_rss_bytes(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;         // Bytes on macOS
+#else
+    return (size_t)usage.ru_maxrss * 1024;  // Kilobytes on Linux and the BSDs
+#endif
+#endif
+}
+
+/**
+ * Estimates the heap footprint of a single malloc, with the same model as
+ * hash_table_memory_stats: a size_t header, 16-byte rounding and a 32-byte
+ * minimum chunk.
+ *
+ * @param size The requested allocation size.
+ * @return The estimated number of heap bytes consumed.
+ */
+static size_t chunk_bytes(size_t size) {
+    size_t chunk = (size + sizeof(size_t) + 15) & ~(size_t)15;
+    return chunk < 32 ? 32 : chunk;
+}
+
+/**
+ * Uppercases and validates a name the way Hash Blocks does (letters only, at
+ * least 3 characters), so the baselines do the same normalization work.
+ *
+ * @param input The name to normalize.
+ * @param output Receives the uppercase name; at least KEY_STRIDE bytes.
+ * @return The length of the name, or 0 if it is invalid.
+ */
+static size_t normalize_key(const char *input, char *output) {
+    size_t length = 0;
+    for (; input[length] != '\0'; length++) {
+        if (length >= KEY_STRIDE - 1 || !isalpha((unsigned char)input[length])) return 0;
+        output[length] = (char)toupper((unsigned char)input[length]);
+    }
+    output[length] = '\0';
+    return length >= 3 ? length : 0;
+}
+
+/**
+ * Hashes a name with 64-bit FNV-1a.
+ *
+ * @param name The name.
+ * @param length The length of the name.
+ * @return The hash value.
+ */
+static uint64_t hash_key(const char *name, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Creates an empty baseline hash table.
+ *
+ * @return The table, or NULL if memory allocation fails.
+ */
+static void* baseline_hash_create(void) {
+    BaselineHash *table = (BaselineHash *)calloc(1, sizeof(BaselineHash));
+    if (table == NULL) return NULL;
+    table->buckets = (BaselineEntry **)calloc(BASELINE_MIN_BUCKETS, sizeof(BaselineEntry *));
+    if (table->buckets == NULL) {
+        free(table);
+        return NULL;
+    }
+    table->bucket_count = BASELINE_MIN_BUCKETS;
+    table->bytes = chunk_bytes(sizeof(BaselineHash)) +
+                   chunk_bytes(BASELINE_MIN_BUCKETS * sizeof(BaselineEntry *));
+    return table;
+}
+
+/**
+ * Doubles the bucket array of a baseline hash table and rehashes its entries.
+ *
+ * @param table The table.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+static int baseline_hash_grow(BaselineHash *table) {
+    size_t count = table->bucket_count * 2;
+    BaselineEntry **buckets = (BaselineEntry **)calloc(count, sizeof(BaselineEntry *));
+    if (buckets == NULL) return 1;
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        BaselineEntry *entry = table->buckets[i];
+        while (entry != NULL) {
+            BaselineEntry *next = entry->next;
+            size_t index = (size_t)entry->hash & (count - 1);
+            entry->next = buckets[index];
+            buckets[index] = entry;
+            entry = next;
+        }
+    }
+    table->bytes += chunk_bytes(count * sizeof(BaselineEntry *)) -
+                    chunk_bytes(table->bucket_count * sizeof(BaselineEntry *));
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucket_count = count;
+    return 0;
+}
+
+/**
+ * Adds a name to a baseline hash table.
+ *
+ * @param structure The table.
+ * @param input The name.
+ * @return 0 on success, or 1 if the name is invalid or memory allocation fails.
+ */
+static int baseline_hash_insert(void *structure, const char *input) {
+    BaselineHash *table = (BaselineHash *)structure;
+    char name[KEY_STRIDE];
+    size_t length = normalize_key(input, name);
+    if (length == 0) return 1;
+    if (table->count >= table->bucket_count && baseline_hash_grow(table) != 0) return 1;
+
+    BaselineEntry *entry = (BaselineEntry *)malloc(sizeof(BaselineEntry) + length + 1);
+    if (entry == NULL) return 1;
+    entry->hash = hash_key(name, length);
+    memcpy(entry->name, name, length + 1);
+    size_t index = (size_t)entry->hash & (table->bucket_count - 1);
+    entry->next = table->buckets[index];
+    table->buckets[index] = entry;
+    table->count++;
+    table->bytes += chunk_bytes(sizeof(BaselineEntry) + length + 1);
+    return 0;
+}
+
+/**
+ * Looks up a name in a baseline hash table.
+ *
+ * @param structure The table.
+ * @param input The name.
+ * @return Non-zero if the name is stored.
+ */
+static int baseline_hash_lookup(void *structure, const char *input) {
+    const BaselineHash *table = (const BaselineHash *)structure;
+    char name[KEY_STRIDE];
+    size_t length = normalize_key(input, name);
+    if (length == 0) return 0;
+    uint64_t hash = hash_key(name, length);
+    for (const BaselineEntry *entry = table->buckets[(size_t)hash & (table->bucket_count - 1)];
+         entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && strcmp(entry->name, name) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Reports the estimated heap bytes of a baseline hash table.
+ *
+ * @param structure The table.
+ * @return The estimated heap bytes.
+ */
+static size_t baseline_hash_memory(void *structure) {
+    return ((const BaselineHash *)structure)->bytes;
+}
+
+/**
+ * Frees a baseline hash table.
+ *
+ * @param structure The table.
+ */
+static void baseline_hash_destroy(void *structure) {
+    BaselineHash *table = (BaselineHash *)structure;
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        BaselineEntry *entry = table->buckets[i];
+        while (entry != NULL) {
+            BaselineEntry *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(table->buckets);
+    free(table);
+}
+
+/**
+ * Creates an empty baseline trie.
+ *
+ * @return The trie, or NULL if memory allocation fails.
+ */
+static void* baseline_trie_create(void) {
+    BaselineTrie *trie = (BaselineTrie *)calloc(1, sizeof(BaselineTrie));
+    if (trie == NULL) return NULL;
+    trie->root = (TrieNode *)calloc(1, sizeof(TrieNode));
+    if (trie->root == NULL) {
+        free(trie);
+        return NULL;
+    }
+    trie->bytes = chunk_bytes(sizeof(BaselineTrie)) + chunk_bytes(sizeof(TrieNode));
+    return trie;
+}
+
+/**
+ * Adds a name to a baseline trie, creating one node per new letter.
+ *
+ * @param structure The trie.
+ * @param input The name.
+ * @return 0 on success, or 1 if the name is invalid or memory allocation fails.
+ */
+static int baseline_trie_insert(void *structure, const char *input) {
+    BaselineTrie *trie = (BaselineTrie *)structure;
+    char name[KEY_STRIDE];
+    size_t length = normalize_key(input, name);
+    if (length == 0) return 1;
+
+    TrieNode *node = trie->root;
+    for (size_t i = 0; i < length; i++) {
+        TrieNode **child = &node->children[name[i] - 'A'];
+        if (*child == NULL) {
+            *child = (TrieNode *)calloc(1, sizeof(TrieNode));
+            if (*child == NULL) return 1;
+            trie->bytes += chunk_bytes(sizeof(TrieNode));
+        }
+        node = *child;
+    }
+    node->terminal++;
+    return 0;
+}
+
+/**
+ * Looks up a name in a baseline trie.
+ *
+ * @param structure The trie.
+ * @param input The name.
+ * @return Non-zero if the name is stored.
+ */
+static int baseline_trie_lookup(void *structure, const char *input) {
+    const BaselineTrie *trie = (const BaselineTrie *)structure;
+    char name[KEY_STRIDE];
+    size_t length = normalize_key(input, name);
+    if (length == 0) return 0;
+
+    const TrieNode *node = trie->root;
+    for (size_t i = 0; i < length && node != NULL; i++) {
+        node = node->children[name[i] - 'A'];
+    }
+    return node != NULL && node->terminal > 0;
+}
+
+/**
+ * Reports the estimated heap bytes of a baseline trie.
+ *
+ * @param structure The trie.
+ * @return The estimated heap bytes.
+ */
+static size_t baseline_trie_memory(void *structure) {
+    return ((const BaselineTrie *)structure)->bytes;
+}
+
+/**
+ * Frees a trie node and everything below it.
+ *
+ * @param node The node. NULL is ignored.
+ */
+static void free_trie_node(TrieNode *node) {
+    if (node == NULL) return;
+    for (int i = 0; i < 26; i++) {
+        free_trie_node(node->children[i]);
+    }
+    free(node);
+}
+
+/**
+ * Frees a baseline trie.
+ *
+ * @param structure The trie.
+ */
+static void baseline_trie_destroy(void *structure) {
+    BaselineTrie *trie = (BaselineTrie *)structure;
+    free_trie_node(trie->root);
+    free(trie);
+}
+
+/**
+ * Creates a Hash Blocks table with the given flags.
+ *
+ * @param flags HASH_TABLE_* flags.
+ * @return The table, or NULL if memory allocation fails.
+ */
+static void* hashblocks_create_with(unsigned int flags) {
+    HashTableOptions options = { .flags = flags };
+    return create_hash_table_ex(&options);
+}
+
+static void* hashblocks_create(void) { return hashblocks_create_with(0); }
+static void* hashblocks_arena_create(void) { return hashblocks_create_with(HASH_TABLE_ARENA); }
+static void* hashblocks_flat_create(void) { return hashblocks_create_with(HASH_TABLE_FLAT); }
+static void* hashblocks_filter_create(void) { return hashblocks_create_with(HASH_TABLE_FILTER); }
+
+/**
+ * Adds a name to a Hash Blocks table (the add_name path).
+ *
+ * @param structure The table.
+ * @param name The name.
+ * @return 0 on success, or 1 on failure.
+ */
+static int hashblocks_insert(void *structure, const char *name) {
+    return hash_table_insert((HashTable *)structure, name);
+}
+
+/**
+ * Looks up a name in a Hash Blocks table (the find_names path, without printing).
+ *
+ * @param structure The table.
+ * @param name The name.
+ * @return Non-zero if the name is stored.
+ */
+static int hashblocks_lookup(void *structure, const char *name) {
+    return hash_table_lookup((const HashTable *)structure, name) != NULL;
+}
+
+/**
+ * Reports the heap bytes of a Hash Blocks table from hash_table_memory_stats:
+ * blocks plus one malloc per node and name, arena pages, or flat buckets.
+ *
+ * @param structure The table.
+ * @return The estimated heap bytes.
+ */
+static size_t hashblocks_memory(void *structure) {
+    HashTableMemoryStats stats;
+    hash_table_memory_stats((const HashTable *)structure, &stats);
+    if (stats.arena_pages > 0) return stats.block_bytes + stats.arena_bytes;
+    if (stats.flat_buckets > 0) return stats.block_bytes + stats.flat_bytes + stats.filter_bytes;
+    return stats.block_bytes + stats.heap_bytes + stats.filter_bytes;
+}
+
+/**
+ * Frees a Hash Blocks table.
+ *
+ * @param structure The table.
+ */
+static void hashblocks_destroy(void *structure) {
+    destroy_hash_table((HashTable *)structure);
+}
+
+// Hash Blocks table that is frozen once loaded
+typedef struct FrozenBench {
+    HashTable *table;    // Table the keys are inserted into; destroyed by frozen_seal
+    HashFrozen *frozen;  // Frozen copy made by frozen_seal
+    unsigned int flags;  // HASH_FROZEN_* flags passed to hash_table_freeze_ex
+} FrozenBench;
+
+/**
+ * Creates an empty table to be frozen after the inserts.
+ *
+ * @return The structure, or NULL if memory allocation fails.
+ */
+static void* frozen_create(void) {
+    FrozenBench *bench = (FrozenBench *)calloc(1, sizeof(FrozenBench));
+    if (bench == NULL) return NULL;
+    bench->table = create_hash_table();
+    if (bench->table == NULL) {
+        free(bench);
+        return NULL;
+    }
+    return bench;
+}
+
+/**
+ * Creates an empty table to be frozen with compact keys after the inserts.
+ *
+ * @return The structure, or NULL if memory allocation fails.
+ */
+static void* frozen_compact_create(void) {
+    FrozenBench *bench = (FrozenBench *)frozen_create();
+    if (bench != NULL) bench->flags = HASH_FROZEN_COMPACT_KEYS;
+    return bench;
+}
+
+/**
+ * Adds a name to the table that will be frozen.
+ *
+ * @param structure The FrozenBench.
+ * @param name The name.
+ * @return 0 on success, or 1 on failure.
+ */
+static int frozen_insert(void *structure, const char *name) {
+    return hash_table_insert(((FrozenBench *)structure)->table, name);
+}
+
+/**
+ * Freezes the loaded table and destroys it, so only the frozen form is measured.
+ *
+ * @param structure The FrozenBench.
+ * @return 0 on success, or 1 if the table could not be frozen.
+ */
+static int frozen_seal(void *structure) {
+    FrozenBench *bench = (FrozenBench *)structure;
+    bench->frozen = hash_table_freeze_ex(bench->table, bench->flags);
+    if (bench->frozen == NULL) return 1;
+    destroy_hash_table(bench->table);
+    bench->table = NULL;
+    return 0;
+}
+
+/**
+ * Looks up a name in the frozen form.
+ *
+ * @param structure The FrozenBench.
+ * @param name The name.
+ * @return Non-zero if the name is stored.
+ */
+static int frozen_lookup(void *structure, const char *name) {
+    return hash_frozen_lookup(((const FrozenBench *)structure)->frozen, name) != NULL;
+}
+
+/**
+ * Reports the size of the frozen form's single allocation.
+ *
+ * @param structure The FrozenBench.
+ * @return The bytes in use.
+ */
+static size_t frozen_memory(void *structure) {
+    const FrozenBench *bench = (const FrozenBench *)structure;
+    return bench->frozen ? hash_frozen_bytes(bench->frozen) : 0;
+}
+
+/**
+ * Frees the frozen form and, if it was never frozen, the table.
+ *
+ * @param structure The FrozenBench.
+ */
+static void frozen_destroy(void *structure) {
+    FrozenBench *bench = (FrozenBench *)structure;
+    hash_frozen_free(bench->frozen);
+    destroy_hash_table(bench->table);
+    free(bench);
+}
+
+static const BenchStructure structures[] = {
+    { "hashblocks", hashblocks_create, hashblocks_insert, NULL, hashblocks_lookup, hashblocks_memory, hashblocks_destroy },
+    { "hashblocks-arena", hashblocks_arena_create, hashblocks_insert, NULL, hashblocks_lookup, hashblocks_memory, hashblocks_destroy },
+    { "hashblocks-flat", hashblocks_flat_create, hashblocks_insert, NULL, hashblocks_lookup, hashblocks_memory, hashblocks_destroy },
+    { "hashblocks-filter", hashblocks_filter_create, hashblocks_insert, NULL, hashblocks_lookup, hashblocks_memory, hashblocks_destroy },
+    { "hashblocks-frozen", frozen_create, frozen_insert, frozen_seal, frozen_lookup, frozen_memory, frozen_destroy },
+    { "hashblocks-frozen-compact", frozen_compact_create, frozen_insert, frozen_seal, frozen_lookup, frozen_memory, frozen_destroy },
+    { "hash", baseline_hash_create, baseline_hash_insert, NULL, baseline_hash_lookup, baseline_hash_memory, baseline_hash_destroy },
+    { "trie", baseline_trie_create, baseline_trie_insert, NULL, baseline_trie_lookup, baseline_trie_memory, baseline_trie_destroy },
+};
+
+#define STRUCTURE_COUNT (sizeof(structures) / sizeof(structures[0]))
+
+static const char *workload_names[] = { "uniform", "zipf", "census" };
+
+#define WORKLOAD_COUNT (sizeof(workload_names) / sizeof(workload_names[0]))
+
+/**
+ * Writes a random mixed-case name into key.
+ *
+ * Uniform and Zipfian workloads use 3 to KEY_MAX_LENGTH random letters.
+ * Census keys start with a common first name or surname, picked with its
+ * census frequency, followed by 1 to 4 random letters, which reproduces the
+ * skew of real names over the first three letters the levels index.
+ *
+ * @param key Receives the name; KEY_STRIDE bytes.
+ * @param census Non-zero for a census key.
+ * @param total_frequency The sum of the census frequencies.
+ * @param state The random generator state.
+ */
+static void generate_key(char *key, int census, unsigned int total_frequency, uint32_t *state) {
+    size_t length = 0, extra;
+    if (census) {
+        unsigned int pick = next_random(state) % total_frequency;
+        size_t index = 0;
+        while (pick >= census_names[index].frequency) {
+            pick -= census_names[index++].frequency;
+        }
+        const char *prefix = census_names[index].name;
+        for (; prefix[length] != '\0' && length < KEY_MAX_LENGTH - 4; length++) {
+            key[length] = prefix[length];
+        }
+        extra = 1 + next_random(state) % 4;
+    } else {
+        extra = 3 + next_random(state) % (KEY_MAX_LENGTH - 2);
+    }
+    for (size_t i = 0; i < extra; i++, length++) {
+        uint32_t value = next_random(state);
+        key[length] = (char)((length == 0 ? 'A' : 'a') + (value >> 8) % 26);
+    }
+    key[length] = '\0';
+}
+
+/**
+ * Builds the keys and query streams of a workload.
+ *
+ * Keys are distinct (checked with a baseline hash table). Hit queries pick
+ * inserted keys uniformly, or with a Zipfian distribution over a random
+ * ranking for the "zipf" workload; miss queries are generated the same way
+ * as keys and rejected if they were inserted.
+ *
+ * @param workload Receives the workload.
+ * @param name The workload name ("uniform", "zipf" or "census").
+ * @param key_count The number of keys.
+ * @param queries The length of each query stream.
+ * @param seed The random seed.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+static int create_workload(Workload *workload, const char *name, size_t key_count, size_t queries,
+                           uint32_t seed) {
+    memset(workload, 0, sizeof(*workload));
+    workload->name = name;
+    workload->key_count = key_count;
+    workload->queries = queries;
+    workload->keys = (char *)malloc(key_count * KEY_STRIDE);
+    workload->hits = (char **)malloc(queries * sizeof(char *));
+    workload->misses = (char *)malloc(queries * KEY_STRIDE);
+    BaselineHash *seen = (BaselineHash *)baseline_hash_create();
+    if (!workload->keys || !workload->hits || !workload->misses || !seen) {
+        printf("Memory allocation failed for workload %s\n", name);
+        if (seen) baseline_hash_destroy(seen);
+        return 1;
+    }
+
+    int census = strcmp(name, "census") == 0;
+    unsigned int total_frequency = 0;
+    for (size_t i = 0; i < CENSUS_NAME_COUNT; i++) {
+        total_frequency += census_names[i].frequency;
+    }
+
+    uint32_t state = seed ? seed : 2463534242u;
+    for (size_t i = 0; i < key_count; i++) {
+        char *key = workload->keys + i * KEY_STRIDE;
+        do {
+            generate_key(key, census, total_frequency, &state);
+        } while (baseline_hash_lookup(seen, key));
+        if (baseline_hash_insert(seen, key) != 0) {
+            printf("Memory allocation failed for workload %s\n", name);
+            baseline_hash_destroy(seen);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < queries; i++) {
+        char *key = workload->misses + i * KEY_STRIDE;
+        do {
+            generate_key(key, census, total_frequency, &state);
+        } while (baseline_hash_lookup(seen, key));
+    }
+    baseline_hash_destroy(seen);
+
+    // Zipfian ranks follow key order, which is already random
+    double *cdf = NULL;
+    if (strcmp(name, "zipf") == 0) {
+        cdf = (double *)malloc(key_count * sizeof(double));
+        if (cdf == NULL) {
+            printf("Memory allocation failed for workload %s\n", name);
+            return 1;
+        }
+        double sum = 0;
+        for (size_t i = 0; i < key_count; i++) {
+            sum += 1.0 / pow((double)(i + 1), ZIPF_EXPONENT);
+            cdf[i] = sum;
+        }
+        for (size_t i = 0; i < key_count; i++) {
+            cdf[i] /= sum;
+        }
+    }
+    for (size_t i = 0; i < queries; i++) {
+        size_t index;
+        if (cdf != NULL) {
+            double target = (double)next_random(&state) / 4294967296.0;
+            size_t low = 0, high = key_count - 1;
+            while (low < high) {
+                size_t middle = low + (high - low) / 2;
+                if (cdf[middle] < target) low = middle + 1;
+                else high = middle;
+            }
+            index = low;
+        } else {
+            index = next_random(&state) % key_count;
+        }
+        workload->hits[i] = workload->keys + index * KEY_STRIDE;
+    }
+    free(cdf);
+    return 0;
+}
+
+/**
+ * Frees the keys and query streams of a workload.
+ *
+ * @param workload The workload.
+ */
+static void destroy_workload(Workload *workload) {
+    free(workload->keys);
+    free(workload->hits);
+    free(workload->misses);
+}
+
+/**
+ * Orders latencies for the percentile computation.
+ */
+static int compare_latency(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Measures the cost of reading the clock twice, which is subtracted from
+ * every timed lookup.
+ *
+ * @return The smallest observed back-to-back clock interval in nanoseconds.
+ */
+static double timer_overhead(void) {
+    double best = 1e9;
+    for (int i = 0; i < 1000; i++) {
+        double start = clock_ns();
+        double elapsed = clock_ns() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+/**
+ * Times every lookup of a query stream and fills in latency percentiles.
+ *
+ * @param structure The structure under test.
+ * @param instance The loaded structure.
+ * @param queries The query stream.
+ * @param count The number of queries.
+ * @param latencies Scratch array of count entries.
+ * @param overhead The timer overhead to subtract.
+ * @param result Receives the p50, p90, p99 and p99.9 latencies.
+ * @return The number of queries found.
+ */
+static size_t time_lookups(const BenchStructure *structure, void *instance, const char *const *queries,
+                           size_t count, double *latencies, double overhead, double result[4]) {
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        double start = clock_ns();
+        found += structure->lookup(instance, queries[i]) != 0;
+        double elapsed = clock_ns() - start - overhead;
+        latencies[i] = elapsed > 0 ? elapsed : 0;
+    }
+    qsort(latencies, count, sizeof(double), compare_latency);
+    for (int p = 0; p < 4; p++) {
+        result[p] = count > 0 ? latencies[(size_t)(percentiles[p] * (double)(count - 1))] : 0;
+    }
+    return found;
+}
+
+/**
+ * Runs one workload against one structure.
+ *
+ * @param structure The structure to benchmark.
+ * @param workload The workload.
+ * @param overhead The timer overhead.
+ * @param result Receives the measurements.
+ * @return 0 on success, or 1 on failure.
+ */
+static int run_benchmark(const BenchStructure *structure, const Workload *workload, double overhead,
+                         BenchResult *result) {
+    memset(result, 0, sizeof(*result));
+    result->workload = workload->name;
+    result->structure = structure->name;
+    result->keys = workload->key_count;
+    result->queries = workload->queries;
+
+    double *latencies = (double *)malloc((workload->queries ? workload->queries : 1) * sizeof(double));
+    const char **misses = (const char **)malloc((workload->queries ? workload->queries : 1) * sizeof(char *));
+    void *instance = structure->create();
+    if (!latencies || !misses || !instance) {
+        printf("Memory allocation failed for benchmark %s\n", structure->name);
+        free(latencies); free(misses);
+        if (instance) structure->destroy(instance);
+        return 1;
+    }
+
+    double start = clock_ns();
+    for (size_t i = 0; i < workload->key_count; i++) {
+        if (structure->insert(instance, workload->keys + i * KEY_STRIDE) != 0) {
+            printf("Insert failed in %s: %s\n", structure->name, workload->keys + i * KEY_STRIDE);
+            break;
+        }
+    }
+    result->insert_ns = workload->key_count ? (clock_ns() - start) / (double)workload->key_count : 0;
+    if (structure->seal != NULL && structure->seal(instance) != 0) {
+        printf("Sealing failed in %s\n", structure->name);
+    }
+    result->bytes_per_key = workload->key_count ? (double)structure->memory(instance) / (double)workload->key_count : 0;
+
+    for (size_t i = 0; i < workload->queries; i++) {
+        misses[i] = workload->misses + i * KEY_STRIDE;
+    }
+    result->hit_count = time_lookups(structure, instance, (const char *const *)workload->hits,
+                                     workload->queries, latencies, overhead, result->hit_ns);
+    result->miss_count = time_lookups(structure, instance, misses, workload->queries, latencies,
+                                      overhead, result->miss_ns);
+    result->peak_rss = peak_rss_bytes();
+
+    structure->destroy(instance);
+    free(latencies);
+    free(misses);
+    if (result->hit_count != workload->queries || result->miss_count != 0) {
+        fprintf(stderr, "%s/%s: %zu of %zu hits found, %zu misses found\n", workload->name,
+                structure->name, result->hit_count, workload->queries, result->miss_count);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Writes one result as a CSV row, preceded by the header for the first row.
+ *
+ * @param out The output stream.
+ * @param result The result.
+ * @param first Non-zero for the first row.
+ */
+static void write_csv(FILE *out, const BenchResult *result, int first) {
+    if (first) {
+        fprintf(out, "workload,structure,keys,queries,insert_ns_per_key,inserts_per_sec,"
+                     "hit_p50_ns,hit_p90_ns,hit_p99_ns,hit_p999_ns,"
+                     "miss_p50_ns,miss_p90_ns,miss_p99_ns,miss_p999_ns,"
+                     "bytes_per_key,peak_rss_bytes\n");
+    }
+    fprintf(out, "%s,%s,%zu,%zu,%.1f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.1f,%zu\n",
+            result->workload, result->structure, result->keys, result->queries, result->insert_ns,
+            result->insert_ns > 0 ? 1e9 / result->insert_ns : 0,
+            result->hit_ns[0], result->hit_ns[1], result->hit_ns[2], result->hit_ns[3],
+            result->miss_ns[0], result->miss_ns[1], result->miss_ns[2], result->miss_ns[3],
+            result->bytes_per_key, result->peak_rss);
+}
+
+/**
+ * Writes one result as an element of a JSON array.
+ *
+ * @param out The output stream.
+ * @param result The result.
+ * @param first Non-zero for the first element.
+ */
+static void write_json(FILE *out, const BenchResult *result, int first) {
+    fprintf(out, "%s\n  {\"workload\": \"%s\", \"structure\": \"%s\", \"keys\": %zu, \"queries\": %zu, "
+                 "\"insert_ns_per_key\": %.1f, \"inserts_per_sec\": %.0f, "
+                 "\"hit_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f}, "
+                 "\"miss_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f}, "
+                 "\"bytes_per_key\": %.1f, \"peak_rss_bytes\": %zu}",
+            first ? "[" : ",", result->workload, result->structure, result->keys, result->queries,
+            result->insert_ns, result->insert_ns > 0 ? 1e9 / result->insert_ns : 0,
+            result->hit_ns[0], result->hit_ns[1], result->hit_ns[2], result->hit_ns[3],
+            result->miss_ns[0], result->miss_ns[1], result->miss_ns[2], result->miss_ns[3],
+            result->bytes_per_key, result->peak_rss);
+}
+
+// Brute-force fuzzy search: the searched name and how many stored names are within budget
+typedef struct FuzzyScan {
+    const char *name;    // Normalized searched name
+    size_t length;       // Its length
+    unsigned int edits;  // Edit budget
+    size_t matches;      // Names within budget
+} FuzzyScan;
+
+/**
+ * Computes the full Levenshtein distance between two names with two rows of
+ * the usual dynamic programming table, as a fuzzy search without an index
+ * would.
+ *
+ * @param a The first name; shorter than KEY_STRIDE.
+ * @param b The second name; shorter than KEY_STRIDE.
+ * @param length_b The length of b.
+ * @return The edit distance.
+ */
+static unsigned int edit_distance(const char *a, const char *b, size_t length_b) {
+    unsigned int rows[2][KEY_STRIDE + 1];
+    for (size_t j = 0; j <= length_b; j++) rows[0][j] = (unsigned int)j;
+    size_t i = 0;
+    for (; a[i] != '\0'; i++) {
+        const unsigned int *row = rows[i & 1];
+        unsigned int *next = rows[(i + 1) & 1];
+        next[0] = (unsigned int)(i + 1);
+        for (size_t j = 1; j <= length_b; j++) {
+            unsigned int value = row[j - 1] + (a[i] != b[j - 1]);
+            if (row[j] + 1 < value) value = row[j] + 1;
+            if (next[j - 1] + 1 < value) value = next[j - 1] + 1;
+            next[j] = value;
+        }
+    }
+    return rows[i & 1][length_b];
+}
+
+/**
+ * Counts one stored name if it is within budget (hash_table_iterate visitor).
+ */
+static int scan_visit(const char *name, void *context) {
+    FuzzyScan *scan = (FuzzyScan *)context;
+    scan->matches += edit_distance(name, scan->name, scan->length) <= scan->edits;
+    return 0;
+}
+
+/**
+ * Counts one name found by hash_table_fuzzy.
+ */
+static int fuzzy_visit(const char *name, unsigned int distance, void *context) {
+    (void)name;
+    (void)distance;
+    (*(size_t *)context)++;
+    return 0;
+}
+
+/**
+ * Times hash_table_fuzzy against a brute-force scan of every stored name and
+ * writes one row per edit budget from 0 to edits.
+ *
+ * Half of the searched names are inserted keys and half are misses, both
+ * taken from the workload's query streams. Both searches must find the same
+ * number of names.
+ *
+ * @param workload The workload.
+ * @param edits The largest edit budget.
+ * @param out The output stream.
+ * @param json Non-zero for JSON rows.
+ * @param rows The number of rows already written; updated.
+ * @return 0 on success, or 1 on failure.
+ */
+static int run_fuzzy_benchmark(const Workload *workload, unsigned int edits, FILE *out, int json, int *rows) {
+    HashTable *table = create_hash_table();
+    if (table == NULL) return 1;
+    for (size_t i = 0; i < workload->key_count; i++) {
+        hash_table_insert(table, workload->keys + i * KEY_STRIDE);
+    }
+
+    size_t count = workload->queries < FUZZY_QUERIES ? workload->queries : FUZZY_QUERIES;
+    int status = 0;
+    for (unsigned int budget = 0; budget <= edits; budget++) {
+        size_t fuzzy_matches = 0, scan_matches = 0;
+        double fuzzy_ns = 0, scan_ns = 0;
+        for (size_t i = 0; i < count; i++) {
+            const char *query = i & 1 ? workload->misses + (i / 2) * KEY_STRIDE : workload->hits[i / 2];
+            char name[KEY_STRIDE];
+            FuzzyScan scan = { name, normalize_key(query, name), budget, 0 };
+
+            double start = clock_ns();
+            hash_table_fuzzy(table, query, budget, fuzzy_visit, &fuzzy_matches);
+            fuzzy_ns += clock_ns() - start;
+            start = clock_ns();
+            hash_table_iterate(table, scan_visit, &scan);
+            scan_ns += clock_ns() - start;
+            scan_matches += scan.matches;
+        }
+        if (fuzzy_matches != scan_matches) {
+            fprintf(stderr, "%s: fuzzy search found %zu names within %u edits, scan found %zu\n",
+                    workload->name, fuzzy_matches, budget, scan_matches);
+            status = 1;
+        }
+
+        double fuzzy_us = count ? fuzzy_ns / (double)count / 1e3 : 0;
+        double scan_us = count ? scan_ns / (double)count / 1e3 : 0;
+        if (json) {
+            fprintf(out, "%s\n  {\"workload\": \"%s\", \"keys\": %zu, \"queries\": %zu, \"edits\": %u, "
+                         "\"fuzzy_us\": %.1f, \"scan_us\": %.1f, \"speedup\": %.1f, \"matches_per_query\": %.2f}",
+                    *rows == 0 ? "[" : ",", workload->name, workload->key_count, count, budget,
+                    fuzzy_us, scan_us, fuzzy_us > 0 ? scan_us / fuzzy_us : 0,
+                    count ? (double)fuzzy_matches / (double)count : 0);
+        } else {
+            if (*rows == 0) {
+                fprintf(out, "workload,keys,queries,edits,fuzzy_us,scan_us,speedup,matches_per_query\n");
+            }
+            fprintf(out, "%s,%zu,%zu,%u,%.1f,%.1f,%.1f,%.2f\n", workload->name, workload->key_count, count,
+                    budget, fuzzy_us, scan_us, fuzzy_us > 0 ? scan_us / fuzzy_us : 0,
+                    count ? (double)fuzzy_matches / (double)count : 0);
+        }
+        (*rows)++;
+        fflush(out);
+    }
+    destroy_hash_table(table);
+    return status;
+}
+
+/**
+ * Times one pass of lookups of every kernel benchmark key, keeping the fastest
+ * of KERNEL_ROUNDS passes.
+ *
+ * @param table The table to search.
+ * @param keys The keys, KERNEL_STRIDE bytes apart.
+ * @param count The number of keys.
+ * @param hits Receives the number of keys found (may be NULL).
+ * @return The fastest pass in nanoseconds.
+ */
+static double time_kernel_lookups(const HashTable *table, const char *keys, size_t count, size_t *hits) {
+    double best = 0;
+    for (int round = 0; round < KERNEL_ROUNDS; round++) {
+        size_t found = 0;
+        double start = clock_ns();
+        for (size_t i = 0; i < count; i++) {
+            found += hash_table_lookup(table, keys + i * KERNEL_STRIDE) != NULL;
+        }
+        double elapsed = clock_ns() - start;
+        if (round == 0 || elapsed < best) best = elapsed;
+        if (hits) *hits = found;
+    }
+    return best;
+}
+
+/**
+ * Times key normalization and flat bucket scans at every supported SIMD level.
+ *
+ * Generates count random mixed-case keys of 3 to 24 letters (the library
+ * reports every invalid name it is given, so none are). Normalization is timed as
+ * lookups in an empty table, which stop at the first level; the UTF-8 pass is
+ * timed the same way on the keys with a hyphen, in a HASH_TABLE_FOLD_ACCENTS
+ * table. The valid keys are then loaded into a HASH_TABLE_FLAT table, and its
+ * lookups are timed at each level and checked against the scalar level: the
+ * same keys must be found, as the same stored names. The SIMD level in use
+ * before is restored at the end.
+ *
+ * @param count The number of keys.
+ * @return 0 if every level agreed with the scalar one, or 1.
+ */
+static int run_kernel_benchmark(size_t count) {
+    if (count == 0) count = 1;
+    char *keys = (char *)malloc(count * KERNEL_STRIDE);
+    char *hyphenated = (char *)malloc(count * KERNEL_STRIDE);
+    char *reference = (char *)malloc(count * KERNEL_STRIDE);
+    HashTableOptions flat = { .flags = HASH_TABLE_FLAT }, utf8 = { .flags = HASH_TABLE_FOLD_ACCENTS };
+    HashTable *empty = create_hash_table(), *empty_utf8 = create_hash_table_ex(&utf8);
+    HashTable *table = create_hash_table_ex(&flat);
+    if (!keys || !hyphenated || !reference || !empty || !empty_utf8 || !table) {
+        printf("Memory allocation failed for benchmark keys\n");
+        free(keys); free(hyphenated); free(reference);
+        if (empty) destroy_hash_table(empty);
+        if (empty_utf8) destroy_hash_table(empty_utf8);
+        if (table) destroy_hash_table(table);
+        return 1;
+    }
+
+    // Deterministic xorshift generator, so runs are comparable
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < count; i++) {
+        char *key = keys + i * KERNEL_STRIDE;
+        state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+        size_t length = 3 + state % 22;
+        for (size_t j = 0; j < length; j++) {
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            key[j] = (char)((state & 32 ? 'a' : 'A') + (state >> 8) % 26);
+        }
+        key[length] = '\0';
+        memcpy(hyphenated + i * KERNEL_STRIDE, key, length + 1);
+        hyphenated[i * KERNEL_STRIDE + length / 2] = '-';
+    }
+
+    HashSimdLevel saved = get_simd_level();
+    HashSimdLevel best = set_simd_level(HASH_SIMD_AVX2); // Lowered to what the CPU supports
+    static const char *labels[] = { "Scalar", "SSE2", "AVX2" };
+
+    set_simd_level(HASH_SIMD_SCALAR);
+    for (size_t i = 0; i < count; i++) {
+        hash_table_insert(table, keys + i * KERNEL_STRIDE);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *found = hash_table_lookup(table, keys + i * KERNEL_STRIDE);
+        strcpy(reference + i * KERNEL_STRIDE, found ? found : "");
+    }
+
+    printf("Normalization (%zu keys):\n", count);
+    for (int level = HASH_SIMD_SCALAR; level <= (int)best; level++) {
+        set_simd_level((HashSimdLevel)level);
+        double elapsed = time_kernel_lookups(empty, keys, count, NULL);
+        printf("  %-6s %8.2f ns/key\n", labels[level], elapsed / (double)count);
+    }
+    double fold_time = time_kernel_lookups(empty_utf8, hyphenated, count, NULL);
+    printf("  %-6s %8.2f ns/key (UTF-8 pass with accent stripping)\n", "UTF-8", fold_time / (double)count);
+
+    HashTableMemoryStats stats;
+    hash_table_memory_stats(table, &stats);
+    printf("Flat bucket lookups (%zu names):\n", stats.names);
+    int status = 0;
+    for (int level = HASH_SIMD_SCALAR; level <= (int)best; level++) {
+        set_simd_level((HashSimdLevel)level);
+        size_t hits = 0;
+        double elapsed = time_kernel_lookups(table, keys, count, &hits);
+        int identical = 1;
+        for (size_t i = 0; i < count; i++) {
+            const char *found = hash_table_lookup(table, keys + i * KERNEL_STRIDE);
+            if (strcmp(found ? found : "", reference + i * KERNEL_STRIDE) != 0) identical = 0;
+        }
+        status |= !identical;
+        printf("  %-6s %8.2f ns/key (%zu hits)%s\n", labels[level], elapsed / (double)count, hits,
+               identical ? "" : "  (MISMATCH against scalar)");
+    }
+
+    set_simd_level(saved);
+    destroy_hash_table(empty);
+    destroy_hash_table(empty_utf8);
+    destroy_hash_table(table);
+    free(keys);
+    free(hyphenated);
+    free(reference);
+    return status;
+}
+
+/**
+ * Reader thread of the concurrency benchmark.
+ *
+ * Three in four lookups pick a stable name, which must be found as itself;
+ * the rest pick a churn name, which may or may not be present. A churn hit
+ * is not compared, since a writer may remove the name, and the stored string
+ * with it, as soon as the lookup returns.
+ *
+ * @param argument The thread's ConcurrencyWorker.
+ * @return Always 0.
+ */
+static int concurrency_reader(void *argument) {
+    ConcurrencyWorker *worker = (ConcurrencyWorker *)argument;
+    ConcurrencyRun *run = worker->run;
+    uint32_t state = 2463534242u ^ (worker->id * 2654435761u);
+    size_t lookups = 0, errors = 0;
+
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        for (int i = 0; i < 1024; i++) {
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            int stable = (state & 3) != 0;
+            const char *key = stable
+                ? run->stable + (state >> 2) % run->stable_count * CONCURRENCY_STRIDE
+                : run->churn + (state >> 2) % run->churn_count * CONCURRENCY_STRIDE;
+            const char *found = hash_table_lookup(run->table, key);
+            if (stable && (found == NULL || strcmp(found, key) != 0)) {
+                errors++;
+            }
+        }
+        lookups += 1024;
+    }
+
+    atomic_fetch_add(&run->lookups, lookups);
+    atomic_fetch_add(&run->errors, errors);
+    return 0;
+}
+
+/**
+ * Writer thread of the concurrency benchmark.
+ *
+ * Each writer owns every count-th churn name starting at its id, and
+ * alternates between inserting all of them and removing all of them. Every
+ * insert and remove must succeed.
+ *
+ * @param argument The thread's ConcurrencyWorker.
+ * @return Always 0.
+ */
+static int concurrency_writer(void *argument) {
+    ConcurrencyWorker *worker = (ConcurrencyWorker *)argument;
+    ConcurrencyRun *run = worker->run;
+    size_t writes = 0, errors = 0;
+
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        for (size_t i = worker->id; i < run->churn_count; i += worker->count) {
+            errors += hash_table_insert(run->table, run->churn + i * CONCURRENCY_STRIDE) != 0;
+            writes++;
+        }
+        for (size_t i = worker->id; i < run->churn_count; i += worker->count) {
+            errors += hash_table_remove(run->table, run->churn + i * CONCURRENCY_STRIDE) != 0;
+            writes++;
+        }
+    }
+
+    atomic_fetch_add(&run->writes, writes);
+    atomic_fetch_add(&run->errors, errors);
+    return 0;
+}
+
+/**
+ * Runs the reader and writer threads of the concurrency benchmark.
+ *
+ * The counters of run are reset, the threads are started, and after the
+ * given time they are asked to stop and joined. Writers only stop between
+ * full insert/remove passes, so the churn names are absent afterwards.
+ *
+ * @param run The shared benchmark state.
+ * @param readers The number of reader threads.
+ * @param writers The number of writer threads.
+ * @param milliseconds How long the threads run.
+ * @return The elapsed time in seconds.
+ */
+static double run_concurrency(ConcurrencyRun *run, unsigned int readers, unsigned int writers,
+                              unsigned int milliseconds) {
+    unsigned int count = readers + writers;
+    thrd_t *handles = (thrd_t *)malloc(count * sizeof(thrd_t));
+    ConcurrencyWorker *workers = (ConcurrencyWorker *)malloc(count * sizeof(ConcurrencyWorker));
+    if (!handles || !workers) {
+        printf("Memory allocation failed for benchmark threads\n");
+        free(handles);
+        free(workers);
+        return 0;
+    }
+
+    atomic_store(&run->stop, 0);
+    atomic_store(&run->lookups, 0);
+    atomic_store(&run->writes, 0);
+    atomic_store(&run->errors, 0);
+
+    double start = clock_ns();
+    unsigned int started = 0;
+    for (; started < count; started++) {
+        int reader = started < readers;
+        workers[started].run = run;
+        workers[started].id = reader ? started : started - readers;
+        workers[started].count = reader ? readers : writers;
+        if (thrd_create(&handles[started], reader ? concurrency_reader : concurrency_writer,
+                        &workers[started]) != thrd_success) {
+            printf("Failed to start benchmark thread\n");
+            break;
+        }
+    }
+
+    struct timespec duration = { milliseconds / 1000, (long)(milliseconds % 1000) * 1000000L };
+    if (started == count) {
+        thrd_sleep(&duration, NULL);
+    }
+    atomic_store(&run->stop, 1);
+    for (unsigned int i = 0; i < started; i++) {
+        thrd_join(handles[i], NULL);
+    }
+    double elapsed = (clock_ns() - start) / 1e9;
+
+    free(handles);
+    free(workers);
+    return elapsed;
+}
+
+/**
+ * Stress-tests and benchmarks HASH_TABLE_CONCURRENT tables.
+ *
+ * A concurrent table is loaded with CONCURRENCY_NAMES stable names, and
+ * writer threads insert and remove a further CONCURRENCY_CHURN names over and
+ * over while reader threads look up random names from both sets. A stable
+ * name must always be found as itself; anything else, or a failed write,
+ * counts as an error. The stress phase runs threads readers against two
+ * writers for one second. The scaling phase then measures lookup throughput
+ * for 1 to threads readers against one writer.
+ *
+ * @param threads The maximum number of reader threads (capped at CONCURRENCY_MAX_READERS).
+ * @return 0 if no error was seen, or 1.
+ */
+static int run_concurrency_benchmark(size_t threads) {
+    if (threads == 0) threads = 1;
+    if (threads > CONCURRENCY_MAX_READERS) threads = CONCURRENCY_MAX_READERS;
+
+    size_t total = CONCURRENCY_NAMES + CONCURRENCY_CHURN;
+    char *names = (char *)malloc(total * CONCURRENCY_STRIDE);
+    HashTableOptions options = { .flags = HASH_TABLE_CONCURRENT };
+    HashTable *table = names ? create_hash_table_ex(&options) : NULL;
+    if (table == NULL) {
+        if (!names) printf("Memory allocation failed for benchmark keys\n");
+        free(names);
+        return 1;
+    }
+
+    // Deterministic xorshift generator, so runs are comparable
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < total; i++) {
+        char *name = names + i * CONCURRENCY_STRIDE;
+        state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+        size_t length = 5 + state % 8;
+        for (size_t j = 0; j < length; j++) {
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            name[j] = (char)('A' + (state >> 8) % 26);
+        }
+        name[length] = '\0';
+    }
+    for (size_t i = 0; i < CONCURRENCY_NAMES; i++) {
+        hash_table_insert(table, names + i * CONCURRENCY_STRIDE);
+    }
+
+    ConcurrencyRun run;
+    memset(&run, 0, sizeof(run));
+    run.table = table;
+    run.stable = names;
+    run.stable_count = CONCURRENCY_NAMES;
+    run.churn = names + CONCURRENCY_NAMES * CONCURRENCY_STRIDE;
+    run.churn_count = CONCURRENCY_CHURN;
+
+    size_t errors = 0;
+    double seconds = run_concurrency(&run, (unsigned int)threads, 2, 1000);
+    errors += run.errors;
+    printf("Stress (%zu readers, 2 writers, %zu names):\n", threads, (size_t)CONCURRENCY_NAMES);
+    printf("  %zu lookups, %zu writes in %.2f s, %zu errors\n",
+           (size_t)run.lookups, (size_t)run.writes, seconds, (size_t)run.errors);
+
+    printf("Lookup scaling (1 writer):\n");
+    double single = 0;
+    for (unsigned int readers = 1; readers <= threads; readers++) {
+        seconds = run_concurrency(&run, readers, 1, 500);
+        errors += run.errors;
+        double rate = seconds > 0 ? (double)run.lookups / seconds : 0;
+        if (readers == 1) single = rate;
+        printf("  %3u threads %14.0f lookups/s (%.2fx)%s\n", readers, rate,
+               single > 0 ? rate / single : 0, run.errors ? "  (ERRORS)" : "");
+    }
+
+    HashTableMemoryStats stats;
+    hash_table_memory_stats(table, &stats);
+    printf("Names after the runs: %zu (expected %zu)\n", stats.names, (size_t)CONCURRENCY_NAMES);
+    destroy_hash_table(table);
+    free(names);
+    return errors != 0 || stats.names != CONCURRENCY_NAMES;
+}
+
+/**
+ * Main function of the benchmark harness.
+ *
+ * Command-line Arguments:
+ * -n keys            : Number of distinct keys per workload (default 100000).
+ * -q queries         : Number of hit and of miss lookups timed (default 100000).
+ * -w workload        : uniform, zipf or census (default: all of them).
+ * -s structure       : hashblocks, hashblocks-arena, hashblocks-flat, hashblocks-filter, hashblocks-frozen,
+ *                      hashblocks-frozen-compact, hash or trie (default: all).
+ * -f format          : csv (default) or json.
+ * -o file            : Write the results to a file instead of stdout.
+ * -r seed            : Seed of the workload generator.
+ * -e edits           : Time fuzzy searches within 0 to edits edits against a
+ *                      brute-force scan instead of the structures.
+ * -k count           : Time key normalization and flat bucket scans at every
+ *                      SIMD level on count synthetic keys instead.
+ * -t threads         : Stress-test and benchmark concurrent lookups with 1 to
+ *                      threads readers instead.
+ *
+ * Peak RSS is the process high-water mark, so it only isolates one structure
+ * when -w and -s select a single run.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @return 0 on success, or 1 if an error occurs.
+ */
+int main(int argc, char *argv[]) {
+    size_t key_count = DEFAULT_KEYS, queries = DEFAULT_QUERIES;
+    const char *workload_filter = NULL, *structure_filter = NULL, *output_path = NULL;
+    int json = 0;
+    uint32_t seed = 0;
+    int edits = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            key_count = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            queries = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            workload_filter = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            structure_filter = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            json = strcmp(argv[++i], "json") == 0;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            edits = (int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            return run_kernel_benchmark(strtoul(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            return run_concurrency_benchmark(strtoul(argv[++i], NULL, 10));
+        } else {
+            printf("Usage: %s [-n keys] [-q queries] [-w uniform|zipf|census] "
+                   "[-s hashblocks|hashblocks-arena|hashblocks-flat|hashblocks-filter|hashblocks-frozen|hashblocks-frozen-compact|hash|trie] "
+                   "[-f csv|json] [-o file] [-r seed] [-e edits] [-k count] [-t threads]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (key_count == 0) key_count = 1;
+
+    FILE *out = output_path ? fopen(output_path, "w") : stdout;
+    if (out == NULL) {
+        printf("Failed to open %s\n", output_path);
+        return 1;
+    }
+
+    double overhead = timer_overhead();
+    int status = 0, rows = 0;
+    for (size_t w = 0; w < WORKLOAD_COUNT; w++) {
+        if (workload_filter && strcmp(workload_filter, workload_names[w]) != 0) continue;
+        Workload workload;
+        if (create_workload(&workload, workload_names[w], key_count, queries, seed) != 0) {
+            destroy_workload(&workload);
+            status = 1;
+            break;
+        }
+        if (edits >= 0) {
+            status |= run_fuzzy_benchmark(&workload, (unsigned int)edits, out, json, &rows);
+            destroy_workload(&workload);
+            continue;
+        }
+        for (size_t s = 0; s < STRUCTURE_COUNT; s++) {
+            if (structure_filter && strcmp(structure_filter, structures[s].name) != 0) continue;
+            BenchResult result;
+            status |= run_benchmark(&structures[s], &workload, overhead, &result);
+            if (json) write_json(out, &result, rows == 0);
+            else write_csv(out, &result, rows == 0);
+            rows++;
+            fflush(out);
+        }
+        destroy_workload(&workload);
+    }
+    if (json) fprintf(out, rows ? "\n]\n" : "[]\n");
+    if (out != stdout) fclose(out);
+    return status;
+}
@@ -1,12 +1,606 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L  // fileno, fsync and ftruncate under -std=c17
+#endif
 #include "hashblocks.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
 
-// Static global variable representing the first level of the hierarchical hash structure.
-// Each element corresponds to a letter A-Z (indexed by char_to_index).
-HashBlocks *first_level[FIRST_LEVEL_SIZE];
+// Snapshots are opened read-only through the platform's file mapping API
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// SIMD kernels are only built for x86, where SSE2 and AVX2 are selected at runtime
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HB_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define HB_TARGET_SSE2
+#define HB_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define HB_TARGET_SSE2 __attribute__((target("sse2")))
+#define HB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Software prefetch hint used by the batch APIs
+#if defined(_MSC_VER) && !defined(__clang__)
+#ifdef HB_X86
+#define HB_PREFETCH(address) _mm_prefetch((const char *)(address), _MM_HINT_T0)
+#else
+#define HB_PREFETCH(address) ((void)(address))
+#endif
+#else
+#define HB_PREFETCH(address) __builtin_prefetch(address)
+#endif
+
+// Acquire loads and release stores of the pointers that link the levels and chains.
+// Readers of HASH_TABLE_CONCURRENT tables follow these pointers while writers publish
+// new blocks and nodes, so the accesses go through an _Atomic view of the plain members
+// declared in hashblocks.h. On x86 both compile to ordinary moves.
+#define LOAD_POINTER(type, location) \
+    atomic_load_explicit((type *_Atomic *)(location), memory_order_acquire)
+#define STORE_POINTER(type, location, value) \
+    atomic_store_explicit((type *_Atomic *)(location), (value), memory_order_release)
+
+// Bucket maps of the default schema: every letter gets its own bucket, or the six
+// vowels get one bucket each and every other letter shares the "Default" bucket.
+#define LETTER_BUCKETS { \
+    ['A'] = 0, ['B'] = 1, ['C'] = 2, ['D'] = 3, ['E'] = 4, ['F'] = 5, ['G'] = 6, \
+    ['H'] = 7, ['I'] = 8, ['J'] = 9, ['K'] = 10, ['L'] = 11, ['M'] = 12, ['N'] = 13, \
+    ['O'] = 14, ['P'] = 15, ['Q'] = 16, ['R'] = 17, ['S'] = 18, ['T'] = 19, ['U'] = 20, \
+    ['V'] = 21, ['W'] = 22, ['X'] = 23, ['Y'] = 24, ['Z'] = 25 }
+#define VOWEL_BUCKETS { \
+    ['A'] = 0, ['E'] = 1, ['I'] = 2, ['O'] = 3, ['U'] = 4, ['Y'] = 5, \
+    ['B'] = 6, ['C'] = 6, ['D'] = 6, ['F'] = 6, ['G'] = 6, ['H'] = 6, ['J'] = 6, \
+    ['K'] = 6, ['L'] = 6, ['M'] = 6, ['N'] = 6, ['P'] = 6, ['Q'] = 6, ['R'] = 6, \
+    ['S'] = 6, ['T'] = 6, ['V'] = 6, ['W'] = 6, ['X'] = 6, ['Z'] = 6 }
+
+// Number of groups a level of hash_schema_from_sample balances over: one per
+// combination of the buckets of the levels above it
+#define SCHEMA_GROUPS (FIRST_LEVEL_SIZE * SECOND_LEVEL_SIZE)
+
+// Character positions a schema can read, and the characters balanced at each
+// level: every byte, with 0 standing for the end of a shorter name
+#define SCHEMA_POSITIONS (HASH_SCHEMA_MAX_POSITION + 1)
+#define SCHEMA_SYMBOLS 256
+
+// Size of a single arena page. Names that do not fit in a page get a dedicated page.
+#define ARENA_PAGE_SIZE 65536
+
+// Size of the stack buffer used to normalize names without a heap allocation.
+#define NAME_BUFFER_SIZE 64
+
+// Shortest name normalize_name accepts, in bytes after normalization
+#define MIN_NAME_LENGTH 3
+
+// Cells of a row of hash_table_fuzzy's edit distances: those within the largest
+// budget of the diagonal
+#define FUZZY_BAND (2 * HASH_FUZZY_MAX_EDITS + 1)
+
+// Characters of the last name checked whose hash_table_fuzzy rows are kept for the next
+#define FUZZY_ROWS NAME_BUFFER_SIZE
+
+// Table flags that select how names are normalized (see normalize_name)
+#define KEY_MODE_FLAGS (HASH_TABLE_UTF8 | HASH_TABLE_FOLD_ACCENTS)
+
+// A page of memory handed out by an Arena with a bump pointer.
+typedef struct ArenaPage {
+    struct ArenaPage *next;  // Next page in the same list
+    size_t size;             // Usable bytes in data
+    size_t used;             // Bytes already handed out from data
+    char data[];             // Page contents
+} ArenaPage;
+
+// Per-table allocator used in HASH_TABLE_ARENA mode.
+// Nodes and names live in separate page lists so nodes stay densely packed, and the
+// whole arena is released page by page instead of node by node.
+typedef struct Arena {
+    ArenaPage *node_pages;   // Pages holding Node structures
+    ArenaPage *name_pages;   // Pages holding name strings
+    Node *free_nodes;        // Nodes released by hash_table_remove, reused by later inserts
+    size_t page_count;       // Number of pages in both lists
+    size_t reserved_bytes;   // Total bytes allocated for pages, including page headers
+} Arena;
+
+// Flat bucket fingerprints are allocated in multiples of this many bytes, so the
+// SIMD scans can always load whole vectors.
+#define FLAT_TAG_ALIGN 32
+
+// Bits in one line of a block filter: a 64-byte cache line. Every bit a name sets
+// lies in the same line, so testing a name reads one cache line.
+#define FILTER_LINE_BITS 512
+#define FILTER_LINE_WORDS (FILTER_LINE_BITS / 64)
+#define LN_2 0.69314718055994530942
+#define FILTER_STEP 0x9E3779B97F4A7C15ull  // Odd multiplier that derives each bit of a name from its hash
+#define FILTER_BIT_SHIFT 55                // Keeps the top log2(FILTER_LINE_BITS) bits of a step
+
+// Blocked Bloom filter of the names below one HashBlock in HASH_TABLE_FILTER tables.
+// It heads a single allocation that also holds the cache-line aligned lines. Removed
+// names keep their bits until the filter is rebuilt.
+typedef struct BlockFilter {
+    uint32_t line_mask;  // Number of lines minus one (lines are a power of two)
+    uint32_t capacity;   // Names the lines hold at the table's bits per name
+    uint32_t names;      // Names added since the filter was built, including removed ones
+    uint32_t removed;    // Of those, names removed since
+    uint64_t *lines;     // line_mask + 1 lines of FILTER_LINE_WORDS words
+} BlockFilter;
+
+// Search state of hash_table_fuzzy. Names arrive sorted within a slot, so the rows
+// of the characters a name shares with the previous one are kept and reused, up to
+// FUZZY_ROWS characters.
+typedef struct FuzzySearch {
+    const HashTable *table;         // Table searched
+    size_t length;                  // Length of the normalized searched name
+    unsigned int edits;             // Edit budget
+    const uint32_t *codes;          // Per byte of the searched name: the byte, then its bucket at each level
+    HashTableMatchVisitor visitor;  // Caller's visitor
+    void *context;                  // Caller's context
+    size_t cached;                  // Characters of prefix whose rows are kept
+    size_t dead;                    // First kept row over budget, or SIZE_MAX
+    char prefix[FUZZY_ROWS];        // Characters of the last name checked
+    unsigned char rows[FUZZY_ROWS + 1][FUZZY_BAND]; // Row i follows the first i characters of prefix
+} FuzzySearch;
+
+// Number of keys the batch APIs keep in flight at once. Each stage of a batch
+// touches one level for every key in the window, so the cache misses of
+// different keys overlap instead of being paid one after another.
+#define BATCH_WINDOW 16
+
+// Number of threads that can read HASH_TABLE_CONCURRENT tables wait-free at the same
+// time. Further reader threads fall back to the writer lock of the letter they read.
+#define MAX_READERS 128
+
+// A stripe tries to free its retired nodes every time this many have accumulated
+#define RECLAIM_THRESHOLD 64
+
+// Read buffer used to stream names from files and stdin (-N and -O). Memory use
+// is bounded by this size however large the input is.
+#define STREAM_BUFFER_SIZE (1 << 20)
+
+// Names handed to the batch APIs at a time while streaming
+#define STREAM_BATCH 1024
+
+// Size of the buffer lookup results are collected in before they are written out
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+// Initial number of entries allocated for a flat bucket.
+#define FLAT_MIN_CAPACITY 4
+
+// Initial size of a flat bucket's string pool.
+#define FLAT_MIN_POOL 32
+
+// A third-level chain of a linked-list table is promoted into a SubBlock once it
+// holds more than PROMOTE_THRESHOLD names that are not all the same, and a SubBlock
+// is flattened back into one chain when fewer than DEMOTE_THRESHOLD names remain
+// below it. The gap keeps a chain hovering around the limit from flipping back and
+// forth.
+#define PROMOTE_THRESHOLD 32
+#define DEMOTE_THRESHOLD 8
+
+// Buckets of a SubBlock: one for names that end at its depth, one per letter
+#define SUB_BLOCK_SIZE 27
+
+// Low bit set on a third-level slot (or SubBlock bucket) that holds a SubBlock
+// instead of the head of a chain. Nodes are at least pointer-aligned, so the bit
+// is free in real Node pointers.
+#define SUB_BLOCK_TAG ((uintptr_t)1)
+
+// Sizing of the perfect hash of a frozen slot: names per displacement bucket on
+// average, and one spare position per FROZEN_SPARE names, which keeps the search
+// for displacements short
+#define FROZEN_BUCKET_SIZE 4
+#define FROZEN_SPARE 8
+
+// Hash seeds tried per frozen slot before it gets more spare positions, and how
+// many times it gets them before hash_table_freeze gives up
+#define FROZEN_SEED_TRIES 8
+#define FROZEN_GROWTHS 8
+
+// Frozen position that holds no name
+#define FROZEN_EMPTY UINT32_MAX
+
+// Nested index replacing an overfull chain of a linked-list table.
+// Every name below the block starts with prefix, and the buckets split them on the
+// character that follows it, in alphabetical order, so an in-order walk of the
+// buckets still yields the names sorted by strcmp.
+typedef struct SubBlock {
+    Node *slots[SUB_BLOCK_SIZE]; // Chain heads or tagged nested SubBlocks
+    size_t count;                // Names stored below this block
+    size_t depth;                // Length of prefix
+    char prefix[];               // Shared prefix of every name below, NUL-terminated
+} SubBlock;
+
+// Fixed-size summary of one name in a FlatBucket.
+typedef struct FlatEntry {
+    uint32_t offset;  // Offset of the name in the bucket's string pool
+    uint32_t length;  // Length of the name, excluding the terminator
+    void *value;      // Payload set by hash_table_put
+} FlatEntry;
+
+// Third-level slot of a HASH_TABLE_FLAT table.
+// Entries are kept sorted by name in one contiguous array, with a parallel array of
+// one-byte fingerprints. A lookup scans the fingerprints (a cache line covers 64 names)
+// and only compares lengths and full strings on a fingerprint match.
+struct FlatBucket {
+    uint32_t count;       // Number of names stored
+    uint32_t capacity;    // Number of entries (and fingerprints) allocated
+    uint32_t pool_used;   // Bytes of the string pool in use, including removed names
+    uint32_t pool_size;   // Bytes allocated for the string pool
+    uint32_t pool_dead;   // Bytes of removed names still occupying the pool
+    FlatEntry *entries;   // Entries sorted by name; the fingerprints follow in the same allocation
+    uint8_t *tags;        // One fingerprint per entry, in entry order, zero-padded to FLAT_TAG_ALIGN
+    char *pool;           // NUL-terminated names, back to back
+};
+
+// Per-key state of a batch insert or lookup while its window is in flight.
+typedef struct BatchKey {
+    char *name;              // Normalized name, or NULL if the input was invalid
+    size_t length;           // Length of name
+    unsigned int first;      // First-level index
+    unsigned int second;     // Second-level index
+    unsigned int third;      // Third-level index
+    HashBlocks *blocks;      // Second-level structure once resolved
+    HashBlock *block;        // Third-level block once resolved
+} BatchKey;
+
+// Number of independent subtrees hash_table_build distributes over its workers:
+// one per pair of first-level letter and second-level bucket.
+#define BUILD_TASKS (FIRST_LEVEL_SIZE * SECOND_LEVEL_SIZE)
+
+// Normalized key collected by a hash_table_build worker before it is inserted.
+typedef struct BuildKey {
+    const char *name;   // Normalized name inside the worker's text buffer
+    size_t length;      // Length of name
+    size_t input;       // Index of the key in the caller's array
+    unsigned int third; // Third-level bucket of name
+} BuildKey;
+
+// Work shared by the threads of one hash_table_build call.
+typedef struct BuildJob {
+    HashTable *table;                        // Table being built
+    const char *const *names;                // Input keys
+    int *results;                            // Per-key results, or NULL
+    size_t *order;                           // Input indices grouped by task
+    size_t task_start[BUILD_TASKS + 1];      // Start of each task's range in order
+    unsigned int tasks[BUILD_TASKS];         // Non-empty tasks, largest first
+    unsigned int task_count;                 // Number of entries in tasks
+    _Atomic unsigned int next_task;          // Next entry of tasks to hand out
+} BuildJob;
+
+// Identification and layout version of snapshot files written by hash_table_save
+#define SNAPSHOT_MAGIC "HBLOCKS"
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// Header at the start of a snapshot file. Every offset is a byte offset from the
+// start of the file, so the mapped image can be used in place at any address.
+//
+// Layout after the header:
+//   uint32_t first_level[FIRST_LEVEL_SIZE]      offset of a second-level record, or 0
+//   second-level records: uint32_t [SECOND_LEVEL_SIZE]   offset of a third-level record, or 0
+//   third-level records:  SnapshotSlot [THIRD_LEVEL_SIZE] range of entries per slot
+//   SnapshotEntry entries[name_count]           sorted within each slot
+//   char pool[pool_size]                        NUL-terminated names
+typedef struct SnapshotHeader {
+    char magic[8];               // SNAPSHOT_MAGIC, NUL-terminated
+    uint32_t version;            // SNAPSHOT_VERSION
+    uint32_t byte_order;         // SNAPSHOT_BYTE_ORDER as stored by the writing machine
+    uint32_t header_size;        // sizeof(SnapshotHeader)
+    uint32_t first_level_size;   // FIRST_LEVEL_SIZE of the writer
+    uint32_t second_level_size;  // SECOND_LEVEL_SIZE of the writer
+    uint32_t third_level_size;   // THIRD_LEVEL_SIZE of the writer
+    uint32_t key_flags;          // Key mode flags (HASH_TABLE_UTF8, HASH_TABLE_FOLD_ACCENTS) of the saved table
+    uint32_t log_generation;     // Generation of the write-ahead log that continues it (0 without a log)
+    uint64_t name_count;         // Number of entries
+    uint64_t file_size;          // Total size of the file
+    uint64_t entries_offset;     // Offset of the entry array
+    uint64_t pool_offset;        // Offset of the string pool
+    uint64_t pool_size;          // Bytes in the string pool
+    uint64_t checksum;           // FNV-1a 64 of every byte after the header
+    HashSchema schema;           // Level schema of the saved table
+} SnapshotHeader;
+
+// Range of entries stored for one third-level slot of a snapshot.
+typedef struct SnapshotSlot {
+    uint32_t start;   // Index of the slot's first entry
+    uint32_t count;   // Number of entries in the slot
+} SnapshotSlot;
+
+// One name of a snapshot.
+typedef struct SnapshotEntry {
+    uint32_t offset;  // Offset of the name within the string pool
+    uint32_t length;  // Length of the name, excluding the terminator
+} SnapshotEntry;
+
+// Output state of hash_table_save.
+typedef struct SnapshotWriter {
+    FILE *file;         // Destination
+    uint64_t checksum;  // FNV-1a 64 of everything written after the header
+    uint64_t pool_used; // Pool bytes assigned to entries written so far
+    int failed;         // Set once a write fails
+} SnapshotWriter;
+
+// Buffered writer for streamed lookup results.
+typedef struct OutputBuffer {
+    FILE *file;    // Destination stream
+    char *data;    // OUTPUT_BUFFER_SIZE bytes of pending output
+    size_t used;   // Bytes pending in data
+} OutputBuffer;
+
+// Characters of a sample key that a schema can read, padded with terminators.
+typedef struct SchemaKey {
+    unsigned char characters[SCHEMA_POSITIONS];
+} SchemaKey;
+
+// Occupancy counts used by derive_level while it balances one level.
+typedef struct SchemaCounts {
+    size_t frequencies[SCHEMA_GROUPS][SCHEMA_SYMBOLS];  // Sample keys per group and character
+    size_t loads[SCHEMA_GROUPS][THIRD_LEVEL_SIZE];      // Sample keys per group and bucket
+} SchemaCounts;
+
+// Node removed from a HASH_TABLE_CONCURRENT table that readers may still be looking at.
+typedef struct RetiredNode {
+    Node *node;       // The unlinked node; freed once every reader of its epoch has left
+    uint64_t epoch;   // Global epoch observed right after the node was unlinked
+} RetiredNode;
+
+// Writer lock and reclamation list of one first-level letter in HASH_TABLE_CONCURRENT tables.
+typedef struct Stripe {
+    mtx_t lock;                  // Serializes writers of the letter (recursive)
+    RetiredNode *retired;        // Nodes removed from the letter and not yet freed
+    size_t retired_count;        // Number of entries in retired
+    size_t retired_capacity;     // Allocated entries in retired
+} Stripe;
+
+// Operation counters of one first-level letter in HASH_TABLE_COUNTERS tables, padded
+// to a cache line so threads working on different letters do not share one.
+typedef struct OpCounters {
+    _Atomic size_t inserts;    // Names added
+    _Atomic size_t hits;       // Lookups that found their name
+    _Atomic size_t misses;     // Lookups that did not
+    _Atomic size_t compares;   // Names compared by those lookups
+    _Atomic size_t rejects;    // Lookups a block filter answered without a walk
+    _Atomic size_t passes;     // Lookups a block filter let through that missed
+    char padding[64 - 6 * sizeof(size_t)];
+} OpCounters;
+
+// Chain lengths gathered by hash_table_stats.
+typedef struct ChainStats {
+    HashTableStats *stats;     // Statistics being filled in
+    size_t *lengths;           // Length of every chain seen so far, for the percentiles
+    size_t capacity;           // Allocated entries in lengths
+    double probes;             // Name comparisons of looking up every stored name once
+    int failed;                // Set if lengths could not grow
+} ChainStats;
+
+// Announcement slot of one reader thread for epoch-based reclamation. Each slot sits
+// on its own cache line so readers never write to a line another reader uses.
+typedef struct ReaderSlot {
+    _Alignas(64) _Atomic uint64_t epoch;  // Epoch of the read in progress, or 0 between reads
+    _Atomic int in_use;                   // Non-zero while a thread owns the slot
+} ReaderSlot;
+
+// Converts length bytes of src to uppercase into dst; returns 1 on a non-letter byte.
+typedef int (*UpperKernel)(char *dst, const char *src, size_t length);
+
+// Returns a bitmask of the positions among 32 fingerprints that equal tag.
+typedef uint32_t (*TagKernel)(const uint8_t *tags, uint8_t tag);
+
+// SIMD level in use, or -1 until the CPU has been inspected.
+static _Atomic int simd_level = -1;
+
+// Epoch-based reclamation state shared by all HASH_TABLE_CONCURRENT tables. A reader
+// announces the global epoch in its slot for the duration of a lookup; a removed node
+// is freed only after the global epoch has advanced twice past the epoch it was
+// retired in, which cannot happen while any reader that might still see it is active.
+static ReaderSlot reader_slots[MAX_READERS];
+static _Atomic int reader_slot_limit;            // One past the highest slot ever claimed
+static _Atomic uint64_t global_epoch = 1;
+static _Thread_local ReaderSlot *thread_reader;  // Slot owned by the calling thread
+static tss_t reader_key;                         // Releases the slot when its thread exits
+static int reader_key_ready;
+static once_flag reader_key_once = ONCE_FLAG_INIT;
+// A single Hash Blocks table.
+// Each table owns the first level of its hierarchical hash structure, so independent
+// tables never share state.
+struct HashTable {
+    HashBlocks *first_level[FIRST_LEVEL_SIZE];  // First-level buckets (A-Z with the default schema)
+    const HashSchema *schema;                   // Level schema; owned by the table unless it is default_schema
+    unsigned int flags;                         // HASH_TABLE_* flags the table was created with
+    _Atomic size_t name_count;                  // Number of names currently stored
+    Arena arena;                                // Node and name storage in HASH_TABLE_ARENA mode
+    Stripe *stripes;                            // Per-letter writer state in HASH_TABLE_CONCURRENT mode
+    OpCounters *counters;                       // Per-letter operation counters in HASH_TABLE_COUNTERS mode
+    double filter_rate;                         // Target false-positive rate of block filters in HASH_TABLE_FILTER mode
+    unsigned int filter_bits;                   // Filter bits per name for that rate
+    unsigned int filter_hashes;                 // Bits each name sets in its filter line
+};
+
+// Contents detached from a table by hash_table_clear_async, hash_table_swap or
+// destroy_hash_table_async. Workers claim first-level buckets through next, and the
+// last one to finish frees what the buckets share.
+struct HashReclaim {
+    HashBlocks *first_level[FIRST_LEVEL_SIZE];  // Detached first-level buckets
+    unsigned int flags;                         // HASH_TABLE_* flags of the table they came from
+    Arena arena;                                // Detached pages in HASH_TABLE_ARENA mode
+    RetiredNode *retired[FIRST_LEVEL_SIZE];     // Detached retired-node list of each stripe
+    size_t retired_count[FIRST_LEVEL_SIZE];     // Entries in each list
+    HashTable *table;                           // Emptied handle to destroy at the end, or NULL
+    uint64_t epoch;                             // Global epoch after the detach in HASH_TABLE_CONCURRENT mode, or 0
+    _Atomic unsigned int next;                  // Next first-level bucket to free
+    _Atomic unsigned int running;               // Workers that have not finished
+    thrd_t *workers;                            // Worker threads
+    unsigned int worker_count;                  // Workers started
+};
+
+// State of one hash_table_build worker thread.
+typedef struct BuildWorker {
+    BuildJob *job;              // Shared work
+    HashTable local;            // Holds the worker's private arena in HASH_TABLE_ARENA mode
+    BuildKey *keys;             // Keys of the current task
+    size_t key_capacity;        // Allocated entries in keys
+    Node **nodes;               // Nodes of the current third-level run
+    size_t node_capacity;       // Allocated entries in nodes
+    char *text;                 // Normalized names of the current task, back to back
+    size_t text_capacity;       // Allocated bytes in text
+    size_t failures;            // Keys this worker could not insert
+} BuildWorker;
+
+// Perfect hash of one third-level slot of a frozen table. A name's hash picks one of
+// the slot's buckets; the bucket's pilot then moves it to a position, and each
+// position holds the only name that can be found there.
+typedef struct FrozenSlot {
+    uint32_t positions;  // Index of the slot's first position
+    uint32_t size;       // Number of positions (0 for an empty slot)
+    uint32_t pilots;     // Index of the slot's first pilot
+    uint32_t buckets;    // Number of buckets, one pilot each
+    uint32_t seed;       // Hash seed for which every bucket found a pilot
+} FrozenSlot;
+
+// Read-only compact copy of a table made by hash_table_freeze. It heads a single
+// allocation that also holds every array it points to.
+struct HashFrozen {
+    HashSchema schema;                                   // Level schema of the frozen table
+    const HashSchema *levels;                            // default_schema if schema is the default, else &schema
+    unsigned int flags;                                  // HASH_FROZEN_* flags it was made with
+    unsigned int key_flags;                              // Key mode flags of the table it was made from
+    char implied[HASH_SCHEMA_LEVELS][FIRST_LEVEL_SIZE];  // Letter each level's bucket implies, or 0
+    size_t bytes;                                        // Size of the whole allocation
+    size_t name_count;                                   // Distinct names stored
+    uint32_t first_level[FIRST_LEVEL_SIZE];              // 1 + index of a second-level record, or 0
+    const uint32_t (*second_level)[SECOND_LEVEL_SIZE];   // 1 + index of a slot record, or 0
+    const FrozenSlot (*slots)[THIRD_LEVEL_SIZE];         // Perfect hash of every third-level slot
+    const uint32_t *positions;                           // Pool offset of each position's name, or FROZEN_EMPTY
+    const uint16_t *pilots;                              // Pilot of each bucket
+    const char *pool;                                    // NUL-terminated names (or compact keys), slot by slot
+};
+
+// Working state of hash_table_freeze. Names are referenced in place in the table,
+// which stays locked until they have been copied.
+typedef struct FreezeBuilder {
+    const HashSchema *schema;   // Level schema of the table being frozen
+    const char (*implied)[FIRST_LEVEL_SIZE]; // Letters left out of compact keys, or NULL
+    const char **names;         // Distinct names of the slots built so far, in slot order
+    size_t name_count;          // Entries in names
+    size_t name_capacity;       // Allocated entries in names
+    size_t pool_bytes;          // Pool bytes the names (or their compact keys) need
+    uint32_t *positions;        // Index in names of each position's name, or FROZEN_EMPTY
+    size_t position_count;      // Positions of the slots built so far
+    size_t position_capacity;   // Allocated entries in positions
+    uint16_t *pilots;           // Pilots of the slots built so far
+    size_t pilot_count;         // Entries in pilots
+    size_t pilot_capacity;      // Allocated entries in pilots
+    uint64_t *hashes;           // Hash of each name of the slot being built
+    uint32_t *order;            // Names of that slot grouped by bucket
+    uint32_t *starts;           // First entry of each bucket in order (one extra at the end)
+    uint64_t *ranked;           // Size and index of each bucket, largest first
+    size_t scratch_capacity;    // Allocated entries in hashes, order, starts and ranked
+    size_t slot_first;          // Index in names of the first name of the slot being built
+} FreezeBuilder;
+
+// Identification and layout version of write-ahead logs
+#define LOG_MAGIC "HBLOG"
+#define LOG_VERSION 1
+
+// Group commit period used when HashLogOptions leaves it at 0, in milliseconds
+#define LOG_COMMIT_INTERVAL 10
+
+// Header at the start of a write-ahead log file.
+typedef struct LogHeader {
+    char magic[8];            // LOG_MAGIC, NUL-terminated
+    uint32_t version;         // LOG_VERSION
+    uint32_t byte_order;      // SNAPSHOT_BYTE_ORDER as stored by the writing machine
+    uint32_t key_flags;       // Key mode flags of the logged table
+    uint32_t generation;      // Matches the log_generation of the checkpoint the log continues
+} LogHeader;
+
+// Operations recorded in a write-ahead log
+#define LOG_INSERT 1
+#define LOG_REMOVE 2
+
+// Header of one log record. The name follows with its terminator.
+typedef struct LogRecord {
+    uint64_t checksum;  // FNV-1a 64 of the length, operation and name bytes
+    uint32_t length;    // Length of the name, excluding the terminator
+    uint32_t op;        // LOG_INSERT or LOG_REMOVE
+} LogRecord;
+
+// Write-ahead log of a table. Changes go through the table and the log under one
+// lock, so the log records them in the order the table saw them. Records collect
+// in a memory buffer; the thread that syncs takes the whole buffer and writes it
+// with one sync while other writers keep appending to the spare buffer.
+struct HashLog {
+    HashTable *table;               // Logged table
+    char *log_path;                 // <path>.log
+    char *snapshot_path;            // <path>.hb, the last checkpoint
+    char *temporary_path;           // <path>.tmp, where new checkpoints and logs are written first
+    FILE *file;                     // Log file, open for appending
+    unsigned int flags;             // HASH_LOG_* flags
+    unsigned int interval_ms;       // Group commit period
+    size_t checkpoint_bytes;        // Log size that starts a background checkpoint, or 0
+    uint32_t generation;            // Generation of the current log file
+    mtx_t lock;                     // Guards the fields below and orders changes with their records
+    cnd_t changed;                  // Broadcast when records are synced or the log is closing
+    char *pending;                  // Records appended but not yet written
+    size_t pending_size;            // Bytes used in pending
+    size_t pending_capacity;        // Bytes allocated for pending
+    char *spare;                    // Second buffer, swapped with pending when a group is written
+    size_t spare_capacity;          // Bytes allocated for spare
+    uint64_t appended;              // Records appended since the log was opened
+    uint64_t durable;               // Records written and synced
+    uint64_t log_bytes;             // Size of the log file once pending is written
+    uint64_t checkpoint_at;         // log_bytes at which the committer starts the next checkpoint
+    int syncing;                    // A thread is writing and syncing a group
+    int failed;                     // Writing the log failed; no more changes are accepted
+    int closing;                    // hash_log_close is stopping the committer
+    thrd_t committer;               // Background group commit and checkpoint thread
+};
+
+// Read-only table mapped from a snapshot file.
+struct HashSnapshot {
+    const unsigned char *base;     // Start of the mapping
+    size_t size;                   // Length of the mapping
+    const SnapshotHeader *header;  // Header at base
+    const HashSchema *schema;      // Level schema inside the header
+    const uint32_t *first_level;   // First-level offset array
+    const SnapshotEntry *entries;  // Entry array
+    const char *pool;              // String pool
+};
+
+// Schema of tables created without one: the first letter, the second letter's vowel
+// bucket and the third letter. It is compiled in as constant tables, and lookups
+// against it take a constant-folded path (see schema_index). Schemas printed with
+// print_hash_schema compile to the same kind of data but use the generic path.
+static const HashSchema default_schema = {
+    { 0, 1, 2 },
+    { LETTER_BUCKETS, VOWEL_BUCKETS, LETTER_BUCKETS }
+};
+
+// Sizes of the three levels, indexed like HashSchema::positions
+static const unsigned int level_sizes[HASH_SCHEMA_LEVELS] = {
+    FIRST_LEVEL_SIZE, SECOND_LEVEL_SIZE, THIRD_LEVEL_SIZE
+};
+
+// Default table used by the original single-table API (add_name, find_names,
+// print_hash_blocks and free_hash_blocks).
+static HashTable default_table = { .schema = &default_schema };
 
 // Forward declarations for internal helper functions.
 // These functions are defined later in this file and are used internally within the implementation.
@@ -17,24 +611,528 @@ HashBlock* create_hash_block();
 /// Creates and initializes a second-level hash structure.
 HashBlocks* create_hash_blocks();
 
-/// Maps an uppercase character (A-Z) to its zero-based index.
-unsigned int char_to_index(char c);
+/// Maps a normalized name to its bucket at one level of a schema.
+unsigned int level_index(const HashSchema *schema, unsigned int level, const char *name);
+
+/**
+ * Maps a normalized name to its bucket at one level of a schema.
+ *
+ * Tables, snapshots and frozen tables whose schema is the default one point 
+ * at default_schema itself, so this check selects a path where the positions 
+ * and bucket maps are compile-time constants: with a constant level, as at 
+ * every call site, it folds into a single load from a static table. Other 
+ * schemas go through level_index.
+ */
+static inline unsigned int schema_index(const HashSchema *schema, unsigned int level, const char *name) {
+    if (schema == &default_schema) {
+        return default_schema.buckets[level][(unsigned char)name[level]]; // Reads the first three characters
+    }
+    return level_index(schema, level, name);
+}
+
+/// Checks that a schema reads valid positions and stays inside the level sizes.
+int check_schema(const HashSchema *schema);
+
+/// Maps the characters one level of a schema reads to balanced buckets.
+double derive_level(const SchemaKey *keys, size_t count, unsigned int level, unsigned int position,
+                    SchemaCounts *counts, HashSchema *schema);
+
+/// Writes the letters that map to a bucket, "Default" for most of the alphabet or "End" for none.
+void schema_label(const HashSchema *schema, unsigned int level, unsigned int bucket, char *label);
 
-/// Maps a vowel (A, E, I, O, U, Y) to its corresponding index or a default bucket.
-unsigned int vowel_to_index(char c);
+/// Reads a file with one name per line into an array of names.
+char* read_lines(const char *path, const char ***names, size_t *count);
 
 /// Creates a new linked list node for storing a name.
-Node* create_node(const char *name);
+Node* create_node(HashTable *table, const char *name, size_t length);
+
+/// Releases a node and its name back to the table's allocator.
+void free_node(HashTable *table, Node *node);
+
+/// Hands out memory from one of an arena's page lists.
+void* arena_alloc(Arena *arena, ArenaPage **pages, size_t size, size_t align);
+
+/// Frees every page owned by an arena.
+void free_arena(Arena *arena);
+
+/// Moves every page and free node of one arena into another.
+void merge_arena(Arena *into, Arena *from);
+
+/// Estimates the heap footprint of a single malloc of the given size.
+size_t heap_chunk_size(size_t size);
+
+/// Prints the memory usage statistics of a table.
+void print_memory_stats(const HashTable *table);
+
+/// Counts a lookup in a HASH_TABLE_COUNTERS table.
+void count_lookup(const HashTable *table, const char *name, int found, unsigned int compares);
+
+/// Counts names added to a HASH_TABLE_COUNTERS table.
+void count_inserts(HashTable *table, const char *name, size_t count);
+
+/// Adds the chains below a slot of a linked-list table to the statistics.
+void add_chain_stats(const Node *slot, ChainStats *chains, size_t *names);
+
+/// Adds a flat bucket to the statistics.
+void add_bucket_stats(const struct FlatBucket *bucket, ChainStats *chains, size_t *names);
+
+/// Records the length of one chain in the histogram and the list of lengths.
+void add_chain_length(ChainStats *chains, size_t length);
+
+/// Compares two chain lengths for qsort.
+int compare_lengths(const void *a, const void *b);
+
+/// Returns a percentile of sorted chain lengths, by the nearest-rank method.
+size_t length_percentile(const size_t *lengths, size_t count, unsigned int percent);
+
+/// Searches for a name in the hierarchical hash structure of a table.
+Node* find_name(const HashTable *table, const char *name);
+
+/// Inserts a normalized name into a table, creating missing levels.
+int insert_key(HashTable *table, const char *name, size_t length);
+
+/// Searches one third-level slot for a normalized name.
+const char* find_in_slot(const HashTable *table, const HashBlock *block, unsigned int k,
+                         const char *name, size_t length);
+
+/// Normalizes the keys of a batch window and computes their level indices.
+void prepare_batch(const HashTable *table, BatchKey *keys, char (*buffers)[NAME_BUFFER_SIZE],
+                   const char *const *names, size_t count);
+
+/// Releases the normalized names of a batch window.
+void release_batch(BatchKey *keys, char (*buffers)[NAME_BUFFER_SIZE], size_t count);
+
+/// Builds the subtrees handed out by a hash_table_build job (thread entry point).
+int build_worker(void *argument);
+
+/// Normalizes, sorts and inserts the keys of one (letter, bucket) subtree.
+void build_task(BuildWorker *worker, unsigned int task);
+
+/// Links a sorted run of new nodes into a sorted third-level list in one pass.
+void merge_sorted_run(Node **head, Node **nodes, size_t count);
+
+/// Orders build keys by third-level letter, then by name.
+int compare_build_keys(const void *a, const void *b);
+
+/// Counts the names of one third-level slot (visitor used by hash_table_save).
+int count_name(const char *name, void *context);
+
+/// Writes the entry of one name (visitor used by hash_table_save).
+int write_entry(const char *name, void *context);
+
+/// Writes the bytes of one name into the pool (visitor used by hash_table_save).
+int write_pool_name(const char *name, void *context);
+
+/// Writes bytes to a snapshot file and adds them to its checksum.
+void snapshot_write(SnapshotWriter *writer, const void *data, size_t size);
+
+/// Updates a FNV-1a 64 checksum with a block of bytes.
+uint64_t snapshot_checksum(uint64_t hash, const void *data, size_t size);
+
+/// Checks that the header and index of a mapped snapshot are consistent with its size.
+int validate_snapshot(const HashSnapshot *snapshot, unsigned int flags);
+
+/// Returns the third-level slot array of a snapshot for a name, or NULL.
+const SnapshotSlot* snapshot_slots(const HashSnapshot *snapshot, const char *name);
+
+/// Maps a whole file read-only into memory.
+const unsigned char* map_file(const char *path, size_t *size);
+
+/// Releases a mapping created by map_file.
+void unmap_file(const unsigned char *base, size_t size);
+
+/// Writes a table to a snapshot file, optionally synced and tagged with a log generation.
+int write_snapshot(const HashTable *table, const char *path, uint32_t log_generation, int durable);
+
+/// Flushes a file and forces its contents to disk.
+int sync_file(FILE *file);
+
+/// Renames a file over another one and makes the rename durable.
+int replace_file(const char *from, const char *to);
+
+/// Loads the names of a snapshot into an empty table and returns its log generation.
+int load_checkpoint(HashTable *table, const char *path, uint32_t *generation);
+
+/// Applies the records of a log file to a table and returns where its valid records end.
+int replay_log(HashTable *table, const char *path, uint32_t generation, uint64_t *valid_bytes);
+
+/// Computes the checksum of a log record.
+uint64_t record_checksum(const LogRecord *record, const char *name);
+
+/// Writes an empty log file of a generation and opens it for appending.
+FILE* create_log(HashLog *log, uint32_t generation);
+
+/// Frees a log's file, buffers and paths.
+void discard_log(HashLog *log);
+
+/// Applies a change to a logged table and appends its record.
+int log_change(HashLog *log, uint32_t op, const char *input_name);
+
+/// Makes room for one record in the pending buffer of a log.
+int reserve_record(HashLog *log, size_t length);
+
+/// Writes and syncs pending records until a record is durable (lock held).
+int sync_records(HashLog *log, uint64_t target);
+
+/// Writes a checkpoint and switches to an empty log (lock held).
+int checkpoint_locked(HashLog *log);
+
+/// Syncs a log every commit interval and starts checkpoints (thread entry point).
+int log_committer(void *argument);
+
+/// Visitor used by hash_table_freeze to collect the distinct names of a slot.
+int collect_frozen_name(const char *name, void *context);
+
+/// Builds the perfect hash of the slot whose names were collected last.
+int freeze_slot(FreezeBuilder *builder, FrozenSlot *slot);
+
+/// Tries to find a pilot for every bucket of a frozen slot with its current seed and size.
+int place_frozen_buckets(FreezeBuilder *builder, const FrozenSlot *slot);
+
+/// Grows an array of the freeze builder to hold at least the given number of entries.
+void* grow_frozen(void *array, size_t *capacity, size_t needed, size_t entry_size);
 
-/// Searches for a name in the hierarchical hash structure.
-Node* find_name(const char *name);
+/// Looks up a normalized name in a frozen table.
+const char* find_frozen(const HashFrozen *frozen, const char *name, size_t length);
+
+/// Finds the letter each bucket of a schema implies, for compact frozen keys.
+void find_implied(const HashSchema *schema, unsigned int key_flags, char implied[HASH_SCHEMA_LEVELS][FIRST_LEVEL_SIZE]);
+
+/// Returns the positions of a name that its slot implies, as a bit mask.
+unsigned int implied_mask(const HashSchema *schema, const char (*implied)[FIRST_LEVEL_SIZE], const char *name);
+
+/// Compares a compact frozen key with a normalized name.
+int compact_key_equals(const char *key, const char *name, unsigned int mask);
+
+/// Copies the built perfect hashes and names into one allocation.
+HashFrozen* pack_frozen(const HashTable *table, const FreezeBuilder *builder,
+                        FrozenSlot (*slots)[SECOND_LEVEL_SIZE][THIRD_LEVEL_SIZE]);
+
+/// Hashes a normalized name for a frozen slot.
+uint64_t frozen_hash(const char *name, size_t length, uint32_t seed);
+
+/// Returns the bucket of a frozen slot that a hash falls into.
+uint32_t frozen_bucket(uint64_t hash, uint32_t buckets);
+
+/// Returns the position of a frozen slot that a hash and pilot select.
+uint32_t frozen_position(uint64_t hash, uint16_t pilot, uint32_t size);
+
+/// Orders the ranked buckets of a frozen slot, largest first.
+int compare_ranked(const void *a, const void *b);
+
+/// Removes one occurrence of a normalized name from a table.
+int remove_key(HashTable *table, const char *name, size_t length, void **value);
+
+/// Frees a third-level block, and the HashBlocks above it, once they hold nothing.
+void release_empty_block(HashTable *table, unsigned int first, unsigned int second);
+
+/// Returns whether every third-level slot of a block is empty.
+int block_is_empty(const HashBlock *block);
+
+/// Returns the third-level block of a name, creating the missing levels.
+HashBlock* ensure_block(HashTable *table, const char *name);
+
+/// Adds a normalized name with a value, or finds it if it is already stored.
+HashPutResult put_key(HashTable *table, const char *name, size_t length, void *value,
+                      HashPutMode mode, void **previous);
+
+/// Returns where the value of a normalized name is stored.
+void* const* find_value(const HashTable *table, const char *name, size_t length);
+
+/// Returns the link at which a name is, or would be, in its chain.
+Node** find_link(Node **slot, const char *name, size_t length);
+
+/// Searches a HASH_TABLE_CONCURRENT table for a normalized name inside a read-side section.
+const char* find_key_concurrent(const HashTable *table, const char *name, size_t length);
+
+/// Allocates the per-letter writer locks of a HASH_TABLE_CONCURRENT table.
+int create_stripes(HashTable *table);
+
+/// Frees the writer locks and retired nodes of a HASH_TABLE_CONCURRENT table.
+void destroy_stripes(HashTable *table);
+
+/// Takes the writer lock of a first-level letter (no-op unless HASH_TABLE_CONCURRENT).
+void lock_stripe(const HashTable *table, unsigned int letter);
+
+/// Releases the writer lock of a first-level letter (no-op unless HASH_TABLE_CONCURRENT).
+void unlock_stripe(const HashTable *table, unsigned int letter);
+
+/// Creates the thread-specific key that releases reader slots at thread exit.
+void init_reader_key(void);
+
+/// Returns a reader slot to the pool (thread-exit destructor).
+void release_reader_slot(void *slot);
+
+/// Returns the calling thread's reader slot, claiming one on first use.
+ReaderSlot* acquire_reader_slot(void);
+
+/// Announces the start of a wait-free read; returns NULL if no reader slot is free.
+ReaderSlot* enter_read(void);
+
+/// Announces the end of a read started with enter_read.
+void exit_read(ReaderSlot *slot);
+
+/// Advances the global epoch if every active reader has observed the current one.
+uint64_t advance_epoch(void);
+
+/// Defers freeing an unlinked node until no reader can still reach it.
+void retire_node(HashTable *table, Node *node);
+
+/// Frees the retired nodes of a stripe that no reader can reach anymore.
+void reclaim_stripe(Stripe *stripe);
+
+/// Frees every retired node of a table regardless of readers.
+void free_retired(HashTable *table);
+
+/// Returns the third-level block a name maps to, or NULL if it does not exist yet.
+HashBlock* locate_block(const HashTable *table, const char *name);
+
+/// Searches for a normalized name in a table, whatever its third-level backend.
+const char* find_key(const HashTable *table, const char *name, size_t length);
+
+/// Prints one stored name (visitor used by print_hash_table).
+int print_name(const char *name, void *context);
+
+/// Prints and counts one name found by hash_table_fuzzy (visitor used by -e).
+int print_match(const char *name, unsigned int distance, void *context);
+
+/// Prints and counts one name found by hash_table_phonetic (visitor used by -P).
+int print_sound_match(const char *name, void *context);
+
+/// Fills in the first row of a banded edit distance computation.
+void fuzzy_start(const FuzzySearch *search, unsigned char *row);
+
+/// Advances a banded edit distance computation by one character or set of characters.
+unsigned int fuzzy_step(const FuzzySearch *search, const unsigned char *row, unsigned char *next, size_t i,
+                        uint32_t mask, uint32_t want);
+
+/// Computes the edit distance between a stored name and the searched name, capped at the budget.
+unsigned int fuzzy_distance(FuzzySearch *search, const char *name);
+
+/// Computes a lower bound of the edit distance of every name below a branch.
+unsigned int fuzzy_bound(const FuzzySearch *search, const unsigned int *buckets, unsigned int fixed);
+
+/// Passes a stored name within the edit budget on to the caller (visitor).
+int fuzzy_visit(const char *name, void *context);
+
+/// Passes a stored name with the searched Soundex code on to the caller (visitor).
+int phonetic_visit(const char *name, void *context);
+
+/// Loads the first name in range of every slot a cursor's range can map to.
+void cursor_fill(HashCursor *cursor);
+
+/// Moves a cursor way to the next name of its slot.
+int cursor_advance(const HashCursor *cursor, HashCursorWay *way);
+
+/// Finds the first name of a third-level slot at or after a bound.
+int slot_lower_bound(const HashTable *table, Node *const *slot, HashCursorWay *way,
+                     const char *bound, int strict);
+
+/// Finds the first node below a slot of a linked-list table at or after a bound.
+const Node* chain_lower_bound(const Node *slot, const char *bound, int strict);
+
+/// Writes the smallest string that sorts after every string starting with a prefix.
+int next_prefix(const char *prefix, size_t length, char *next);
+
+/// Normalizes and validates a cursor bound in the key mode of a table.
+int normalize_bound(unsigned int flags, const char *input, char *bound);
+
+/// Moves a heap entry of a cursor up until its parent sorts before it.
+void cursor_sift_up(HashCursor *cursor, size_t i);
+
+/// Moves a heap entry of a cursor down until its children sort after it.
+void cursor_sift_down(HashCursor *cursor, size_t i);
+
+/// Calls a visitor for every name in one third-level slot, in sorted order.
+int visit_slot(const HashTable *table, const HashBlock *block, unsigned int k,
+               HashTableVisitor visitor, void *context);
+
+/// Computes the one-byte fingerprint of a name.
+uint8_t name_tag(const char *name, size_t length);
+
+/// Computes the 64-bit hash block filters use for a name.
+uint64_t filter_hash(const char *name, size_t length);
+
+/// Returns whether a block filter may hold a name with the given hash.
+int filter_may_contain(const HashTable *table, const BlockFilter *filter, uint64_t hash);
+
+/// Sets the bits of a name with the given hash in a block filter.
+void filter_set(const HashTable *table, BlockFilter *filter, uint64_t hash);
+
+/// Records a name just added to a block in its filter.
+void filter_add(const HashTable *table, HashBlock *block, const char *name, size_t length);
+
+/// Records a name just removed from a block in its filter.
+void filter_remove(const HashTable *table, HashBlock *block);
+
+/// Builds a block's filter from the names it holds, sized for them.
+int rebuild_filter(const HashTable *table, HashBlock *block);
+
+/// Sets the bits of one name in the filter being built (visitor).
+int filter_visit(const char *name, void *context);
+
+/// Counts a lookup a block filter answered or let through in a HASH_TABLE_COUNTERS table.
+void count_filter(const HashTable *table, const char *name, int rejected);
+
+/// Searches a flat bucket for a name and returns its index, or -1.
+long find_flat_index(const struct FlatBucket *bucket, const char *name, size_t length, unsigned int *compares);
+
+/// Inserts a name into a flat bucket, creating the bucket if needed.
+int flat_insert(struct FlatBucket **slot, const char *name, size_t length, void *value, void ***existing);
+
+/// Removes one occurrence of a name from a flat bucket, freeing the bucket when it empties.
+int flat_remove(struct FlatBucket **slot, const char *name, size_t length, void **value);
+
+/// Makes room for at least one more entry in a flat bucket.
+int flat_grow_entries(struct FlatBucket *bucket);
+
+/// Returns the padded size of the fingerprint array for a given entry capacity.
+size_t flat_tag_bytes(uint32_t capacity);
+
+/// Makes room for the given number of bytes in a flat bucket's string pool.
+int flat_reserve_pool(struct FlatBucket *bucket, size_t needed);
+
+/// Frees a flat bucket and everything it owns.
+void free_flat_bucket(struct FlatBucket *bucket);
+
+/// Frees every block and node of a table, leaving it empty.
+void clear_hash_table(HashTable *table);
+
+/// Frees one first-level bucket and everything below it.
+void free_first_level(HashBlocks *blocks, unsigned int flags);
+
+/// Allocates a reclamation for the contents of a table.
+HashReclaim* create_reclaim(const HashTable *table, unsigned int threads);
+
+/// Moves the contents of a table into a reclamation, replacing them with those of fresh.
+void detach_contents(HashTable *table, HashReclaim *reclaim, HashTable *fresh);
+
+/// Starts the workers of a reclamation whose contents are detached.
+HashReclaim* start_reclaim(HashReclaim *reclaim);
+
+/// Frees the detached first-level buckets of a reclamation (thread entry point).
+int reclaim_worker(void *argument);
 
 /// Inserts a node into a sorted linked list while maintaining order.
 void insert_sorted(Node **head, Node *new_node);
 
+/// Returns whether a third-level slot or SubBlock bucket holds a SubBlock.
+int is_sub_block(const Node *slot);
+
+/// Returns the SubBlock held by a tagged slot.
+SubBlock* as_sub_block(const Node *slot);
+
+/// Returns whether chains of a table are promoted into SubBlocks.
+int promotes_chains(const HashTable *table);
+
+/// Returns the bucket of a SubBlock a name belongs to.
+unsigned int sub_block_index(const SubBlock *sub, const char *name, size_t length);
+
+/// Allocates an empty SubBlock for the given prefix.
+SubBlock* create_sub_block(const char *prefix, size_t depth);
+
+/// Follows SubBlocks from a slot down to the chain a name belongs to.
+Node* const* find_chain(Node *const *slot, const char *name, size_t length);
+
+/// Inserts a node below a third-level slot, promoting its chain if it grows too long.
+int insert_node(HashTable *table, Node **slot, Node *node, size_t length);
+
+/// Promotes a chain that a node was just linked into if it has grown too long.
+void promote_if_long(HashTable *table, Node **chain, const Node *node);
+
+/// Returns whether a chain holds more than the given number of nodes.
+int chain_longer_than(const Node *head, size_t limit);
+
+/// Replaces a sorted chain with a SubBlock keyed on the character after its common prefix.
+int promote_chain(Node **slot);
+
+/// Flattens the SubBlock held by a slot back into a single sorted chain.
+void demote_chain(Node **slot);
+
+/// Appends every node below a slot, in order, to a chain under construction.
+Node** flatten_slot(Node *slot, Node **tail);
+
+/// Frees the SubBlocks below a slot, and its nodes too when free_nodes is set.
+void free_slot(Node *slot, int free_nodes);
+
+/// Visits every name below a slot of a linked-list table in order.
+int visit_chain(const Node *slot, HashTableVisitor visitor, void *context);
+
+/// Adds the SubBlocks, nodes and names below a slot to memory statistics.
+void add_slot_stats(const Node *slot, HashTableMemoryStats *stats);
+
 /// Converts a string to uppercase and validates its content.
 int convert_to_upper(const char *input_name, char **output_name);
 
+/// Converts a string to uppercase into a caller-supplied buffer when it fits.
+int convert_to_upper_buffer(const char *input_name, char *buffer, size_t buffer_size,
+                            char **output_name, size_t *output_length);
+
+/// Validates and normalizes a name in the key mode of a table's flags.
+int normalize_name(unsigned int flags, const char *input_name, char *buffer, size_t buffer_size,
+                   char **output_name, size_t *output_length);
+
+/// Frees a name produced by convert_to_upper_buffer unless it lives in the caller's buffer.
+void release_name(char *name, const char *buffer);
+
+/// Validates and case folds a UTF-8 key in one pass, optionally stripping accents.
+size_t fold_utf8(char *dst, const char *src, size_t length, int strip_accents);
+
+/// Folds the first characters of a UTF-8 name, as many as a schema can read.
+size_t fold_prefix(const char *name, int strip_accents, char *prefix);
+
+/// Decodes one UTF-8 sequence, rejecting overlong forms, surrogates and truncation.
+size_t decode_utf8(const unsigned char *src, size_t length, uint32_t *code_point);
+
+/// Returns the simple uppercase mapping of a Latin, Greek or Cyrillic code point.
+uint32_t upper_code_point(uint32_t code_point);
+
+/// Returns the unaccented form of an uppercase Greek or Cyrillic letter.
+uint32_t strip_code_point(uint32_t code_point);
+
+/// Returns the best SIMD level supported by the CPU and operating system.
+HashSimdLevel detect_simd_level(void);
+
+/// Uppercases and validates a key one byte at a time.
+int upper_scalar(char *dst, const char *src, size_t length);
+
+/// Uppercases and validates a key 16 bytes at a time.
+int upper_sse2(char *dst, const char *src, size_t length);
+
+/// Uppercases and validates a key 32 bytes at a time.
+int upper_avx2(char *dst, const char *src, size_t length);
+
+/// Compares 32 fingerprints against a tag one byte at a time.
+uint32_t match_tags_scalar(const uint8_t *tags, uint8_t tag);
+
+/// Compares 32 fingerprints against a tag with two SSE2 compares.
+uint32_t match_tags_sse2(const uint8_t *tags, uint8_t tag);
+
+/// Compares 32 fingerprints against a tag with one AVX2 compare.
+uint32_t match_tags_avx2(const uint8_t *tags, uint8_t tag);
+
+/// Returns the index of the lowest set bit of a non-zero mask.
+unsigned int lowest_bit(uint32_t mask);
+
+/// Returns a monotonic timestamp in nanoseconds for the benchmarks.
+static double now_ns(void);
+
+/// Splits a comma-separated argument in place into an array of names.
+char** split_names(char *list, size_t *count);
+
+/// Streams newline-delimited names from a file or stdin into inserts or lookups.
+int stream_names(HashTable *table, const char *path, int lookup);
+
+/// Inserts or looks up one batch of streamed names and writes lookup results.
+size_t stream_batch(HashTable *table, const char **names, size_t count, int lookup,
+                    const char **found, OutputBuffer *out);
+
+/// Appends bytes to an output buffer, flushing it when full.
+void output_write(OutputBuffer *out, const char *text, size_t length);
+
+/// Writes out everything pending in an output buffer.
+void output_flush(OutputBuffer *out);
+
 /**
  * Entry point of the program.
  *
@@ -51,6 +1149,27 @@ int convert_to_upper(const char *input_name, char **output_name);
  * Command-line Arguments:
  * -n name1,name2,... : A comma-separated list of names to add to the hash structure.
  * -o name1,name2,... : A comma-separated list of names to search for in the structure.
+ * -a                 : Store nodes and names in the table's arena instead of one malloc each.
+ * -f                 : Store third-level slots as flat sorted arrays instead of linked lists.
+ * -u                 : Accept UTF-8 names (digits, spaces, punctuation, accented letters), case folded.
+ * -U                 : Like -u, and strip accents from the names.
+ * -F rate            : Keep a Bloom filter per HashBlock with the given false-positive rate (e.g. 0.01).
+ * -m                 : Print memory usage statistics before exiting.
+ * --stats            : Count operations and print level, chain and counter statistics as JSON.
+ * -b file            : Bulk-build the table from a file with one name per line.
+ * -j threads         : Number of worker threads used by -b (default 1).
+ * -N file            : Add the names in a file (one per line, - for stdin), streamed.
+ * -O file            : Search the names in a file (one per line, - for stdin), streamed.
+ * -p file            : Derive the level schema from a sample file, print it as C and use it.
+ * -c prefix          : List the stored names that start with prefix, in sorted order.
+ * -s file            : Save the table as a snapshot file before exiting.
+ * -l file            : Search the -o names in a snapshot file instead of building a table.
+ * -z                 : Freeze the table once it is loaded and search the -o names in the frozen form.
+ * -Z                 : Like -z, but store each name without the characters its slot implies.
+ * -L path            : Recover the table from path.hb and path.log, log the -n names and checkpoint -b and -N.
+ * -K                 : With -L, write a checkpoint before exiting.
+ * -e edits           : Search for the names within edits of each -o name instead of exact matches.
+ * -P                 : Search for the names that sound like each -o name (Soundex) instead of exact matches.
  * 
  * Example Usage:
  * ./hashblock3.exe -n Bill,Jane,Lincoln,Tim -o Jane,Tim
@@ -62,6 +1181,7 @@ int convert_to_upper(const char *input_name, char **output_name);
  * @param argv The array of command-line arguments.
  * @return 0 on successful execution, or 1 if an error occurs.
  */
+#ifndef HASHBLOCKS_NO_MAIN
 int main(int argc, char *argv[]) {
 
     // Check if there are enough command-line arguments
@@ -72,7 +1192,28 @@ int main(int argc, char *argv[]) {
 
             "\033[93mCommand-line Arguments:\033[0m\n"
             "  \033[38;2;255;140;0m-n\033[0m \033[38;2;210;105;30mname1,name2,...\033[0m : A comma-separated list of names to add to the hash structure.\n"
-            "  \033[38;2;255;140;0m-o\033[0m \033[38;2;210;105;30mname1,name2,...\033[0m : A comma-separated list of names to search for in the structure.\n\n"
+            "  \033[38;2;255;140;0m-o\033[0m \033[38;2;210;105;30mname1,name2,...\033[0m : A comma-separated list of names to search for in the structure.\n"
+            "  \033[38;2;255;140;0m-a\033[0m                 : Store nodes and names in the table's arena instead of one malloc each.\n"
+            "  \033[38;2;255;140;0m-f\033[0m                 : Store third-level slots as flat sorted arrays instead of linked lists.\n"
+            "  \033[38;2;255;140;0m-u\033[0m                 : Accept UTF-8 names (digits, spaces, punctuation, accented letters), case folded.\n"
+            "  \033[38;2;255;140;0m-U\033[0m                 : Like -u, and strip accents from the names.\n"
+            "  \033[38;2;255;140;0m-F\033[0m \033[38;2;210;105;30mrate\033[0m            : Keep a Bloom filter per HashBlock with the given false-positive rate (e.g. 0.01).\n"
+            "  \033[38;2;255;140;0m-m\033[0m                 : Print memory usage statistics before exiting.\n"
+            "  \033[38;2;255;140;0m--stats\033[0m            : Count operations and print level, chain and counter statistics as JSON.\n"
+            "  \033[38;2;255;140;0m-b\033[0m \033[38;2;210;105;30mfile\033[0m            : Bulk-build the table from a file with one name per line.\n"
+            "  \033[38;2;255;140;0m-j\033[0m \033[38;2;210;105;30mthreads\033[0m         : Number of worker threads used by -b (default 1).\n"
+            "  \033[38;2;255;140;0m-N\033[0m \033[38;2;210;105;30mfile\033[0m            : Add the names in a file (one per line, - for stdin), streamed.\n"
+            "  \033[38;2;255;140;0m-O\033[0m \033[38;2;210;105;30mfile\033[0m            : Search the names in a file (one per line, - for stdin), streamed.\n"
+            "  \033[38;2;255;140;0m-p\033[0m \033[38;2;210;105;30mfile\033[0m            : Derive the level schema from a sample file, print it as C and use it.\n"
+            "  \033[38;2;255;140;0m-c\033[0m \033[38;2;210;105;30mprefix\033[0m          : List the stored names that start with prefix, in sorted order.\n"
+            "  \033[38;2;255;140;0m-s\033[0m \033[38;2;210;105;30mfile\033[0m            : Save the table as a snapshot file before exiting.\n"
+            "  \033[38;2;255;140;0m-l\033[0m \033[38;2;210;105;30mfile\033[0m            : Search the -o names in a snapshot file instead of building a table.\n"
+            "  \033[38;2;255;140;0m-z\033[0m                 : Freeze the table once it is loaded and search the -o names in the frozen form.\n"
+            "  \033[38;2;255;140;0m-Z\033[0m                 : Like -z, but store each name without the characters its slot implies.\n"
+            "  \033[38;2;255;140;0m-L\033[0m \033[38;2;210;105;30mpath\033[0m            : Recover the table from path.hb and path.log, log the -n names and checkpoint -b and -N.\n"
+            "  \033[38;2;255;140;0m-K\033[0m                 : With -L, write a checkpoint before exiting.\n"
+            "  \033[38;2;255;140;0m-e\033[0m \033[38;2;210;105;30medits\033[0m           : Search for the names within edits of each -o name instead of exact matches.\n"
+            "  \033[38;2;255;140;0m-P\033[0m                 : Search for the names that sound like each -o name (Soundex) instead of exact matches.\n\n"
 
             "\033[93mExample Usage:\033[0m \033[38;2;255;160;122m.\\%s\033[0m \033[38;2;255;140;0m-n\033[0m \033[38;2;210;105;30mBill,Jane,Lincoln,Tim\033[0m \033[38;2;255;140;0m-o\033[0m \033[38;2;210;105;30mJane,Tim\033[0m\n\n",
             "hashblock4.exe", "hashblock4.exe"
@@ -82,56 +1223,325 @@ int main(int argc, char *argv[]) {
 
     char *add_names = NULL;         // Pointer to hold names to be added (-n argument)
     char *find_names_arg = NULL;    // Pointer to hold names to be searched (-o argument)
+    HashTableOptions options = { 0 };
+    int show_memory = 0;            // Print memory statistics (-m argument)
+    int show_stats = 0;             // Print JSON statistics (--stats argument)
+    const char *build_path = NULL;  // File to bulk-build the table from (-b argument)
+    unsigned int build_threads = 1; // Worker threads for the bulk build (-j argument)
+    const char *save_path = NULL;   // Snapshot file to write (-s argument)
+    const char *add_path = NULL;    // File of names to add (-N argument)
+    const char *find_path = NULL;   // File of names to search for (-O argument)
+    const char *load_path = NULL;   // Snapshot file to search (-l argument)
+    const char *sample_path = NULL; // Sample file to derive the level schema from (-p argument)
+    HashSchema schema;              // Level schema derived with -p
+    const char *prefix = NULL;      // Prefix of the names to list (-c argument)
+    int freeze = 0;                 // Search a frozen copy of the table (-z argument)
+    unsigned int freeze_flags = 0;  // HASH_FROZEN_* flags of the frozen copy (-Z argument)
+    HashFrozen *frozen = NULL;      // Frozen copy made with -z
+    const char *log_path = NULL;    // Checkpoint and log path without extension (-L argument)
+    int checkpoint = 0;             // Write a checkpoint before exiting (-K argument)
+    HashLog *log = NULL;            // Log opened with -L
+    int fuzzy_edits = -1;           // Edit distance of the -o searches, or -1 for exact matches (-e argument)
+    int phonetic = 0;               // Search the -o names by Soundex code (-P argument)
 
     // Parse command-line arguments
-    // Loop through all provided arguments and match them with valid switches (-n and -o)
+    // Loop through all provided arguments and match them with valid switches (-n, -o, -N, -O, -a, -f, -u, -U, -F, -m, --stats, -b, -j, -p, -c, -s, -l, -z, -Z, -L, -K, -e and -P)
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
             add_names = argv[++i]; // Store names following the -n flag
         } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             find_names_arg = argv[++i]; // Store names following the -o flag
+        } else if (strcmp(argv[i], "-N") == 0 && i + 1 < argc) {
+            add_path = argv[++i]; // Store the file following the -N flag
+        } else if (strcmp(argv[i], "-O") == 0 && i + 1 < argc) {
+            find_path = argv[++i]; // Store the file following the -O flag
+        } else if (strcmp(argv[i], "-a") == 0) {
+            options.flags |= HASH_TABLE_ARENA;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            options.flags |= HASH_TABLE_FLAT;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            options.flags |= HASH_TABLE_UTF8;
+        } else if (strcmp(argv[i], "-U") == 0) {
+            options.flags |= HASH_TABLE_FOLD_ACCENTS;
+        } else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            options.flags |= HASH_TABLE_FILTER;
+            options.filter_rate = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            show_memory = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+            options.flags |= HASH_TABLE_COUNTERS;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            build_path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            build_threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            sample_path = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            prefix = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            load_path = argv[++i];
+        } else if (strcmp(argv[i], "-z") == 0) {
+            freeze = 1;
+        } else if (strcmp(argv[i], "-Z") == 0) {
+            freeze = 1;
+            freeze_flags = HASH_FROZEN_COMPACT_KEYS;
+        } else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (strcmp(argv[i], "-K") == 0) {
+            checkpoint = 1;
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            fuzzy_edits = (int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-P") == 0) {
+            phonetic = 1;
         }
     }
 
-    // Add names to the hash structure
-    if (add_names) {
-        char *context = NULL;               // Context variable for strtok_s
-        char *name = strtok_s(add_names, ",", &context); // Tokenize names using commas
-        while (name) {
-            if (add_name(name) != 0) {      // Call add_name function for each token
-                printf("Failed to add name: %s\n", name); // Handle errors if name addition fails
+    // Answer lookups straight from a mapped snapshot
+    if (load_path) {
+        HashSnapshot *snapshot = hash_snapshot_open(load_path, HASH_SNAPSHOT_VERIFY);
+        if (snapshot == NULL) {
+            return 1;
+        }
+        printf("Opened %s (%zu names)\n", load_path, hash_snapshot_count(snapshot));
+        size_t count = 0;
+        char **names = find_names_arg ? split_names(find_names_arg, &count) : NULL; // Tokenize names using commas
+        for (size_t i = 0; names != NULL && i < count; i++) {
+            const char *found = hash_snapshot_lookup(snapshot, names[i]);
+            if (found != NULL) {
+                printf("Found: %s\n", found);
+            } else {
+                printf("Not Found: %s\n", names[i]);
             }
-            name = strtok_s(NULL, ",", &context); // Continue tokenizing the remaining names
         }
+        free(names);
+        hash_snapshot_close(snapshot);
+        return 0;
     }
 
-    // Search for names in the hash structure
-    if (find_names_arg) {
-        char *context = NULL;               // Context variable for strtok_s
-        char *name = strtok_s(find_names_arg, ",", &context); // Tokenize names using commas
-        while (name) {
-            if (find_names(name) != 0) {    // Call find_names function for each token
-                printf("Name not found: %s\n", name); // Notify user if name is not found
-            }
-            name = strtok_s(NULL, ",", &context); // Continue tokenizing the remaining names
+    // Balance the levels for the key distribution of a sample
+    if (sample_path) {
+        if (hash_schema_from_file(sample_path, &schema) != 0) {
+            return 1;
         }
+        print_hash_schema(&schema, "derived_schema");
+        options.schema = &schema;
     }
 
-    // Display the hash block structure
-    // Prints the hierarchical organization of names for debugging and visualization
-    print_hash_blocks();
+    HashTable *table = create_hash_table_ex(&options);
+    if (table == NULL) {
+        return 1;
+    }
+    int status = 0; // Exit status; failures below jump to cleanup, which closes the log first
 
-    // Free all allocated memory to prevent memory leaks
-    // Releases resources used by the hierarchical hash structure
-    free_hash_blocks();
+    // Recover the table from its checkpoint and log
+    if (log_path) {
+        log = hash_log_open(table, log_path, NULL);
+        if (log == NULL) {
+            status = 1;
+            goto cleanup;
+        }
+        printf("Recovered %zu names from %s\n", (size_t)table->name_count, log_path);
+    }
 
-    return 0; // Exit the program successfully
-}
+    // Bulk-build the table from a file
+    if (build_path) {
+        size_t failures = 0;
+        double start = now_ns();
+        if (hash_table_build_file(table, build_path, build_threads, &failures) != 0) {
+            status = 1;
+            goto cleanup;
+        }
+        printf("Built %zu names from %s in %.1f ms with %u threads (%zu failed)\n",
+               (size_t)table->name_count, build_path, (now_ns() - start) / 1e6,
+               build_threads ? build_threads : 1, failures);
+    }
 
-/**
- * Initializes a new HashBlock.
- *
- * This function allocates memory for a HashBlock structure, which represents 
+    // Add names to the hash structure through its log
+    if (add_names && log) {
+        size_t count = 0;
+        char **names = split_names(add_names, &count); // Tokenize names using commas
+        for (size_t i = 0; names != NULL && i < count; i++) {
+            int result = hash_log_insert(log, names[i]);
+            if (result == HASH_LOG_NOT_DURABLE) {
+                printf("Added but not logged: %s\n", names[i]);
+            } else if (result != 0) {
+                printf("Failed to add name: %s\n", names[i]);
+            }
+        }
+        free(names);
+    }
+
+    // Add names to the hash structure
+    if (add_names && !log) {
+        size_t count = 0;
+        char **names = split_names(add_names, &count); // Tokenize names using commas
+        int *results = names ? (int *)malloc((count ? count : 1) * sizeof(int)) : NULL;
+        if (results != NULL) {
+            hash_table_insert_batch(table, (const char *const *)names, count, results);
+            for (size_t i = 0; i < count; i++) {
+                if (results[i] != 0) {
+                    printf("Failed to add name: %s\n", names[i]); // Handle errors if name addition fails
+                }
+            }
+        }
+        free(results);
+        free(names);
+    }
+
+    // Stream names to add from a file or stdin
+    if (add_path && stream_names(table, add_path, 0) != 0) {
+        status = 1;
+        goto cleanup;
+    }
+
+    // -b and -N insert straight into the table, bypassing the log, so a
+    // checkpoint is what keeps their names across the next recovery
+    if (log && (build_path || add_path)) {
+        if (hash_log_checkpoint(log) != 0) {
+            printf("Failed to write checkpoint %s.hb\n", log_path);
+            status = 1;
+            goto cleanup;
+        }
+        printf("Wrote checkpoint %s.hb\n", log_path);
+    }
+
+    // Convert the loaded table into its read-only compact form
+    if (freeze) {
+        double start = now_ns();
+        frozen = hash_table_freeze_ex(table, freeze_flags);
+        if (frozen == NULL) {
+            status = 1;
+            goto cleanup;
+        }
+        size_t count = hash_frozen_count(frozen);
+        printf("Froze %zu names into %zu bytes (%.1f bytes per name) in %.1f ms\n", count,
+               hash_frozen_bytes(frozen), count ? (double)hash_frozen_bytes(frozen) / (double)count : 0.0,
+               (now_ns() - start) / 1e6);
+    }
+
+    // Search for names in the frozen form
+    if (find_names_arg && frozen) {
+        size_t count = 0;
+        char **names = split_names(find_names_arg, &count); // Tokenize names using commas
+        for (size_t i = 0; names != NULL && i < count; i++) {
+            const char *found = hash_frozen_lookup(frozen, names[i]);
+            if (found != NULL && (freeze_flags & HASH_FROZEN_COMPACT_KEYS)) {
+                printf("Found: %s\n", names[i]);
+            } else if (found != NULL) {
+                printf("Found: %s\n", found);
+            } else {
+                printf("Not Found: %s\n", names[i]);
+            }
+        }
+        free(names);
+    }
+
+    // Search for the names close to or sounding like the -o names
+    if (find_names_arg && !frozen && (fuzzy_edits >= 0 || phonetic)) {
+        size_t count = 0;
+        char **names = split_names(find_names_arg, &count); // Tokenize names using commas
+        for (size_t i = 0; names != NULL && i < count; i++) {
+            const char *name = names[i];
+            size_t matches = 0;
+            if (phonetic) {
+                char code[HASH_SOUNDEX_SIZE];
+                if (hash_table_phonetic(table, name, print_sound_match, &matches) == 0 && hash_soundex(name, code) == 0) {
+                    printf("%zu names sound like %s (%s)\n", matches, name, code);
+                }
+            } else if (hash_table_fuzzy(table, name, (unsigned int)fuzzy_edits, print_match, &matches) == 0) {
+                printf("%zu names within %d edits of %s\n", matches, fuzzy_edits, name);
+            }
+        }
+        free(names);
+    }
+
+    // Search for names in the hash structure
+    if (find_names_arg && !frozen && fuzzy_edits < 0 && !phonetic) {
+        size_t count = 0;
+        char **names = split_names(find_names_arg, &count); // Tokenize names using commas
+        const char **found = names ? (const char **)malloc((count ? count : 1) * sizeof(char *)) : NULL;
+        if (found != NULL) {
+            hash_table_lookup_batch(table, (const char *const *)names, count, found);
+            for (size_t i = 0; i < count; i++) {
+                if (found[i] != NULL) {
+                    printf("Found: %s\n", found[i]);
+                } else {
+                    printf("Not Found: %s\n", names[i]);
+                    printf("Name not found: %s\n", names[i]); // Notify user if name is not found
+                }
+            }
+        }
+        free(found);
+        free(names);
+    }
+
+    // Stream names to search for from a file or stdin
+    if (find_path && stream_names(table, find_path, 1) != 0) {
+        status = 1;
+        goto cleanup;
+    }
+
+    // List the names starting with a prefix, in sorted order
+    if (prefix) {
+        static HashCursor cursor; // Too large for some thread stacks
+        if (hash_cursor_prefix(&cursor, table, prefix) == 0) {
+            size_t matches = 0;
+            for (const char *name = hash_cursor_next(&cursor); name != NULL; name = hash_cursor_next(&cursor)) {
+                printf("Match: %s\n", name);
+                matches++;
+            }
+            printf("%zu names start with %s\n", matches, prefix);
+        }
+    }
+
+    // Display the hash block structure
+    // Prints the hierarchical organization of names for debugging and visualization.
+    // Streamed inputs can be arbitrarily large, and -c, -e, -P and --stats already
+    // show what was asked for, so the dump is skipped for them.
+    if (!add_path && !find_path && !prefix && !show_stats && fuzzy_edits < 0 && !phonetic) {
+        print_hash_table(table);
+    }
+
+    if (show_memory) {
+        print_memory_stats(table);
+    }
+
+    if (show_stats) {
+        print_hash_table_stats(table);
+    }
+
+    if (save_path && hash_table_save(table, save_path) == 0) {
+        printf("Saved %zu names to %s\n", (size_t)table->name_count, save_path);
+    }
+
+    if (log && checkpoint && hash_log_checkpoint(log) == 0) {
+        printf("Wrote checkpoint %s.hb\n", log_path);
+    }
+
+cleanup:
+    // Every exit once the table exists comes through here, so the names already
+    // logged are synced even when a later step failed
+    if (hash_log_close(log) != 0) {
+        printf("Failed to sync %s.log\n", log_path);
+        status = 1;
+    }
+
+    // Free all allocated memory to prevent memory leaks
+    // Releases resources used by the hierarchical hash structure
+    hash_frozen_free(frozen);
+    destroy_hash_table(table);
+
+    return status; // 0 if the program succeeded
+}
+#endif // HASHBLOCKS_NO_MAIN
+
+/**
+ * Initializes a new HashBlock.
+ *
+ * This function allocates memory for a HashBlock structure, which represents 
  * a third-level hash table in the hierarchical hash structure. All pointers in 
  * the third_level array are initialized to NULL to ensure a clean state for 
  * subsequent operations.
@@ -149,397 +1559,7402 @@ int main(int argc, char *argv[]) {
  */
 HashBlock* create_hash_block() {
     HashBlock *block = (HashBlock *)malloc(sizeof(HashBlock));
+    if (!block) {
+        printf("Memory allocation failed for HashBlock\n");
+        return NULL;
+    }
     memset(block->third_level, 0, sizeof(block->third_level)); // Set all elements to NULL
+    block->filter = NULL;
     return block;
 }
 
 /**
- * Initializes a new HashBlocks structure.
- *
- * This function allocates memory for a HashBlocks structure, which represents 
- * a second-level hash table in the hierarchical hash structure. All pointers 
- * within the second-level array are initialized to NULL, ensuring a clean and 
- * predictable state for further operations.
+ * Initializes a new HashBlocks structure.
+ *
+ * This function allocates memory for a HashBlocks structure, which represents 
+ * a second-level hash table in the hierarchical hash structure. All pointers 
+ * within the second-level array are initialized to NULL, ensuring a clean and 
+ * predictable state for further operations.
+ *
+ * Memory Management:
+ * - The caller is responsible for freeing the memory allocated for the returned 
+ *   HashBlocks structure to prevent memory leaks.
+ *
+ * @return A pointer to the newly created HashBlocks structure, or NULL if 
+ *         memory allocation fails.
+ */
+HashBlocks* create_hash_blocks() {
+    HashBlocks *blocks = (HashBlocks *)malloc(sizeof(HashBlocks));
+    if (!blocks) {
+        printf("Memory allocation failed for HashBlocks\n");
+        return NULL;
+    }
+    for (int i = 0; i < SECOND_LEVEL_SIZE; i++) {
+        blocks->second_level[i] = NULL; // Set all elements to NULL
+    }
+    return blocks;
+}
+
+/**
+ * Creates a new, empty Hash Blocks table.
+ *
+ * The table handle owns its own first-level array, so any number of tables 
+ * can coexist in one process and be populated or freed independently. Lower 
+ * levels are still allocated lazily as names are inserted.
+ *
+ * Memory Management:
+ * - The caller is responsible for releasing the table with destroy_hash_table.
+ *
+ * @return A pointer to the newly created table, or NULL if memory allocation fails.
+ */
+HashTable* create_hash_table(void) {
+    return create_hash_table_ex(NULL);
+}
+
+/**
+ * Creates a new, empty Hash Blocks table with the given options.
+ *
+ * With HASH_TABLE_ARENA set, nodes are bump-allocated from node pages and 
+ * names are copied back to back into string pages owned by the table. An 
+ * insert then costs no malloc at all in the common case, and destroying the 
+ * table frees a handful of pages instead of two allocations per name.
+ *
+ * With HASH_TABLE_CONCURRENT set, lookups may run on any number of threads 
+ * without locks while other threads insert and remove names. Writers take a 
+ * lock per first-level letter, so writers of different letters do not block 
+ * each other. The flag cannot be combined with HASH_TABLE_ARENA or 
+ * HASH_TABLE_FLAT, whose storage is rewritten in place; such tables are 
+ * rejected.
+ *
+ * With HASH_TABLE_COUNTERS set, inserts, lookup hits and misses and the names 
+ * compared by lookups are counted per first-level letter with relaxed atomic 
+ * adds, for hash_table_stats. Tables without the flag pay one branch per 
+ * operation.
+ *
+ * With HASH_TABLE_UTF8 set, names may hold any UTF-8 text without control 
+ * characters and are uppercased with simple case folding; 
+ * HASH_TABLE_FOLD_ACCENTS also strips accents (see normalize_name). The 
+ * levels read bytes, so a schema derived from a sample of such names spreads 
+ * them better than the default one, which sends every byte other than a 
+ * letter to bucket 0. Chains of these tables are not promoted to SubBlocks, 
+ * whose buckets only cover the letters.
+ *
+ * With HASH_TABLE_FILTER set, every HashBlock keeps a blocked Bloom filter of 
+ * its names, sized for options->filter_rate (1% by default). A lookup tests 
+ * its name's line of the filter first and only walks the slot if every bit is 
+ * set, so most misses cost one cache line instead of a chain walk. Inserts 
+ * set the bits and removals only count the stale ones; a filter is rebuilt 
+ * from its block when it fills up or half its names are gone. The flag cannot 
+ * be combined with HASH_TABLE_CONCURRENT, whose readers could see a filter 
+ * while it is replaced.
+ *
+ * options->schema selects which characters the levels read and how they map 
+ * to buckets (see hash_schema_from_sample); the table keeps its own copy. 
+ * Schemas that read beyond the third character or map outside a level are 
+ * rejected. A schema equal to the default one is not copied, so the table 
+ * keeps the constant-folded default path (see schema_index).
+ *
+ * @param options The options to apply, or NULL for the defaults.
+ * @return A pointer to the newly created table, or NULL if memory allocation fails.
+ */
+HashTable* create_hash_table_ex(const HashTableOptions *options) {
+    HashTable *table = (HashTable *)calloc(1, sizeof(HashTable));
+    if (!table) {
+        printf("Memory allocation failed for HashTable\n");
+        return NULL;
+    }
+    table->schema = &default_schema;
+    if (options != NULL) {
+        table->flags = options->flags;
+    }
+    if (options != NULL && options->schema != NULL &&
+        memcmp(options->schema, &default_schema, sizeof(HashSchema)) != 0) {
+        if (check_schema(options->schema) != 0) {
+            printf("Invalid level schema\n");
+            free(table);
+            return NULL;
+        }
+        HashSchema *schema = (HashSchema *)malloc(sizeof(HashSchema));
+        if (!schema) {
+            printf("Memory allocation failed for HashSchema\n");
+            free(table);
+            return NULL;
+        }
+        *schema = *options->schema;
+        table->schema = schema;
+    }
+    if (table->flags & HASH_TABLE_CONCURRENT) {
+        if (table->flags & (HASH_TABLE_ARENA | HASH_TABLE_FLAT)) {
+            printf("HASH_TABLE_CONCURRENT cannot be combined with HASH_TABLE_ARENA or HASH_TABLE_FLAT\n");
+            destroy_hash_table(table);
+            return NULL;
+        }
+        if (create_stripes(table) != 0) {
+            destroy_hash_table(table);
+            return NULL;
+        }
+    }
+    if (table->flags & HASH_TABLE_FILTER) {
+        double rate = options->filter_rate != 0.0 ? options->filter_rate : 0.01;
+        if ((table->flags & HASH_TABLE_CONCURRENT) || !(rate > 0.0 && rate < 1.0)) {
+            printf("HASH_TABLE_FILTER needs a false-positive rate between 0 and 1 and cannot be combined with HASH_TABLE_CONCURRENT\n");
+            destroy_hash_table(table);
+            return NULL;
+        }
+        // Optimal Bloom sizing, plus a tenth for the uneven load of the lines
+        double bits = -log(rate) / (LN_2 * LN_2);
+        table->filter_rate = rate;
+        table->filter_bits = (unsigned int)(bits * 1.1) + 1;
+        table->filter_hashes = (unsigned int)(bits * LN_2 + 0.5);
+        table->filter_bits = table->filter_bits < 2 ? 2 : (table->filter_bits > 64 ? 64 : table->filter_bits);
+        table->filter_hashes = table->filter_hashes < 1 ? 1 : (table->filter_hashes > 16 ? 16 : table->filter_hashes);
+    }
+    if (table->flags & HASH_TABLE_COUNTERS) {
+        table->counters = (OpCounters *)calloc(FIRST_LEVEL_SIZE, sizeof(OpCounters));
+        if (!table->counters) {
+            printf("Memory allocation failed for OpCounters\n");
+            destroy_hash_table(table);
+            return NULL;
+        }
+    }
+    return table;
+}
+
+/**
+ * Destroys a table created with create_hash_table.
+ *
+ * All blocks, nodes and names owned by the table are freed, followed by the 
+ * table handle itself. Passing NULL is a no-op. No other thread may be using 
+ * the table.
+ *
+ * @param table The table to destroy.
+ */
+void destroy_hash_table(HashTable *table) {
+    if (table == NULL) return;
+    clear_hash_table(table);
+    destroy_stripes(table);
+    free(table->counters);
+    if (table->schema != &default_schema) {
+        free((void *)table->schema);
+    }
+    free(table);
+}
+
+/**
+ * Searches for a name in the hierarchical hash structure and displays the result.
+ *
+ * This function takes an input name, converts it to uppercase for consistent 
+ * lookup, and searches for it in the hierarchical hash structure. If the name 
+ * is found, the function prints "Found" along with the name. If the name is not 
+ * found, it prints "Not Found" and returns an error code.
+ *
+ * - The name is converted to uppercase using convert_to_upper for consistency.
+ * - The search is performed using the find_name function, which locates the 
+ *   node in the hash structure.
+ *
+ * Memory Management:
+ * - The temporary uppercase version of the name lives in a stack buffer, and 
+ *   is only allocated on the heap for names too long to fit it.
+ *
+ * @param input_name The name to search for in the hash structure.
+ * @return 0 if the name is found, or 1 if the name is not found or an error occurs.
+ */
+int find_names(const char *input_name) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+
+    // Convert to uppercase characters
+    if (convert_to_upper_buffer(input_name, buffer, sizeof(buffer), &name, NULL) != 0) {
+        return 1;
+    }
+
+    Node *result = find_name(&default_table, name);
+    release_name(name, buffer);
+
+    if (result == NULL) {
+        printf("Not Found: %s\n", input_name);
+        return 1;
+    }
+
+    printf("Found: %s\n", result->name);
+    return 0;
+}
+
+/**
+ * Looks up a name in a table.
+ *
+ * The input is normalized in the table's key mode (see normalize_name) before 
+ * the lookup, as find_names does for the default table, but nothing is 
+ * printed on success or on a miss so the function can be used on hot paths.
+ *
+ * @param table The table to search.
+ * @param input_name The name to search for.
+ * @return The stored (uppercase) name, or NULL if the name is not found or is invalid.
+ *         The returned string is owned by the table and stays valid until the name 
+ *         is removed or the table is destroyed. In HASH_TABLE_FLAT tables names 
+ *         live in relocatable string pools, so the pointer is only valid until the 
+ *         table is next modified. In HASH_TABLE_CONCURRENT tables the lookup is 
+ *         wait-free and the pointer stays valid until another thread removes the name.
+ */
+const char* hash_table_lookup(const HashTable *table, const char *input_name) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+
+    // Convert to uppercase characters
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return NULL;
+    }
+
+    const char *result = (table->flags & HASH_TABLE_CONCURRENT)
+        ? find_key_concurrent(table, name, length)
+        : find_key(table, name, length);
+    release_name(name, buffer);
+    return result;
+}
+
+/**
+ * Adds several names to the default Hash Block table.
+ *
+ * @param names The names to add.
+ * @param count The number of names.
+ * @return The number of names that could not be added.
+ */
+size_t add_names_batch(const char *const *names, size_t count) {
+    return hash_table_insert_batch(&default_table, names, count, NULL);
+}
+
+/**
+ * Looks up several names in the default Hash Block table.
+ *
+ * Unlike find_names, nothing is printed.
+ *
+ * @param names The names to search for.
+ * @param count The number of names.
+ * @param results Receives the stored name or NULL for each input (may be NULL).
+ * @return The number of names found.
+ */
+size_t find_names_batch(const char *const *names, size_t count, const char **results) {
+    return hash_table_lookup_batch(&default_table, names, count, results);
+}
+
+/**
+ * Adds several names to a table.
+ *
+ * Names are processed in windows of BATCH_WINDOW keys. Every key in a window 
+ * is normalized and its level indices computed first; missing blocks are then 
+ * created and the third-level slot of every key is prefetched before the 
+ * inserts themselves run in input order. The resulting table is identical to 
+ * calling hash_table_insert for each name in turn. HASH_TABLE_CONCURRENT tables 
+ * insert one name at a time, since creating blocks needs the writer locks.
+ *
+ * @param table The table to add the names to.
+ * @param names The names to add.
+ * @param count The number of names.
+ * @param results Receives 0 or 1 for each name, as hash_table_insert would return (may be NULL).
+ * @return The number of names that could not be added.
+ */
+size_t hash_table_insert_batch(HashTable *table, const char *const *names, size_t count, int *results) {
+    BatchKey keys[BATCH_WINDOW];
+    char buffers[BATCH_WINDOW][NAME_BUFFER_SIZE];
+    size_t failures = 0;
+
+    if (table->flags & HASH_TABLE_CONCURRENT) {
+        for (size_t i = 0; i < count; i++) {
+            int result = hash_table_insert(table, names[i]);
+            failures += (size_t)result;
+            if (results != NULL) results[i] = result;
+        }
+        return failures;
+    }
+
+    for (size_t base = 0; base < count; base += BATCH_WINDOW) {
+        size_t n = count - base < BATCH_WINDOW ? count - base : BATCH_WINDOW;
+        prepare_batch(table, keys, buffers, names + base, n);
+
+        // Stage 1: make sure the second level exists and prefetch the block pointer
+        for (size_t i = 0; i < n; i++) {
+            BatchKey *key = &keys[i];
+            if (key->name == NULL) continue;
+            HashBlocks **blocks = &table->first_level[key->first];
+            if (*blocks == NULL) STORE_POINTER(HashBlocks, blocks, create_hash_blocks());
+            key->blocks = *blocks;
+            if (key->blocks != NULL) HB_PREFETCH(&key->blocks->second_level[key->second]);
+        }
+
+        // Stage 2: make sure the third level exists and prefetch the slot
+        for (size_t i = 0; i < n; i++) {
+            BatchKey *key = &keys[i];
+            if (key->blocks == NULL) continue;
+            HashBlock **slot = &key->blocks->second_level[key->second];
+            if (*slot == NULL) STORE_POINTER(HashBlock, slot, create_hash_block());
+            key->block = *slot;
+            if (key->block != NULL) HB_PREFETCH(&key->block->third_level[key->third]);
+        }
+
+        // Stage 3: prefetch the chain head or flat bucket
+        for (size_t i = 0; i < n; i++) {
+            if (keys[i].block != NULL) HB_PREFETCH(keys[i].block->third_level[keys[i].third]);
+        }
+
+        // Stage 4: insert in input order so duplicates behave exactly like hash_table_insert
+        for (size_t i = 0; i < n; i++) {
+            int result = keys[i].block == NULL || insert_key(table, keys[i].name, keys[i].length) != 0;
+            failures += (size_t)result;
+            if (results != NULL) results[base + i] = result;
+        }
+
+        release_batch(keys, buffers, n);
+    }
+    return failures;
+}
+
+/**
+ * Looks up several names in a table.
+ *
+ * Names are processed in windows of BATCH_WINDOW keys. Instead of walking 
+ * first level, second level, third level and chain for one key before 
+ * starting the next, each stage advances every key in the window by one 
+ * level and prefetches what the next stage will read: the HashBlocks entry, 
+ * the HashBlock slot, the chain head or flat bucket, and finally the first 
+ * name or the fingerprint array. The memory latency of the keys in a window 
+ * therefore overlaps. Nothing is printed. In HASH_TABLE_CONCURRENT tables each 
+ * window is one wait-free read-side section.
+ *
+ * @param table The table to search.
+ * @param names The names to search for.
+ * @param count The number of names.
+ * @param results Receives the stored name or NULL for each input (may be NULL).
+ *                Pointer lifetimes are the same as for hash_table_lookup.
+ * @return The number of names found.
+ */
+size_t hash_table_lookup_batch(const HashTable *table, const char *const *names, size_t count,
+                               const char **results) {
+    BatchKey keys[BATCH_WINDOW];
+    char buffers[BATCH_WINDOW][NAME_BUFFER_SIZE];
+    int flat = (table->flags & HASH_TABLE_FLAT) != 0;
+    int concurrent = (table->flags & HASH_TABLE_CONCURRENT) != 0;
+    size_t hits = 0;
+
+    for (size_t base = 0; base < count; base += BATCH_WINDOW) {
+        size_t n = count - base < BATCH_WINDOW ? count - base : BATCH_WINDOW;
+        ReaderSlot *reader = concurrent ? enter_read() : NULL;
+        if (concurrent && reader == NULL) {
+            // No reader slot left: resolve the window through the locking fallback
+            for (size_t i = 0; i < n; i++) {
+                const char *found = hash_table_lookup(table, names[base + i]);
+                hits += found != NULL;
+                if (results != NULL) results[base + i] = found;
+            }
+            continue;
+        }
+        prepare_batch(table, keys, buffers, names + base, n);
+
+        // Stage 1: first level (part of the table itself) -> prefetch the HashBlocks entry
+        for (size_t i = 0; i < n; i++) {
+            BatchKey *key = &keys[i];
+            if (key->name == NULL) continue;
+            key->blocks = LOAD_POINTER(HashBlocks, &table->first_level[key->first]);
+            if (key->blocks != NULL) HB_PREFETCH(&key->blocks->second_level[key->second]);
+        }
+
+        // Stage 2: second level -> prefetch the third-level slot
+        for (size_t i = 0; i < n; i++) {
+            BatchKey *key = &keys[i];
+            if (key->blocks == NULL) continue;
+            key->block = LOAD_POINTER(HashBlock, &key->blocks->second_level[key->second]);
+            if (key->block != NULL) HB_PREFETCH(&key->block->third_level[key->third]);
+        }
+
+        // Stage 3: third level -> prefetch the chain head or flat bucket
+        for (size_t i = 0; i < n; i++) {
+            if (keys[i].block != NULL) HB_PREFETCH(keys[i].block->third_level[keys[i].third]);
+        }
+
+        // Stage 4: prefetch the first name of the chain, or the fingerprints and entries;
+        // with a block filter only its line, since most keys should stop there
+        for (size_t i = 0; i < n; i++) {
+            if (keys[i].block == NULL) continue;
+            const BlockFilter *filter = keys[i].block->filter;
+            if (filter != NULL) {
+                uint64_t hash = filter_hash(keys[i].name, keys[i].length);
+                HB_PREFETCH(filter->lines + (size_t)(hash & filter->line_mask) * FILTER_LINE_WORDS);
+            } else if (flat) {
+                const struct FlatBucket *bucket = keys[i].block->buckets[keys[i].third];
+                if (bucket != NULL) {
+                    HB_PREFETCH(bucket->tags);
+                    HB_PREFETCH(bucket->entries);
+                }
+            } else {
+                const Node *head = keys[i].block->third_level[keys[i].third];
+                if (head != NULL && !is_sub_block(head)) HB_PREFETCH(head->name);
+            }
+        }
+
+        // Stage 5: resolve every key against data that should now be in cache
+        for (size_t i = 0; i < n; i++) {
+            const BatchKey *key = &keys[i];
+            const char *found = key->block == NULL ? NULL
+                : find_in_slot(table, key->block, key->third, key->name, key->length);
+            if (key->block == NULL && key->name != NULL && table->counters != NULL) {
+                count_lookup(table, key->name, 0, 0);
+            }
+            hits += found != NULL;
+            if (results != NULL) results[base + i] = found;
+        }
+
+        if (reader != NULL) exit_read(reader);
+        release_batch(keys, buffers, n);
+    }
+    return hits;
+}
+
+/**
+ * Normalizes the keys of a batch window and computes their level indices.
+ *
+ * Invalid names get a NULL name and are skipped by the later stages.
+ *
+ * @param table The table, for its key mode and level schema.
+ * @param keys Receives the per-key state.
+ * @param buffers One scratch buffer per key for normalize_name.
+ * @param names The input names of the window.
+ * @param count The number of names in the window.
+ */
+void prepare_batch(const HashTable *table, BatchKey *keys, char (*buffers)[NAME_BUFFER_SIZE],
+                   const char *const *names, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        BatchKey *key = &keys[i];
+        memset(key, 0, sizeof(*key));
+        if (normalize_name(table->flags, names[i], buffers[i], NAME_BUFFER_SIZE, &key->name, &key->length) != 0) {
+            key->name = NULL;
+            continue;
+        }
+        key->first = schema_index(table->schema, 0, key->name);
+        key->second = schema_index(table->schema, 1, key->name);
+        key->third = schema_index(table->schema, 2, key->name);
+    }
+}
+
+/**
+ * Releases the normalized names of a batch window.
+ *
+ * @param keys The per-key state.
+ * @param buffers The scratch buffers passed to prepare_batch.
+ * @param count The number of names in the window.
+ */
+void release_batch(BatchKey *keys, char (*buffers)[NAME_BUFFER_SIZE], size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (keys[i].name != NULL) {
+            release_name(keys[i].name, buffers[i]);
+        }
+    }
+}
+
+/**
+ * Bulk-loads many names into a table on several threads.
+ *
+ * The keys are partitioned by first-level letter and second-level bucket, 
+ * which splits the table into BUILD_TASKS subtrees that share no memory. 
+ * Worker threads take subtrees largest first; each normalizes its keys, sorts 
+ * them and links each third-level run in a single pass, so building costs 
+ * O(n log n) instead of one chain walk per insert. Nodes and names come from 
+ * a private arena per worker in HASH_TABLE_ARENA mode, which is handed to 
+ * the table when the workers finish. The result is the same as inserting 
+ * every name with hash_table_insert.
+ *
+ * The table may already hold names. No other thread may modify it during the 
+ * build; HASH_TABLE_CONCURRENT tables hold all writer locks for the duration, 
+ * and their readers keep working throughout.
+ *
+ * @param table The table to load.
+ * @param names The names to add.
+ * @param count The number of names.
+ * @param threads The number of worker threads (0 or 1 builds on the calling thread).
+ * @param results Receives 0 or 1 for each name, as hash_table_insert would return (may be NULL).
+ * @return The number of names that could not be added.
+ */
+size_t hash_table_build(HashTable *table, const char *const *names, size_t count,
+                        unsigned int threads, int *results) {
+    BuildJob *job = (BuildJob *)calloc(1, sizeof(BuildJob));
+    size_t *order = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    if (!job || !order) {
+        printf("Memory allocation failed for build job\n");
+        free(job);
+        free(order);
+        for (size_t i = 0; results != NULL && i < count; i++) results[i] = 1;
+        return count;
+    }
+
+    // Partition by the first two levels; names that fail normalization later
+    // land in whatever task their raw characters select
+    size_t sizes[BUILD_TASKS] = { 0 };
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char *name = (const unsigned char *)names[i];
+        unsigned int task = 0;
+        char prefix[SCHEMA_POSITIONS + 1] = { 0 };
+        size_t length = 0;
+        if (table->flags & KEY_MODE_FLAGS) {
+            // Folding can change the leading bytes, so partition by the folded name
+            length = fold_prefix(names[i], (table->flags & HASH_TABLE_FOLD_ACCENTS) != 0, prefix);
+        } else {
+            while (length < SCHEMA_POSITIONS && name[length] != '\0') {
+                prefix[length] = (char)toupper(name[length]);
+                length++;
+            }
+        }
+        if (length >= 3) {
+            task = schema_index(table->schema, 0, prefix) * SECOND_LEVEL_SIZE +
+                   schema_index(table->schema, 1, prefix);
+        }
+        order[i] = task; // Temporarily holds the task of each key
+        sizes[task]++;
+    }
+    for (unsigned int t = 0; t < BUILD_TASKS; t++) {
+        job->task_start[t + 1] = job->task_start[t] + sizes[t];
+    }
+    size_t fill[BUILD_TASKS];
+    memcpy(fill, job->task_start, sizeof(fill));
+    size_t *grouped = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    if (!grouped) {
+        printf("Memory allocation failed for build job\n");
+        free(job);
+        free(order);
+        for (size_t i = 0; results != NULL && i < count; i++) results[i] = 1;
+        return count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        grouped[fill[order[i]]++] = i;
+    }
+    free(order);
+
+    job->table = table;
+    job->names = names;
+    job->results = results;
+    job->order = grouped;
+    for (unsigned int t = 0; t < BUILD_TASKS; t++) {
+        if (sizes[t] == 0) continue;
+        // Insertion sort by size, descending: at most BUILD_TASKS entries
+        unsigned int i = job->task_count++;
+        while (i > 0 && sizes[job->tasks[i - 1]] < sizes[t]) {
+            job->tasks[i] = job->tasks[i - 1];
+            i--;
+        }
+        job->tasks[i] = t;
+    }
+
+    // Block other writers of concurrent tables; workers write without locking
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+    }
+
+    // Create the second levels up front so each worker only writes its own slots
+    for (unsigned int i = 0; i < job->task_count; i++) {
+        unsigned int letter = job->tasks[i] / SECOND_LEVEL_SIZE;
+        if (table->first_level[letter] == NULL) {
+            HashBlocks *created = create_hash_blocks();
+            if (created != NULL) STORE_POINTER(HashBlocks, &table->first_level[letter], created);
+        }
+    }
+
+    if (threads == 0) threads = 1;
+    if (threads > job->task_count) threads = job->task_count ? job->task_count : 1;
+    BuildWorker *workers = (BuildWorker *)calloc(threads, sizeof(BuildWorker));
+    thrd_t *handles = (thrd_t *)malloc(threads * sizeof(thrd_t));
+    size_t failures = 0;
+    if (!workers || !handles) {
+        printf("Memory allocation failed for build workers\n");
+        threads = 0;
+        failures = count;
+        for (size_t i = 0; results != NULL && i < count; i++) results[i] = 1;
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        workers[i].job = job;
+        workers[i].local.flags = table->flags & HASH_TABLE_ARENA;
+    }
+
+    // The calling thread is worker 0; the others get their own threads
+    unsigned int started = 1;
+    for (; started < threads; started++) {
+        if (thrd_create(&handles[started], build_worker, &workers[started]) != thrd_success) {
+            printf("Failed to start build thread\n");
+            break;
+        }
+    }
+    if (threads > 0) {
+        build_worker(&workers[0]);
+    }
+    for (unsigned int i = 1; i < started; i++) {
+        thrd_join(handles[i], NULL);
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        failures += workers[i].failures;
+        merge_arena(&table->arena, &workers[i].local.arena);
+        free(workers[i].keys);
+        free(workers[i].nodes);
+        free(workers[i].text);
+    }
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        unlock_stripe(table, i);
+    }
+
+    free(workers);
+    free(handles);
+    free(grouped);
+    free(job);
+    return failures;
+}
+
+/**
+ * Bulk-loads a file with one name per line into a table.
+ *
+ * The whole file is read into memory, split into lines (a trailing carriage 
+ * return is dropped and empty lines are skipped) and passed to 
+ * hash_table_build.
+ *
+ * @param table The table to load.
+ * @param path The file to read.
+ * @param threads The number of worker threads.
+ * @param failures Receives the number of names that could not be added (may be NULL).
+ * @return 0 on success, or 1 if the file cannot be read.
+ */
+int hash_table_build_file(HashTable *table, const char *path, unsigned int threads, size_t *failures) {
+    const char **names = NULL;
+    size_t count = 0;
+    char *text = read_lines(path, &names, &count);
+    if (text == NULL) {
+        return 1;
+    }
+
+    size_t failed = hash_table_build(table, names, count, threads, NULL);
+    if (failures != NULL) *failures = failed;
+    free(names);
+    free(text);
+    return 0;
+}
+
+/**
+ * Reads a file with one name per line into an array of names.
+ *
+ * The file is read in chunks, so pipes and files of unknown size work the 
+ * same way, and split in place: the names point into the returned text. A 
+ * carriage return before the newline is dropped and empty lines are skipped.
+ *
+ * @param path The file to read.
+ * @param names Receives the array of names; free it with free().
+ * @param count Receives the number of names.
+ * @return The text holding the names, to be freed after the names, or NULL on failure.
+ */
+char* read_lines(const char *path, const char ***names, size_t *count) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("Failed to open %s\n", path);
+        return NULL;
+    }
+
+    size_t size = 0, capacity = 1 << 16;
+    char *text = (char *)malloc(capacity);
+    while (text != NULL) {
+        size += fread(text + size, 1, capacity - size - 1, file);
+        if (size < capacity - 1) break;
+        char *grown = (char *)realloc(text, capacity * 2);
+        if (!grown) {
+            free(text);
+            text = NULL;
+            break;
+        }
+        text = grown;
+        capacity *= 2;
+    }
+    int read_error = ferror(file);
+    fclose(file);
+    if (!text || read_error) {
+        printf(text ? "Failed to read %s\n" : "Memory allocation failed for %s\n", path);
+        free(text);
+        return NULL;
+    }
+    text[size] = '\0';
+
+    size_t lines = 1;
+    for (size_t i = 0; i < size; i++) {
+        lines += text[i] == '\n';
+    }
+    *names = (const char **)malloc(lines * sizeof(char *));
+    if (!*names) {
+        printf("Memory allocation failed for %s\n", path);
+        free(text);
+        return NULL;
+    }
+
+    *count = 0;
+    for (char *line = text; line < text + size; ) {
+        char *end = memchr(line, '\n', (size_t)(text + size - line));
+        if (end == NULL) end = text + size;
+        *end = '\0';
+        if (end > line && end[-1] == '\r') end[-1] = '\0';
+        if (*line != '\0') (*names)[(*count)++] = line;
+        line = end + 1;
+    }
+    return text;
+}
+
+/**
+ * Worker thread of hash_table_build.
+ *
+ * Takes subtrees from the shared job until none are left.
+ *
+ * @param argument The worker's BuildWorker.
+ * @return Always 0.
+ */
+int build_worker(void *argument) {
+    BuildWorker *worker = (BuildWorker *)argument;
+    BuildJob *job = worker->job;
+    for (;;) {
+        unsigned int next = atomic_fetch_add(&job->next_task, 1);
+        if (next >= job->task_count) break;
+        build_task(worker, job->tasks[next]);
+    }
+    return 0;
+}
+
+/**
+ * Builds one (letter, bucket) subtree of a hash_table_build job.
+ *
+ * The task's keys are normalized into the worker's text buffer and sorted by 
+ * third-level bucket and name. Flat tables then append them to their buckets 
+ * in order, which makes every flat_insert an append. Linked-list tables 
+ * create the nodes of each third-level run and merge them into the existing 
+ * chain with merge_sorted_run.
+ *
+ * @param worker The worker running the task.
+ * @param task The task index (letter * SECOND_LEVEL_SIZE + bucket).
+ */
+void build_task(BuildWorker *worker, unsigned int task) {
+    BuildJob *job = worker->job;
+    HashTable *table = job->table;
+    size_t begin = job->task_start[task], end = job->task_start[task + 1];
+    size_t count = end - begin;
+    HashBlocks *blocks = table->first_level[task / SECOND_LEVEL_SIZE];
+    HashBlock **slot = blocks ? &blocks->second_level[task % SECOND_LEVEL_SIZE] : NULL;
+
+    if (slot != NULL && *slot == NULL) {
+        HashBlock *created = create_hash_block();
+        if (created != NULL) STORE_POINTER(HashBlock, slot, created);
+    }
+    if (count > worker->key_capacity) {
+        BuildKey *keys = (BuildKey *)realloc(worker->keys, count * sizeof(BuildKey));
+        if (keys != NULL) {
+            worker->keys = keys;
+            worker->key_capacity = count;
+        }
+    }
+    if (slot == NULL || *slot == NULL || count > worker->key_capacity) {
+        if (count > worker->key_capacity) printf("Memory allocation failed for build keys\n");
+        for (size_t i = begin; i < end; i++) {
+            if (job->results != NULL) job->results[job->order[i]] = 1;
+        }
+        worker->failures += count;
+        return;
+    }
+    HashBlock *block = *slot;
+
+    // Normalize into the text buffer; offsets become pointers once it stops growing
+    size_t keys = 0, used = 0;
+    for (size_t i = begin; i < end; i++) {
+        size_t input = job->order[i];
+        char buffer[NAME_BUFFER_SIZE];
+        char *name = NULL;
+        size_t length = 0;
+        int result = normalize_name(table->flags, job->names[input], buffer, sizeof(buffer), &name, &length);
+        if (result == 0 && used + length + 1 > worker->text_capacity) {
+            size_t capacity = worker->text_capacity ? worker->text_capacity : 4096;
+            while (capacity < used + length + 1) capacity *= 2;
+            char *text = (char *)realloc(worker->text, capacity);
+            if (!text) {
+                printf("Memory allocation failed for build keys\n");
+                result = 1;
+            } else {
+                worker->text = text;
+                worker->text_capacity = capacity;
+            }
+        }
+        if (result == 0) {
+            memcpy(worker->text + used, name, length + 1);
+            worker->keys[keys].name = (const char *)(uintptr_t)used;
+            worker->keys[keys].length = length;
+            worker->keys[keys].input = input;
+            worker->keys[keys].third = schema_index(table->schema, 2, name);
+            keys++;
+            used += length + 1;
+            release_name(name, buffer);
+        }
+        if (job->results != NULL) job->results[input] = result;
+        worker->failures += (size_t)result;
+    }
+    for (size_t i = 0; i < keys; i++) {
+        worker->keys[i].name = worker->text + (uintptr_t)worker->keys[i].name;
+    }
+    qsort(worker->keys, keys, sizeof(BuildKey), compare_build_keys);
+
+    size_t inserted = 0;
+    for (size_t run = 0; run < keys; ) {
+        unsigned int k = worker->keys[run].third;
+        size_t stop = run;
+        while (stop < keys && worker->keys[stop].third == k) {
+            stop++;
+        }
+
+        if (table->flags & HASH_TABLE_FLAT) {
+            for (size_t i = run; i < stop; i++) {
+                int result = flat_insert(&block->buckets[k], worker->keys[i].name, worker->keys[i].length, NULL, NULL);
+                if (job->results != NULL) job->results[worker->keys[i].input] = result;
+                worker->failures += (size_t)result;
+                inserted += result == 0;
+            }
+            run = stop;
+            continue;
+        }
+
+        if (stop - run > worker->node_capacity) {
+            Node **nodes = (Node **)realloc(worker->nodes, (stop - run) * sizeof(Node *));
+            if (nodes != NULL) {
+                worker->nodes = nodes;
+                worker->node_capacity = stop - run;
+            }
+        }
+        // A slot that was already promoted takes each node down to its own chain
+        Node **slot = &block->third_level[k];
+        int promoted = is_sub_block(*slot);
+        size_t created = 0;
+        for (size_t i = run; i < stop; i++) {
+            Node *node = promoted || stop - run <= worker->node_capacity
+                ? create_node(&worker->local, worker->keys[i].name, worker->keys[i].length)
+                : NULL;
+            if (node != NULL && promoted && insert_node(table, slot, node, worker->keys[i].length) != 0) {
+                free_node(&worker->local, node);
+                node = NULL;
+            }
+            if (node != NULL) {
+                if (!promoted) worker->nodes[created] = node;
+                created++;
+            } else {
+                if (job->results != NULL) job->results[worker->keys[i].input] = 1;
+                worker->failures++;
+            }
+        }
+        if (!promoted) {
+            merge_sorted_run(slot, worker->nodes, created);
+            if (promotes_chains(table) && chain_longer_than(*slot, PROMOTE_THRESHOLD)) {
+                promote_chain(slot); // Stays a chain if the SubBlock cannot be allocated
+            }
+        }
+        inserted += created;
+        run = stop;
+    }
+    if ((table->flags & HASH_TABLE_FILTER) && inserted > 0) {
+        rebuild_filter(table, block);
+    }
+    table->name_count += inserted;
+    if (table->counters != NULL && inserted > 0) count_inserts(table, worker->keys[0].name, inserted);
+}
+
+/**
+ * Links a sorted run of new nodes into a sorted third-level list.
+ *
+ * A cursor moves down the existing list once while the new nodes are placed, 
+ * so the whole run costs O(list + run) instead of one walk per node. Existing 
+ * links are only ever redirected to a new node whose next pointer is already 
+ * set, so concurrent readers always see a complete chain.
+ *
+ * @param head A pointer to the head of the linked list.
+ * @param nodes The new nodes, sorted by name.
+ * @param count The number of new nodes.
+ */
+void merge_sorted_run(Node **head, Node **nodes, size_t count) {
+    Node **link = head;
+    for (size_t i = 0; i < count; i++) {
+        while (*link != NULL && strcmp((*link)->name, nodes[i]->name) < 0) {
+            link = &(*link)->next;
+        }
+        nodes[i]->next = *link;
+        STORE_POINTER(Node, link, nodes[i]);
+        link = &nodes[i]->next;
+    }
+}
+
+/**
+ * Orders build keys by third-level bucket, then alphabetically.
+ *
+ * @param a The first BuildKey.
+ * @param b The second BuildKey.
+ * @return A negative, zero or positive value, as for strcmp.
+ */
+int compare_build_keys(const void *a, const void *b) {
+    const BuildKey *x = (const BuildKey *)a;
+    const BuildKey *y = (const BuildKey *)b;
+    if (x->third != y->third) {
+        return x->third < y->third ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+/**
+ * Writes a table to a snapshot file.
+ *
+ * The snapshot mirrors the three levels with offset arrays instead of 
+ * pointers: a first-level array of 26 offsets, one record of 7 offsets per 
+ * existing HashBlocks, one record of 26 entry ranges per non-empty HashBlock, 
+ * then an entry array sorted within each slot and a string pool. Nothing in 
+ * the file depends on the address it is loaded at, so hash_snapshot_open can 
+ * map it and answer lookups in place. The header carries a format version, 
+ * the level sizes and a checksum of everything after it.
+ *
+ * The table is walked three times (counting, entries, pool) while streaming 
+ * the file, so no copy of the table is built in memory. In 
+ * HASH_TABLE_CONCURRENT tables all writer locks are held while saving.
+ *
+ * @param table The table to save.
+ * @param path The file to write; an existing file is replaced.
+ * @return 0 on success, or 1 if the file cannot be written or the names exceed 
+ *         the 4 GB string pool limit of the format.
+ */
+int hash_table_save(const HashTable *table, const char *path) {
+    return write_snapshot(table, path, 0, 0);
+}
+
+/**
+ * Writes a table to a snapshot file; the implementation of hash_table_save.
+ *
+ * Checkpoints of a HashLog tag the snapshot with the generation of the log 
+ * that continues it, and sync it before it is renamed into place.
+ *
+ * @param table The table to save.
+ * @param path The file to write; an existing file is replaced.
+ * @param log_generation Stored in the header's log_generation.
+ * @param durable Non-zero to force the file to disk before returning.
+ * @return 0 on success, or 1 on failure.
+ */
+int write_snapshot(const HashTable *table, const char *path, uint32_t log_generation, int durable) {
+    // Pass 1: names and pool bytes per slot
+    uint32_t (*slots)[SECOND_LEVEL_SIZE][THIRD_LEVEL_SIZE] =
+        (uint32_t (*)[SECOND_LEVEL_SIZE][THIRD_LEVEL_SIZE])calloc(FIRST_LEVEL_SIZE, sizeof(*slots));
+    if (!slots) {
+        printf("Memory allocation failed for snapshot index\n");
+        return 1;
+    }
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+    }
+
+    uint64_t totals[2] = { 0, 0 }; // Names and pool bytes
+    uint32_t blocks_records = 0, block_records = 0;
+    int blocks_present[FIRST_LEVEL_SIZE] = { 0 };
+    int block_present[FIRST_LEVEL_SIZE][SECOND_LEVEL_SIZE] = { { 0 } };
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        HashBlocks *blocks = table->first_level[i];
+        for (unsigned int j = 0; blocks != NULL && j < SECOND_LEVEL_SIZE; j++) {
+            HashBlock *block = blocks->second_level[j];
+            for (unsigned int k = 0; block != NULL && k < THIRD_LEVEL_SIZE; k++) {
+                uint64_t before = totals[0];
+                visit_slot(table, block, k, count_name, totals);
+                slots[i][j][k] = (uint32_t)(totals[0] - before);
+                if (slots[i][j][k] != 0) {
+                    block_present[i][j] = 1;
+                }
+            }
+            if (block_present[i][j]) {
+                blocks_present[i] = 1;
+                block_records++;
+            }
+        }
+        blocks_records += (uint32_t)blocks_present[i];
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.header_size = sizeof(SnapshotHeader);
+    header.first_level_size = FIRST_LEVEL_SIZE;
+    header.second_level_size = SECOND_LEVEL_SIZE;
+    header.third_level_size = THIRD_LEVEL_SIZE;
+    header.key_flags = table->flags & KEY_MODE_FLAGS;
+    header.log_generation = log_generation;
+    header.schema = *table->schema;
+    header.name_count = totals[0];
+    header.entries_offset = sizeof(SnapshotHeader) + sizeof(uint32_t) * FIRST_LEVEL_SIZE +
+                            (uint64_t)blocks_records * sizeof(uint32_t) * SECOND_LEVEL_SIZE +
+                            (uint64_t)block_records * sizeof(SnapshotSlot) * THIRD_LEVEL_SIZE;
+    header.pool_offset = header.entries_offset + totals[0] * sizeof(SnapshotEntry);
+    header.pool_size = totals[1];
+    header.file_size = header.pool_offset + header.pool_size;
+
+    int result = 1;
+    FILE *file = NULL;
+    if (totals[0] > UINT32_MAX || totals[1] > UINT32_MAX) {
+        printf("Table too large for a snapshot: %s\n", path);
+    } else if ((file = fopen(path, "wb")) == NULL) {
+        printf("Failed to open %s\n", path);
+    } else {
+        SnapshotWriter writer = { file, 14695981039346656037ull, 0, 0 };
+        snapshot_write(&writer, &header, sizeof(header)); // Rewritten with the checksum below
+        writer.checksum = 14695981039346656037ull;
+
+        // First level: offsets of the second-level records, which follow it
+        uint32_t offset = sizeof(SnapshotHeader) + sizeof(uint32_t) * FIRST_LEVEL_SIZE;
+        for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+            uint32_t value = blocks_present[i] ? offset : 0;
+            snapshot_write(&writer, &value, sizeof(value));
+            offset += blocks_present[i] ? sizeof(uint32_t) * SECOND_LEVEL_SIZE : 0;
+        }
+
+        // Second level: offsets of the third-level records, which follow all of them
+        for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+            for (unsigned int j = 0; blocks_present[i] && j < SECOND_LEVEL_SIZE; j++) {
+                uint32_t value = block_present[i][j] ? offset : 0;
+                snapshot_write(&writer, &value, sizeof(value));
+                offset += block_present[i][j] ? sizeof(SnapshotSlot) * THIRD_LEVEL_SIZE : 0;
+            }
+        }
+
+        // Third level: entry ranges
+        uint32_t start = 0;
+        for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+            for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+                for (unsigned int k = 0; block_present[i][j] && k < THIRD_LEVEL_SIZE; k++) {
+                    SnapshotSlot slot = { start, slots[i][j][k] };
+                    snapshot_write(&writer, &slot, sizeof(slot));
+                    start += slot.count;
+                }
+            }
+        }
+
+        // Entries, then the pool, in the same slot order
+        HashTableVisitor passes[2] = { write_entry, write_pool_name };
+        for (int pass = 0; pass < 2; pass++) {
+            for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+                HashBlocks *blocks = table->first_level[i];
+                for (unsigned int j = 0; blocks != NULL && j < SECOND_LEVEL_SIZE; j++) {
+                    HashBlock *block = blocks->second_level[j];
+                    for (unsigned int k = 0; block != NULL && k < THIRD_LEVEL_SIZE; k++) {
+                        visit_slot(table, block, k, passes[pass], &writer);
+                    }
+                }
+            }
+        }
+
+        header.checksum = writer.checksum;
+        if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) {
+            writer.failed = 1;
+        }
+        if (durable && !writer.failed && sync_file(file) != 0) {
+            writer.failed = 1;
+        }
+        if (fclose(file) != 0 || writer.failed) {
+            printf("Failed to write %s\n", path);
+        } else {
+            result = 0;
+        }
+    }
+
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        unlock_stripe(table, i);
+    }
+    free(slots);
+    return result;
+}
+
+/**
+ * Visitor used by hash_table_save to count names and pool bytes.
+ *
+ * @param name The stored name.
+ * @param context A uint64_t[2] holding the name count and the pool size.
+ * @return Always 0, so the walk continues.
+ */
+int count_name(const char *name, void *context) {
+    uint64_t *totals = (uint64_t *)context;
+    totals[0]++;
+    totals[1] += strlen(name) + 1;
+    return 0;
+}
+
+/**
+ * Visitor used by hash_table_save to write the entry of one name.
+ *
+ * @param name The stored name.
+ * @param context The SnapshotWriter.
+ * @return Always 0, so the walk continues.
+ */
+int write_entry(const char *name, void *context) {
+    SnapshotWriter *writer = (SnapshotWriter *)context;
+    size_t length = strlen(name);
+    SnapshotEntry entry = { (uint32_t)writer->pool_used, (uint32_t)length };
+    snapshot_write(writer, &entry, sizeof(entry));
+    writer->pool_used += length + 1;
+    return 0;
+}
+
+/**
+ * Visitor used by hash_table_save to write one name into the string pool.
+ *
+ * @param name The stored name.
+ * @param context The SnapshotWriter.
+ * @return Always 0, so the walk continues.
+ */
+int write_pool_name(const char *name, void *context) {
+    snapshot_write((SnapshotWriter *)context, name, strlen(name) + 1);
+    return 0;
+}
+
+/**
+ * Writes bytes to a snapshot file and adds them to the running checksum.
+ *
+ * @param writer The snapshot being written.
+ * @param data The bytes to write.
+ * @param size The number of bytes.
+ */
+void snapshot_write(SnapshotWriter *writer, const void *data, size_t size) {
+    writer->checksum = snapshot_checksum(writer->checksum, data, size);
+    if (!writer->failed && fwrite(data, 1, size, writer->file) != size) {
+        writer->failed = 1;
+    }
+}
+
+/**
+ * Updates a 64-bit FNV-1a checksum.
+ *
+ * @param hash The checksum so far (14695981039346656037 to start).
+ * @param data The bytes to add.
+ * @param size The number of bytes.
+ * @return The updated checksum.
+ */
+uint64_t snapshot_checksum(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Opens a snapshot written by hash_table_save.
+ *
+ * The file is mapped read-only and used in place: opening only checks the 
+ * header and the small level index, so it takes constant time regardless of 
+ * the number of names, and processes that open the same file share one copy 
+ * in the page cache. With HASH_SNAPSHOT_VERIFY the checksum and every entry 
+ * are checked as well, which reads the whole file once.
+ *
+ * @param path The snapshot file.
+ * @param flags HASH_SNAPSHOT_* flags.
+ * @return The snapshot, or NULL if the file cannot be mapped or is not a valid snapshot.
+ */
+HashSnapshot* hash_snapshot_open(const char *path, unsigned int flags) {
+    size_t size = 0;
+    const unsigned char *base = map_file(path, &size);
+    if (base == NULL) {
+        printf("Failed to map %s\n", path);
+        return NULL;
+    }
+
+    HashSnapshot *snapshot = (HashSnapshot *)malloc(sizeof(HashSnapshot));
+    if (!snapshot) {
+        printf("Memory allocation failed for HashSnapshot\n");
+        unmap_file(base, size);
+        return NULL;
+    }
+    snapshot->base = base;
+    snapshot->size = size;
+    snapshot->header = (const SnapshotHeader *)base;
+    if (validate_snapshot(snapshot, flags) != 0) {
+        printf("Invalid snapshot: %s\n", path);
+        hash_snapshot_close(snapshot);
+        return NULL;
+    }
+    snapshot->schema = memcmp(&snapshot->header->schema, &default_schema, sizeof(HashSchema)) == 0
+        ? &default_schema : &snapshot->header->schema;
+    snapshot->first_level = (const uint32_t *)(base + snapshot->header->header_size);
+    snapshot->entries = (const SnapshotEntry *)(base + snapshot->header->entries_offset);
+    snapshot->pool = (const char *)(base + snapshot->header->pool_offset);
+    return snapshot;
+}
+
+/**
+ * Checks a mapped snapshot before it is used.
+ *
+ * The header must match this build (magic, version, byte order and level 
+ * sizes), hold a valid schema and describe exactly the mapped size, and every offset and entry 
+ * range in the level index must stay inside the file. With 
+ * HASH_SNAPSHOT_VERIFY the checksum is recomputed and every entry must point 
+ * at a NUL-terminated name inside the pool.
+ *
+ * @param snapshot The snapshot with base, size and header set.
+ * @param flags HASH_SNAPSHOT_* flags.
+ * @return 0 if the snapshot can be used, or 1 otherwise.
+ */
+int validate_snapshot(const HashSnapshot *snapshot, unsigned int flags) {
+    const SnapshotHeader *header = snapshot->header;
+    if (snapshot->size < sizeof(SnapshotHeader) ||
+        memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER ||
+        header->header_size != sizeof(SnapshotHeader) ||
+        header->first_level_size != FIRST_LEVEL_SIZE || header->second_level_size != SECOND_LEVEL_SIZE ||
+        header->third_level_size != THIRD_LEVEL_SIZE || header->file_size != snapshot->size ||
+        (header->key_flags & ~(uint32_t)KEY_MODE_FLAGS) != 0 ||
+        header->name_count > UINT32_MAX ||
+        header->entries_offset % sizeof(uint32_t) != 0 ||
+        header->entries_offset < sizeof(SnapshotHeader) + sizeof(uint32_t) * FIRST_LEVEL_SIZE ||
+        header->pool_offset != header->entries_offset + header->name_count * sizeof(SnapshotEntry) ||
+        header->pool_offset + header->pool_size != header->file_size ||
+        check_schema(&header->schema) != 0) {
+        return 1;
+    }
+
+    // The index is at most a few kilobytes, so it is always checked
+    const uint32_t *first_level = (const uint32_t *)(snapshot->base + sizeof(SnapshotHeader));
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        if (first_level[i] == 0) continue;
+        if (first_level[i] % sizeof(uint32_t) != 0 ||
+            first_level[i] + sizeof(uint32_t) * SECOND_LEVEL_SIZE > header->entries_offset) {
+            return 1;
+        }
+        const uint32_t *second_level = (const uint32_t *)(snapshot->base + first_level[i]);
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+            if (second_level[j] == 0) continue;
+            if (second_level[j] % sizeof(uint32_t) != 0 ||
+                second_level[j] + sizeof(SnapshotSlot) * THIRD_LEVEL_SIZE > header->entries_offset) {
+                return 1;
+            }
+            const SnapshotSlot *slots = (const SnapshotSlot *)(snapshot->base + second_level[j]);
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+                if ((uint64_t)slots[k].start + slots[k].count > header->name_count) {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    if (flags & HASH_SNAPSHOT_VERIFY) {
+        uint64_t checksum = snapshot_checksum(14695981039346656037ull, snapshot->base + sizeof(SnapshotHeader),
+                                              snapshot->size - sizeof(SnapshotHeader));
+        if (checksum != header->checksum) {
+            return 1;
+        }
+        const SnapshotEntry *entries = (const SnapshotEntry *)(snapshot->base + header->entries_offset);
+        const char *pool = (const char *)(snapshot->base + header->pool_offset);
+        for (uint64_t i = 0; i < header->name_count; i++) {
+            if ((uint64_t)entries[i].offset + entries[i].length >= header->pool_size ||
+                pool[entries[i].offset + entries[i].length] != '\0') {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Looks up a name in a snapshot.
+ *
+ * The name is normalized exactly as for hash_table_lookup, in the key mode of 
+ * the saved table. Its first- and second-level buckets select the slot array 
+ * through the offset arrays, and the slot's sorted entries are binary 
+ * searched. Nothing is allocated unless the name is longer than the 
+ * normalization buffer.
+ *
+ * @param snapshot The snapshot to search.
+ * @param input_name The name to search for.
+ * @return The stored name inside the mapping, valid until hash_snapshot_close, 
+ *         or NULL if the name is not found or is invalid.
+ */
+const char* hash_snapshot_lookup(const HashSnapshot *snapshot, const char *input_name) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+
+    // Convert to uppercase characters
+    if (normalize_name(snapshot->header->key_flags, input_name, buffer, sizeof(buffer), &name, NULL) != 0) {
+        return NULL;
+    }
+
+    const char *result = NULL;
+    const SnapshotSlot *slots = snapshot_slots(snapshot, name);
+    if (slots != NULL) {
+        const SnapshotSlot *slot = &slots[schema_index(snapshot->schema, 2, name)];
+        uint32_t low = slot->start, high = slot->start + slot->count;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            const char *candidate = snapshot->pool + snapshot->entries[mid].offset;
+            int cmp = strcmp(candidate, name);
+            if (cmp == 0) {
+                result = candidate;
+                break;
+            }
+            if (cmp < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+    }
+    release_name(name, buffer);
+    return result;
+}
+
+/**
+ * Returns the third-level slot array of a snapshot that a name maps to.
+ *
+ * @param snapshot The snapshot to search.
+ * @param name The normalized (uppercase) name.
+ * @return The THIRD_LEVEL_SIZE slots of the name's block, or NULL if the block is empty.
+ */
+const SnapshotSlot* snapshot_slots(const HashSnapshot *snapshot, const char *name) {
+    uint32_t blocks = snapshot->first_level[schema_index(snapshot->schema, 0, name)];
+    if (blocks == 0) return NULL;
+    uint32_t block = ((const uint32_t *)(snapshot->base + blocks))[schema_index(snapshot->schema, 1, name)];
+    return block ? (const SnapshotSlot *)(snapshot->base + block) : NULL;
+}
+
+/**
+ * Returns the number of names stored in a snapshot.
+ *
+ * @param snapshot The snapshot.
+ * @return The number of names.
+ */
+size_t hash_snapshot_count(const HashSnapshot *snapshot) {
+    return (size_t)snapshot->header->name_count;
+}
+
+/**
+ * Unmaps a snapshot opened with hash_snapshot_open. Passing NULL is a no-op.
+ *
+ * @param snapshot The snapshot to close.
+ */
+void hash_snapshot_close(HashSnapshot *snapshot) {
+    if (snapshot == NULL) return;
+    unmap_file(snapshot->base, snapshot->size);
+    free(snapshot);
+}
+
+/**
+ * Maps a whole file read-only into memory.
+ *
+ * The file handles are closed right away; the mapping keeps the contents 
+ * available until unmap_file.
+ *
+ * @param path The file to map.
+ * @param size Receives the length of the mapping.
+ * @return The start of the mapping, or NULL on failure (including empty files).
+ */
+const unsigned char* map_file(const char *path, size_t *size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || length.QuadPart == 0 || (uint64_t)length.QuadPart > SIZE_MAX) {
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+    const unsigned char *base = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    *size = (size_t)length.QuadPart;
+    return base;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > SIZE_MAX) {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    *size = (size_t)info.st_size;
+    return (const unsigned char *)base;
+#endif
+}
+
+/**
+ * Releases a mapping created by map_file.
+ *
+ * @param base The start of the mapping.
+ * @param size The length of the mapping.
+ */
+void unmap_file(const unsigned char *base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap((void *)base, size);
+#endif
+}
+
+/**
+ * Flushes a file and forces its contents to disk.
+ *
+ * @param file The file.
+ * @return 0 on success, or 1 on failure.
+ */
+int sync_file(FILE *file) {
+    if (fflush(file) != 0) return 1;
+#ifdef _WIN32
+    return _commit(_fileno(file)) != 0;
+#else
+    return fsync(fileno(file)) != 0;
+#endif
+}
+
+/**
+ * Renames a file over another one and makes the rename durable.
+ *
+ * The rename replaces the target atomically, so a crash leaves either the old 
+ * or the new file in place. On POSIX systems the directory is synced as well.
+ *
+ * @param from The file to rename.
+ * @param to The file to replace.
+ * @return 0 on success, or 1 on failure.
+ */
+int replace_file(const char *from, const char *to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : 1;
+#else
+    if (rename(from, to) != 0) return 1;
+    const char *slash = strrchr(to, '/');
+    size_t length = slash == NULL ? 1 : (slash == to ? 1 : (size_t)(slash - to));
+    char *directory = (char *)malloc(length + 1);
+    if (!directory) return 1;
+    memcpy(directory, slash == NULL ? "." : to, length);
+    directory[length] = '\0';
+    int fd = open(directory, O_RDONLY);
+    free(directory);
+    if (fd < 0) return 1;
+    int result = fsync(fd) != 0;
+    close(fd);
+    return result;
+#endif
+}
+
+/**
+ * Recovers a table from its last checkpoint and write-ahead log, and keeps logging it.
+ *
+ * Recovery loads the checkpoint <path>.hb, if there is one, with 
+ * hash_table_build and replays the log <path>.log over it. Restarting 
+ * therefore costs a bulk load of the checkpoint plus the records logged 
+ * since, however many changes the table has seen overall. Every record 
+ * carries a checksum; the first one that is incomplete or does not match 
+ * marks where a crash interrupted a write, and it is cut off with 
+ * everything after it.
+ *
+ * A log file starts with a generation equal to the log_generation of the 
+ * checkpoint it continues. A checkpoint is synced and renamed into place 
+ * before the new, empty log replaces the old one, so after a crash between 
+ * the two renames recovery finds a log older than the checkpoint, knows the 
+ * checkpoint already holds its records, and starts a new log.
+ *
+ * Records hold the names as given and are normalized again on replay, so 
+ * the table must be created with the same key mode every time. Values are 
+ * not logged, as they are not stored in snapshots either.
+ *
+ * A background thread writes and syncs the records collected since its 
+ * last pass every commit interval, and starts a checkpoint once the log 
+ * grows past checkpoint_bytes. With HASH_LOG_DURABLE, changes also wait 
+ * for their record to be synced; writers that wait at the same time share 
+ * one sync (group commit).
+ *
+ * @param table An empty table, created with the flags the logged names need.
+ * @param path The path of the checkpoint and log without their extensions.
+ * @param options The options to apply, or NULL for the defaults.
+ * @return The log, or NULL if the table is not empty, recovery fails or 
+ *         memory allocation fails.
+ */
+HashLog* hash_log_open(HashTable *table, const char *path, const HashLogOptions *options) {
+    if (table->name_count != 0) {
+        printf("A logged table must be empty when its log is opened\n");
+        return NULL;
+    }
+    HashLog *log = (HashLog *)calloc(1, sizeof(HashLog));
+    if (!log) {
+        printf("Memory allocation failed for HashLog\n");
+        return NULL;
+    }
+    log->table = table;
+    log->flags = options ? options->flags : 0;
+    log->interval_ms = options && options->commit_interval_ms ? options->commit_interval_ms : LOG_COMMIT_INTERVAL;
+    log->checkpoint_bytes = options ? options->checkpoint_bytes : 0;
+
+    size_t length = strlen(path) + 5;
+    log->log_path = (char *)malloc(length);
+    log->snapshot_path = (char *)malloc(length);
+    log->temporary_path = (char *)malloc(length);
+    if (!log->log_path || !log->snapshot_path || !log->temporary_path) {
+        printf("Memory allocation failed for HashLog\n");
+        discard_log(log);
+        return NULL;
+    }
+    snprintf(log->log_path, length, "%s.log", path);
+    snprintf(log->snapshot_path, length, "%s.hb", path);
+    snprintf(log->temporary_path, length, "%s.tmp", path);
+
+    // Replay the checkpoint and the log written after it
+    uint32_t generation = 0;
+    uint64_t valid = 0;
+    FILE *probe = fopen(log->snapshot_path, "rb");
+    if (probe != NULL) {
+        fclose(probe);
+        if (load_checkpoint(table, log->snapshot_path, &generation) != 0) {
+            discard_log(log);
+            return NULL;
+        }
+    }
+    if (replay_log(table, log->log_path, generation, &valid) != 0) {
+        discard_log(log);
+        return NULL;
+    }
+    log->file = valid != 0 ? fopen(log->log_path, "ab") : create_log(log, generation);
+    if (log->file == NULL) {
+        printf("Failed to open %s\n", log->log_path);
+        discard_log(log);
+        return NULL;
+    }
+    log->generation = generation;
+    log->log_bytes = valid != 0 ? valid : sizeof(LogHeader);
+    log->checkpoint_at = log->checkpoint_bytes;
+
+    if (mtx_init(&log->lock, mtx_plain) != thrd_success) {
+        discard_log(log);
+        return NULL;
+    }
+    if (cnd_init(&log->changed) != thrd_success) {
+        mtx_destroy(&log->lock);
+        discard_log(log);
+        return NULL;
+    }
+    if (thrd_create(&log->committer, log_committer, log) != thrd_success) {
+        printf("Failed to start the log committer\n");
+        cnd_destroy(&log->changed);
+        mtx_destroy(&log->lock);
+        discard_log(log);
+        return NULL;
+    }
+    return log;
+}
+
+/**
+ * Loads the names of a checkpoint into an empty table.
+ *
+ * @param table The table.
+ * @param path The checkpoint snapshot.
+ * @param generation Receives the generation of the log that continues the checkpoint.
+ * @return 0 on success, or 1 if the snapshot is invalid, was saved with another 
+ *         key mode or cannot be loaded.
+ */
+int load_checkpoint(HashTable *table, const char *path, uint32_t *generation) {
+    HashSnapshot *snapshot = hash_snapshot_open(path, HASH_SNAPSHOT_VERIFY);
+    if (snapshot == NULL) {
+        return 1;
+    }
+    if (snapshot->header->key_flags != (table->flags & KEY_MODE_FLAGS)) {
+        printf("Checkpoint %s was saved with another key mode\n", path);
+        hash_snapshot_close(snapshot);
+        return 1;
+    }
+    size_t count = (size_t)snapshot->header->name_count;
+    const char **names = (const char **)malloc((count ? count : 1) * sizeof(const char *));
+    if (!names) {
+        printf("Memory allocation failed for checkpoint names\n");
+        hash_snapshot_close(snapshot);
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        names[i] = snapshot->pool + snapshot->entries[i].offset;
+    }
+    size_t failures = hash_table_build(table, names, count, 1, NULL);
+    *generation = snapshot->header->log_generation;
+    free(names);
+    hash_snapshot_close(snapshot);
+    if (failures != 0) {
+        printf("Failed to load %zu names from %s\n", failures, path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Applies the records of a log file to a table.
+ *
+ * A missing log, or one older than the checkpoint, has nothing to replay. 
+ * Replay stops at the first incomplete or corrupt record, and the file is 
+ * truncated there so new records follow the last valid one.
+ *
+ * @param table The table.
+ * @param path The log file.
+ * @param generation The log generation of the checkpoint loaded into the table.
+ * @param valid_bytes Receives the size of the log's valid part, or 0 if a new 
+ *                    log has to be started.
+ * @return 0 on success, or 1 if the log is invalid, belongs to a newer 
+ *         checkpoint or a record cannot be applied.
+ */
+int replay_log(HashTable *table, const char *path, uint32_t generation, uint64_t *valid_bytes) {
+    *valid_bytes = 0;
+    FILE *probe = fopen(path, "rb");
+    if (probe == NULL) {
+        return 0;
+    }
+    fclose(probe);
+
+    size_t size = 0;
+    const unsigned char *base = map_file(path, &size);
+    LogHeader header;
+    if (base == NULL || size < sizeof(header)) {
+        printf("Invalid log: %s\n", path);
+        if (base != NULL) unmap_file(base, size);
+        return 1;
+    }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || header.version != LOG_VERSION ||
+        header.byte_order != SNAPSHOT_BYTE_ORDER || header.key_flags != (table->flags & KEY_MODE_FLAGS)) {
+        printf("Invalid log: %s\n", path);
+        unmap_file(base, size);
+        return 1;
+    }
+    if (header.generation != generation) {
+        unmap_file(base, size);
+        if (header.generation < generation) {
+            return 0; // The checkpoint already holds these records
+        }
+        printf("Log %s is newer than its checkpoint\n", path);
+        return 1;
+    }
+
+    size_t offset = sizeof(header);
+    while (size - offset >= sizeof(LogRecord)) {
+        LogRecord record;
+        memcpy(&record, base + offset, sizeof(record));
+        const char *name = (const char *)(base + offset + sizeof(record));
+        if ((uint64_t)record.length + 1 > size - offset - sizeof(record) || name[record.length] != '\0' ||
+            (record.op != LOG_INSERT && record.op != LOG_REMOVE) ||
+            record.checksum != record_checksum(&record, name)) {
+            break;
+        }
+        int result = record.op == LOG_INSERT ? hash_table_insert(table, name) : hash_table_remove(table, name);
+        if (result != 0) {
+            printf("Failed to replay a record of %s\n", path);
+            unmap_file(base, size);
+            return 1;
+        }
+        offset += sizeof(record) + record.length + 1;
+    }
+    unmap_file(base, size);
+
+    // Cut off a record torn by a crash
+    if (offset < size) {
+        FILE *file = fopen(path, "r+b");
+#ifdef _WIN32
+        int failed = file == NULL || _chsize_s(_fileno(file), (long long)offset) != 0;
+#else
+        int failed = file == NULL || ftruncate(fileno(file), (off_t)offset) != 0;
+#endif
+        if (file != NULL && (sync_file(file) != 0 || fclose(file) != 0)) {
+            failed = 1;
+        }
+        if (failed) {
+            printf("Failed to truncate %s\n", path);
+            return 1;
+        }
+    }
+    *valid_bytes = offset;
+    return 0;
+}
+
+/**
+ * Computes the checksum of a log record: FNV-1a 64 of its length, operation 
+ * and name bytes.
+ *
+ * @param record The record header.
+ * @param name The name it carries.
+ * @return The checksum.
+ */
+uint64_t record_checksum(const LogRecord *record, const char *name) {
+    uint64_t hash = snapshot_checksum(14695981039346656037ull, &record->length, sizeof(uint32_t) * 2);
+    return snapshot_checksum(hash, name, record->length);
+}
+
+/**
+ * Writes an empty log file of a generation and opens it for appending.
+ *
+ * The header is written to the temporary file and synced before it replaces 
+ * the log, so the log on disk is always complete.
+ *
+ * @param log The log.
+ * @param generation The generation stored in the header.
+ * @return The log file, or NULL on failure.
+ */
+FILE* create_log(HashLog *log, uint32_t generation) {
+    LogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+    header.version = LOG_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.key_flags = log->table->flags & KEY_MODE_FLAGS;
+    header.generation = generation;
+
+    FILE *file = fopen(log->temporary_path, "wb");
+    int failed = file == NULL || fwrite(&header, sizeof(header), 1, file) != 1 || sync_file(file) != 0;
+    if (file != NULL && fclose(file) != 0) {
+        failed = 1;
+    }
+    if (failed || replace_file(log->temporary_path, log->log_path) != 0) {
+        printf("Failed to write %s\n", log->log_path);
+        return NULL;
+    }
+    return fopen(log->log_path, "ab");
+}
+
+/**
+ * Frees a log's file, buffers and paths, and the log itself.
+ *
+ * @param log The log.
+ */
+void discard_log(HashLog *log) {
+    if (log->file != NULL) {
+        fclose(log->file);
+    }
+    free(log->pending);
+    free(log->spare);
+    free(log->log_path);
+    free(log->snapshot_path);
+    free(log->temporary_path);
+    free(log);
+}
+
+/**
+ * Adds a name to a logged table and appends the insert to the log.
+ *
+ * The table is changed and the record appended under the log's lock, so 
+ * concurrent writers are logged in the order the table saw them. With 
+ * HASH_LOG_DURABLE the call returns once the record is synced.
+ *
+ * @param log The log.
+ * @param input_name The name to add.
+ * @return 0 on success, 1 if the name is invalid or the log had already failed, or 
+ *         HASH_LOG_NOT_DURABLE if the change was applied but its record could 
+ *         not be synced.
+ */
+int hash_log_insert(HashLog *log, const char *input_name) {
+    return log_change(log, LOG_INSERT, input_name);
+}
+
+/**
+ * Removes a name from a logged table and appends the removal to the log.
+ *
+ * @param log The log.
+ * @param input_name The name to remove.
+ * @return 0 on success, 1 if the name was not found or the log had already failed, or 
+ *         HASH_LOG_NOT_DURABLE if the change was applied but its record could 
+ *         not be synced.
+ */
+int hash_log_remove(HashLog *log, const char *input_name) {
+    return log_change(log, LOG_REMOVE, input_name);
+}
+
+/**
+ * Applies a change to a logged table and appends its record.
+ *
+ * Room for the record is made before the table changes, so a change is never 
+ * applied without being logged. Only changes that succeed are logged. With 
+ * HASH_LOG_DURABLE the record is synced after the change, so readers may 
+ * already see it when the sync fails; the change is not rolled back, since 
+ * other writers of the same group may have built on it, and the distinct 
+ * HASH_LOG_NOT_DURABLE result tells the caller it is applied but not durable.
+ *
+ * @param log The log.
+ * @param op LOG_INSERT or LOG_REMOVE.
+ * @param input_name The name as given by the caller.
+ * @return 0 on success, 1 if nothing was changed, or HASH_LOG_NOT_DURABLE.
+ */
+int log_change(HashLog *log, uint32_t op, const char *input_name) {
+    size_t length = input_name ? strlen(input_name) : 0;
+    mtx_lock(&log->lock);
+    int result = log->failed || reserve_record(log, length) != 0;
+    if (result == 0) {
+        result = op == LOG_INSERT ? hash_table_insert(log->table, input_name)
+                                  : hash_table_remove(log->table, input_name);
+    }
+    if (result == 0) {
+        LogRecord record = { 0, (uint32_t)length, op };
+        record.checksum = record_checksum(&record, input_name);
+        char *out = log->pending + log->pending_size;
+        memcpy(out, &record, sizeof(record));
+        memcpy(out + sizeof(record), input_name, length + 1);
+        log->pending_size += sizeof(record) + length + 1;
+        log->log_bytes += sizeof(record) + length + 1;
+        log->appended++;
+        if ((log->flags & HASH_LOG_DURABLE) && sync_records(log, log->appended) != 0) {
+            result = HASH_LOG_NOT_DURABLE;
+        }
+    }
+    mtx_unlock(&log->lock);
+    return result;
+}
+
+/**
+ * Makes room for one record in the pending buffer of a log.
+ *
+ * @param log The log (lock held).
+ * @param length The length of the record's name.
+ * @return 0 on success, or 1 if memory allocation fails or the name is too long.
+ */
+int reserve_record(HashLog *log, size_t length) {
+    size_t needed = log->pending_size + sizeof(LogRecord) + length + 1;
+    if (length >= UINT32_MAX) {
+        printf("Name too long for the log\n");
+        return 1;
+    }
+    if (needed <= log->pending_capacity) {
+        return 0;
+    }
+    size_t capacity = log->pending_capacity ? log->pending_capacity : 4096;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char *grown = (char *)realloc(log->pending, capacity);
+    if (!grown) {
+        printf("Memory allocation failed for log records\n");
+        return 1;
+    }
+    log->pending = grown;
+    log->pending_capacity = capacity;
+    return 0;
+}
+
+/**
+ * Writes and syncs pending records until a given record is durable.
+ *
+ * The first waiter to find no sync in progress leads a group: it swaps the 
+ * pending buffer with the spare one and writes and syncs it without holding 
+ * the lock, so other writers keep appending meanwhile and are covered by 
+ * the next group. The others wait for the group that holds their record.
+ *
+ * @param log The log (lock held; released while the leader writes).
+ * @param target The number of records that must be durable.
+ * @return 0 on success, or 1 if the log failed.
+ */
+int sync_records(HashLog *log, uint64_t target) {
+    while (log->durable < target && !log->failed) {
+        if (log->syncing) {
+            cnd_wait(&log->changed, &log->lock);
+            continue;
+        }
+        char *group = log->pending;
+        size_t size = log->pending_size, capacity = log->pending_capacity;
+        uint64_t last = log->appended;
+        log->pending = log->spare;
+        log->pending_capacity = log->spare_capacity;
+        log->pending_size = 0;
+        log->syncing = 1;
+        FILE *file = log->file;
+        mtx_unlock(&log->lock);
+
+        int failed = fwrite(group, 1, size, file) != size || sync_file(file) != 0;
+
+        mtx_lock(&log->lock);
+        log->spare = group;
+        log->spare_capacity = capacity;
+        log->syncing = 0;
+        if (failed) {
+            printf("Failed to write %s\n", log->log_path);
+            log->failed = 1;
+        } else {
+            log->durable = last;
+        }
+        cnd_broadcast(&log->changed);
+    }
+    return log->failed;
+}
+
+/**
+ * Waits until every record appended so far is on disk.
+ *
+ * @param log The log.
+ * @return 0 on success, or 1 if writing or syncing the log failed.
+ */
+int hash_log_sync(HashLog *log) {
+    mtx_lock(&log->lock);
+    int result = sync_records(log, log->appended);
+    mtx_unlock(&log->lock);
+    return result;
+}
+
+/**
+ * Writes a new checkpoint of the table and starts an empty log.
+ *
+ * Writers through the log wait until the checkpoint is written, so it holds 
+ * exactly the changes logged so far; readers do not take the log's lock, and 
+ * in HASH_TABLE_CONCURRENT tables keep running. The committer thread calls 
+ * this on its own once the log grows past checkpoint_bytes.
+ *
+ * @param log The log.
+ * @return 0 on success, or 1 on failure (the previous checkpoint and log stay valid).
+ */
+int hash_log_checkpoint(HashLog *log) {
+    mtx_lock(&log->lock);
+    int result = checkpoint_locked(log);
+    mtx_unlock(&log->lock);
+    return result;
+}
+
+/**
+ * Writes a checkpoint and switches to an empty log.
+ *
+ * The snapshot goes to the temporary file, is synced and replaces the 
+ * checkpoint, and only then does a new log of the next generation replace 
+ * the old one. Pending records are dropped: the checkpoint holds them. If 
+ * the new log cannot be created the log fails, because changes appended to 
+ * the old one would be discarded by the next recovery.
+ *
+ * @param log The log (lock held).
+ * @return 0 on success, or 1 on failure.
+ */
+int checkpoint_locked(HashLog *log) {
+    while (log->syncing) {
+        cnd_wait(&log->changed, &log->lock);
+    }
+    if (log->failed) {
+        return 1;
+    }
+    uint32_t generation = log->generation + 1;
+    if (write_snapshot(log->table, log->temporary_path, generation, 1) != 0 ||
+        replace_file(log->temporary_path, log->snapshot_path) != 0) {
+        printf("Failed to write checkpoint %s\n", log->snapshot_path);
+        log->checkpoint_at = log->log_bytes + log->checkpoint_bytes;
+        return 1;
+    }
+    fclose(log->file);
+    log->file = create_log(log, generation);
+    if (log->file == NULL) {
+        log->failed = 1;
+        cnd_broadcast(&log->changed);
+        return 1;
+    }
+    log->generation = generation;
+    log->pending_size = 0;
+    log->durable = log->appended;
+    log->log_bytes = sizeof(LogHeader);
+    log->checkpoint_at = log->checkpoint_bytes;
+    cnd_broadcast(&log->changed);
+    return 0;
+}
+
+/**
+ * Syncs a log every commit interval and starts checkpoints.
+ *
+ * @param argument The HashLog.
+ * @return Always 0.
+ */
+int log_committer(void *argument) {
+    HashLog *log = (HashLog *)argument;
+    mtx_lock(&log->lock);
+    while (!log->closing) {
+        struct timespec until;
+        timespec_get(&until, TIME_UTC);
+        until.tv_sec += log->interval_ms / 1000;
+        until.tv_nsec += (long)(log->interval_ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        cnd_timedwait(&log->changed, &log->lock, &until);
+        if (log->pending_size > 0 && !log->syncing) {
+            sync_records(log, log->appended);
+        }
+        if (log->checkpoint_bytes != 0 && log->log_bytes >= log->checkpoint_at && !log->failed) {
+            checkpoint_locked(log);
+        }
+    }
+    mtx_unlock(&log->lock);
+    return 0;
+}
+
+/**
+ * Syncs the log, stops its committer thread and frees it. The table is left open.
+ *
+ * @param log The log to close. NULL is ignored.
+ * @return 0 on success, or 1 if the final sync failed.
+ */
+int hash_log_close(HashLog *log) {
+    if (log == NULL) return 0;
+    mtx_lock(&log->lock);
+    log->closing = 1;
+    cnd_broadcast(&log->changed);
+    mtx_unlock(&log->lock);
+    thrd_join(log->committer, NULL);
+
+    mtx_lock(&log->lock);
+    int result = sync_records(log, log->appended);
+    mtx_unlock(&log->lock);
+    cnd_destroy(&log->changed);
+    mtx_destroy(&log->lock);
+    discard_log(log);
+    return result;
+}
+
+/**
+ * Converts a table into a read-only compact form.
+ *
+ * The frozen form keeps the first-, second- and third-level dispatch of the 
+ * table's schema, but every third-level slot becomes a perfect hash over its 
+ * names, built by hash and displace: a seeded hash sends each name to one of 
+ * about count / FROZEN_BUCKET_SIZE buckets, and every bucket, largest first, 
+ * gets the first pilot (displacement) that moves all of its names to free 
+ * positions. One spare position per FROZEN_SPARE names keeps that search 
+ * short. A position holds the offset of its name in the string pool, so a 
+ * lookup hashes the name once and compares at most one string.
+ *
+ * Arrays of offsets replace the blocks, and everything (the dispatch records, 
+ * perfect hashes and names) is packed into a single allocation. Duplicate 
+ * names are stored once and values are not kept. The table is not changed and 
+ * can be destroyed afterwards; in HASH_TABLE_CONCURRENT tables all writer 
+ * locks are held while freezing.
+ *
+ * @param table The table to freeze.
+ * @return The frozen table, or NULL if memory allocation fails or the names 
+ *         exceed the 4 GB string pool limit.
+ */
+HashFrozen* hash_table_freeze(const HashTable *table) {
+    return hash_table_freeze_ex(table, 0);
+}
+
+/**
+ * Converts a table into a read-only compact form, like hash_table_freeze.
+ *
+ * With HASH_FROZEN_COMPACT_KEYS, the string pool holds each name without the 
+ * characters its slot already implies. A level implies a character when its 
+ * bucket holds a single letter: the first and third letters with the default 
+ * schema, and the second when it falls in one of the vowel buckets. All names 
+ * of a slot share those characters, so leaving them out keeps the slot's 
+ * order, and the perfect hash still runs over the full name. A lookup skips 
+ * the implied positions while comparing, and hash_frozen_iterate puts them 
+ * back. Names that reach a slot through a bucket shared by several letters 
+ * (the default schema's Misc bucket) keep that character.
+ *
+ * @param table The table to freeze.
+ * @param flags Bitwise OR of HASH_FROZEN_* flags, or 0.
+ * @return The frozen table, or NULL if memory allocation fails or the names 
+ *         exceed the 4 GB string pool limit.
+ */
+HashFrozen* hash_table_freeze_ex(const HashTable *table, unsigned int flags) {
+    char implied[HASH_SCHEMA_LEVELS][FIRST_LEVEL_SIZE];
+    FrozenSlot (*slots)[SECOND_LEVEL_SIZE][THIRD_LEVEL_SIZE] =
+        (FrozenSlot (*)[SECOND_LEVEL_SIZE][THIRD_LEVEL_SIZE])calloc(FIRST_LEVEL_SIZE, sizeof(*slots));
+    if (!slots) {
+        printf("Memory allocation failed for frozen table\n");
+        return NULL;
+    }
+    FreezeBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.schema = table->schema;
+    if (flags & HASH_FROZEN_COMPACT_KEYS) {
+        find_implied(table->schema, table->flags & KEY_MODE_FLAGS, implied);
+        builder.implied = (const char (*)[FIRST_LEVEL_SIZE])implied;
+    }
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+    }
+
+    int failed = 0;
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE && !failed; i++) {
+        HashBlocks *blocks = table->first_level[i];
+        for (unsigned int j = 0; blocks != NULL && j < SECOND_LEVEL_SIZE && !failed; j++) {
+            HashBlock *block = blocks->second_level[j];
+            for (unsigned int k = 0; block != NULL && k < THIRD_LEVEL_SIZE && !failed; k++) {
+                builder.slot_first = builder.name_count;
+                failed = visit_slot(table, block, k, collect_frozen_name, &builder) != 0 ||
+                         freeze_slot(&builder, &slots[i][j][k]) != 0;
+            }
+        }
+    }
+    HashFrozen *frozen = failed ? NULL : pack_frozen(table, &builder, slots);
+
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        unlock_stripe(table, i);
+    }
+    free(builder.names);
+    free(builder.positions);
+    free(builder.pilots);
+    free(builder.hashes);
+    free(builder.order);
+    free(builder.starts);
+    free(builder.ranked);
+    free(slots);
+    return frozen;
+}
+
+/**
+ * Visitor used by hash_table_freeze to collect the distinct names of a slot.
+ *
+ * Slots are visited in sorted order, so duplicates follow each other.
+ *
+ * @param name The stored name.
+ * @param context The FreezeBuilder.
+ * @return 0 to continue, or 1 if memory allocation fails.
+ */
+int collect_frozen_name(const char *name, void *context) {
+    FreezeBuilder *builder = (FreezeBuilder *)context;
+    if (builder->name_count > builder->slot_first &&
+        strcmp(builder->names[builder->name_count - 1], name) == 0) {
+        return 0;
+    }
+    const char **names = (const char **)grow_frozen((void *)builder->names, &builder->name_capacity,
+                                                    builder->name_count + 1, sizeof(*names));
+    if (names == NULL) {
+        return 1;
+    }
+    builder->names = names;
+    builder->names[builder->name_count++] = name;
+    builder->pool_bytes += strlen(name) + 1;
+    if (builder->implied != NULL) {
+        for (unsigned int mask = implied_mask(builder->schema, builder->implied, name); mask; mask &= mask - 1) {
+            builder->pool_bytes--;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Builds the perfect hash of the slot whose names were collected last.
+ *
+ * Every seed from 0 up is tried in turn; after FROZEN_SEED_TRIES failed seeds 
+ * the slot gets more spare positions. The positions and pilots are appended 
+ * to the builder's arrays.
+ *
+ * @param builder The builder; the slot's names start at slot_first.
+ * @param slot Receives the slot's perfect hash (all zero for an empty slot).
+ * @return 0 on success, or 1 if memory allocation fails or no seed works.
+ */
+int freeze_slot(FreezeBuilder *builder, FrozenSlot *slot) {
+    size_t count = builder->name_count - builder->slot_first;
+    memset(slot, 0, sizeof(*slot));
+    if (count == 0) return 0;
+
+    if (count + 1 > builder->scratch_capacity) {
+        size_t capacity = count + 1;
+        uint64_t *hashes = (uint64_t *)realloc(builder->hashes, capacity * sizeof(uint64_t));
+        if (hashes) builder->hashes = hashes;
+        uint32_t *order = (uint32_t *)realloc(builder->order, capacity * sizeof(uint32_t));
+        if (order) builder->order = order;
+        uint32_t *starts = (uint32_t *)realloc(builder->starts, capacity * sizeof(uint32_t));
+        if (starts) builder->starts = starts;
+        uint64_t *ranked = (uint64_t *)realloc(builder->ranked, capacity * sizeof(uint64_t));
+        if (ranked) builder->ranked = ranked;
+        if (!hashes || !order || !starts || !ranked) {
+            printf("Memory allocation failed for frozen table\n");
+            return 1;
+        }
+        builder->scratch_capacity = capacity;
+    }
+
+    slot->buckets = (uint32_t)((count + FROZEN_BUCKET_SIZE - 1) / FROZEN_BUCKET_SIZE);
+    uint16_t *pilots = (uint16_t *)grow_frozen(builder->pilots, &builder->pilot_capacity,
+                                               builder->pilot_count + slot->buckets, sizeof(uint16_t));
+    if (pilots == NULL) return 1;
+    builder->pilots = pilots;
+    slot->pilots = (uint32_t)builder->pilot_count;
+    slot->positions = (uint32_t)builder->position_count;
+
+    size_t size = count + count / FROZEN_SPARE;
+    for (unsigned int growth = 0; growth < FROZEN_GROWTHS; growth++) {
+        if (builder->position_count + size >= FROZEN_EMPTY) {
+            printf("Table too large to freeze\n");
+            return 1;
+        }
+        uint32_t *positions = (uint32_t *)grow_frozen(builder->positions, &builder->position_capacity,
+                                                      builder->position_count + size, sizeof(uint32_t));
+        if (positions == NULL) return 1;
+        builder->positions = positions;
+        slot->size = (uint32_t)size;
+        for (unsigned int seed = 0; seed < FROZEN_SEED_TRIES; seed++) {
+            slot->seed = growth * FROZEN_SEED_TRIES + seed;
+            if (place_frozen_buckets(builder, slot) == 0) {
+                builder->position_count += size;
+                builder->pilot_count += slot->buckets;
+                return 0;
+            }
+        }
+        size += size / FROZEN_SPARE + 1;
+    }
+    printf("Failed to build a perfect hash for %zu names\n", count);
+    return 1;
+}
+
+/**
+ * Tries to find a pilot for every bucket of a frozen slot.
+ *
+ * The names are hashed with the slot's seed and grouped by bucket with a 
+ * counting sort. Buckets are then placed largest first, while most positions 
+ * are still free: for each pilot in turn, the bucket's names are written to 
+ * the positions it selects until one is taken, in which case they are 
+ * cleared again and the next pilot is tried.
+ *
+ * @param builder The builder; the slot's names start at slot_first.
+ * @param slot The slot, with its seed, size, buckets and array starts set.
+ * @return 0 if every bucket was placed, or 1 if some bucket has no pilot that works.
+ */
+int place_frozen_buckets(FreezeBuilder *builder, const FrozenSlot *slot) {
+    size_t first = builder->slot_first;
+    uint32_t count = (uint32_t)(builder->name_count - first);
+    uint32_t *positions = builder->positions + slot->positions;
+    uint16_t *pilots = builder->pilots + slot->pilots;
+    uint64_t *hashes = builder->hashes;
+    uint32_t *order = builder->order;
+    uint32_t *starts = builder->starts;
+    uint64_t *ranked = builder->ranked;
+
+    // Group the names by bucket
+    memset(starts, 0, (slot->buckets + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        const char *name = builder->names[first + i];
+        hashes[i] = frozen_hash(name, strlen(name), slot->seed);
+        starts[frozen_bucket(hashes[i], slot->buckets) + 1]++;
+    }
+    for (uint32_t b = 0; b < slot->buckets; b++) {
+        starts[b + 1] += starts[b];
+        ranked[b] = starts[b];
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        order[ranked[frozen_bucket(hashes[i], slot->buckets)]++] = i;
+    }
+    for (uint32_t b = 0; b < slot->buckets; b++) {
+        ranked[b] = ((uint64_t)(starts[b + 1] - starts[b]) << 32) | b;
+    }
+    qsort(ranked, slot->buckets, sizeof(uint64_t), compare_ranked);
+
+    for (uint32_t p = 0; p < slot->size; p++) {
+        positions[p] = FROZEN_EMPTY;
+    }
+    for (uint32_t r = 0; r < slot->buckets; r++) {
+        uint32_t b = (uint32_t)ranked[r];
+        uint32_t begin = starts[b], end = starts[b + 1];
+        uint32_t pilot = 0;
+        for (; begin < end && pilot <= UINT16_MAX; pilot++) {
+            uint32_t placed = begin;
+            while (placed < end) {
+                uint32_t p = frozen_position(hashes[order[placed]], (uint16_t)pilot, slot->size);
+                if (positions[p] != FROZEN_EMPTY) break;
+                positions[p] = (uint32_t)(first + order[placed]);
+                placed++;
+            }
+            if (placed == end) break;
+            for (uint32_t i = begin; i < placed; i++) {
+                positions[frozen_position(hashes[order[i]], (uint16_t)pilot, slot->size)] = FROZEN_EMPTY;
+            }
+        }
+        if (pilot > UINT16_MAX) return 1;
+        pilots[b] = (uint16_t)(begin < end ? pilot : 0);
+    }
+    return 0;
+}
+
+/**
+ * Grows an array of the freeze builder to hold at least the given number of entries.
+ *
+ * @param array The array (may be NULL).
+ * @param capacity The allocated entries; updated when the array grows.
+ * @param needed The number of entries required.
+ * @param entry_size The size of one entry.
+ * @return The array, possibly moved, or NULL if memory allocation fails 
+ *         (the original array is left untouched).
+ */
+void* grow_frozen(void *array, size_t *capacity, size_t needed, size_t entry_size) {
+    if (needed <= *capacity) return array;
+    size_t grown = *capacity ? *capacity : 1024;
+    while (grown < needed) grown *= 2;
+    void *resized = realloc(array, grown * entry_size);
+    if (!resized) {
+        printf("Memory allocation failed for frozen table\n");
+        return NULL;
+    }
+    *capacity = grown;
+    return resized;
+}
+
+/**
+ * Copies the built perfect hashes and names into one allocation.
+ *
+ * Only the HashBlocks and HashBlock structures that hold names get a record. 
+ * The allocation holds, in order: the HashFrozen head with the first level, 
+ * the second-level records, the slot records, the positions, the pilots and 
+ * the string pool, so each array stays aligned for its type.
+ *
+ * @param table The table being frozen.
+ * @param builder The builder holding every slot's names, positions and pilots.
+ * @param slots The perfect hash of every third-level slot of the table.
+ * @return The frozen table, or NULL if memory allocation fails or the pool is too large.
+ */
+HashFrozen* pack_frozen(const HashTable *table, const FreezeBuilder *builder,
+                        FrozenSlot (*slots)[SECOND_LEVEL_SIZE][THIRD_LEVEL_SIZE]) {
+    if (builder->pool_bytes >= FROZEN_EMPTY) {
+        printf("Table too large to freeze\n");
+        return NULL;
+    }
+
+    // Number the records of the blocks that hold names
+    uint32_t first_level[FIRST_LEVEL_SIZE] = { 0 };
+    uint32_t second_level[FIRST_LEVEL_SIZE][SECOND_LEVEL_SIZE] = { { 0 } };
+    size_t blocks_records = 0, block_records = 0;
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+                if (slots[i][j][k].size != 0) {
+                    second_level[i][j] = (uint32_t)++block_records;
+                    break;
+                }
+            }
+            if (second_level[i][j] != 0 && first_level[i] == 0) {
+                first_level[i] = (uint32_t)++blocks_records;
+            }
+        }
+    }
+
+    size_t second_offset = sizeof(HashFrozen);
+    size_t slots_offset = second_offset + blocks_records * sizeof(uint32_t[SECOND_LEVEL_SIZE]);
+    size_t positions_offset = slots_offset + block_records * sizeof(FrozenSlot[THIRD_LEVEL_SIZE]);
+    size_t pilots_offset = positions_offset + builder->position_count * sizeof(uint32_t);
+    size_t pool_offset = pilots_offset + builder->pilot_count * sizeof(uint16_t);
+    size_t bytes = pool_offset + builder->pool_bytes;
+    unsigned char *base = (unsigned char *)malloc(bytes);
+    uint32_t *offsets = (uint32_t *)malloc((builder->name_count ? builder->name_count : 1) * sizeof(uint32_t));
+    if (!base || !offsets) {
+        printf("Memory allocation failed for frozen table\n");
+        free(base);
+        free(offsets);
+        return NULL;
+    }
+
+    HashFrozen *frozen = (HashFrozen *)base;
+    frozen->schema = *table->schema;
+    frozen->levels = table->schema == &default_schema ? &default_schema : &frozen->schema;
+    frozen->flags = builder->implied != NULL ? HASH_FROZEN_COMPACT_KEYS : 0;
+    frozen->key_flags = table->flags & KEY_MODE_FLAGS;
+    if (builder->implied != NULL) {
+        memcpy(frozen->implied, builder->implied, sizeof(frozen->implied));
+    } else {
+        memset(frozen->implied, 0, sizeof(frozen->implied));
+    }
+    frozen->bytes = bytes;
+    frozen->name_count = builder->name_count;
+    memcpy(frozen->first_level, first_level, sizeof(first_level));
+    uint32_t (*second_records)[SECOND_LEVEL_SIZE] = (uint32_t (*)[SECOND_LEVEL_SIZE])(base + second_offset);
+    FrozenSlot (*slot_records)[THIRD_LEVEL_SIZE] = (FrozenSlot (*)[THIRD_LEVEL_SIZE])(base + slots_offset);
+    uint32_t *positions = (uint32_t *)(base + positions_offset);
+    char *pool = (char *)(base + pool_offset);
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        if (first_level[i] == 0) continue;
+        memcpy(second_records[first_level[i] - 1], second_level[i], sizeof(second_level[i]));
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+            if (second_level[i][j] != 0) {
+                memcpy(slot_records[second_level[i][j] - 1], slots[i][j], sizeof(slots[i][j]));
+            }
+        }
+    }
+
+    // Names (or compact keys) in slot order, then the positions as pool offsets
+    size_t used = 0;
+    for (size_t n = 0; n < builder->name_count; n++) {
+        const char *name = builder->names[n];
+        offsets[n] = (uint32_t)used;
+        if (builder->implied == NULL) {
+            size_t size = strlen(name) + 1;
+            memcpy(pool + used, name, size);
+            used += size;
+            continue;
+        }
+        unsigned int mask = implied_mask(builder->schema, builder->implied, name);
+        size_t c = 0;
+        for (; c <= HASH_SCHEMA_MAX_POSITION && name[c] != '\0'; c++) {
+            if (((mask >> c) & 1) == 0) pool[used++] = name[c];
+        }
+        size_t size = strlen(name + c) + 1;
+        memcpy(pool + used, name + c, size);
+        used += size;
+    }
+    for (size_t p = 0; p < builder->position_count; p++) {
+        uint32_t name = builder->positions[p];
+        positions[p] = name == FROZEN_EMPTY ? FROZEN_EMPTY : offsets[name];
+    }
+    if (builder->pilot_count > 0) {
+        memcpy(base + pilots_offset, builder->pilots, builder->pilot_count * sizeof(uint16_t));
+    }
+    free(offsets);
+
+    frozen->second_level = (const uint32_t (*)[SECOND_LEVEL_SIZE])second_records;
+    frozen->slots = (const FrozenSlot (*)[THIRD_LEVEL_SIZE])slot_records;
+    frozen->positions = positions;
+    frozen->pilots = (const uint16_t *)(base + pilots_offset);
+    frozen->pool = pool;
+    return frozen;
+}
+
+/**
+ * Looks up a name in a frozen table, normalizing it like hash_table_lookup.
+ *
+ * @param frozen The frozen table to search.
+ * @param input_name The name to search for.
+ * @return The stored name inside the frozen table, valid until hash_frozen_free, 
+ *         or NULL if the name is not found or is invalid.
+ */
+const char* hash_frozen_lookup(const HashFrozen *frozen, const char *input_name) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+
+    // Convert to uppercase characters
+    if (normalize_name(frozen->key_flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return NULL;
+    }
+
+    const char *result = find_frozen(frozen, name, length);
+    release_name(name, buffer);
+    return result;
+}
+
+/**
+ * Looks up a normalized name in a frozen table.
+ *
+ * The three levels select the slot record, the name's hash selects a bucket, 
+ * and the bucket's pilot selects the one position the name can be at. Only 
+ * the name found there is compared.
+ *
+ * @param frozen The frozen table to search.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The stored name, or NULL if not found.
+ */
+const char* find_frozen(const HashFrozen *frozen, const char *name, size_t length) {
+    uint32_t blocks = frozen->first_level[schema_index(frozen->levels, 0, name)];
+    if (blocks == 0) return NULL;
+    uint32_t block = frozen->second_level[blocks - 1][schema_index(frozen->levels, 1, name)];
+    if (block == 0) return NULL;
+    const FrozenSlot *slot = &frozen->slots[block - 1][schema_index(frozen->levels, 2, name)];
+    if (slot->size == 0) return NULL;
+
+    uint64_t hash = frozen_hash(name, length, slot->seed);
+    uint16_t pilot = frozen->pilots[slot->pilots + frozen_bucket(hash, slot->buckets)];
+    uint32_t offset = frozen->positions[slot->positions + frozen_position(hash, pilot, slot->size)];
+    if (offset == FROZEN_EMPTY) return NULL;
+    const char *candidate = frozen->pool + offset;
+    if (frozen->flags & HASH_FROZEN_COMPACT_KEYS) {
+        unsigned int mask = implied_mask(&frozen->schema, (const char (*)[FIRST_LEVEL_SIZE])frozen->implied, name);
+        return compact_key_equals(candidate, name, mask) ? candidate : NULL;
+    }
+    return strcmp(candidate, name) == 0 ? candidate : NULL;
+}
+
+/**
+ * Finds the character that each bucket of a schema implies.
+ *
+ * A bucket implies a character when it is the only one that the level maps 
+ * to it: every name that reaches the bucket then has this character at the 
+ * level's position. The terminator is counted only for positions at or past 
+ * MIN_NAME_LENGTH, since no name ends before them. Names of tables with a 
+ * UTF-8 key mode may hold any byte but 0, so every byte is counted for them.
+ *
+ * @param schema The level schema.
+ * @param key_flags The key mode flags of the table (HASH_TABLE_UTF8, HASH_TABLE_FOLD_ACCENTS).
+ * @param implied Receives, per level and bucket, the implied character or 0.
+ */
+void find_implied(const HashSchema *schema, unsigned int key_flags, char implied[HASH_SCHEMA_LEVELS][FIRST_LEVEL_SIZE]) {
+    int first = key_flags ? 1 : 'A', last = key_flags ? 255 : 'Z';
+    for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+        unsigned int counts[FIRST_LEVEL_SIZE] = { 0 };
+        memset(implied[level], 0, FIRST_LEVEL_SIZE);
+        if (schema->positions[level] >= MIN_NAME_LENGTH) {
+            counts[schema->buckets[level][0]]++; // Shorter names may end here
+        }
+        for (int c = first; c <= last; c++) {
+            unsigned int bucket = schema->buckets[level][c];
+            if (counts[bucket]++ == 0) implied[level][bucket] = (char)c;
+        }
+        for (unsigned int bucket = 0; bucket < FIRST_LEVEL_SIZE; bucket++) {
+            if (counts[bucket] != 1) implied[level][bucket] = 0;
+        }
+    }
+}
+
+/**
+ * Returns the positions of a name that its slot implies.
+ *
+ * @param schema The level schema.
+ * @param implied The letters found by find_implied.
+ * @param name The normalized name.
+ * @return A mask with bit p set when the character at position p is implied.
+ */
+unsigned int implied_mask(const HashSchema *schema, const char (*implied)[FIRST_LEVEL_SIZE], const char *name) {
+    unsigned int mask = 0;
+    for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+        if (implied[level][schema_index(schema, level, name)] != 0) {
+            mask |= 1u << schema->positions[level];
+        }
+    }
+    return mask;
+}
+
+/**
+ * Compares a compact frozen key with a normalized name of the same slot.
+ *
+ * @param key The stored key, without the implied characters.
+ * @param name The normalized name.
+ * @param mask The positions of name its slot implies (see implied_mask).
+ * @return Non-zero if the key is the name's.
+ */
+int compact_key_equals(const char *key, const char *name, unsigned int mask) {
+    size_t c = 0;
+    for (; c <= HASH_SCHEMA_MAX_POSITION; c++) {
+        if ((mask >> c) & 1) continue;
+        if (*key != name[c]) return 0;
+        if (*key++ == '\0') return 1;
+    }
+    return strcmp(key, name + c) == 0;
+}
+
+/**
+ * Hashes a normalized name for a frozen slot.
+ *
+ * FNV-1a over the name, started from the seed, followed by the splitmix64 
+ * finalizer so that the last characters reach the high bits too.
+ *
+ * @param name The normalized name.
+ * @param length The length of name.
+ * @param seed The slot's seed.
+ * @return The 64-bit hash.
+ */
+uint64_t frozen_hash(const char *name, size_t length, uint32_t seed) {
+    uint64_t hash = 14695981039346656037ull ^ ((uint64_t)seed * 0x9E3779B97F4A7C15ull);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ull;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * Returns the bucket of a frozen slot that a hash falls into.
+ *
+ * @param hash The name's hash.
+ * @param buckets The slot's number of buckets.
+ * @return The bucket, from the high half of the hash.
+ */
+uint32_t frozen_bucket(uint64_t hash, uint32_t buckets) {
+    return (uint32_t)(((hash >> 32) * buckets) >> 32);
+}
+
+/**
+ * Returns the position of a frozen slot that a hash and pilot select.
+ *
+ * The pilot is mixed into the hash with a multiplication, so that every bit 
+ * of the hash reaches the high half, which is then scaled to the slot size. 
+ * A plain XOR of the pilot would move two names together whenever their 
+ * hashes agree in the bits the size keeps.
+ *
+ * @param hash The name's hash.
+ * @param pilot The pilot of the name's bucket.
+ * @param size The slot's number of positions.
+ * @return The position.
+ */
+uint32_t frozen_position(uint64_t hash, uint16_t pilot, uint32_t size) {
+    uint64_t mixed = (hash ^ ((uint64_t)(pilot + 1) * 0x9E3779B97F4A7C15ull)) * 0xD6E8FEB86659FD93ull;
+    return (uint32_t)(((mixed >> 32) * size) >> 32);
+}
+
+/**
+ * Orders the ranked buckets of a frozen slot for qsort, largest first.
+ *
+ * @param a The first bucket (size in the high half, index in the low half).
+ * @param b The second bucket.
+ * @return A negative, zero or positive value.
+ */
+int compare_ranked(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x < y) - (x > y);
+}
+
+/**
+ * Returns the number of distinct names stored in a frozen table.
+ *
+ * @param frozen The frozen table.
+ * @return The number of names.
+ */
+size_t hash_frozen_count(const HashFrozen *frozen) {
+    return frozen->name_count;
+}
+
+/**
+ * Visits every name of a frozen table, slot by slot.
+ *
+ * Within a slot names come in position order, which is not sorted. Compact 
+ * keys are expanded into a buffer with the characters their slot implies 
+ * before the visitor sees them.
+ *
+ * @param frozen The frozen table to walk.
+ * @param visitor The callback invoked for each name.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every name was visited, the non-zero value returned by the 
+ *         visitor that stopped the walk, or -1 if memory allocation fails.
+ */
+int hash_frozen_iterate(const HashFrozen *frozen, HashTableVisitor visitor, void *context) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = buffer;
+    size_t name_size = sizeof(buffer);
+    int result = 0;
+
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE && result == 0; i++) {
+        if (frozen->first_level[i] == 0) continue;
+        const uint32_t *second_level = frozen->second_level[frozen->first_level[i] - 1];
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE && result == 0; j++) {
+            if (second_level[j] == 0) continue;
+            const FrozenSlot *slots = frozen->slots[second_level[j] - 1];
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE && result == 0; k++) {
+                // Letters the slot implies, by position
+                char letters[HASH_SCHEMA_MAX_POSITION + 1];
+                unsigned int buckets[HASH_SCHEMA_LEVELS] = { i, j, k };
+                unsigned int mask = 0;
+                for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+                    char letter = frozen->implied[level][buckets[level]];
+                    if (letter != 0) {
+                        letters[frozen->schema.positions[level]] = letter;
+                        mask |= 1u << frozen->schema.positions[level];
+                    }
+                }
+
+                const uint32_t *positions = frozen->positions + slots[k].positions;
+                for (uint32_t p = 0; p < slots[k].size && result == 0; p++) {
+                    if (positions[p] == FROZEN_EMPTY) continue;
+                    const char *key = frozen->pool + positions[p];
+                    if (mask == 0) {
+                        result = visitor(key, context);
+                        continue;
+                    }
+
+                    size_t size = strlen(key) + HASH_SCHEMA_MAX_POSITION + 2;
+                    if (size > name_size) {
+                        char *grown = (char *)(name == buffer ? malloc(size) : realloc(name, size));
+                        if (!grown) {
+                            printf("Memory allocation failed for frozen name\n");
+                            result = -1;
+                            break;
+                        }
+                        name = grown;
+                        name_size = size;
+                    }
+                    size_t c = 0;
+                    for (; c <= HASH_SCHEMA_MAX_POSITION; c++) {
+                        if ((mask >> c) & 1) {
+                            name[c] = letters[c];
+                        } else if ((name[c] = *key++) == '\0') {
+                            break;
+                        }
+                    }
+                    if (c > HASH_SCHEMA_MAX_POSITION) strcpy(name + c, key);
+                    result = visitor(name, context);
+                }
+            }
+        }
+    }
+
+    if (name != buffer) free(name);
+    return result;
+}
+
+/**
+ * Returns the size of a frozen table's single allocation.
+ *
+ * @param frozen The frozen table.
+ * @return The number of bytes, including the names.
+ */
+size_t hash_frozen_bytes(const HashFrozen *frozen) {
+    return frozen->bytes;
+}
+
+/**
+ * Frees a frozen table made by hash_table_freeze. Passing NULL is a no-op.
+ *
+ * @param frozen The frozen table to free.
+ */
+void hash_frozen_free(HashFrozen *frozen) {
+    free(frozen);
+}
+
+/**
+ * Maps a normalized name to its bucket at one level of a schema.
+ *
+ * The level reads one character of the name and looks it up in the level's 
+ * bucket map. Every valid name has three characters; a level reading further 
+ * into a shorter name uses the bucket of the terminator. With the default 
+ * schema this is the letter index (A-Z = 0-25) at the first and third levels 
+ * and the vowel bucket (A, E, I, O, U, Y = 0-5, other letters 6) at the 
+ * second. Every byte that is not a letter, the terminator included, maps to 
+ * bucket 0 at each level, the bucket of 'A'.
+ *
+ * @param schema The level schema.
+ * @param level The level (0, 1 or 2).
+ * @param name The normalized (uppercase) name.
+ * @return The bucket index within the level.
+ */
+unsigned int level_index(const HashSchema *schema, unsigned int level, const char *name) {
+    unsigned int position = schema->positions[level];
+    for (unsigned int i = 3; i < position; i++) {
+        if (name[i] == '\0') return schema->buckets[level][0];
+    }
+    return schema->buckets[level][(unsigned char)name[position]];
+}
+
+/**
+ * Checks that a schema can be used by a table or snapshot.
+ *
+ * Every level must read one of the first HASH_SCHEMA_MAX_POSITION + 1 
+ * characters and map every byte to a bucket inside the level.
+ *
+ * @param schema The schema to check.
+ * @return 0 if the schema is valid, or 1 otherwise.
+ */
+int check_schema(const HashSchema *schema) {
+    for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+        if (schema->positions[level] > HASH_SCHEMA_MAX_POSITION) return 1;
+        for (unsigned int c = 0; c < 256; c++) {
+            if (schema->buckets[level][c] >= level_sizes[level]) return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the schema used by tables created without one.
+ *
+ * @return The default schema (first letter, vowel bucket, third letter).
+ */
+const HashSchema* hash_schema_default(void) {
+    return &default_schema;
+}
+
+/**
+ * Returns the level schema of a table.
+ *
+ * @param table The table.
+ * @return The schema, owned by the table.
+ */
+const HashSchema* hash_table_schema(const HashTable *table) {
+    return table->schema;
+}
+
+/**
+ * Derives a level schema that balances bucket occupancy for a sample of keys.
+ *
+ * The levels are chosen top down. For each level every character position 
+ * not used by the levels above is tried: derive_level maps its characters to 
+ * buckets, and the position whose map leaves the sample keys in the smallest 
+ * sum of squared bucket occupancies (which the expected chain length grows 
+ * with) is kept. The default schema's vowel level sends every consonant to 
+ * one bucket and names with a common prefix all share a slot, which is what 
+ * makes its chains long on data such as street names.
+ *
+ * The sample is normalized as in a HASH_TABLE_UTF8 table, so the same 
+ * schema serves letter-only and UTF-8 tables. Invalid names in the sample 
+ * are reported and skipped.
+ *
+ * @param names The sample names.
+ * @param count The number of names.
+ * @param schema Receives the derived schema.
+ * @return 0 on success, or 1 if the sample holds no valid name or memory allocation fails.
+ */
+int hash_schema_from_sample(const char *const *names, size_t count, HashSchema *schema) {
+    SchemaKey *keys = (SchemaKey *)malloc((count ? count : 1) * sizeof(SchemaKey));
+    SchemaCounts *counts = (SchemaCounts *)malloc(sizeof(SchemaCounts));
+    if (!keys || !counts) {
+        printf("Memory allocation failed for schema sample\n");
+        free(keys);
+        free(counts);
+        return 1;
+    }
+
+    // Keep the characters a schema can read; shorter names are padded with terminators
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        char buffer[NAME_BUFFER_SIZE];
+        char *name = NULL;
+        size_t length = 0;
+        if (normalize_name(HASH_TABLE_UTF8, names[i], buffer, sizeof(buffer), &name, &length) != 0) {
+            continue;
+        }
+        memset(keys[valid].characters, 0, sizeof(keys[valid].characters));
+        memcpy(keys[valid].characters, name, length < SCHEMA_POSITIONS ? length : SCHEMA_POSITIONS);
+        valid++;
+        release_name(name, buffer);
+    }
+    if (valid == 0) {
+        printf("No valid names in the schema sample\n");
+        free(keys);
+        free(counts);
+        return 1;
+    }
+
+    memset(schema, 0, sizeof(*schema));
+    int used[SCHEMA_POSITIONS] = { 0 };
+    for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+        HashSchema candidate = *schema;
+        double best = -1;
+        for (unsigned int position = 0; position < SCHEMA_POSITIONS; position++) {
+            if (used[position]) continue;
+            double cost = derive_level(keys, valid, level, position, counts, &candidate);
+            if (best < 0 || cost < best) {
+                best = cost;
+                schema->positions[level] = (unsigned char)position;
+                memcpy(schema->buckets[level], candidate.buckets[level], sizeof(schema->buckets[level]));
+            }
+        }
+        used[schema->positions[level]] = 1;
+    }
+    free(keys);
+    free(counts);
+    return 0;
+}
+
+/**
+ * Derives a level schema from a file with one name per line.
+ *
+ * @param path The sample file.
+ * @param schema Receives the derived schema.
+ * @return 0 on success, or 1 if the file cannot be read or holds no valid name.
+ */
+int hash_schema_from_file(const char *path, HashSchema *schema) {
+    const char **names = NULL;
+    size_t count = 0;
+    char *text = read_lines(path, &names, &count);
+    if (text == NULL) {
+        return 1;
+    }
+    int result = hash_schema_from_sample(names, count, schema);
+    free(names);
+    free(text);
+    return result;
+}
+
+/**
+ * Maps the characters one level of a schema reads to balanced buckets.
+ *
+ * The keys are grouped by the buckets they reached on the levels above, 
+ * which the schema already holds. Characters (the 26 letters, the end of the 
+ * name and any other byte the sample holds, such as the bytes of UTF-8 
+ * letters) are placed greedily, most frequent first, into the bucket that 
+ * adds the least to the sum of squared group-and-bucket occupancies. 
+ * Ties, such as letters missing from the sample, go to the emptiest 
+ * bucket, and bytes the sample lacks map to bucket 0.
+ *
+ * @param keys The sample keys.
+ * @param count The number of keys.
+ * @param level The level to map.
+ * @param position The character position the level reads.
+ * @param counts Scratch space for the occupancy counts.
+ * @param schema The schema; the levels above are read and the level's buckets are written.
+ * @return The sum of squared group-and-bucket occupancies after the level.
+ */
+double derive_level(const SchemaKey *keys, size_t count, unsigned int level, unsigned int position,
+                    SchemaCounts *counts, HashSchema *schema) {
+    memset(counts, 0, sizeof(*counts));
+    memset(schema->buckets[level], 0, sizeof(schema->buckets[level]));
+    size_t totals[SCHEMA_SYMBOLS] = { 0 }, bucket_totals[THIRD_LEVEL_SIZE] = { 0 };
+    unsigned int bucket_symbols[THIRD_LEVEL_SIZE] = { 0 };
+    for (size_t i = 0; i < count; i++) {
+        unsigned int group = 0;
+        for (unsigned int above = 0; above < level; above++) {
+            unsigned char c = keys[i].characters[schema->positions[above]];
+            group = group * level_sizes[above] + schema->buckets[above][c];
+        }
+        unsigned char c = keys[i].characters[position];
+        counts->frequencies[group][c]++;
+        totals[c]++;
+    }
+
+    // Letters and the end of the name are always placed, in this order on ties;
+    // other bytes only when the sample holds them
+    unsigned char order[SCHEMA_SYMBOLS];
+    unsigned int symbols = 0;
+    for (int c = 'A'; c <= 'Z'; c++) {
+        order[symbols++] = (unsigned char)c;
+    }
+    order[symbols++] = '\0';
+    for (unsigned int c = 1; c < SCHEMA_SYMBOLS; c++) {
+        if (totals[c] > 0 && (c < 'A' || c > 'Z')) order[symbols++] = (unsigned char)c;
+    }
+
+    double cost = 0;
+    int placed[SCHEMA_SYMBOLS] = { 0 };
+    for (unsigned int n = 0; n < symbols; n++) {
+        unsigned int next = 0;
+        for (unsigned int s = 1; s < symbols; s++) {
+            if (placed[next] || (!placed[s] && totals[order[s]] > totals[order[next]])) next = s;
+        }
+        placed[next] = 1;
+        unsigned int symbol = order[next];
+
+        unsigned int best = 0;
+        size_t best_cost = SIZE_MAX;
+        for (unsigned int bucket = 0; bucket < level_sizes[level]; bucket++) {
+            size_t added = 0;
+            for (unsigned int group = 0; group < SCHEMA_GROUPS; group++) {
+                size_t f = counts->frequencies[group][symbol];
+                added += f * (2 * counts->loads[group][bucket] + f);
+            }
+            if (added < best_cost ||
+                (added == best_cost && (bucket_totals[bucket] < bucket_totals[best] ||
+                                        (bucket_totals[bucket] == bucket_totals[best] &&
+                                         bucket_symbols[bucket] < bucket_symbols[best])))) {
+                best = bucket;
+                best_cost = added;
+            }
+        }
+        for (unsigned int group = 0; group < SCHEMA_GROUPS; group++) {
+            counts->loads[group][best] += counts->frequencies[group][symbol];
+        }
+        bucket_totals[best] += totals[symbol];
+        bucket_symbols[best]++;
+        cost += (double)best_cost;
+        schema->buckets[level][symbol] = (unsigned char)best;
+    }
+    return cost;
+}
+
+/**
+ * Writes the label of a bucket: the letters that map to it, "Default" when 
+ * more than half of the alphabet does, or "End" when only the end of shorter 
+ * names does.
+ *
+ * @param schema The schema.
+ * @param level The level of the bucket.
+ * @param bucket The bucket.
+ * @param label Receives the label; at least 27 bytes.
+ */
+void schema_label(const HashSchema *schema, unsigned int level, unsigned int bucket, char *label) {
+    size_t length = 0;
+    for (char c = 'A'; c <= 'Z'; c++) {
+        if (schema->buckets[level][(unsigned char)c] == bucket) label[length++] = c;
+    }
+    label[length] = '\0';
+    if (length > 13) strcpy(label, "Default");
+    if (length == 0) strcpy(label, "End");
+}
+
+/**
+ * Prints a schema as a C initializer.
+ *
+ * The output compiles to a constant HashSchema, so a schema derived from a 
+ * profile can be built into a program and passed in HashTableOptions without 
+ * sampling at startup. Buckets of 0 are left out.
+ *
+ * @param schema The schema to print.
+ * @param name The name of the generated variable.
+ */
+void print_hash_schema(const HashSchema *schema, const char *name) {
+    printf("static const HashSchema %s = {\n", name);
+    printf("    { %u, %u, %u },\n", schema->positions[0], schema->positions[1], schema->positions[2]);
+    printf("    {\n");
+    for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+        printf("        {");
+        unsigned int written = 0;
+        for (unsigned int c = 0; c < 256; c++) {
+            if (schema->buckets[level][c] == 0) continue;
+            if (written % 8 == 0) printf("\n           ");
+            if (isalpha(c)) {
+                printf(" ['%c'] = %u,", (char)c, schema->buckets[level][c]);
+            } else {
+                printf(" [0x%02x] = %u,", c, schema->buckets[level][c]);
+            }
+            written++;
+        }
+        printf("\n        },\n");
+    }
+    printf("    }\n};\n");
+}
+
+/**
+ * Creates a new linked list node for storing a name.
+ *
+ * This function allocates memory for a new Node structure, initializes it with 
+ * the provided name, and sets the next pointer to NULL. The node gets its own 
+ * copy of the name.
+ *
+ * - In HASH_TABLE_ARENA mode the node comes from the table's free list or node 
+ *   pages, and the name is copied into the table's string pages.
+ * - Otherwise the Node and its name are allocated with malloc.
+ * - If memory allocation for the Node or its name fails, an error message is 
+ *   printed, and NULL is returned to indicate failure.
+ * - The node must be released with free_node when it is no longer needed.
+ *
+ * @param table The table that will own the node.
+ * @param name The name to be stored in the new node.
+ * @param length The length of name, excluding the terminator.
+ * @return A pointer to the newly created Node, or NULL if memory allocation fails.
+ */
+Node* create_node(HashTable *table, const char *name, size_t length) {
+    Node *new_node;
+    char *copy;
+
+    if (table->flags & HASH_TABLE_ARENA) {
+        Arena *arena = &table->arena;
+        if (arena->free_nodes != NULL) {
+            new_node = arena->free_nodes;
+            arena->free_nodes = new_node->next;
+        } else {
+            new_node = (Node *)arena_alloc(arena, &arena->node_pages, sizeof(Node), _Alignof(Node));
+        }
+        copy = new_node ? (char *)arena_alloc(arena, &arena->name_pages, length + 1, 1) : NULL;
+        if (!new_node || !copy) {
+            printf("Memory allocation failed for arena page\n");
+            if (new_node) {
+                new_node->next = arena->free_nodes;
+                arena->free_nodes = new_node;
+            }
+            return NULL;
+        }
+    } else {
+        new_node = (Node *)malloc(sizeof(Node));
+        if (!new_node) {
+            printf("Memory allocation failed for Node\n");
+            return NULL;
+        }
+        copy = (char *)malloc(length + 1);
+        if (!copy) {
+            printf("Memory allocation failed for name\n");
+            free(new_node);
+            return NULL;
+        }
+    }
+
+    memcpy(copy, name, length + 1);
+    new_node->name = copy;
+    new_node->next = NULL;
+    new_node->value = NULL;
+    return new_node;
+}
+
+/**
+ * Releases a node created with create_node.
+ *
+ * In HASH_TABLE_ARENA mode the node is pushed onto the table's free list for 
+ * reuse, while the bytes of its name stay in the string pages until the table 
+ * is cleared. In HASH_TABLE_CONCURRENT mode readers may still be walking 
+ * over the node, so it is retired and freed later. Otherwise the node and its 
+ * name are freed immediately.
+ *
+ * @param table The table that owns the node.
+ * @param node The node to release.
+ */
+void free_node(HashTable *table, Node *node) {
+    if (table->flags & HASH_TABLE_CONCURRENT) {
+        retire_node(table, node);
+        return;
+    }
+    if (table->flags & HASH_TABLE_ARENA) {
+        node->name = NULL;
+        node->next = table->arena.free_nodes;
+        table->arena.free_nodes = node;
+        return;
+    }
+    free(node->name);
+    free(node);
+}
+
+/**
+ * Hands out memory from one of an arena's page lists.
+ *
+ * Allocations are carved from the head page of the list with a bump pointer. 
+ * When the head page is full a new page is pushed in front of it. Requests 
+ * larger than a quarter page get a dedicated page that is linked behind the 
+ * head, so the partially used head page keeps serving small requests.
+ *
+ * @param arena The arena that owns the pages.
+ * @param pages The page list to allocate from (node pages or name pages).
+ * @param size The number of bytes needed.
+ * @param align The required alignment (a power of two).
+ * @return A pointer to the memory, or NULL if a new page could not be allocated.
+ */
+void* arena_alloc(Arena *arena, ArenaPage **pages, size_t size, size_t align) {
+    ArenaPage *page = *pages;
+    if (page != NULL) {
+        size_t offset = (page->used + align - 1) & ~(align - 1);
+        if (offset + size <= page->size) {
+            page->used = offset + size;
+            return page->data + offset;
+        }
+    }
+
+    int dedicated = size > ARENA_PAGE_SIZE / 4;
+    size_t page_size = dedicated ? size : ARENA_PAGE_SIZE;
+    ArenaPage *fresh = (ArenaPage *)malloc(sizeof(ArenaPage) + page_size);
+    if (!fresh) {
+        return NULL;
+    }
+    fresh->size = page_size;
+    fresh->used = size;
+    if (dedicated && page != NULL) {
+        fresh->next = page->next;
+        page->next = fresh;
+    } else {
+        fresh->next = page;
+        *pages = fresh;
+    }
+    arena->page_count++;
+    arena->reserved_bytes += sizeof(ArenaPage) + page_size;
+    return fresh->data;
+}
+
+/**
+ * Frees every page owned by an arena and resets it to the empty state.
+ *
+ * This is O(pages): the nodes and names carved from the pages are released 
+ * together with them.
+ *
+ * @param arena The arena to free.
+ */
+void free_arena(Arena *arena) {
+    ArenaPage *lists[2] = { arena->node_pages, arena->name_pages };
+    for (int i = 0; i < 2; i++) {
+        ArenaPage *page = lists[i];
+        while (page != NULL) {
+            ArenaPage *tmp = page;
+            page = page->next;
+            free(tmp);
+        }
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * Moves every page and free node of one arena into another.
+ *
+ * The pages of from are linked in behind the head pages of into, so into 
+ * keeps filling the pages it was filling before. Used by hash_table_build to 
+ * hand the workers' private arenas to the table. from is left empty.
+ *
+ * @param into The arena that takes ownership.
+ * @param from The arena to empty.
+ */
+void merge_arena(Arena *into, Arena *from) {
+    ArenaPage **targets[2] = { &into->node_pages, &into->name_pages };
+    ArenaPage *sources[2] = { from->node_pages, from->name_pages };
+    for (int i = 0; i < 2; i++) {
+        ArenaPage *source = sources[i];
+        if (source == NULL) continue;
+        ArenaPage *tail = source;
+        while (tail->next != NULL) {
+            tail = tail->next;
+        }
+        if (*targets[i] == NULL) {
+            *targets[i] = source;
+        } else {
+            tail->next = (*targets[i])->next;
+            (*targets[i])->next = source;
+        }
+    }
+
+    if (from->free_nodes != NULL) {
+        Node *tail = from->free_nodes;
+        while (tail->next != NULL) {
+            tail = tail->next;
+        }
+        tail->next = into->free_nodes;
+        into->free_nodes = from->free_nodes;
+    }
+    into->page_count += from->page_count;
+    into->reserved_bytes += from->reserved_bytes;
+    memset(from, 0, sizeof(*from));
+}
+
+/**
+ * Adds a name to the hierarchical hash structure.
+ *
+ * This function processes an input name, validates it, converts it to uppercase,
+ * and determines the appropriate bucket in the three-level hierarchical hash table.
+ * The name is then inserted into a sorted linked list at the third level.
+ *
+ * - The first-level index is determined by the first character of the name.
+ * - The second-level index is determined by the first vowel in the name.
+ * - The third-level index is determined by the third character of the name.
+ *
+ * If the necessary levels or blocks in the hierarchy do not exist, they are
+ * initialized dynamically before the insertion.
+ *
+ * @param input_name The name to be added to the hash structure.
+ * @return 0 on success, or 1 on failure (e.g., invalid input or memory issues).
+ */
+int add_name(const char *input_name) {
+    return hash_table_insert(&default_table, input_name);
+}
+
+/**
+ * Adds a name to the hierarchical hash structure of a table.
+ *
+ * This is the table-aware implementation behind add_name. Missing second- and 
+ * third-level blocks are created on demand, and the name is inserted into the 
+ * sorted linked list selected by its first, second and third characters.
+ *
+ * @param table The table to add the name to.
+ * @param input_name The name to be added to the hash structure.
+ * @return 0 on success, or 1 on failure (e.g., invalid input or memory issues).
+ */
+int hash_table_insert(HashTable *table, const char *input_name) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+
+    // Convert to uppercase characters
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return 1;
+    }
+
+    unsigned int letter = schema_index(table->schema, 0, name);
+    lock_stripe(table, letter);
+    int result = insert_key(table, name, length);
+    unlock_stripe(table, letter);
+    release_name(name, buffer); // Free the temporary copy
+    return result;
+}
+
+/**
+ * Inserts a normalized name into a table.
+ *
+ * Missing second- and third-level blocks are created, then the name goes into 
+ * the sorted linked list (or flat bucket) selected by its first, second and 
+ * third characters. New blocks and nodes are fully initialized before they are 
+ * linked in with a release store, so concurrent readers never see them half 
+ * built. In HASH_TABLE_CONCURRENT tables the caller holds the letter's lock.
+ *
+ * @param table The table to add the name to.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return 0 on success, or 1 on memory allocation failure.
+ */
+int insert_key(HashTable *table, const char *name, size_t length) {
+    HashBlock *block = ensure_block(table, name);
+    if (block == NULL) return 1;
+    unsigned int third_index = schema_index(table->schema, 2, name);
+
+    // Flat tables keep the third level as a sorted array instead of a list
+    if (table->flags & HASH_TABLE_FLAT) {
+        if (flat_insert(&block->buckets[third_index], name, length, NULL, NULL) != 0) {
+            return 1;
+        }
+        filter_add(table, block, name, length);
+        table->name_count++;
+        if (table->counters != NULL) count_inserts(table, name, 1);
+        return 0;
+    }
+
+    // Insert the name into the third-level linked list (or the SubBlock it was promoted to)
+    Node *new_node = create_node(table, name, length);
+    if (new_node == NULL) {
+        return 1;
+    }
+    if (insert_node(table, &block->third_level[third_index], new_node, length) != 0) {
+        free_node(table, new_node);
+        return 1;
+    }
+    filter_add(table, block, name, length);
+    table->name_count++;
+    if (table->counters != NULL) count_inserts(table, name, 1);
+    return 0;
+}
+
+/**
+ * Returns the third-level block of a name, creating the missing levels.
+ *
+ * New blocks are fully initialized before they are linked in with a release 
+ * store. In HASH_TABLE_CONCURRENT tables the caller holds the letter's lock.
+ *
+ * @param table The table.
+ * @param name The normalized (uppercase) name.
+ * @return The HashBlock for the name, or NULL on memory allocation failure.
+ */
+HashBlock* ensure_block(HashTable *table, const char *name) {
+    HashBlocks **blocks = &table->first_level[schema_index(table->schema, 0, name)];
+    if (*blocks == NULL) {
+        HashBlocks *created = create_hash_blocks();
+        if (created == NULL) return NULL;
+        STORE_POINTER(HashBlocks, blocks, created);
+    }
+    HashBlock **slot = &(*blocks)->second_level[schema_index(table->schema, 1, name)];
+    if (*slot == NULL) {
+        HashBlock *created = create_hash_block();
+        if (created == NULL) return NULL;
+        STORE_POINTER(HashBlock, slot, created);
+    }
+    return *slot;
+}
+
+/**
+ * Adds a name with a value, or finds it if it is already stored, in a single traversal.
+ *
+ * In linked-list tables the chain is walked once to the first node not 
+ * smaller than the name: either it holds the name, or the new node is linked 
+ * right there. Only a slot that was promoted into SubBlocks goes through 
+ * insert_node, which may have to split one. In HASH_TABLE_FLAT tables the 
+ * binary search that finds the insertion point also finds an existing entry. 
+ * In HASH_TABLE_CONCURRENT tables the caller holds the letter's lock, and a 
+ * replaced value is published with a release store.
+ *
+ * @param table The table.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @param value The value to store.
+ * @param mode Whether a value already stored for the name is kept or replaced.
+ * @param previous If not NULL, receives the value stored before the call.
+ * @return HASH_PUT_ADDED, HASH_PUT_FOUND or HASH_PUT_FAILED.
+ */
+HashPutResult put_key(HashTable *table, const char *name, size_t length, void *value,
+                      HashPutMode mode, void **previous) {
+    HashBlock *block = ensure_block(table, name);
+    if (block == NULL) return HASH_PUT_FAILED;
+    unsigned int third_index = schema_index(table->schema, 2, name);
+    void **stored = NULL;
+
+    if (table->flags & HASH_TABLE_FLAT) {
+        if (flat_insert(&block->buckets[third_index], name, length, value, &stored) != 0) {
+            return HASH_PUT_FAILED;
+        }
+    } else {
+        Node **slot = &block->third_level[third_index];
+        Node **link = find_link(slot, name, length);
+        if (*link != NULL && strcmp((*link)->name, name) == 0) {
+            stored = &(*link)->value;
+        } else {
+            Node *new_node = create_node(table, name, length);
+            if (new_node == NULL) return HASH_PUT_FAILED;
+            new_node->value = value;
+            if (!is_sub_block(*slot)) {
+                new_node->next = *link;
+                STORE_POINTER(Node, link, new_node);
+                promote_if_long(table, slot, new_node);
+            } else if (insert_node(table, slot, new_node, length) != 0) {
+                free_node(table, new_node);
+                return HASH_PUT_FAILED;
+            }
+        }
+    }
+
+    if (stored == NULL) {
+        if (previous != NULL) *previous = NULL;
+        filter_add(table, block, name, length);
+        table->name_count++;
+        if (table->counters != NULL) count_inserts(table, name, 1);
+        return HASH_PUT_ADDED;
+    }
+    if (previous != NULL) *previous = LOAD_POINTER(void, stored);
+    if (mode == HASH_PUT_REPLACE) STORE_POINTER(void, stored, value);
+    return HASH_PUT_FOUND;
+}
+
+/**
+ * Adds a name with a value to a table, or finds it if it is already stored.
+ *
+ * @param table The table to add the name to.
+ * @param input_name The name.
+ * @param value The value to store.
+ * @param mode Whether a value already stored for the name is kept or replaced.
+ * @param previous If not NULL, receives the value stored before the call (NULL if the name was added).
+ * @return HASH_PUT_ADDED, HASH_PUT_FOUND or HASH_PUT_FAILED.
+ */
+HashPutResult hash_table_put(HashTable *table, const char *input_name, void *value,
+                             HashPutMode mode, void **previous) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+
+    // Convert to uppercase characters
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return HASH_PUT_FAILED;
+    }
+
+    unsigned int letter = schema_index(table->schema, 0, name);
+    lock_stripe(table, letter);
+    HashPutResult result = put_key(table, name, length, value, mode, previous);
+    unlock_stripe(table, letter);
+    release_name(name, buffer);
+    return result;
+}
+
+/**
+ * Looks up the value stored with a name.
+ *
+ * HASH_TABLE_CONCURRENT tables are read wait-free inside a read-side 
+ * section, like find_key_concurrent, and fall back to the letter's lock for 
+ * threads without a reader slot.
+ *
+ * @param table The table to search.
+ * @param input_name The name to search for.
+ * @param value Receives the value if the name is found (may be NULL).
+ * @return 0 if the name was found, 1 if it was not found or is invalid.
+ */
+int hash_table_get(const HashTable *table, const char *input_name, void **value) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+
+    // Convert to uppercase characters
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return 1;
+    }
+
+    ReaderSlot *reader = NULL;
+    unsigned int letter = schema_index(table->schema, 0, name);
+    if (table->flags & HASH_TABLE_CONCURRENT) {
+        reader = enter_read();
+        if (reader == NULL) lock_stripe(table, letter);
+    }
+    void *const *stored = find_value(table, name, length);
+    if (stored != NULL && value != NULL) {
+        *value = LOAD_POINTER(void, stored);
+    }
+    if (reader != NULL) {
+        exit_read(reader);
+    } else if (table->flags & HASH_TABLE_CONCURRENT) {
+        unlock_stripe(table, letter);
+    }
+    release_name(name, buffer);
+    return stored == NULL;
+}
+
+/**
+ * Returns where the value of a normalized name is stored.
+ *
+ * @param table The table to search.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The value field of the name's node or flat entry, or NULL if the name is not stored.
+ */
+void* const* find_value(const HashTable *table, const char *name, size_t length) {
+    const HashBlock *block = locate_block(table, name);
+    if (block == NULL) {
+        if (table->counters != NULL) count_lookup(table, name, 0, 0);
+        return NULL;
+    }
+    unsigned int k = schema_index(table->schema, 2, name);
+
+    void *const *found = NULL;
+    unsigned int compares = 0;
+    const BlockFilter *filter = block->filter;
+    if (filter != NULL && !filter_may_contain(table, filter, filter_hash(name, length))) {
+        if (table->counters != NULL) {
+            count_lookup(table, name, 0, 0);
+            count_filter(table, name, 1);
+        }
+        return NULL;
+    }
+    if (table->flags & HASH_TABLE_FLAT) {
+        const struct FlatBucket *bucket = block->buckets[k];
+        long index = find_flat_index(bucket, name, length, &compares);
+        if (index >= 0) found = &bucket->entries[index].value;
+    } else {
+        for (Node *current = LOAD_POINTER(Node, find_chain(&block->third_level[k], name, length)); current != NULL;
+             current = LOAD_POINTER(Node, &current->next)) {
+            int cmp = strcmp(current->name, name);
+            compares++;
+            if (cmp == 0) found = &current->value;
+            if (cmp >= 0) break;
+        }
+    }
+    if (table->counters != NULL) {
+        count_lookup(table, name, found != NULL, compares);
+        if (filter != NULL && found == NULL) count_filter(table, name, 0);
+    }
+    return found;
+}
+
+/**
+ * Returns the link at which a name is, or would be, in its chain.
+ *
+ * SubBlocks are followed down to the name's chain, which is then walked to 
+ * its first node that is not smaller than the name.
+ *
+ * @param slot The third-level slot.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The link holding that node, or the terminating NULL link.
+ */
+Node** find_link(Node **slot, const char *name, size_t length) {
+    Node **link = (Node **)find_chain(slot, name, length);
+    while (*link != NULL && strcmp((*link)->name, name) < 0) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/**
+ * Searches for a name in the hierarchical hash structure.
+ *
+ * This function looks up a name in the three-level hierarchical hash table 
+ * using its indices at each level:
+ * - First-level index is determined by the first character of the name.
+ * - Second-level index is determined by the first vowel in the name.
+ * - Third-level index is determined by the third character of the name.
+ *
+ * It traverses the corresponding linked list in the third-level hash block 
+ * to find a node with a matching name. If found, it returns a pointer to the 
+ * node. If not found or if any level is missing, the function returns NULL.
+ *
+ * @param table The table to search.
+ * @param name The name to search for in the hash structure.
+ * @return A pointer to the Node containing the name, or NULL if not found.
+ */
+Node* find_name(const HashTable *table, const char *name) {
+    HashBlock *block = locate_block(table, name);
+    if (block == NULL) return NULL;
+
+    Node *const *slot = &block->third_level[schema_index(table->schema, 2, name)];
+    Node *current = LOAD_POINTER(Node, find_chain(slot, name, strlen(name)));
+    while (current != NULL) {
+        if (strcmp(current->name, name) == 0) {
+            return current;
+        }
+        current = LOAD_POINTER(Node, &current->next);
+    }
+    return NULL;
+}
+
+/**
+ * Returns the third-level block a name maps to.
+ *
+ * The first- and second-level buckets of the name under the table's schema 
+ * select the block. No levels are created.
+ *
+ * @param table The table to search.
+ * @param name The normalized (uppercase) name.
+ * @return The HashBlock for the name, or NULL if it has not been created yet.
+ */
+HashBlock* locate_block(const HashTable *table, const char *name) {
+    HashBlocks *blocks = LOAD_POINTER(HashBlocks, &table->first_level[schema_index(table->schema, 0, name)]);
+    return blocks ? LOAD_POINTER(HashBlock, &blocks->second_level[schema_index(table->schema, 1, name)]) : NULL;
+}
+
+/**
+ * Searches for a normalized name in a table, whatever its third-level backend.
+ *
+ * The block is found with locate_block and the third-level slot is searched 
+ * with find_in_slot: linked-list tables compare names along the chain, 
+ * HASH_TABLE_FLAT tables scan the fingerprints of the selected flat bucket.
+ *
+ * @param table The table to search.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The stored name, or NULL if not found.
+ */
+const char* find_key(const HashTable *table, const char *name, size_t length) {
+    HashBlock *block = locate_block(table, name);
+    if (block == NULL) {
+        if (table->counters != NULL) count_lookup(table, name, 0, 0);
+        return NULL;
+    }
+    return find_in_slot(table, block, schema_index(table->schema, 2, name), name, length);
+}
+
+/**
+ * Searches one third-level slot for a normalized name.
+ *
+ * @param table The table that owns the block.
+ * @param block The third-level block.
+ * @param k The third-level index within the block.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The stored name, or NULL if not found.
+ */
+const char* find_in_slot(const HashTable *table, const HashBlock *block, unsigned int k,
+                         const char *name, size_t length) {
+    const char *found = NULL;
+    unsigned int compares = 0;
+    const BlockFilter *filter = block->filter;
+    if (filter != NULL && !filter_may_contain(table, filter, filter_hash(name, length))) {
+        if (table->counters != NULL) {
+            count_lookup(table, name, 0, 0);
+            count_filter(table, name, 1);
+        }
+        return NULL;
+    }
+    if (table->flags & HASH_TABLE_FLAT) {
+        const struct FlatBucket *bucket = block->buckets[k];
+        long index = find_flat_index(bucket, name, length, &compares);
+        if (index >= 0) found = bucket->pool + bucket->entries[index].offset;
+    } else {
+        for (Node *current = LOAD_POINTER(Node, find_chain(&block->third_level[k], name, length)); current != NULL;
+             current = LOAD_POINTER(Node, &current->next)) {
+            compares++;
+            if (strcmp(current->name, name) == 0) {
+                found = current->name;
+                break;
+            }
+        }
+    }
+    if (table->counters != NULL) {
+        count_lookup(table, name, found != NULL, compares);
+        if (filter != NULL && found == NULL) count_filter(table, name, 0);
+    }
+    return found;
+}
+
+/**
+ * Searches a HASH_TABLE_CONCURRENT table for a normalized name.
+ *
+ * The lookup runs inside a read-side section: the calling thread announces 
+ * the current epoch in its reader slot, walks the levels and the chain with 
+ * acquire loads and clears the slot again. It takes no lock and never retries, 
+ * so it is wait-free. Threads beyond MAX_READERS get no slot and fall back to 
+ * the writer lock of the name's first letter.
+ *
+ * @param table The table to search.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The stored name, or NULL if not found.
+ */
+const char* find_key_concurrent(const HashTable *table, const char *name, size_t length) {
+    ReaderSlot *slot = enter_read();
+    if (slot == NULL) {
+        unsigned int letter = schema_index(table->schema, 0, name);
+        lock_stripe(table, letter);
+        const char *result = find_key(table, name, length);
+        unlock_stripe(table, letter);
+        return result;
+    }
+    const char *result = find_key(table, name, length);
+    exit_read(slot);
+    return result;
+}
+
+/**
+ * Removes one occurrence of a name from a table.
+ *
+ * The name is normalized in the table's key mode and located through the same 
+ * three-level indexing as find_name. The first matching node is unlinked from 
+ * its third-level list and released together with its name. Blocks left empty 
+ * are freed right away, except in HASH_TABLE_CONCURRENT tables, where readers 
+ * may still be inside them; hash_table_compact frees those.
+ *
+ * In HASH_TABLE_CONCURRENT tables the node is unlinked under the letter's 
+ * writer lock and freed once no reader can still be walking over it.
+ *
+ * @param table The table to remove the name from.
+ * @param input_name The name to remove.
+ * @return 0 if the name was removed, or 1 if it was not found or is invalid.
+ */
+int hash_table_remove(HashTable *table, const char *input_name) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+
+    // Convert to uppercase characters
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return 1;
+    }
+
+    unsigned int letter = schema_index(table->schema, 0, name);
+    lock_stripe(table, letter);
+    int result = remove_key(table, name, length, NULL);
+    unlock_stripe(table, letter);
+    release_name(name, buffer);
+    return result;
+}
+
+/**
+ * Removes one occurrence of a name from a table and returns its value.
+ *
+ * Works like hash_table_remove, in the same single traversal.
+ *
+ * @param table The table to remove the name from.
+ * @param input_name The name to remove.
+ * @param value Receives the value of the removed name (may be NULL).
+ * @return 0 if the name was removed, or 1 if it was not found or is invalid.
+ */
+int hash_table_remove_value(HashTable *table, const char *input_name, void **value) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+
+    // Convert to uppercase characters
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return 1;
+    }
+
+    unsigned int letter = schema_index(table->schema, 0, name);
+    lock_stripe(table, letter);
+    int result = remove_key(table, name, length, value);
+    unlock_stripe(table, letter);
+    release_name(name, buffer);
+    return result;
+}
+
+/**
+ * Removes one occurrence of a normalized name from a table.
+ *
+ * The matching node is unlinked with a release store, so a concurrent reader 
+ * either still sees it or sees its successor, never a broken chain. In 
+ * HASH_TABLE_CONCURRENT tables the caller holds the letter's lock. When the 
+ * chain was promoted, the counts of the SubBlocks above it are decremented and 
+ * the highest one left with fewer than DEMOTE_THRESHOLD names is flattened 
+ * back into a single chain. Once the slot is empty, release_empty_block frees 
+ * the blocks that no longer hold anything.
+ *
+ * @param table The table to remove the name from.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @param value If not NULL, receives the value of the removed name.
+ * @return 0 if the name was removed, or 1 if it was not found.
+ */
+int remove_key(HashTable *table, const char *name, size_t length, void **value) {
+    unsigned int first_index = schema_index(table->schema, 0, name);
+    unsigned int second_index = schema_index(table->schema, 1, name);
+    unsigned int third_index = schema_index(table->schema, 2, name);
+
+    HashBlocks *blocks = table->first_level[first_index];
+    HashBlock *block = blocks ? blocks->second_level[second_index] : NULL;
+    if (block == NULL) {
+        return 1;
+    }
+
+    if (table->flags & HASH_TABLE_FLAT) {
+        if (flat_remove(&block->buckets[third_index], name, length, value) != 0) {
+            return 1;
+        }
+        table->name_count--;
+        filter_remove(table, block);
+        release_empty_block(table, first_index, second_index);
+        return 0;
+    }
+
+    // Walk the sorted list with a pointer-to-link so the head needs no special case
+    Node **slot = &block->third_level[third_index];
+    Node **link = (Node **)find_chain(slot, name, length);
+    while (*link != NULL) {
+        int cmp = strcmp((*link)->name, name);
+        if (cmp == 0) {
+            Node *victim = *link;
+            STORE_POINTER(Node, link, victim->next);
+            if (value != NULL) *value = victim->value;
+            free_node(table, victim);
+            table->name_count--;
+
+            // Retrace the SubBlocks above the chain and flatten the highest one that got too small
+            Node **collapse = NULL;
+            for (Node **walk = slot; is_sub_block(*walk); ) {
+                SubBlock *sub = as_sub_block(*walk);
+                if (--sub->count < DEMOTE_THRESHOLD && collapse == NULL) {
+                    collapse = walk;
+                }
+                walk = &sub->slots[sub_block_index(sub, name, length)];
+            }
+            if (collapse != NULL) {
+                demote_chain(collapse);
+            }
+            filter_remove(table, block);
+            release_empty_block(table, first_index, second_index);
+            return 0;
+        }
+        if (cmp > 0) break; // Sorted order: the name cannot appear further down
+        link = &(*link)->next;
+    }
+    return 1;
+}
+
+/**
+ * Frees a third-level block, and the HashBlocks above it, once they hold nothing.
+ *
+ * Called after a removal. HASH_TABLE_CONCURRENT tables are left alone, since 
+ * lock-free readers may be inside the blocks; hash_table_compact frees them.
+ *
+ * @param table The table.
+ * @param first The first-level index of the block.
+ * @param second The second-level index of the block.
+ */
+void release_empty_block(HashTable *table, unsigned int first, unsigned int second) {
+    if (table->flags & HASH_TABLE_CONCURRENT) return;
+    HashBlocks *blocks = table->first_level[first];
+    if (!block_is_empty(blocks->second_level[second])) return;
+    free(blocks->second_level[second]->filter);
+    free(blocks->second_level[second]);
+    blocks->second_level[second] = NULL;
+    for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+        if (blocks->second_level[j] != NULL) return;
+    }
+    free(blocks);
+    table->first_level[first] = NULL;
+}
+
+/**
+ * Returns whether every third-level slot of a block is empty.
+ *
+ * Empty flat buckets are freed, so a NULL slot is empty for both backends.
+ *
+ * @param block The block.
+ * @return 1 if the block holds no names, 0 otherwise.
+ */
+int block_is_empty(const HashBlock *block) {
+    for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+        if (block->third_level[k] != NULL) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Frees the second- and third-level blocks that removals have left empty.
+ *
+ * Each letter is scanned under its writer lock; empty blocks are unlinked 
+ * with release stores and collected. In HASH_TABLE_CONCURRENT tables they 
+ * are only freed once the global epoch has advanced twice, so every reader 
+ * that could have been inside them has left. A table has at most 
+ * FIRST_LEVEL_SIZE * (SECOND_LEVEL_SIZE + 1) blocks, so they are collected 
+ * on the stack.
+ *
+ * @param table The table to compact.
+ * @return The number of blocks freed.
+ */
+size_t hash_table_compact(HashTable *table) {
+    void *dead[FIRST_LEVEL_SIZE * (SECOND_LEVEL_SIZE + 1)];
+    size_t count = 0;
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+        HashBlocks *blocks = table->first_level[i];
+        size_t used = 0;
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE && blocks != NULL; j++) {
+            HashBlock *block = blocks->second_level[j];
+            if (block == NULL) continue;
+            if (block_is_empty(block)) {
+                STORE_POINTER(HashBlock, &blocks->second_level[j], NULL);
+                free(block->filter); // Filter tables are never HASH_TABLE_CONCURRENT
+                block->filter = NULL;
+                dead[count++] = block;
+            } else {
+                used++;
+            }
+        }
+        if (blocks != NULL && used == 0) {
+            STORE_POINTER(HashBlocks, &table->first_level[i], NULL);
+            dead[count++] = blocks;
+        }
+        unlock_stripe(table, i);
+    }
+
+    if (count > 0 && (table->flags & HASH_TABLE_CONCURRENT)) {
+        // The unlinks must be visible before the epoch is sampled
+        atomic_thread_fence(memory_order_seq_cst);
+        uint64_t retired = atomic_load(&global_epoch);
+        while (advance_epoch() < retired + 2) {
+            thrd_yield();
+        }
+    }
+    for (size_t n = 0; n < count; n++) {
+        free(dead[n]);
+    }
+    return count;
+}
+
+/**
+ * Inserts a node into a sorted linked list while maintaining the sort order.
+ *
+ * This function takes a pointer to the head of a linked list and a new node to insert.
+ * It finds the appropriate position in the list for the new node based on its name 
+ * field (alphabetical order) and inserts it in such a way that the list remains sorted.
+ *
+ * - If the list is empty or the new node's name is smaller than the head's name,
+ *   the new node becomes the new head.
+ * - Otherwise, the function traverses the list to find the correct position for insertion.
+ *
+ * The new node's next pointer is set before the node is linked in with a 
+ * release store, so concurrent readers always see a complete chain.
+ *
+ * @param head A pointer to the head of the linked list.
+ * @param new_node The new node to be inserted into the list.
+ */
+void insert_sorted(Node **head, Node *new_node) {
+    if (*head == NULL || strcmp((*head)->name, new_node->name) > 0) {
+        new_node->next = *head;
+        STORE_POINTER(Node, head, new_node);
+        return;
+    }
+
+    Node *current = *head;
+    while (current->next != NULL && strcmp(current->next->name, new_node->name) < 0) {
+        current = current->next;
+    }
+    new_node->next = current->next;
+    STORE_POINTER(Node, &current->next, new_node);
+}
+
+/**
+ * Returns whether a third-level slot or SubBlock bucket holds a SubBlock.
+ *
+ * @param slot The value of the slot.
+ * @return 1 if the slot holds a tagged SubBlock, 0 if it holds a chain head or NULL.
+ */
+int is_sub_block(const Node *slot) {
+    return ((uintptr_t)slot & SUB_BLOCK_TAG) != 0;
+}
+
+/**
+ * Returns the SubBlock held by a tagged slot.
+ *
+ * @param slot The value of a slot for which is_sub_block returned 1.
+ * @return The SubBlock.
+ */
+SubBlock* as_sub_block(const Node *slot) {
+    return (SubBlock *)((uintptr_t)slot & ~SUB_BLOCK_TAG);
+}
+
+/**
+ * Returns whether chains of a table are promoted into SubBlocks.
+ *
+ * HASH_TABLE_FLAT tables have no chains. HASH_TABLE_CONCURRENT tables keep 
+ * plain chains, because promoting one relinks nodes that wait-free readers 
+ * may be walking at that moment. Names of UTF-8 tables hold bytes that no 
+ * SubBlock bucket covers.
+ *
+ * @param table The table.
+ * @return 1 if overfull chains are promoted, 0 otherwise.
+ */
+int promotes_chains(const HashTable *table) {
+    return (table->flags & (HASH_TABLE_FLAT | HASH_TABLE_CONCURRENT | KEY_MODE_FLAGS)) == 0;
+}
+
+/**
+ * Returns the bucket of a SubBlock a name belongs to.
+ *
+ * Bucket 0 holds names that end at the block's depth, buckets 1 to 26 the 
+ * letters A to Z, so the buckets follow strcmp order.
+ *
+ * @param sub The SubBlock.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The bucket index, below SUB_BLOCK_SIZE.
+ */
+unsigned int sub_block_index(const SubBlock *sub, const char *name, size_t length) {
+    return sub->depth < length ? (unsigned int)(name[sub->depth] - 'A') + 1 : 0;
+}
+
+/**
+ * Allocates an empty SubBlock for the given prefix.
+ *
+ * @param prefix The prefix shared by every name that will be stored below the block.
+ * @param depth The number of characters of prefix to keep.
+ * @return The new SubBlock, or NULL if memory allocation fails.
+ */
+SubBlock* create_sub_block(const char *prefix, size_t depth) {
+    SubBlock *sub = (SubBlock *)calloc(1, sizeof(SubBlock) + depth + 1);
+    if (!sub) {
+        printf("Memory allocation failed for SubBlock\n");
+        return NULL;
+    }
+    sub->depth = depth;
+    memcpy(sub->prefix, prefix, depth);
+    return sub;
+}
+
+/**
+ * Follows SubBlocks from a slot down to the chain a name belongs to.
+ *
+ * Only the character after each block's prefix is looked at; a name that 
+ * does not share the prefix simply ends up in a chain that cannot contain it.
+ *
+ * @param slot The third-level slot.
+ * @param name The normalized (uppercase) name.
+ * @param length The length of name.
+ * @return The link holding the head of the chain for name.
+ */
+Node* const* find_chain(Node *const *slot, const char *name, size_t length) {
+    for (const Node *head = LOAD_POINTER(Node, slot); is_sub_block(head); head = *slot) {
+        const SubBlock *sub = as_sub_block(head);
+        slot = &sub->slots[sub_block_index(sub, name, length)];
+    }
+    return slot;
+}
+
+/**
+ * Inserts a node below a third-level slot, promoting its chain if it grows too long.
+ *
+ * The SubBlocks on the way down count the new name. When the name leaves the 
+ * prefix of a block, a new block is inserted above it at the first differing 
+ * character, like a split in a radix tree. Once the node is in its chain, a 
+ * chain longer than PROMOTE_THRESHOLD that now holds two different names is 
+ * promoted with promote_chain. Tables for which promotes_chains returns 0 only 
+ * ever hold plain chains, so this reduces to insert_sorted for them.
+ *
+ * @param table The table that owns the slot.
+ * @param slot The third-level slot.
+ * @param node The new node, with its name set.
+ * @param length The length of the node's name.
+ * @return 0 on success, or 1 if a SubBlock could not be allocated (the node is not linked).
+ */
+int insert_node(HashTable *table, Node **slot, Node *node, size_t length) {
+    Node **top = slot;
+    while (is_sub_block(*slot)) {
+        SubBlock *sub = as_sub_block(*slot);
+        size_t shared = 0;
+        while (shared < sub->depth && sub->prefix[shared] == node->name[shared]) {
+            shared++;
+        }
+        if (shared < sub->depth) {
+            SubBlock *split = create_sub_block(sub->prefix, shared);
+            if (split == NULL) {
+                // Undo the counts already taken on the way down
+                for (Node **walk = top; walk != slot; ) {
+                    SubBlock *above = as_sub_block(*walk);
+                    above->count--;
+                    walk = &above->slots[sub_block_index(above, node->name, length)];
+                }
+                return 1;
+            }
+            split->slots[sub_block_index(split, sub->prefix, sub->depth)] = *slot;
+            split->count = sub->count;
+            *slot = (Node *)((uintptr_t)split | SUB_BLOCK_TAG);
+            sub = split;
+        }
+        sub->count++;
+        slot = &sub->slots[sub_block_index(sub, node->name, length)];
+    }
+
+    insert_sorted(slot, node);
+    promote_if_long(table, slot, node);
+    return 0;
+}
+
+/**
+ * Promotes a chain that a node was just linked into if it has grown too long.
+ *
+ * The chain must also hold two different names, which is the case when the 
+ * new node differs from the head or from its successor; a chain of 
+ * duplicates cannot be split.
+ *
+ * @param table The table that owns the chain.
+ * @param chain The link holding the head of the chain.
+ * @param node The node just linked in.
+ */
+void promote_if_long(HashTable *table, Node **chain, const Node *node) {
+    int distinct = strcmp((*chain)->name, node->name) != 0 ||
+                   (node->next != NULL && strcmp(node->next->name, node->name) != 0);
+    if (promotes_chains(table) && distinct && chain_longer_than(*chain, PROMOTE_THRESHOLD)) {
+        promote_chain(chain); // Stays a chain if the SubBlock cannot be allocated
+    }
+}
+
+/**
+ * Returns whether a chain holds more than the given number of nodes.
+ *
+ * At most limit + 1 nodes are visited.
+ *
+ * @param head The head of the chain.
+ * @param limit The number of nodes to compare against.
+ * @return 1 if the chain is longer than limit, 0 otherwise.
+ */
+int chain_longer_than(const Node *head, size_t limit) {
+    for (size_t count = 0; head != NULL; head = head->next) {
+        if (++count > limit) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Replaces a sorted chain with a SubBlock keyed on the character after its common prefix.
+ *
+ * Since the chain is sorted, the prefix shared by all of its names is the one 
+ * shared by its first and last name. The nodes are distributed over the 
+ * buckets in one pass without reallocating anything, and buckets that are 
+ * still longer than PROMOTE_THRESHOLD are promoted in turn. Chains whose 
+ * names are all identical are left alone, since no character can split them.
+ *
+ * @param slot The link holding the head of the chain.
+ * @return 0 on success or if the chain cannot be split, or 1 if memory allocation fails.
+ */
+int promote_chain(Node **slot) {
+    Node *first = *slot;
+    Node *last = first;
+    size_t count = 1;
+    while (last->next != NULL) {
+        last = last->next;
+        count++;
+    }
+    size_t depth = 0;
+    while (first->name[depth] != '\0' && first->name[depth] == last->name[depth]) {
+        depth++;
+    }
+    if (first->name[depth] == last->name[depth]) return 0;
+
+    SubBlock *sub = create_sub_block(first->name, depth);
+    if (sub == NULL) return 1;
+    Node **tails[SUB_BLOCK_SIZE];
+    for (unsigned int b = 0; b < SUB_BLOCK_SIZE; b++) {
+        tails[b] = &sub->slots[b];
+    }
+    for (Node *current = first; current != NULL; current = current->next) {
+        unsigned int b = current->name[depth] == '\0' ? 0 : (unsigned int)(current->name[depth] - 'A') + 1;
+        *tails[b] = current;
+        tails[b] = &current->next;
+    }
+    for (unsigned int b = 0; b < SUB_BLOCK_SIZE; b++) {
+        *tails[b] = NULL;
+    }
+    sub->count = count;
+    *slot = (Node *)((uintptr_t)sub | SUB_BLOCK_TAG);
+
+    int result = 0;
+    for (unsigned int b = 1; b < SUB_BLOCK_SIZE; b++) {
+        if (chain_longer_than(sub->slots[b], PROMOTE_THRESHOLD)) {
+            result |= promote_chain(&sub->slots[b]);
+        }
+    }
+    return result;
+}
+
+/**
+ * Flattens the SubBlock held by a slot back into a single sorted chain.
+ *
+ * The nodes are relinked in bucket order, which is strcmp order, and every 
+ * SubBlock below the slot is freed.
+ *
+ * @param slot The link holding the tagged SubBlock.
+ */
+void demote_chain(Node **slot) {
+    Node *head = NULL;
+    *flatten_slot(*slot, &head) = NULL;
+    free_slot(*slot, 0);
+    *slot = head;
+}
+
+/**
+ * Appends every node below a slot, in order, to a chain under construction.
+ *
+ * @param slot The value of a slot: a chain head, a tagged SubBlock or NULL.
+ * @param tail The link the next node is stored in.
+ * @return The link following the last appended node.
+ */
+Node** flatten_slot(Node *slot, Node **tail) {
+    if (is_sub_block(slot)) {
+        SubBlock *sub = as_sub_block(slot);
+        for (unsigned int b = 0; b < SUB_BLOCK_SIZE; b++) {
+            tail = flatten_slot(sub->slots[b], tail);
+        }
+        return tail;
+    }
+    for (; slot != NULL; slot = slot->next) {
+        *tail = slot;
+        tail = &slot->next;
+    }
+    return tail;
+}
+
+/**
+ * Frees the SubBlocks below a slot, and its nodes too when free_nodes is set.
+ *
+ * @param slot The value of a slot: a chain head, a tagged SubBlock or NULL.
+ * @param free_nodes Whether the nodes and names are malloc'd and must be freed as well.
+ */
+void free_slot(Node *slot, int free_nodes) {
+    if (is_sub_block(slot)) {
+        SubBlock *sub = as_sub_block(slot);
+        for (unsigned int b = 0; b < SUB_BLOCK_SIZE; b++) {
+            free_slot(sub->slots[b], free_nodes);
+        }
+        free(sub);
+        return;
+    }
+    while (free_nodes && slot != NULL) {
+        Node *tmp = slot;
+        slot = slot->next;
+        free(tmp->name); // Free the name string
+        free(tmp);       // Free the node
+    }
+}
+
+/**
+ * Visits every name below a slot of a linked-list table in order.
+ *
+ * @param slot The value of a slot: a chain head, a tagged SubBlock or NULL.
+ * @param visitor The callback invoked for each name.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every name was visited, or the non-zero value returned by the visitor.
+ */
+int visit_chain(const Node *slot, HashTableVisitor visitor, void *context) {
+    if (is_sub_block(slot)) {
+        const SubBlock *sub = as_sub_block(slot);
+        for (unsigned int b = 0; b < SUB_BLOCK_SIZE; b++) {
+            int result = visit_chain(sub->slots[b], visitor, context);
+            if (result != 0) return result;
+        }
+        return 0;
+    }
+    for (const Node *current = slot; current != NULL; current = current->next) {
+        int result = visitor(current->name, context);
+        if (result != 0) return result;
+    }
+    return 0;
+}
+
+/**
+ * Adds the SubBlocks, nodes and names below a slot to memory statistics.
+ *
+ * @param slot The value of a slot: a chain head, a tagged SubBlock or NULL.
+ * @param stats The statistics being accumulated.
+ */
+void add_slot_stats(const Node *slot, HashTableMemoryStats *stats) {
+    if (is_sub_block(slot)) {
+        const SubBlock *sub = as_sub_block(slot);
+        stats->sub_blocks++;
+        stats->sub_block_bytes += sizeof(SubBlock) + sub->depth + 1;
+        for (unsigned int b = 0; b < SUB_BLOCK_SIZE; b++) {
+            add_slot_stats(sub->slots[b], stats);
+        }
+        return;
+    }
+    for (const Node *current = slot; current != NULL; current = current->next) {
+        size_t name_size = strlen(current->name) + 1;
+        stats->node_bytes += sizeof(Node);
+        stats->name_bytes += name_size;
+        stats->heap_bytes += heap_chunk_size(sizeof(Node)) + heap_chunk_size(name_size);
+    }
+}
+
+/**
+ * Allocates the per-letter writer state of a HASH_TABLE_CONCURRENT table.
+ *
+ * The locks are recursive so that a visitor running under hash_table_iterate 
+ * can still look names up when the thread has no reader slot.
+ *
+ * @param table The table being created.
+ * @return 0 on success, or 1 if memory allocation or lock creation fails.
+ */
+int create_stripes(HashTable *table) {
+    table->stripes = (Stripe *)calloc(FIRST_LEVEL_SIZE, sizeof(Stripe));
+    if (!table->stripes) {
+        printf("Memory allocation failed for writer locks\n");
+        return 1;
+    }
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        if (mtx_init(&table->stripes[i].lock, mtx_plain | mtx_recursive) != thrd_success) {
+            printf("Failed to create writer lock\n");
+            while (i-- > 0) {
+                mtx_destroy(&table->stripes[i].lock);
+            }
+            free(table->stripes);
+            table->stripes = NULL;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Frees the writer locks and retired node lists of a table.
+ *
+ * Retired nodes themselves are freed by clear_hash_table. Does nothing for 
+ * tables without HASH_TABLE_CONCURRENT.
+ *
+ * @param table The table being destroyed.
+ */
+void destroy_stripes(HashTable *table) {
+    if (table->stripes == NULL) return;
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        mtx_destroy(&table->stripes[i].lock);
+        free(table->stripes[i].retired);
+    }
+    free(table->stripes);
+    table->stripes = NULL;
+}
+
+/**
+ * Takes the writer lock of a first-level letter.
+ *
+ * @param table The table to lock.
+ * @param letter The first-level index.
+ */
+void lock_stripe(const HashTable *table, unsigned int letter) {
+    if (table->stripes != NULL) {
+        mtx_lock(&table->stripes[letter].lock);
+    }
+}
+
+/**
+ * Releases the writer lock of a first-level letter.
+ *
+ * @param table The table to unlock.
+ * @param letter The first-level index.
+ */
+void unlock_stripe(const HashTable *table, unsigned int letter) {
+    if (table->stripes != NULL) {
+        mtx_unlock(&table->stripes[letter].lock);
+    }
+}
+
+/**
+ * Creates the thread-specific key whose destructor hands a thread's reader 
+ * slot back when the thread exits. Called once through call_once.
+ */
+void init_reader_key(void) {
+    reader_key_ready = tss_create(&reader_key, release_reader_slot) == thrd_success;
+}
+
+/**
+ * Returns a reader slot to the pool.
+ *
+ * @param slot The ReaderSlot owned by the exiting thread.
+ */
+void release_reader_slot(void *slot) {
+    ReaderSlot *reader = (ReaderSlot *)slot;
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+    atomic_store_explicit(&reader->in_use, 0, memory_order_release);
+}
+
+/**
+ * Returns the calling thread's reader slot.
+ *
+ * A free slot is claimed on the thread's first read and kept until the 
+ * thread exits.
+ *
+ * @return The slot, or NULL if all MAX_READERS slots are owned by other threads.
+ */
+ReaderSlot* acquire_reader_slot(void) {
+    if (thread_reader != NULL) return thread_reader;
+
+    call_once(&reader_key_once, init_reader_key);
+    if (!reader_key_ready) return NULL; // A claimed slot could never be given back
+
+    for (int i = 0; i < MAX_READERS; i++) {
+        int expected = 0;
+        if (!atomic_compare_exchange_strong(&reader_slots[i].in_use, &expected, 1)) continue;
+        if (tss_set(reader_key, &reader_slots[i]) != thrd_success) {
+            atomic_store(&reader_slots[i].in_use, 0);
+            return NULL;
+        }
+        int limit = atomic_load(&reader_slot_limit);
+        while (limit <= i && !atomic_compare_exchange_weak(&reader_slot_limit, &limit, i + 1)) {
+        }
+        thread_reader = &reader_slots[i];
+        return thread_reader;
+    }
+    return NULL;
+}
+
+/**
+ * Starts a wait-free read of a HASH_TABLE_CONCURRENT table.
+ *
+ * The global epoch is published in the thread's reader slot with a 
+ * sequentially consistent store, which orders it before every pointer the 
+ * read loads afterwards.
+ *
+ * @return The reader slot to pass to exit_read, or NULL if no slot is available.
+ */
+ReaderSlot* enter_read(void) {
+    ReaderSlot *slot = acquire_reader_slot();
+    if (slot != NULL) {
+        atomic_store(&slot->epoch, atomic_load(&global_epoch));
+    }
+    return slot;
+}
+
+/**
+ * Ends a read started with enter_read.
+ *
+ * @param slot The slot returned by enter_read.
+ */
+void exit_read(ReaderSlot *slot) {
+    atomic_store_explicit(&slot->epoch, 0, memory_order_release);
+}
+
+/**
+ * Advances the global epoch by one if every reader inside a read has 
+ * observed the current epoch.
+ *
+ * @return The global epoch after the attempt.
+ */
+uint64_t advance_epoch(void) {
+    uint64_t epoch = atomic_load(&global_epoch);
+    int limit = atomic_load(&reader_slot_limit);
+    for (int i = 0; i < limit; i++) {
+        uint64_t seen = atomic_load(&reader_slots[i].epoch);
+        if (seen != 0 && seen != epoch) {
+            return epoch; // A reader from an older epoch is still active
+        }
+    }
+    atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+    return atomic_load(&global_epoch);
+}
+
+/**
+ * Defers freeing a node that was just unlinked from a HASH_TABLE_CONCURRENT table.
+ *
+ * The node is tagged with the current global epoch and queued on the stripe of 
+ * its first letter, whose lock the caller holds. Every RECLAIM_THRESHOLD 
+ * retirements the stripe tries to free what has become unreachable. If the 
+ * queue cannot grow the node is leaked rather than freed under a reader.
+ *
+ * @param table The table that owned the node.
+ * @param node The unlinked node.
+ */
+void retire_node(HashTable *table, Node *node) {
+    Stripe *stripe = &table->stripes[schema_index(table->schema, 0, node->name)];
+    if (stripe->retired_count == stripe->retired_capacity) {
+        size_t capacity = stripe->retired_capacity ? stripe->retired_capacity * 2 : RECLAIM_THRESHOLD;
+        RetiredNode *retired = (RetiredNode *)realloc(stripe->retired, capacity * sizeof(RetiredNode));
+        if (!retired) {
+            printf("Memory allocation failed for retired node list\n");
+            return;
+        }
+        stripe->retired = retired;
+        stripe->retired_capacity = capacity;
+    }
+
+    // The unlink must be visible before the epoch is sampled
+    atomic_thread_fence(memory_order_seq_cst);
+    stripe->retired[stripe->retired_count].node = node;
+    stripe->retired[stripe->retired_count].epoch = atomic_load(&global_epoch);
+    stripe->retired_count++;
+    if (stripe->retired_count % RECLAIM_THRESHOLD == 0) {
+        reclaim_stripe(stripe);
+    }
+}
+
+/**
+ * Frees the retired nodes of a stripe that no reader can reach anymore.
+ *
+ * A node retired in epoch e is unreachable once the global epoch reaches 
+ * e + 2: advancing to e + 1 and then to e + 2 required every active reader 
+ * to have started after the node was unlinked. The caller holds the 
+ * stripe's lock.
+ *
+ * @param stripe The stripe to reclaim.
+ */
+void reclaim_stripe(Stripe *stripe) {
+    uint64_t epoch = advance_epoch();
+    size_t kept = 0;
+    for (size_t i = 0; i < stripe->retired_count; i++) {
+        RetiredNode *entry = &stripe->retired[i];
+        if (entry->epoch + 2 <= epoch) {
+            free(entry->node->name);
+            free(entry->node);
+        } else {
+            stripe->retired[kept++] = *entry;
+        }
+    }
+    stripe->retired_count = kept;
+}
+
+/**
+ * Frees every retired node of a table.
+ *
+ * Only safe when no other thread is reading the table. Does nothing for 
+ * tables without HASH_TABLE_CONCURRENT.
+ *
+ * @param table The table being cleared.
+ */
+void free_retired(HashTable *table) {
+    if (table->stripes == NULL) return;
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        Stripe *stripe = &table->stripes[i];
+        for (size_t j = 0; j < stripe->retired_count; j++) {
+            free(stripe->retired[j].node->name);
+            free(stripe->retired[j].node);
+        }
+        stripe->retired_count = 0;
+    }
+}
+
+/**
+ * Computes the one-byte fingerprint of a name.
+ *
+ * The fingerprint is a 32-bit FNV-1a hash of the whole name folded to 8 bits. 
+ * Flat buckets compare fingerprints first, so a full string comparison only 
+ * happens for about one in 256 non-matching names.
+ *
+ * @param name The normalized name.
+ * @param length The length of name.
+ * @return The fingerprint.
+ */
+uint8_t name_tag(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return (uint8_t)(hash ^ (hash >> 8) ^ (hash >> 16) ^ (hash >> 24));
+}
+
+/**
+ * Computes the 64-bit hash block filters use for a name.
+ *
+ * FNV-1a 64 over the name, followed by a multiply-xorshift finalizer so that 
+ * the low bits, which pick the line, and the high bits, which pick the bits 
+ * inside it, are both well mixed.
+ *
+ * @param name The normalized name.
+ * @param length The length of name.
+ * @return The hash.
+ */
+uint64_t filter_hash(const char *name, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * Returns whether a block filter may hold a name.
+ *
+ * The low bits of the hash pick the line. Each of the table's filter_hashes 
+ * bits within it is the top 9 bits of the hash multiplied once more by an 
+ * odd constant. Plain double hashing inside a 512-bit line only has 2^17 
+ * distinct bit patterns, which put a floor of about 0.1% under the 
+ * false-positive rate.
+ *
+ * @param table The table, for its number of hashes.
+ * @param filter The filter.
+ * @param hash The name's filter_hash.
+ * @return Non-zero if the name may be stored, 0 if it certainly is not.
+ */
+int filter_may_contain(const HashTable *table, const BlockFilter *filter, uint64_t hash) {
+    const uint64_t *line = filter->lines + (size_t)(hash & filter->line_mask) * FILTER_LINE_WORDS;
+    for (unsigned int i = 0; i < table->filter_hashes; i++) {
+        hash *= FILTER_STEP;
+        uint32_t b = (uint32_t)(hash >> FILTER_BIT_SHIFT);
+        if (!((line[b / 64] >> (b % 64)) & 1)) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Sets the bits of a name in a block filter.
+ *
+ * @param table The table, for its number of hashes.
+ * @param filter The filter.
+ * @param hash The name's filter_hash.
+ */
+void filter_set(const HashTable *table, BlockFilter *filter, uint64_t hash) {
+    uint64_t *line = filter->lines + (size_t)(hash & filter->line_mask) * FILTER_LINE_WORDS;
+    for (unsigned int i = 0; i < table->filter_hashes; i++) {
+        hash *= FILTER_STEP;
+        uint32_t b = (uint32_t)(hash >> FILTER_BIT_SHIFT);
+        line[b / 64] |= (uint64_t)1 << (b % 64);
+    }
+}
+
+/**
+ * Records a name that was just added to a block in the block's filter.
+ *
+ * A missing or full filter is rebuilt from the block, which already holds the 
+ * new name; otherwise the name's bits are set. If the rebuild fails the name 
+ * still goes into the old filter, which then answers less precisely but never 
+ * wrongly. Does nothing unless the table has HASH_TABLE_FILTER.
+ *
+ * @param table The table.
+ * @param block The block the name was added to.
+ * @param name The normalized name.
+ * @param length The length of name.
+ */
+void filter_add(const HashTable *table, HashBlock *block, const char *name, size_t length) {
+    if (!(table->flags & HASH_TABLE_FILTER)) return;
+    BlockFilter *filter = block->filter;
+    if ((filter == NULL || filter->names >= filter->capacity) && rebuild_filter(table, block) == 0) {
+        return;
+    }
+    if (filter != NULL) {
+        filter_set(table, filter, filter_hash(name, length));
+        filter->names++;
+    }
+}
+
+/**
+ * Records a name that was just removed from a block in the block's filter.
+ *
+ * Bloom filters cannot clear a name's bits, since other names may share 
+ * them, so removals are only counted. Once half the names the filter was 
+ * built from are gone it is rebuilt, which also shrinks it.
+ *
+ * @param table The table.
+ * @param block The block the name was removed from.
+ */
+void filter_remove(const HashTable *table, HashBlock *block) {
+    BlockFilter *filter = block->filter;
+    if (filter == NULL) return;
+    filter->removed++;
+    if (filter->removed * 2 > filter->names) {
+        rebuild_filter(table, block);
+    }
+}
+
+// State of rebuild_filter while it visits a block's names
+typedef struct FilterBuild {
+    const HashTable *table;  // Table, for its number of hashes
+    BlockFilter *filter;     // Filter being built, or NULL while the names are counted
+    size_t names;            // Names visited
+} FilterBuild;
+
+/**
+ * Builds a block's filter from the names it holds.
+ *
+ * The names are counted, the filter gets the smallest power of two of lines 
+ * that holds twice as many at the table's bits per name, and every name's 
+ * bits are set. The lines start on a cache-line boundary inside the filter's 
+ * allocation. On failure the old filter is kept.
+ *
+ * @param table The table.
+ * @param block The block.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+int rebuild_filter(const HashTable *table, HashBlock *block) {
+    FilterBuild build = { table, NULL, 0 };
+    for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+        if (table->flags & HASH_TABLE_FLAT) {
+            build.names += block->buckets[k] ? block->buckets[k]->count : 0;
+        } else {
+            visit_chain(block->third_level[k], filter_visit, &build);
+        }
+    }
+
+    size_t wanted = (build.names * 2 * table->filter_bits + FILTER_LINE_BITS - 1) / FILTER_LINE_BITS;
+    size_t lines = 1;
+    while (lines < wanted) {
+        lines *= 2;
+    }
+    size_t capacity = lines * FILTER_LINE_BITS / table->filter_bits;
+    if (capacity > UINT32_MAX) {
+        printf("Too many names for a block filter\n");
+        return 1;
+    }
+    BlockFilter *filter = (BlockFilter *)malloc(sizeof(BlockFilter) + 63 + lines * FILTER_LINE_BITS / 8);
+    if (!filter) {
+        printf("Memory allocation failed for BlockFilter\n");
+        return 1;
+    }
+    filter->line_mask = (uint32_t)(lines - 1);
+    filter->capacity = (uint32_t)capacity;
+    filter->names = (uint32_t)build.names;
+    filter->removed = 0;
+    filter->lines = (uint64_t *)(((uintptr_t)(filter + 1) + 63) & ~(uintptr_t)63);
+    memset(filter->lines, 0, lines * FILTER_LINE_BITS / 8);
+
+    build.filter = filter;
+    for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+        if (table->flags & HASH_TABLE_FLAT) {
+            const struct FlatBucket *bucket = block->buckets[k];
+            for (uint32_t e = 0; bucket != NULL && e < bucket->count; e++) {
+                filter_set(table, filter, filter_hash(bucket->pool + bucket->entries[e].offset,
+                                                      bucket->entries[e].length));
+            }
+        } else {
+            visit_chain(block->third_level[k], filter_visit, &build);
+        }
+    }
+    free(block->filter);
+    block->filter = filter;
+    return 0;
+}
+
+/**
+ * Counts a name, or sets its bits once the filter exists (visit_chain callback).
+ *
+ * @param name The stored name.
+ * @param context The FilterBuild.
+ * @return Always 0, to visit every name.
+ */
+int filter_visit(const char *name, void *context) {
+    FilterBuild *build = (FilterBuild *)context;
+    if (build->filter == NULL) {
+        build->names++;
+    } else {
+        filter_set(build->table, build->filter, filter_hash(name, strlen(name)));
+    }
+    return 0;
+}
+
+/**
+ * Searches a flat bucket for a name.
+ *
+ * The fingerprint array is scanned 32 entries at a time with the kernel for 
+ * the active SIMD level; only entries with a matching fingerprint and length 
+ * have their name compared against the string pool.
+ *
+ * @param bucket The bucket to search, or NULL.
+ * @param name The normalized name.
+ * @param length The length of name.
+ * @param compares If not NULL, the number of entries whose fingerprint matched is added to it.
+ * @return The index of the first matching entry, or -1 if the name is not present.
+ */
+long find_flat_index(const struct FlatBucket *bucket, const char *name, size_t length, unsigned int *compares) {
+    if (bucket == NULL) return -1;
+    unsigned int matched = 0;
+
+    static const TagKernel kernels[] = { match_tags_scalar, match_tags_sse2, match_tags_avx2 };
+    TagKernel match_tags = kernels[get_simd_level()];
+    uint8_t tag = name_tag(name, length);
+
+    // The fingerprint array is padded to FLAT_TAG_ALIGN, so whole blocks can be loaded
+    for (uint32_t base = 0; base < bucket->count; base += FLAT_TAG_ALIGN) {
+        uint32_t mask = match_tags(bucket->tags + base, tag);
+        uint32_t remaining = bucket->count - base;
+        if (remaining < FLAT_TAG_ALIGN) {
+            mask &= (1u << remaining) - 1;
+        }
+        while (mask != 0) {
+            uint32_t i = base + lowest_bit(mask);
+            matched++;
+            if (bucket->entries[i].length == length &&
+                memcmp(bucket->pool + bucket->entries[i].offset, name, length) == 0) {
+                if (compares != NULL) *compares += matched;
+                return (long)i;
+            }
+            mask &= mask - 1;
+        }
+    }
+    if (compares != NULL) *compares += matched;
+    return -1;
+}
+
+/**
+ * Inserts a name into a flat bucket.
+ *
+ * The bucket is created on first use. The insertion point is found with a 
+ * binary search over the sorted entries (after any equal names, so duplicates 
+ * keep their insertion order just like insert_sorted), then the entries and 
+ * fingerprints behind it are shifted up by one and the name is appended to 
+ * the string pool. With existing set, the same search first checks whether 
+ * the name is already stored, and nothing is inserted if it is.
+ *
+ * @param slot The third-level slot holding the bucket.
+ * @param name The normalized name.
+ * @param length The length of name.
+ * @param value The value stored with the name.
+ * @param existing If not NULL, receives the value field of the first entry already 
+ *                 holding the name, or NULL if the name was inserted.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+int flat_insert(struct FlatBucket **slot, const char *name, size_t length, void *value, void ***existing) {
+    struct FlatBucket *bucket = *slot;
+
+    // Upper bound: first entry whose name is greater than the new one
+    uint32_t low = 0, high = bucket ? bucket->count : 0;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (strcmp(bucket->pool + bucket->entries[mid].offset, name) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (existing != NULL) {
+        // Any equal entries end right before the upper bound
+        *existing = NULL;
+        if (low > 0 && strcmp(bucket->pool + bucket->entries[low - 1].offset, name) == 0) {
+            for (high = low - 1; high > 0 && strcmp(bucket->pool + bucket->entries[high - 1].offset, name) == 0; high--) {
+            }
+            *existing = &bucket->entries[high].value;
+            return 0;
+        }
+    }
+
+    if (bucket == NULL) {
+        bucket = (struct FlatBucket *)calloc(1, sizeof(struct FlatBucket));
+        if (!bucket) {
+            printf("Memory allocation failed for FlatBucket\n");
+            return 1;
+        }
+        *slot = bucket;
+    }
+    if (bucket->count == bucket->capacity && flat_grow_entries(bucket) != 0) {
+        return 1;
+    }
+    if (bucket->pool_size - bucket->pool_used < length + 1 && flat_reserve_pool(bucket, length + 1) != 0) {
+        return 1;
+    }
+
+    uint32_t tail = bucket->count - low;
+    memmove(&bucket->entries[low + 1], &bucket->entries[low], tail * sizeof(FlatEntry));
+    memmove(&bucket->tags[low + 1], &bucket->tags[low], tail);
+    bucket->entries[low].offset = bucket->pool_used;
+    bucket->entries[low].length = (uint32_t)length;
+    bucket->entries[low].value = value;
+    bucket->tags[low] = name_tag(name, length);
+
+    memcpy(bucket->pool + bucket->pool_used, name, length + 1);
+    bucket->pool_used += (uint32_t)(length + 1);
+    bucket->count++;
+    return 0;
+}
+
+/**
+ * Removes one occurrence of a name from a flat bucket.
+ *
+ * The entry and fingerprint are removed by shifting the tail of both arrays 
+ * down. The name's bytes stay in the pool as dead space until the pool is 
+ * next compacted by flat_reserve_pool. A bucket that becomes empty is freed.
+ *
+ * @param slot The third-level slot holding the bucket.
+ * @param name The normalized name.
+ * @param length The length of name.
+ * @param value If not NULL, receives the value of the removed entry.
+ * @return 0 if the name was removed, or 1 if it was not found.
+ */
+int flat_remove(struct FlatBucket **slot, const char *name, size_t length, void **value) {
+    struct FlatBucket *bucket = *slot;
+    long index = find_flat_index(bucket, name, length, NULL);
+    if (index < 0) return 1;
+    if (value != NULL) *value = bucket->entries[index].value;
+
+    uint32_t tail = bucket->count - (uint32_t)index - 1;
+    memmove(&bucket->entries[index], &bucket->entries[index + 1], tail * sizeof(FlatEntry));
+    memmove(&bucket->tags[index], &bucket->tags[index + 1], tail);
+    bucket->pool_dead += (uint32_t)(length + 1);
+    bucket->count--;
+
+    if (bucket->count == 0) {
+        free_flat_bucket(bucket);
+        *slot = NULL;
+    }
+    return 0;
+}
+
+/**
+ * Doubles the entry capacity of a flat bucket.
+ *
+ * Entries and fingerprints share a single allocation (entries first, then 
+ * fingerprints padded to FLAT_TAG_ALIGN), so both arrays are moved to the 
+ * new block.
+ *
+ * @param bucket The bucket to grow.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+int flat_grow_entries(struct FlatBucket *bucket) {
+    uint32_t capacity = bucket->capacity ? bucket->capacity * 2 : FLAT_MIN_CAPACITY;
+    size_t tag_bytes = flat_tag_bytes(capacity);
+    FlatEntry *entries = (FlatEntry *)malloc((size_t)capacity * sizeof(FlatEntry) + tag_bytes);
+    if (!entries) {
+        printf("Memory allocation failed for FlatBucket entries\n");
+        return 1;
+    }
+    uint8_t *tags = (uint8_t *)(entries + capacity);
+    memset(tags, 0, tag_bytes); // Padding is loaded by the SIMD scans
+    if (bucket->count > 0) {
+        memcpy(entries, bucket->entries, bucket->count * sizeof(FlatEntry));
+        memcpy(tags, bucket->tags, bucket->count);
+    }
+    free(bucket->entries);
+    bucket->entries = entries;
+    bucket->tags = tags;
+    bucket->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Returns the padded size of a flat bucket's fingerprint array.
+ *
+ * @param capacity The entry capacity of the bucket.
+ * @return capacity rounded up to a multiple of FLAT_TAG_ALIGN.
+ */
+size_t flat_tag_bytes(uint32_t capacity) {
+    return ((size_t)capacity + FLAT_TAG_ALIGN - 1) & ~(size_t)(FLAT_TAG_ALIGN - 1);
+}
+
+/**
+ * Makes room in a flat bucket's string pool.
+ *
+ * Pools grow by doubling. When removed names occupy part of the pool, the 
+ * live names are compacted into the new pool in entry order and their offsets 
+ * rewritten, so dead space never survives a growth step.
+ *
+ * @param bucket The bucket whose pool needs room.
+ * @param needed The number of free bytes required.
+ * @return 0 on success, or 1 if memory allocation fails or the pool would exceed 4 GB.
+ */
+int flat_reserve_pool(struct FlatBucket *bucket, size_t needed) {
+    size_t live = (size_t)bucket->pool_used - bucket->pool_dead;
+    size_t size = bucket->pool_size ? bucket->pool_size : FLAT_MIN_POOL;
+    while (size < live + needed) {
+        size *= 2;
+    }
+    if (size > UINT32_MAX) {
+        printf("FlatBucket string pool is full\n");
+        return 1;
+    }
+
+    if (bucket->pool_dead == 0) {
+        char *pool = (char *)realloc(bucket->pool, size);
+        if (!pool) {
+            printf("Memory allocation failed for FlatBucket pool\n");
+            return 1;
+        }
+        bucket->pool = pool;
+        bucket->pool_size = (uint32_t)size;
+        return 0;
+    }
+
+    char *pool = (char *)malloc(size);
+    if (!pool) {
+        printf("Memory allocation failed for FlatBucket pool\n");
+        return 1;
+    }
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < bucket->count; i++) {
+        FlatEntry *entry = &bucket->entries[i];
+        memcpy(pool + used, bucket->pool + entry->offset, entry->length + 1);
+        entry->offset = used;
+        used += entry->length + 1;
+    }
+    free(bucket->pool);
+    bucket->pool = pool;
+    bucket->pool_size = (uint32_t)size;
+    bucket->pool_used = used;
+    bucket->pool_dead = 0;
+    return 0;
+}
+
+/**
+ * Frees a flat bucket, its entries and its string pool.
+ *
+ * @param bucket The bucket to free. NULL is ignored.
+ */
+void free_flat_bucket(struct FlatBucket *bucket) {
+    if (bucket == NULL) return;
+    free(bucket->entries);
+    free(bucket->pool);
+    free(bucket);
+}
+
+/**
+ * Converts a given string to uppercase while validating its content.
+ *
+ * This function takes an input string, validates that it meets the required 
+ * criteria (non-NULL, at least 3 characters, and only alphabetic characters),
+ * and converts all its characters to uppercase. The resulting string is returned 
+ * to the caller via an output pointer. If any validation fails, an error message 
+ * is printed, and the function returns an error code.
+ *
+ * @param input_name The input string to be validated and converted.
+ * @param output_name A pointer to a string where the converted uppercase string 
+ *                    will be stored. Memory is dynamically allocated and must
+ *                    be freed by the caller.
+ * @return 0 on success, or 1 on failure (e.g., invalid input or memory allocation issues).
+ */
+int convert_to_upper(const char *input_name, char **output_name) {
+    return convert_to_upper_buffer(input_name, NULL, 0, output_name, NULL);
+}
+
+/**
+ * Converts a given string to uppercase, using a caller-supplied buffer when possible.
+ *
+ * This is the implementation behind convert_to_upper: normalize_name for a 
+ * table without a UTF-8 key mode, so only ASCII letters are accepted, which 
+ * matches isalpha in the default "C" locale.
+ *
+ * @param input_name The input string to be validated and converted.
+ * @param buffer A scratch buffer for the converted name, or NULL to always allocate.
+ * @param buffer_size The size of buffer in bytes.
+ * @param output_name Receives the converted uppercase string.
+ * @param output_length Receives the length of the converted string, or NULL if not needed.
+ * @return 0 on success, or 1 on failure (e.g., invalid input or memory allocation issues).
+ */
+int convert_to_upper_buffer(const char *input_name, char *buffer, size_t buffer_size,
+                            char **output_name, size_t *output_length) {
+    return normalize_name(0, input_name, buffer, buffer_size, output_name, output_length);
+}
+
+/**
+ * Validates and normalizes a name in the key mode selected by a table's flags.
+ *
+ * Names that fit in the buffer (including the terminator) are converted in 
+ * place there, so the hot insert and lookup paths do not touch the heap. 
+ * Longer names are copied to a heap allocation. Either way, the caller 
+ * releases the result with release_name.
+ *
+ * Every name first goes through the letter kernel of the active SIMD level 
+ * (see get_simd_level), which copies, validates and uppercases it in a 
+ * single pass. Tables without HASH_TABLE_UTF8 or HASH_TABLE_FOLD_ACCENTS 
+ * accept nothing else. In the UTF-8 modes, a name the kernel rejects is 
+ * normalized again by fold_utf8, which also accepts digits, spaces, 
+ * punctuation and non-ASCII letters. Letter-only names therefore cost the 
+ * same in every mode. Normalized names never grow, and must still be at 
+ * least three bytes long.
+ *
+ * @param flags The table's flags; only HASH_TABLE_UTF8 and HASH_TABLE_FOLD_ACCENTS are read.
+ * @param input_name The input string to be validated and converted.
+ * @param buffer A scratch buffer for the converted name, or NULL to always allocate.
+ * @param buffer_size The size of buffer in bytes.
+ * @param output_name Receives the normalized string.
+ * @param output_length Receives the length of the normalized string, or NULL if not needed.
+ * @return 0 on success, or 1 on failure (e.g., invalid input or memory allocation issues).
+ */
+int normalize_name(unsigned int flags, const char *input_name, char *buffer, size_t buffer_size,
+                   char **output_name, size_t *output_length) {
+    size_t length = input_name ? strlen(input_name) : 0;
+
+    // Validate input to ensure it is non-NULL and has at least 3 characters
+    if (input_name == NULL || length < 3) {
+        printf("Name must have at least 3 characters: %s\n", input_name ? input_name : "(null)");
+        return 1; // Return an error if input is invalid
+    }
+
+    // Create a mutable copy of the input string for processing
+    char *name = buffer;
+    if (buffer == NULL || length >= buffer_size) {
+        name = (char *)malloc(length + 1);
+        if (name == NULL) {
+            printf("Memory allocation failed.\n");
+            return 1; // Return an error if memory allocation fails
+        }
+    }
+
+    // Validate and convert the whole key with the active SIMD kernel, and fall
+    // back to the UTF-8 pass for anything but letters when the table allows it
+    static const UpperKernel kernels[] = { upper_scalar, upper_sse2, upper_avx2 };
+    if (kernels[get_simd_level()](name, input_name, length) != 0) {
+        size_t folded = (flags & KEY_MODE_FLAGS) != 0
+            ? fold_utf8(name, input_name, length, (flags & HASH_TABLE_FOLD_ACCENTS) != 0)
+            : SIZE_MAX;
+        if (folded == SIZE_MAX) {
+            // If a character is invalid, print an error, free memory, and exit
+            printf("Invalid character in name: %s\n", input_name);
+            release_name(name, buffer); // Avoid memory leaks
+            return 1;
+        }
+        if (folded < 3) {
+            printf("Name must have at least 3 characters: %s\n", input_name);
+            release_name(name, buffer);
+            return 1;
+        }
+        length = folded;
+    }
+    name[length] = '\0';
+
+    // Pass the converted uppercase string back to the caller via the output pointer
+    *output_name = name;
+    if (output_length != NULL) {
+        *output_length = length;
+    }
+    return 0; // Return success
+}
+
+/**
+ * Releases a name produced by convert_to_upper_buffer.
+ *
+ * @param name The converted name.
+ * @param buffer The scratch buffer that was passed to convert_to_upper_buffer.
+ */
+void release_name(char *name, const char *buffer) {
+    if (name != buffer) {
+        free(name);
+    }
+}
+
+// Unaccented uppercase form of U+00C0 to U+017F, or NULL for the two signs in the
+// range. Letters without a decomposition get their usual transliteration.
+static const char *const latin_bases[] = {
+    "A", "A", "A", "A", "A", "A", "AE", "C", "E", "E", "E", "E", "I", "I", "I", "I",
+    "D", "N", "O", "O", "O", "O", "O", NULL, "O", "U", "U", "U", "U", "Y", "TH", "SS",
+    "A", "A", "A", "A", "A", "A", "AE", "C", "E", "E", "E", "E", "I", "I", "I", "I",
+    "D", "N", "O", "O", "O", "O", "O", NULL, "O", "U", "U", "U", "U", "Y", "TH", "Y",
+    "A", "A", "A", "A", "A", "A", "C", "C", "C", "C", "C", "C", "C", "C", "D", "D",
+    "D", "D", "E", "E", "E", "E", "E", "E", "E", "E", "E", "E", "G", "G", "G", "G",
+    "G", "G", "G", "G", "H", "H", "H", "H", "I", "I", "I", "I", "I", "I", "I", "I",
+    "I", "I", "IJ", "IJ", "J", "J", "K", "K", "K", "L", "L", "L", "L", "L", "L", "L",
+    "L", "L", "L", "N", "N", "N", "N", "N", "N", "N", "N", "N", "O", "O", "O", "O",
+    "O", "O", "OE", "OE", "R", "R", "R", "R", "R", "R", "S", "S", "S", "S", "S", "S",
+    "S", "S", "T", "T", "T", "T", "T", "T", "U", "U", "U", "U", "U", "U", "U", "U",
+    "U", "U", "U", "U", "W", "W", "Y", "Y", "Y", "Z", "Z", "Z", "Z", "Z", "Z", "S",
+};
+
+/**
+ * Validates and case folds a UTF-8 key in a single streaming pass.
+ *
+ * ASCII letters are uppercased, and other printable ASCII (digits, spaces, 
+ * hyphens, apostrophes) is kept. Multi-byte sequences are decoded, mapped 
+ * to their simple uppercase form (see upper_code_point) and encoded again. 
+ * With strip_accents set, Latin letters of U+00C0 to U+017F become their 
+ * ASCII base ("Ø" gives "O", "ß" gives "SS"), accented Greek and Cyrillic 
+ * letters lose their accent, and combining marks (U+0300 to U+036F) are 
+ * dropped, so decomposed input folds like precomposed input. No mapping 
+ * writes more bytes than it reads, so dst needs no more than length bytes.
+ *
+ * Control characters, malformed or overlong sequences, surrogates and code 
+ * points past U+10FFFF are rejected.
+ *
+ * @param dst Receives the folded key (no terminator).
+ * @param src The key to fold.
+ * @param length The number of bytes in src.
+ * @param strip_accents Non-zero to strip accents as well.
+ * @return The number of bytes written, or SIZE_MAX if the key is invalid.
+ */
+size_t fold_utf8(char *dst, const char *src, size_t length, int strip_accents) {
+    const unsigned char *in = (const unsigned char *)src;
+    size_t out = 0;
+    for (size_t i = 0; i < length; ) {
+        unsigned char c = in[i];
+        if (c < 0x80) {
+            if (c < 0x20 || c == 0x7F) return SIZE_MAX;
+            dst[out++] = (char)((unsigned char)(c - 'a') < 26 ? c - 0x20 : c);
+            i++;
+            continue;
+        }
+        uint32_t code_point;
+        size_t read = decode_utf8(in + i, length - i, &code_point);
+        if (read == 0 || code_point < 0xA0) return SIZE_MAX;
+        i += read;
+
+        code_point = upper_code_point(code_point);
+        if (strip_accents) {
+            if (code_point >= 0x300 && code_point <= 0x36F) continue;
+            if (code_point >= 0xC0 && code_point <= 0x17F && latin_bases[code_point - 0xC0] != NULL) {
+                const char *base = latin_bases[code_point - 0xC0];
+                while (*base) dst[out++] = *base++;
+                continue;
+            }
+            code_point = strip_code_point(code_point);
+        }
+        if (code_point < 0x80) {
+            dst[out++] = (char)code_point;
+        } else if (code_point < 0x800) {
+            dst[out++] = (char)(0xC0 | (code_point >> 6));
+            dst[out++] = (char)(0x80 | (code_point & 0x3F));
+        } else if (code_point < 0x10000) {
+            dst[out++] = (char)(0xE0 | (code_point >> 12));
+            dst[out++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            dst[out++] = (char)(0x80 | (code_point & 0x3F));
+        } else {
+            dst[out++] = (char)(0xF0 | (code_point >> 18));
+            dst[out++] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+            dst[out++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            dst[out++] = (char)(0x80 | (code_point & 0x3F));
+        }
+    }
+    return out;
+}
+
+/**
+ * Folds the first characters of a name like fold_utf8, as many as a schema can read.
+ *
+ * Used by hash_table_build to partition UTF-8 names by their normalized 
+ * leading bytes without normalizing the whole name. The name is folded in 
+ * chunks cut at character boundaries until SCHEMA_POSITIONS bytes are out, 
+ * which gives the same bytes as folding it whole.
+ *
+ * @param name The name as given by the caller.
+ * @param strip_accents Non-zero to strip accents as well.
+ * @param prefix Receives the folded prefix (SCHEMA_POSITIONS + 1 bytes).
+ * @return The length of the prefix, or 0 if the name is not valid UTF-8.
+ */
+size_t fold_prefix(const char *name, int strip_accents, char *prefix) {
+    char chunk[4 * SCHEMA_POSITIONS];
+    size_t length = 0;
+    while (length < SCHEMA_POSITIONS && *name != '\0') {
+        size_t take = 0;
+        while (take < sizeof(chunk) && name[take] != '\0') take++;
+        size_t cut = take;
+        while (cut > 0 && ((unsigned char)name[cut] & 0xC0) == 0x80) cut--;
+        size_t folded = cut > 0 ? fold_utf8(chunk, name, cut, strip_accents) : SIZE_MAX;
+        if (folded == SIZE_MAX) return 0;
+        if (folded > SCHEMA_POSITIONS - length) folded = SCHEMA_POSITIONS - length;
+        memcpy(prefix + length, chunk, folded);
+        length += folded;
+        name += cut;
+    }
+    prefix[length] = '\0';
+    return length;
+}
+
+/**
+ * Decodes one UTF-8 sequence.
+ *
+ * @param src The first byte of the sequence.
+ * @param length The bytes available from src.
+ * @param code_point Receives the decoded code point.
+ * @return The length of the sequence, or 0 if it is malformed, overlong, 
+ *         truncated, a surrogate or past U+10FFFF.
+ */
+size_t decode_utf8(const unsigned char *src, size_t length, uint32_t *code_point) {
+    size_t size;
+    uint32_t value, minimum;
+    if (src[0] >= 0xC2 && src[0] <= 0xDF) {
+        size = 2; value = src[0] & 0x1F; minimum = 0x80;
+    } else if ((src[0] & 0xF0) == 0xE0) {
+        size = 3; value = src[0] & 0x0F; minimum = 0x800;
+    } else if (src[0] >= 0xF0 && src[0] <= 0xF4) {
+        size = 4; value = src[0] & 0x07; minimum = 0x10000;
+    } else {
+        return 0;
+    }
+    if (length < size) return 0;
+    for (size_t i = 1; i < size; i++) {
+        if ((src[i] & 0xC0) != 0x80) return 0;
+        value = (value << 6) | (src[i] & 0x3F);
+    }
+    if (value < minimum || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) return 0;
+    *code_point = value;
+    return size;
+}
+
+/**
+ * Returns the simple uppercase mapping of a code point.
+ *
+ * Covers Latin-1, Latin Extended-A, Greek and Cyrillic, which is where the 
+ * names a table meets fold in practice. Every mapping keeps the length of 
+ * the UTF-8 encoding or shortens it ("ı" and "ſ" give ASCII letters); "ß" 
+ * has no single-letter uppercase and is kept. Other code points are 
+ * returned unchanged.
+ *
+ * @param code_point The code point.
+ * @return Its uppercase form.
+ */
+uint32_t upper_code_point(uint32_t code_point) {
+    uint32_t c = code_point;
+    if (c < 0x100) {
+        if (c == 0xB5) return 0x39C;
+        if (c == 0xFF) return 0x178;
+        return c >= 0xE0 && c != 0xF7 ? c - 0x20 : c;
+    }
+    if (c < 0x180) {
+        if (c == 0x131) return 'I';
+        if (c == 0x17F) return 'S';
+        if (c < 0x138 && c != 0x130) return c & ~1u;
+        if ((c > 0x138 && c < 0x149) || (c > 0x178 && c < 0x17F)) return (c & 1) ? c : c - 1;
+        if (c > 0x149 && c < 0x178) return c & ~1u;
+        return c;
+    }
+    if (c >= 0x3AC && c <= 0x3CE) {
+        if (c == 0x3AC) return 0x386;
+        if (c <= 0x3AF) return c - 0x25;
+        if (c == 0x3C2) return 0x3A3;
+        if (c >= 0x3B1 && c <= 0x3CB) return c - 0x20;
+        if (c == 0x3CC) return 0x38C;
+        if (c >= 0x3CD) return c - 0x3F;
+        return c;
+    }
+    if (c >= 0x430 && c <= 0x44F) return c - 0x20;
+    if (c >= 0x450 && c <= 0x45F) return c - 0x50;
+    return c;
+}
+
+/**
+ * Returns the unaccented form of an uppercase Greek or Cyrillic letter.
+ *
+ * These are the letters whose canonical decomposition is a base letter 
+ * followed by combining marks. Other code points are returned unchanged.
+ *
+ * @param code_point The uppercase code point.
+ * @return The base letter.
+ */
+uint32_t strip_code_point(uint32_t code_point) {
+    switch (code_point) {
+    case 0x386: return 0x391;
+    case 0x388: return 0x395;
+    case 0x389: return 0x397;
+    case 0x38A: case 0x390: case 0x3AA: return 0x399;
+    case 0x38C: return 0x39F;
+    case 0x38E: case 0x3AB: case 0x3B0: return 0x3A5;
+    case 0x38F: return 0x3A9;
+    case 0x400: case 0x401: return 0x415;
+    case 0x403: return 0x413;
+    case 0x407: return 0x406;
+    case 0x40C: return 0x41A;
+    case 0x40D: case 0x419: return 0x418;
+    case 0x40E: return 0x423;
+    default: return code_point;
+    }
+}
+
+/**
+ * Frees all allocated memory for the hierarchical hash structure.
+ *
+ * This function traverses the entire hierarchical hash table and deallocates 
+ * all dynamically allocated memory at each level:
+ * - Third level: Frees all nodes in the linked lists and their associated names.
+ * - Second level: Frees all hash blocks.
+ * - First level: Frees the memory for the first-level array of hash blocks.
+ *
+ * This ensures that no memory leaks occur and that all resources used by the 
+ * hierarchical hash structure are properly released.
+ *
+ * Note: This function should be called before the program terminates to clean 
+ * up memory allocated for the hash structure.
+ */
+void free_hash_blocks() {
+    clear_hash_table(&default_table);
+}
+
+/**
+ * Frees every block and node owned by a table.
+ *
+ * The first-level array itself belongs to the table handle and is reset to 
+ * NULL entries, so the table is empty but still usable after this call. In 
+ * HASH_TABLE_ARENA mode the chains are not walked at all; nodes and names 
+ * go away with the arena pages, so the cost is O(blocks + SubBlocks + pages). Nodes 
+ * still waiting for reclamation in a HASH_TABLE_CONCURRENT table are freed 
+ * too, so no other thread may be using the table.
+ *
+ * @param table The table to clear.
+ */
+void clear_hash_table(HashTable *table) {
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        if (table->first_level[i] != NULL) {
+            free_first_level(table->first_level[i], table->flags);
+            table->first_level[i] = NULL;
+        }
+    }
+    if (table->flags & HASH_TABLE_ARENA) {
+        free_arena(&table->arena);
+    }
+    free_retired(table);
+    table->name_count = 0;
+}
+
+/**
+ * Frees one first-level bucket and every block, SubBlock and flat bucket below it.
+ *
+ * Nodes and names are freed too, except in HASH_TABLE_ARENA mode where they 
+ * go away with the arena pages.
+ *
+ * @param blocks The first-level bucket, or NULL.
+ * @param flags The HASH_TABLE_* flags of the table it belongs to.
+ */
+void free_first_level(HashBlocks *blocks, unsigned int flags) {
+    int arena = (flags & HASH_TABLE_ARENA) != 0;
+    int flat = (flags & HASH_TABLE_FLAT) != 0;
+    if (blocks == NULL) return;
+    for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+        if (blocks->second_level[j] != NULL) {
+            HashBlock *block = blocks->second_level[j];
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE && flat; k++) {
+                free_flat_bucket(block->buckets[k]);
+            }
+            // Arena nodes and names are released with their pages,
+            // only their SubBlocks are freed here
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE && !flat; k++) {
+                free_slot(block->third_level[k], !arena);
+            }
+            free(block->filter);
+            free(block); // Free the second-level hash block
+        }
+    }
+    free(blocks); // Free the first-level hash block
+}
+
+/**
+ * Frees a table on background threads and returns without walking it.
+ *
+ * The emptied handle goes with the detached contents and is destroyed by the 
+ * last worker, so its stripes outlive every reader the workers wait for.
+ *
+ * @param table The table to destroy. NULL is ignored.
+ * @param threads Number of worker threads (0 means 1).
+ * @return A handle for hash_reclaim_wait, or NULL if table is NULL or memory 
+ *         allocation fails.
+ */
+HashReclaim* destroy_hash_table_async(HashTable *table, unsigned int threads) {
+    if (table == NULL) return NULL;
+    HashReclaim *reclaim = create_reclaim(table, threads);
+    if (reclaim == NULL) {
+        return NULL;
+    }
+    detach_contents(table, reclaim, NULL);
+    reclaim->table = table;
+    return start_reclaim(reclaim);
+}
+
+/**
+ * Empties a table at once and frees its former contents on background threads.
+ *
+ * @param table The table to clear.
+ * @param threads Number of worker threads (0 means 1).
+ * @return A handle for hash_reclaim_wait, or NULL if memory allocation fails.
+ */
+HashReclaim* hash_table_clear_async(HashTable *table, unsigned int threads) {
+    HashReclaim *reclaim = create_reclaim(table, threads);
+    if (reclaim == NULL) {
+        return NULL;
+    }
+    detach_contents(table, reclaim, NULL);
+    return start_reclaim(reclaim);
+}
+
+/**
+ * Replaces the contents of a table with those of another table and frees 
+ * the old contents on background threads.
+ *
+ * The tables must agree on everything that decides where a name is stored and 
+ * how its slot is laid out: the schema, the key mode, and the arena, flat and 
+ * concurrent modes (HASH_TABLE_CONCURRENT tables never hold SubBlocks, which 
+ * their lock-free readers could not walk).
+ *
+ * @param table The table to refill.
+ * @param fresh The table whose contents move into table; destroyed on success.
+ * @param threads Number of worker threads (0 means 1).
+ * @return A handle for hash_reclaim_wait, or NULL if the tables do not match or 
+ *         memory allocation fails.
+ */
+HashReclaim* hash_table_swap(HashTable *table, HashTable *fresh, unsigned int threads) {
+    if ((table->flags & ~HASH_TABLE_COUNTERS) != (fresh->flags & ~HASH_TABLE_COUNTERS) ||
+        memcmp(table->schema, fresh->schema, sizeof(HashSchema)) != 0) {
+        printf("Tables with different flags or schemas cannot be swapped\n");
+        return NULL;
+    }
+    HashReclaim *reclaim = create_reclaim(table, threads);
+    if (reclaim == NULL) {
+        return NULL;
+    }
+    detach_contents(table, reclaim, fresh);
+    destroy_hash_table(fresh);
+    return start_reclaim(reclaim);
+}
+
+/**
+ * Allocates a reclamation for the contents of a table.
+ *
+ * @param table The table whose contents will be detached.
+ * @param threads Number of worker threads (0 means 1).
+ * @return The reclamation, or NULL if memory allocation fails.
+ */
+HashReclaim* create_reclaim(const HashTable *table, unsigned int threads) {
+    HashReclaim *reclaim = (HashReclaim *)calloc(1, sizeof(HashReclaim));
+    threads = threads ? threads : 1;
+    thrd_t *workers = reclaim ? (thrd_t *)malloc(threads * sizeof(thrd_t)) : NULL;
+    if (!workers) {
+        printf("Memory allocation failed for HashReclaim\n");
+        free(reclaim);
+        return NULL;
+    }
+    reclaim->flags = table->flags;
+    reclaim->workers = workers;
+    reclaim->worker_count = threads;
+    return reclaim;
+}
+
+/**
+ * Moves the contents of a table into a reclamation.
+ *
+ * Every writer lock is held, so writers see the whole table change at once. 
+ * Each first-level bucket is replaced with a release store; the bucket a 
+ * reader finds is intact whether it is the old or the new one. The arena, 
+ * the retired nodes and the name count move along. In HASH_TABLE_CONCURRENT 
+ * tables the epoch is sampled after the stores, so the workers know how long 
+ * readers may still be inside the old buckets.
+ *
+ * @param table The table to empty or refill.
+ * @param reclaim The reclamation receiving the old contents.
+ * @param fresh The table whose contents replace them, or NULL to leave table empty.
+ */
+void detach_contents(HashTable *table, HashReclaim *reclaim, HashTable *fresh) {
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+    }
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        reclaim->first_level[i] = table->first_level[i];
+        STORE_POINTER(HashBlocks, &table->first_level[i], fresh ? fresh->first_level[i] : NULL);
+        if (fresh) {
+            fresh->first_level[i] = NULL;
+        }
+    }
+    reclaim->arena = table->arena;
+    memset(&table->arena, 0, sizeof(table->arena));
+    if (fresh) {
+        table->arena = fresh->arena;
+        memset(&fresh->arena, 0, sizeof(fresh->arena));
+    }
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE && table->stripes != NULL; i++) {
+        Stripe *stripe = &table->stripes[i];
+        reclaim->retired[i] = stripe->retired;
+        reclaim->retired_count[i] = stripe->retired_count;
+        stripe->retired = NULL;
+        stripe->retired_count = 0;
+        stripe->retired_capacity = 0;
+    }
+    table->name_count = fresh ? (size_t)fresh->name_count : 0;
+    if (fresh) {
+        fresh->name_count = 0;
+        // The block filters that moved in were sized for the fresh table's rate
+        table->filter_rate = fresh->filter_rate;
+        table->filter_bits = fresh->filter_bits;
+        table->filter_hashes = fresh->filter_hashes;
+    }
+    for (unsigned int i = FIRST_LEVEL_SIZE; i-- > 0;) {
+        unlock_stripe(table, i);
+    }
+
+    if (table->flags & HASH_TABLE_CONCURRENT) {
+        // The unlinks must be visible before the epoch is sampled
+        atomic_thread_fence(memory_order_seq_cst);
+        reclaim->epoch = atomic_load(&global_epoch);
+    }
+}
+
+/**
+ * Starts the workers of a reclamation whose contents are detached.
+ *
+ * If not every thread can be started, the calling thread does the share of 
+ * the missing ones before returning.
+ *
+ * @param reclaim The reclamation.
+ * @return reclaim.
+ */
+HashReclaim* start_reclaim(HashReclaim *reclaim) {
+    unsigned int threads = reclaim->worker_count;
+    reclaim->running = threads;
+    unsigned int started = 0;
+    while (started < threads && thrd_create(&reclaim->workers[started], reclaim_worker, reclaim) == thrd_success) {
+        started++;
+    }
+    reclaim->worker_count = started;
+    if (started < threads) {
+        // The calling thread stands in for the workers that did not start
+        atomic_fetch_sub(&reclaim->running, threads - started - 1);
+        reclaim_worker(reclaim);
+    }
+    return reclaim;
+}
+
+/**
+ * Frees the detached first-level buckets of a reclamation.
+ *
+ * Workers first wait until the global epoch has advanced twice past the 
+ * detach, as hash_table_compact does, then claim buckets one at a time. The 
+ * last worker to finish frees the arena pages and retired nodes, which 
+ * buckets of any letter may point into, and the handle of a destroyed table.
+ *
+ * @param argument The HashReclaim.
+ * @return Always 0.
+ */
+int reclaim_worker(void *argument) {
+    HashReclaim *reclaim = (HashReclaim *)argument;
+    while (reclaim->epoch != 0 && advance_epoch() < reclaim->epoch + 2) {
+        thrd_yield();
+    }
+    for (unsigned int i = atomic_fetch_add(&reclaim->next, 1); i < FIRST_LEVEL_SIZE;
+         i = atomic_fetch_add(&reclaim->next, 1)) {
+        free_first_level(reclaim->first_level[i], reclaim->flags);
+    }
+    if (atomic_fetch_sub(&reclaim->running, 1) != 1) {
+        return 0;
+    }
+    if (reclaim->flags & HASH_TABLE_ARENA) {
+        free_arena(&reclaim->arena);
+    }
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        for (size_t j = 0; j < reclaim->retired_count[i]; j++) {
+            free(reclaim->retired[i][j].node->name);
+            free(reclaim->retired[i][j].node);
+        }
+        free(reclaim->retired[i]);
+    }
+    destroy_hash_table(reclaim->table);
+    return 0;
+}
+
+/**
+ * Waits until a background reclamation has freed everything, then frees its handle.
+ *
+ * @param reclaim The reclamation to wait for. NULL is ignored.
+ */
+void hash_reclaim_wait(HashReclaim *reclaim) {
+    if (reclaim == NULL) return;
+    for (unsigned int i = 0; i < reclaim->worker_count; i++) {
+        thrd_join(reclaim->workers[i], NULL);
+    }
+    free(reclaim->workers);
+    free(reclaim);
+}
+
+/**
+ * Prints a visual representation of the hierarchical hash structure.
+ *
+ * This function traverses the three levels of the hierarchical hash table and 
+ * prints the contents of each level, starting from the first level down to the 
+ * third level. Each bucket is labeled with the letters that map to it; with 
+ * the default schema:
+ * - The first level uses alphabetical indices (A-Z).
+ * - The second level uses vowels (A, E, I, O, U, Y) and "Default".
+ * - The third level uses alphabetical indices (A-Z).
+ *
+ * For each entry in the hash structure, the function prints the names stored 
+ * in the third-level linked lists. If a level is empty, it is skipped.
+ *
+ * This function is primarily used for debugging or visualization purposes.
+ */
+void print_hash_blocks() {
+    print_hash_table(&default_table);
+}
+
+/**
+ * Prints a visual representation of a table.
+ *
+ * This is the table-aware implementation behind print_hash_blocks. In 
+ * HASH_TABLE_CONCURRENT tables each letter is printed under its writer lock.
+ *
+ * @param table The table to print.
+ */
+void print_hash_table(const HashTable *table) {
+    HashBlocks *const *first_level = table->first_level;
+    printf("\n");
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+        if (first_level[i] != NULL) {
+            char label[32];
+            schema_label(table->schema, 0, i, label);
+            printf("First Level [%s]:\n", label);
+            for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+                if (first_level[i]->second_level[j] != NULL) {
+                    // Label each bucket with the letters that map to it
+                    schema_label(table->schema, 1, j, label);
+                    printf("  Second Level [%s]:\n", label);
+                    HashBlock *block = first_level[i]->second_level[j];
+                    for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+                        // Empty flat buckets are freed, so a NULL slot is empty for both backends
+                        if (block->third_level[k] != NULL) {
+                            schema_label(table->schema, 2, k, label);
+                            printf("    Third Level [%s]:\n", label);
+                            visit_slot(table, block, k, print_name, NULL);
+                        }
+                    }
+                }
+            }
+        }
+        unlock_stripe(table, i);
+    }
+}
+
+/**
+ * Visits every name stored in a table.
+ *
+ * Names are visited in the same order print_hash_table displays them: by 
+ * first-level letter, then second-level bucket, then third-level letter, and 
+ * alphabetically within each third-level list. The visitor may stop the walk 
+ * early by returning a non-zero value. The table must not be modified from 
+ * inside the visitor. In HASH_TABLE_CONCURRENT tables each letter is walked 
+ * under its writer lock, so other threads may keep inserting and removing.
+ *
+ * @param table The table to walk.
+ * @param visitor The callback invoked for each stored name.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every name was visited, or the non-zero value returned by the visitor.
+ */
+int hash_table_iterate(const HashTable *table, HashTableVisitor visitor, void *context) {
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        int result = 0;
+        lock_stripe(table, i);
+        HashBlocks *blocks = table->first_level[i];
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE && blocks != NULL && result == 0; j++) {
+            HashBlock *block = blocks->second_level[j];
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE && block != NULL && result == 0; k++) {
+                result = visit_slot(table, block, k, visitor, context);
+            }
+        }
+        unlock_stripe(table, i);
+        if (result != 0) return result;
+    }
+    return 0;
+}
+
+/**
+ * Opens a cursor over the names of a table that start with a prefix.
+ *
+ * The prefix becomes the range [prefix, next prefix), where the next prefix 
+ * is the smallest string that sorts after every name starting with prefix 
+ * ("MAR" gives "MAS", "MAZ" gives "MA["). All of its characters are known to 
+ * be shared by every name in range, which is what lets the cursor skip the 
+ * slots the prefix cannot map to.
+ *
+ * @param cursor The cursor to fill in.
+ * @param table The table to walk.
+ * @param prefix The prefix (normalized like a name, but may be empty or shorter).
+ * @return 0 on success, or 1 if the prefix is invalid or too long.
+ */
+int hash_cursor_prefix(HashCursor *cursor, const HashTable *table, const char *prefix) {
+    if (normalize_bound(table->flags, prefix, cursor->low) != 0) {
+        return 1;
+    }
+    size_t length = strlen(cursor->low);
+    cursor->table = table;
+    cursor->fixed = length;
+    cursor->bounded = next_prefix(cursor->low, length, cursor->high) == 0;
+    cursor->started = 0;
+    cursor->ways = 0;
+    return 0;
+}
+
+/**
+ * Opens a cursor over the names of a table from one bound up to another.
+ *
+ * Every name in range shares the common prefix of the two bounds, so that 
+ * prefix narrows the slots to visit just like in hash_cursor_prefix.
+ *
+ * @param cursor The cursor to fill in.
+ * @param table The table to walk.
+ * @param from The inclusive lower bound (normalized like a name), or NULL for no lower bound.
+ * @param to The exclusive upper bound (normalized like a name), or NULL for no upper bound.
+ * @return 0 on success, or 1 if a bound is invalid or too long.
+ */
+int hash_cursor_range(HashCursor *cursor, const HashTable *table, const char *from, const char *to) {
+    if (normalize_bound(table->flags, from ? from : "", cursor->low) != 0 ||
+        (to != NULL && normalize_bound(table->flags, to, cursor->high) != 0)) {
+        return 1;
+    }
+    size_t fixed = 0;
+    while (to != NULL && cursor->low[fixed] != '\0' && cursor->low[fixed] == cursor->high[fixed]) {
+        fixed++;
+    }
+    cursor->table = table;
+    cursor->fixed = fixed;
+    cursor->bounded = to != NULL;
+    cursor->started = 0;
+    cursor->ways = 0;
+    return 0;
+}
+
+/**
+ * Returns the next name of a cursor.
+ *
+ * The first call loads the first name in range of every slot the range can 
+ * map to into a min-heap (see cursor_fill). Every call then takes the 
+ * smallest one and advances its slot by one node or entry, so a step costs 
+ * O(log ways), plus a short descent when a promoted slot moves on to its 
+ * next chain.
+ *
+ * @param cursor The cursor.
+ * @return The next stored name in order, or NULL once the range is exhausted.
+ */
+const char* hash_cursor_next(HashCursor *cursor) {
+    if (!cursor->started) {
+        cursor->started = 1;
+        cursor_fill(cursor);
+    }
+    if (cursor->ways == 0) {
+        return NULL;
+    }
+
+    HashCursorWay *top = &cursor->heap[0];
+    const char *name = top->name;
+    if (cursor_advance(cursor, top) != 0) {
+        *top = cursor->heap[--cursor->ways]; // Slot exhausted
+    }
+    cursor_sift_down(cursor, 0);
+    return name;
+}
+
+/**
+ * Loads the first name in range of every slot a cursor's range can map to.
+ *
+ * A level is fixed to one bucket when the characters shared by the whole 
+ * range cover the position it reads, and open otherwise. With the default 
+ * schema a prefix of three letters leaves a single slot, two letters leave 
+ * 26 and one letter 182.
+ *
+ * @param cursor The cursor.
+ */
+void cursor_fill(HashCursor *cursor) {
+    const HashTable *table = cursor->table;
+    unsigned int from[HASH_SCHEMA_LEVELS], to[HASH_SCHEMA_LEVELS];
+    for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+        size_t position = table->schema->positions[level];
+        if (position < cursor->fixed) {
+            from[level] = to[level] = table->schema->buckets[level][(unsigned char)cursor->low[position]];
+        } else {
+            from[level] = 0;
+            to[level] = level_sizes[level] - 1;
+        }
+    }
+
+    for (unsigned int i = from[0]; i <= to[0]; i++) {
+        const HashBlocks *blocks = table->first_level[i];
+        for (unsigned int j = from[1]; j <= to[1] && blocks != NULL; j++) {
+            const HashBlock *block = blocks->second_level[j];
+            for (unsigned int k = from[2]; k <= to[2] && block != NULL; k++) {
+                HashCursorWay way;
+                if (slot_lower_bound(table, &block->third_level[k], &way, cursor->low, 0) != 0) continue;
+                if (cursor->bounded && strcmp(way.name, cursor->high) >= 0) continue;
+                cursor->heap[cursor->ways] = way;
+                cursor_sift_up(cursor, cursor->ways++);
+            }
+        }
+    }
+}
+
+/**
+ * Moves a cursor way to the next name of its slot.
+ *
+ * The slot is not stored in the way: it is the one the current name maps to.
+ *
+ * @param cursor The cursor.
+ * @param way The way to advance.
+ * @return 0 if the way has another name in range, or 1 if it is exhausted.
+ */
+int cursor_advance(const HashCursor *cursor, HashCursorWay *way) {
+    const HashTable *table = cursor->table;
+    if (table->flags & HASH_TABLE_FLAT) {
+        const HashBlock *block = locate_block(table, way->name);
+        const struct FlatBucket *bucket = block->buckets[schema_index(table->schema, 2, way->name)];
+        if (++way->index >= bucket->count) return 1;
+        way->name = bucket->pool + bucket->entries[way->index].offset;
+    } else if (way->node->next != NULL) {
+        way->node = way->node->next;
+        way->name = way->node->name;
+    } else {
+        // A plain chain ends here; a promoted slot continues in its next chain
+        const HashBlock *block = locate_block(table, way->name);
+        Node *const *slot = &block->third_level[schema_index(table->schema, 2, way->name)];
+        if (!is_sub_block(*slot) || slot_lower_bound(table, slot, way, way->name, 1) != 0) return 1;
+    }
+    return cursor->bounded && strcmp(way->name, cursor->high) >= 0;
+}
+
+/**
+ * Finds the first name of a third-level slot at or after a bound.
+ *
+ * @param table The table that owns the slot.
+ * @param slot The third-level slot (chain head or flat bucket).
+ * @param way Receives the name and its position.
+ * @param bound The bound.
+ * @param strict Whether names equal to bound are skipped.
+ * @return 0 if such a name exists, or 1 otherwise.
+ */
+int slot_lower_bound(const HashTable *table, Node *const *slot, HashCursorWay *way,
+                     const char *bound, int strict) {
+    if (table->flags & HASH_TABLE_FLAT) {
+        const struct FlatBucket *bucket = *(struct FlatBucket *const *)slot;
+        if (bucket == NULL) return 1;
+        uint32_t low = 0, high = bucket->count;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            int cmp = strcmp(bucket->pool + bucket->entries[mid].offset, bound);
+            if (cmp < 0 || (cmp == 0 && strict)) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == bucket->count) return 1;
+        way->index = low;
+        way->name = bucket->pool + bucket->entries[low].offset;
+        return 0;
+    }
+
+    way->node = chain_lower_bound(*slot, bound, strict);
+    if (way->node == NULL) return 1;
+    way->name = way->node->name;
+    return 0;
+}
+
+/**
+ * Finds the first node below a slot of a linked-list table at or after a bound.
+ *
+ * SubBlocks whose prefix sorts entirely before the bound are skipped, and 
+ * only the bucket of the bound's next character is searched with the bound; 
+ * the buckets after it start with their first name.
+ *
+ * @param slot The value of a slot: a chain head, a tagged SubBlock or NULL.
+ * @param bound The bound.
+ * @param strict Whether names equal to bound are skipped.
+ * @return The node, or NULL if every name below the slot is smaller.
+ */
+const Node* chain_lower_bound(const Node *slot, const char *bound, int strict) {
+    if (is_sub_block(slot)) {
+        const SubBlock *sub = as_sub_block(slot);
+        int cmp = strncmp(bound, sub->prefix, sub->depth);
+        if (cmp > 0) return NULL;
+        unsigned int start = cmp == 0 ? sub_block_index(sub, bound, strlen(bound)) : 0;
+        for (unsigned int b = start; b < SUB_BLOCK_SIZE; b++) {
+            int bounded = cmp == 0 && b == start;
+            const Node *found = chain_lower_bound(sub->slots[b], bounded ? bound : "", bounded && strict);
+            if (found != NULL) return found;
+        }
+        return NULL;
+    }
+    for (; slot != NULL; slot = slot->next) {
+        int cmp = strcmp(slot->name, bound);
+        if (cmp > 0 || (cmp == 0 && !strict)) return slot;
+    }
+    return NULL;
+}
+
+/**
+ * Writes the smallest string that sorts after every string starting with a prefix.
+ *
+ * The last byte that is not 0xFF is incremented and everything after it 
+ * dropped, so "MAZ" gives "MA[": names of UTF-8 tables may continue with any 
+ * byte after a Z. A prefix made of 0xFF bytes only has no such string.
+ *
+ * @param prefix The prefix.
+ * @param length The length of prefix.
+ * @param next Receives the string (at least length + 1 bytes).
+ * @return 0 on success, or 1 if every string starting with prefix is a last one.
+ */
+int next_prefix(const char *prefix, size_t length, char *next) {
+    while (length > 0 && (unsigned char)prefix[length - 1] == 0xFF) {
+        length--;
+    }
+    if (length == 0) return 1;
+    memcpy(next, prefix, length);
+    next[length - 1]++;
+    next[length] = '\0';
+    return 0;
+}
+
+/**
+ * Normalizes and validates a cursor bound in the key mode of a table.
+ *
+ * Unlike names, bounds may be shorter than three characters or empty.
+ *
+ * @param flags The table's flags; only HASH_TABLE_UTF8 and HASH_TABLE_FOLD_ACCENTS are read.
+ * @param input The bound as given by the caller.
+ * @param bound Receives the normalized bound (HASH_CURSOR_KEY_SIZE bytes).
+ * @return 0 on success, or 1 if the bound is NULL, too long or has invalid characters.
+ */
+int normalize_bound(unsigned int flags, const char *input, char *bound) {
+    size_t length = input ? strlen(input) : 0;
+    if (input == NULL || length >= HASH_CURSOR_KEY_SIZE) {
+        printf("Cursor bound must have fewer than %d characters\n", HASH_CURSOR_KEY_SIZE);
+        return 1;
+    }
+    if (upper_scalar(bound, input, length) != 0 &&
+        ((flags & KEY_MODE_FLAGS) == 0 ||
+         (length = fold_utf8(bound, input, length, (flags & HASH_TABLE_FOLD_ACCENTS) != 0)) == SIZE_MAX)) {
+        printf("Invalid character in cursor bound: %s\n", input);
+        return 1;
+    }
+    bound[length] = '\0';
+    return 0;
+}
+
+/**
+ * Moves a heap entry of a cursor up until its parent sorts before it.
+ *
+ * @param cursor The cursor.
+ * @param i The index of the entry.
+ */
+void cursor_sift_up(HashCursor *cursor, size_t i) {
+    HashCursorWay way = cursor->heap[i];
+    while (i > 0 && strcmp(cursor->heap[(i - 1) / 2].name, way.name) > 0) {
+        cursor->heap[i] = cursor->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    cursor->heap[i] = way;
+}
+
+/**
+ * Moves a heap entry of a cursor down until its children sort after it.
+ *
+ * @param cursor The cursor.
+ * @param i The index of the entry.
+ */
+void cursor_sift_down(HashCursor *cursor, size_t i) {
+    if (i >= cursor->ways) return;
+    HashCursorWay way = cursor->heap[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= cursor->ways) break;
+        if (child + 1 < cursor->ways && strcmp(cursor->heap[child + 1].name, cursor->heap[child].name) < 0) {
+            child++;
+        }
+        if (strcmp(cursor->heap[child].name, way.name) >= 0) break;
+        cursor->heap[i] = cursor->heap[child];
+        i = child;
+    }
+    cursor->heap[i] = way;
+}
+
+/**
+ * Fills in the first row of a banded edit distance computation.
+ *
+ * A row holds the distances between a prefix of a stored name and every 
+ * prefix of the searched name, but only for the 2 * edits + 1 prefixes whose 
+ * length differs from the stored prefix's by at most edits: every other cell 
+ * is already over budget. Cell d of row i is searched prefix i + d - edits, and 
+ * every cell is capped at edits + 1.
+ *
+ * @param search The search.
+ * @param row Receives row 0.
+ */
+void fuzzy_start(const FuzzySearch *search, unsigned char *row) {
+    unsigned int edits = search->edits;
+    for (unsigned int d = 0; d <= 2 * edits; d++) {
+        size_t j = d - edits; // Wraps for d < edits
+        row[d] = d < edits || j > search->length ? (unsigned char)(edits + 1)
+                                                 : (unsigned char)(j <= edits ? j : edits + 1);
+    }
+}
+
+/**
+ * Advances a banded edit distance computation by one character.
+ *
+ * The character is given as a set: searched byte j matches it when 
+ * (codes[j] & mask) == want. A mask of 0xFF with want set to a byte matches 
+ * that byte; the bucket bits of codes match every character a level bucket 
+ * holds, and a mask of 0 matches any character.
+ *
+ * @param search The search.
+ * @param row Row i.
+ * @param next Receives row i + 1.
+ * @param i The number of stored characters row holds.
+ * @param mask The code bits the character constrains.
+ * @param want Their value.
+ * @return The smallest distance in next.
+ */
+unsigned int fuzzy_step(const FuzzySearch *search, const unsigned char *row, unsigned char *next, size_t i,
+                        uint32_t mask, uint32_t want) {
+    unsigned int edits = search->edits, best = edits + 1;
+    for (unsigned int d = 0; d <= 2 * edits; d++) {
+        size_t j = i + 1 + d - edits;
+        unsigned int value;
+        if (i + 1 + d < edits || j > search->length) {
+            value = edits + 1;
+        } else if (j == 0) {
+            value = (unsigned int)(i + 1);
+        } else {
+            value = row[d] + ((search->codes[j - 1] & mask) != want);   // Substitution or match
+            if (d < 2 * edits && row[d + 1] + 1u < value) value = row[d + 1] + 1u; // Stored character dropped
+            if (d > 0 && next[d - 1] + 1u < value) value = next[d - 1] + 1u;      // Searched character dropped
+        }
+        next[d] = (unsigned char)(value <= edits ? value : edits + 1);
+        if (next[d] < best) best = next[d];
+    }
+    return best;
+}
+
+/**
+ * Computes the edit distance between a stored name and the searched name.
+ *
+ * The distance is counted in bytes of the normalized names. Rows start after 
+ * the characters the name shares with the previous one, and stop as soon as 
+ * every cell is over budget; a name whose shared characters already were 
+ * costs nothing more. Characters past FUZZY_ROWS go through two scratch rows.
+ *
+ * @param search The search.
+ * @param name The stored name.
+ * @return The distance, or edits + 1 if it is over budget.
+ */
+unsigned int fuzzy_distance(FuzzySearch *search, const char *name) {
+    unsigned int edits = search->edits;
+    size_t length = strlen(name);
+    if (length + edits < search->length || length > search->length + edits) {
+        return edits + 1;
+    }
+
+    size_t i = 0;
+    while (i < search->cached && name[i] == search->prefix[i]) {
+        i++;
+    }
+    if (search->dead <= i) {
+        return edits + 1;
+    }
+    search->dead = SIZE_MAX;
+
+    unsigned char scratch[2][FUZZY_BAND];
+    const unsigned char *row = search->rows[i];
+    for (; i < length; i++) {
+        unsigned char *next = i < FUZZY_ROWS ? search->rows[i + 1] : scratch[i & 1];
+        if (i < FUZZY_ROWS) {
+            search->prefix[i] = name[i];
+            search->cached = i + 1;
+        }
+        unsigned int best = fuzzy_step(search, row, next, i, 0xFF, (unsigned char)name[i]);
+        if (best > edits) {
+            if (i < FUZZY_ROWS) search->dead = i + 1;
+            return edits + 1;
+        }
+        row = next;
+    }
+    return row[search->length + edits - length];
+}
+
+/**
+ * Computes a lower bound of the edit distance of every name below a branch.
+ *
+ * The branch fixes the bucket of the first levels. Walking the character 
+ * positions from the first, each one becomes the set of characters the fixed 
+ * levels reading it allow (any character if none does), and the rows advance 
+ * over those sets. Rows only grow along a name, so their smallest cell bounds 
+ * the distance of every name that has the characters. The walk stops at the 
+ * last position a fixed level reads, or at the first one a name may be too 
+ * short to have.
+ *
+ * @param search The search.
+ * @param buckets The bucket of each fixed level.
+ * @param fixed The number of fixed levels.
+ * @return The bound, at most edits + 1.
+ */
+unsigned int fuzzy_bound(const FuzzySearch *search, const unsigned int *buckets, unsigned int fixed) {
+    const HashSchema *schema = search->table->schema;
+    size_t last = 0;
+    for (unsigned int level = 0; level < fixed; level++) {
+        if (schema->positions[level] > last) last = schema->positions[level];
+    }
+
+    unsigned char rows[2][FUZZY_BAND];
+    unsigned int best = 0;
+    fuzzy_start(search, rows[0]);
+    for (size_t position = 0; position <= last; position++) {
+        uint32_t mask = 0, want = 0;
+        int present = position < MIN_NAME_LENGTH;
+        for (unsigned int level = 0; level < fixed; level++) {
+            if (schema->positions[level] != position) continue;
+            mask |= (uint32_t)0xFF << (8 * (level + 1));
+            want |= (uint32_t)buckets[level] << (8 * (level + 1));
+            if (buckets[level] != schema->buckets[level][0]) present = 1;
+        }
+        if (!present) break;
+        best = fuzzy_step(search, rows[position & 1], rows[(position + 1) & 1], position, mask, want);
+        if (best > search->edits) break;
+    }
+    return best;
+}
+
+/**
+ * Passes a stored name within the edit budget on to the caller (visitor).
+ *
+ * @param name The stored name.
+ * @param context The FuzzySearch.
+ * @return 0 to continue, or the caller's non-zero value.
+ */
+int fuzzy_visit(const char *name, void *context) {
+    FuzzySearch *search = (FuzzySearch *)context;
+    unsigned int distance = fuzzy_distance(search, name);
+    return distance <= search->edits ? search->visitor(name, distance, search->context) : 0;
+}
+
+/**
+ * Visits every stored name within an edit distance of a name.
+ *
+ * Names are compared by Levenshtein distance (insertions, deletions and 
+ * substitutions of one byte each) after normalization, so case never counts 
+ * and, with HASH_TABLE_FOLD_ACCENTS, neither do accents. The walk only enters 
+ * the first-, second- and third-level branches whose buckets can still hold a 
+ * name within budget (see fuzzy_bound), and then checks the names of each 
+ * slot with a band of 2 * max_edits + 1 cells per row, so the memory used 
+ * does not depend on the length of the names. Like hash_table_iterate, each 
+ * letter is walked under its writer lock in HASH_TABLE_CONCURRENT tables.
+ *
+ * @param table The table to search.
+ * @param input_name The name to match.
+ * @param max_edits The largest distance accepted, at most HASH_FUZZY_MAX_EDITS.
+ * @param visitor The callback invoked for each name within max_edits.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every match was visited, 1 if the name or max_edits is invalid, 
+ *         or the non-zero value returned by the visitor.
+ */
+int hash_table_fuzzy(const HashTable *table, const char *input_name, unsigned int max_edits,
+                     HashTableMatchVisitor visitor, void *context) {
+    if (max_edits > HASH_FUZZY_MAX_EDITS) {
+        printf("Edit distance must be at most %d\n", HASH_FUZZY_MAX_EDITS);
+        return 1;
+    }
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    size_t length = 0;
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, &length) != 0) {
+        return 1;
+    }
+    uint32_t code_buffer[NAME_BUFFER_SIZE];
+    uint32_t *codes = length <= NAME_BUFFER_SIZE ? code_buffer : (uint32_t *)malloc(length * sizeof(uint32_t));
+    if (codes == NULL) {
+        printf("Memory allocation failed for fuzzy search\n");
+        release_name(name, buffer);
+        return 1;
+    }
+    for (size_t j = 0; j < length; j++) {
+        unsigned char c = (unsigned char)name[j];
+        codes[j] = c;
+        for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+            codes[j] |= (uint32_t)table->schema->buckets[level][c] << (8 * (level + 1));
+        }
+    }
+
+    FuzzySearch search;
+    search.table = table;
+    search.length = length;
+    search.edits = max_edits;
+    search.codes = codes;
+    search.visitor = visitor;
+    search.context = context;
+    search.cached = 0;
+    search.dead = SIZE_MAX;
+    fuzzy_start(&search, search.rows[0]);
+    unsigned int buckets[HASH_SCHEMA_LEVELS];
+    int result = 0;
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE && result == 0; i++) {
+        buckets[0] = i;
+        if (fuzzy_bound(&search, buckets, 1) > max_edits) continue;
+        lock_stripe(table, i);
+        HashBlocks *blocks = table->first_level[i];
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE && blocks != NULL && result == 0; j++) {
+            HashBlock *block = blocks->second_level[j];
+            buckets[1] = j;
+            if (block == NULL || fuzzy_bound(&search, buckets, 2) > max_edits) continue;
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE && result == 0; k++) {
+                buckets[2] = k;
+                if (block->third_level[k] == NULL || fuzzy_bound(&search, buckets, 3) > max_edits) continue;
+                result = visit_slot(table, block, k, fuzzy_visit, &search);
+            }
+        }
+        unlock_stripe(table, i);
+    }
+
+    if (codes != code_buffer) free(codes);
+    release_name(name, buffer);
+    return result;
+}
+
+// Soundex digit of each letter; vowels, H, W and Y are 0
+static const char soundex_digits[27] = "01230120022455012623010202";
+
+/**
+ * Computes the American Soundex code of a name.
+ *
+ * The code is the first letter followed by the digits of the next consonants 
+ * (B F P V 1, C G J K Q S X Z 2, D T 3, L 4, M N 5, R 6), padded with zeros to 
+ * three digits. Letters with the same digit count once when they are adjacent 
+ * or only separated by H or W, which includes the first letter. Characters 
+ * other than ASCII letters are skipped.
+ *
+ * @param name The name.
+ * @param code Receives the code, such as "R163" for Robert and Rupert.
+ * @return 0 on success, or 1 if the name has no ASCII letter.
+ */
+int hash_soundex(const char *name, char code[HASH_SOUNDEX_SIZE]) {
+    size_t length = 0;
+    char last = 0;
+    for (const char *c = name; *c != '\0' && length < HASH_SOUNDEX_SIZE - 1; c++) {
+        char letter = (char)toupper((unsigned char)*c);
+        if (letter < 'A' || letter > 'Z') continue;
+        char digit = soundex_digits[letter - 'A'];
+        if (length == 0) {
+            code[length++] = letter;
+        } else if (letter == 'H' || letter == 'W') {
+            continue; // Does not separate equal digits
+        } else if (digit != '0' && digit != last) {
+            code[length++] = digit;
+        }
+        last = digit;
+    }
+    if (length == 0) {
+        return 1;
+    }
+    while (length < HASH_SOUNDEX_SIZE - 1) {
+        code[length++] = '0';
+    }
+    code[length] = '\0';
+    return 0;
+}
+
+// Search state of hash_table_phonetic
+typedef struct PhoneticSearch {
+    char code[HASH_SOUNDEX_SIZE];  // Soundex code of the searched name
+    HashTableVisitor visitor;      // Caller's visitor
+    void *context;                 // Caller's context
+} PhoneticSearch;
+
+/**
+ * Passes a stored name with the searched Soundex code on to the caller (visitor).
+ *
+ * @param name The stored name.
+ * @param context The PhoneticSearch.
+ * @return 0 to continue, or the caller's non-zero value.
+ */
+int phonetic_visit(const char *name, void *context) {
+    const PhoneticSearch *search = (const PhoneticSearch *)context;
+    char code[HASH_SOUNDEX_SIZE];
+    if (hash_soundex(name, code) != 0 || memcmp(code, search->code, HASH_SOUNDEX_SIZE) != 0) {
+        return 0;
+    }
+    return search->visitor(name, search->context);
+}
+
+/**
+ * Visits every stored name with the same Soundex code as a name.
+ *
+ * A Soundex code keeps the first letter, so in tables of letter-only names 
+ * (without HASH_TABLE_UTF8 or HASH_TABLE_FOLD_ACCENTS) the levels that read 
+ * the first character are fixed to its bucket: with the default schema only 
+ * one first-level letter is walked. Other tables are walked whole, since 
+ * their names may start with characters the code skips.
+ *
+ * @param table The table to search.
+ * @param input_name The name to match.
+ * @param visitor The callback invoked for each name that sounds alike.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every match was visited, 1 if the name is invalid or has no 
+ *         ASCII letter, or the non-zero value returned by the visitor.
+ */
+int hash_table_phonetic(const HashTable *table, const char *input_name, HashTableVisitor visitor,
+                        void *context) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name = NULL;
+    if (normalize_name(table->flags, input_name, buffer, sizeof(buffer), &name, NULL) != 0) {
+        return 1;
+    }
+    PhoneticSearch search;
+    search.visitor = visitor;
+    search.context = context;
+    int invalid = hash_soundex(name, search.code);
+    release_name(name, buffer);
+    if (invalid) {
+        printf("Name has no letters to encode: %s\n", input_name);
+        return 1;
+    }
+
+    unsigned int from[HASH_SCHEMA_LEVELS], to[HASH_SCHEMA_LEVELS];
+    for (unsigned int level = 0; level < HASH_SCHEMA_LEVELS; level++) {
+        if (table->schema->positions[level] == 0 && !(table->flags & KEY_MODE_FLAGS)) {
+            from[level] = to[level] = table->schema->buckets[level][(unsigned char)search.code[0]];
+        } else {
+            from[level] = 0;
+            to[level] = level_sizes[level] - 1;
+        }
+    }
+
+    int result = 0;
+    for (unsigned int i = from[0]; i <= to[0] && result == 0; i++) {
+        lock_stripe(table, i);
+        HashBlocks *blocks = table->first_level[i];
+        for (unsigned int j = from[1]; j <= to[1] && blocks != NULL && result == 0; j++) {
+            HashBlock *block = blocks->second_level[j];
+            for (unsigned int k = from[2]; k <= to[2] && block != NULL && result == 0; k++) {
+                result = visit_slot(table, block, k, phonetic_visit, &search);
+            }
+        }
+        unlock_stripe(table, i);
+    }
+    return result;
+}
+
+/**
+ * Calls a visitor for every name in one third-level slot.
+ *
+ * Names are visited in sorted order for both the linked-list and the flat 
+ * backend.
+ *
+ * @param table The table that owns the block.
+ * @param block The third-level block.
+ * @param k The third-level index within the block.
+ * @param visitor The callback invoked for each name.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every name was visited, or the non-zero value returned by the visitor.
+ */
+int visit_slot(const HashTable *table, const HashBlock *block, unsigned int k,
+               HashTableVisitor visitor, void *context) {
+    if (table->flags & HASH_TABLE_FLAT) {
+        const struct FlatBucket *bucket = block->buckets[k];
+        for (uint32_t i = 0; bucket != NULL && i < bucket->count; i++) {
+            int result = visitor(bucket->pool + bucket->entries[i].offset, context);
+            if (result != 0) return result;
+        }
+        return 0;
+    }
+
+    return visit_chain(block->third_level[k], visitor, context);
+}
+
+/**
+ * Visitor used by print_hash_table to print one stored name.
+ *
+ * @param name The stored name.
+ * @param context Unused.
+ * @return Always 0, so the walk continues.
+ */
+int print_name(const char *name, void *context) {
+    (void)context;
+    printf("      Name: %s\n", name);
+    return 0;
+}
+
+/**
+ * Visitor used by the -e option to print one name close to a searched name.
+ *
+ * @param name The stored name.
+ * @param distance Its edit distance from the searched name.
+ * @param context A size_t counting the matches.
+ * @return Always 0, so the search continues.
+ */
+int print_match(const char *name, unsigned int distance, void *context) {
+    (*(size_t *)context)++;
+    printf("Match: %s (%u edits)\n", name, distance);
+    return 0;
+}
+
+/**
+ * Visitor used by the -P option to print one name that sounds like a searched name.
+ *
+ * @param name The stored name.
+ * @param context A size_t counting the matches.
+ * @return Always 0, so the search continues.
+ */
+int print_sound_match(const char *name, void *context) {
+    (*(size_t *)context)++;
+    printf("Match: %s\n", name);
+    return 0;
+}
+
+/**
+ * Estimates the heap footprint of a single malloc of the given size.
+ *
+ * The model follows a typical general-purpose allocator: one size_t header 
+ * per chunk, chunks rounded up to 16 bytes and a 32-byte minimum chunk. It is 
+ * only used to report what the nodes and names would cost without the arena.
+ *
+ * @param size The requested allocation size.
+ * @return The estimated number of heap bytes consumed by the allocation.
+ */
+size_t heap_chunk_size(size_t size) {
+    size_t chunk = (size + sizeof(size_t) + 15) & ~(size_t)15;
+    return chunk < 32 ? 32 : chunk;
+}
+
+/**
+ * Reports the memory used by a table.
+ *
+ * The function walks every block and chain to count structures and name bytes. 
+ * heap_bytes estimates what the nodes and names cost with one malloc each (the 
+ * default mode), so in HASH_TABLE_ARENA mode it can be compared directly with 
+ * arena_bytes; the difference is reported as arena_saved_bytes. In 
+ * HASH_TABLE_FLAT mode it can likewise be compared with flat_bytes. In 
+ * HASH_TABLE_CONCURRENT tables each letter is counted under its writer lock.
+ *
+ * @param table The table to inspect.
+ * @param stats Receives the memory usage figures.
+ */
+void hash_table_memory_stats(const HashTable *table, HashTableMemoryStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->names = table->name_count;
+
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+        HashBlocks *blocks = table->first_level[i];
+        if (blocks == NULL) {
+            unlock_stripe(table, i);
+            continue;
+        }
+        stats->hash_blocks_count++;
+        for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+            HashBlock *block = blocks->second_level[j];
+            if (block == NULL) continue;
+            stats->hash_block_count++;
+            if (block->filter != NULL) {
+                stats->filters++;
+                stats->filter_bytes += sizeof(BlockFilter) + 63 +
+                                       ((size_t)block->filter->line_mask + 1) * FILTER_LINE_BITS / 8;
+            }
+            for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+                if (table->flags & HASH_TABLE_FLAT) {
+                    const struct FlatBucket *bucket = block->buckets[k];
+                    if (bucket == NULL) continue;
+                    stats->flat_buckets++;
+                    stats->flat_bytes += sizeof(*bucket) + bucket->pool_size +
+                                         (size_t)bucket->capacity * sizeof(FlatEntry) +
+                                         flat_tag_bytes(bucket->capacity);
+                    for (uint32_t e = 0; e < bucket->count; e++) {
+                        size_t name_size = (size_t)bucket->entries[e].length + 1;
+                        stats->name_bytes += name_size;
+                        stats->heap_bytes += heap_chunk_size(sizeof(Node)) + heap_chunk_size(name_size);
+                    }
+                    continue;
+                }
+                add_slot_stats(block->third_level[k], stats);
+            }
+        }
+        unlock_stripe(table, i);
+    }
+    stats->block_bytes = stats->hash_blocks_count * sizeof(HashBlocks) +
+                         stats->hash_block_count * sizeof(HashBlock) + stats->sub_block_bytes;
+
+    if (table->flags & HASH_TABLE_ARENA) {
+        stats->arena_pages = table->arena.page_count;
+        stats->arena_bytes = table->arena.reserved_bytes;
+        if (stats->heap_bytes > stats->arena_bytes) {
+            stats->arena_saved_bytes = stats->heap_bytes - stats->arena_bytes;
+        }
+    }
+}
+
+/**
+ * Prints the memory usage statistics of a table.
+ *
+ * Used by the -m command-line switch. The arena lines are only printed for 
+ * tables created with HASH_TABLE_ARENA.
+ *
+ * @param table The table to report on.
+ */
+void print_memory_stats(const HashTable *table) {
+    HashTableMemoryStats stats;
+    hash_table_memory_stats(table, &stats);
+
+    printf("\nMemory Stats:\n");
+    printf("  Names: %zu\n", stats.names);
+    printf("  HashBlocks: %zu, HashBlock: %zu (%zu bytes)\n",
+           stats.hash_blocks_count, stats.hash_block_count, stats.block_bytes);
+    printf("  Nodes: %zu bytes, Names: %zu bytes\n", stats.node_bytes, stats.name_bytes);
+    printf("  Heap (one malloc per node and name): %zu bytes\n", stats.heap_bytes);
+    if (stats.arena_pages > 0) {
+        printf("  Arena: %zu pages, %zu bytes, saves %zu bytes\n",
+               stats.arena_pages, stats.arena_bytes, stats.arena_saved_bytes);
+    }
+    if (stats.flat_buckets > 0) {
+        printf("  Flat buckets: %zu (%zu bytes)\n", stats.flat_buckets, stats.flat_bytes);
+    }
+    if (stats.sub_blocks > 0) {
+        printf("  SubBlocks: %zu (%zu bytes)\n", stats.sub_blocks, stats.sub_block_bytes);
+    }
+    if (stats.filters > 0) {
+        printf("  Block filters: %zu (%zu bytes, %.1f bits per name)\n", stats.filters, stats.filter_bytes,
+               stats.names ? 8.0 * (double)stats.filter_bytes / (double)stats.names : 0.0);
+    }
+}
+
+/**
+ * Counts a lookup in a HASH_TABLE_COUNTERS table.
+ *
+ * @param table The table that was searched.
+ * @param name The normalized name that was looked up.
+ * @param found Non-zero if the name was found.
+ * @param compares The number of names compared along the way.
+ */
+void count_lookup(const HashTable *table, const char *name, int found, unsigned int compares) {
+    OpCounters *counters = &table->counters[schema_index(table->schema, 0, name)];
+    atomic_fetch_add_explicit(found ? &counters->hits : &counters->misses, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->compares, compares, memory_order_relaxed);
+}
+
+/**
+ * Counts a lookup that a block filter answered, or let through to a miss.
+ *
+ * @param table The table that was searched.
+ * @param name The normalized name that was looked up.
+ * @param rejected Non-zero if the filter answered the lookup, 0 if it was a false positive.
+ */
+void count_filter(const HashTable *table, const char *name, int rejected) {
+    OpCounters *counters = &table->counters[schema_index(table->schema, 0, name)];
+    atomic_fetch_add_explicit(rejected ? &counters->rejects : &counters->passes, 1, memory_order_relaxed);
+}
+
+/**
+ * Counts names added to a HASH_TABLE_COUNTERS table.
+ *
+ * @param table The table the names were added to.
+ * @param name One of the normalized names; all of them share its first-level bucket.
+ * @param count The number of names added.
+ */
+void count_inserts(HashTable *table, const char *name, size_t count) {
+    OpCounters *counters = &table->counters[schema_index(table->schema, 0, name)];
+    atomic_fetch_add_explicit(&counters->inserts, count, memory_order_relaxed);
+}
+
+/**
+ * Reports how a table's names are spread over its levels and how its operations went.
+ *
+ * The figures of hash_table_memory_stats are gathered first. Every block is 
+ * then visited again, under the letter's writer lock in HASH_TABLE_CONCURRENT 
+ * tables, to count the HashBlock structures and names of each second-level 
+ * bucket and the length of every chain. A chain is a third-level list, a list 
+ * below a SubBlock or a flat bucket. The chain lengths are sorted to find the 
+ * percentiles.
+ *
+ * probe_depth is the average number of names a successful lookup compares, 
+ * taken over every stored name: the position of the name in its chain, or in 
+ * a flat bucket the entries before it with the same fingerprint plus one. It 
+ * is computed from the structure, so it is available for every table. Tables 
+ * created with HASH_TABLE_COUNTERS also report the inserts, hits, misses and 
+ * comparisons counted since they were created, which show what the actual 
+ * lookups cost.
+ *
+ * @param table The table to inspect.
+ * @param stats Receives the statistics.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+int hash_table_stats(const HashTable *table, HashTableStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    hash_table_memory_stats(table, &stats->memory);
+    ChainStats chains = { stats, NULL, 0, 0.0, 0 };
+    size_t names = 0;
+    size_t filter_lines = 0, filter_set_bits = 0;
+    double line_rates = 0.0;
+
+    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+        lock_stripe(table, i);
+        HashBlocks *blocks = table->first_level[i];
+        if (blocks != NULL) {
+            stats->first_level_used++;
+            for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+                HashBlock *block = blocks->second_level[j];
+                if (block == NULL) continue;
+                stats->second_level_blocks[j]++;
+                stats->third_level_slots += THIRD_LEVEL_SIZE;
+                const BlockFilter *filter = block->filter;
+                for (size_t line = 0; filter != NULL && line <= filter->line_mask; line++) {
+                    size_t bits = 0;
+                    for (unsigned int w = 0; w < FILTER_LINE_WORDS; w++) {
+                        for (uint64_t word = filter->lines[line * FILTER_LINE_WORDS + w]; word != 0; word &= word - 1) {
+                            bits++;
+                        }
+                    }
+                    filter_lines++;
+                    filter_set_bits += bits;
+                    double rate = 1.0;
+                    for (unsigned int h = 0; h < table->filter_hashes; h++) {
+                        rate *= (double)bits / FILTER_LINE_BITS;
+                    }
+                    line_rates += rate;
+                }
+                for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
+                    size_t slot_names = 0;
+                    if (table->flags & HASH_TABLE_FLAT) {
+                        add_bucket_stats(block->buckets[k], &chains, &slot_names);
+                    } else {
+                        add_chain_stats(block->third_level[k], &chains, &slot_names);
+                    }
+                    stats->third_level_used += slot_names > 0;
+                    stats->second_level_names[j] += slot_names;
+                    names += slot_names;
+                }
+            }
+        }
+        unlock_stripe(table, i);
+    }
+
+    if (chains.failed) {
+        free(chains.lengths);
+        return 1;
+    }
+    if (stats->chains > 0) {
+        qsort(chains.lengths, stats->chains, sizeof(size_t), compare_lengths);
+        stats->chain_p50 = length_percentile(chains.lengths, stats->chains, 50);
+        stats->chain_p99 = length_percentile(chains.lengths, stats->chains, 99);
+        stats->chain_max = chains.lengths[stats->chains - 1];
+    }
+    free(chains.lengths);
+    stats->probe_depth = names > 0 ? chains.probes / (double)names : 0.0;
+
+    // A miss lands on a random line of its block's filter and passes if all its bits are set
+    if (table->flags & HASH_TABLE_FILTER) {
+        stats->filter_rate = table->filter_rate;
+        stats->filter_bits = table->filter_bits;
+        stats->filter_hashes = table->filter_hashes;
+        stats->filter_fill = filter_lines ? (double)filter_set_bits / ((double)filter_lines * FILTER_LINE_BITS) : 0.0;
+        stats->filter_estimated_rate = filter_lines ? line_rates / (double)filter_lines : 0.0;
+    }
+
+    if (table->counters != NULL) {
+        stats->counters = 1;
+        for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
+            const OpCounters *counters = &table->counters[i];
+            stats->inserts += atomic_load_explicit(&counters->inserts, memory_order_relaxed);
+            stats->hits += atomic_load_explicit(&counters->hits, memory_order_relaxed);
+            stats->misses += atomic_load_explicit(&counters->misses, memory_order_relaxed);
+            stats->compares += atomic_load_explicit(&counters->compares, memory_order_relaxed);
+            stats->filter_rejects += atomic_load_explicit(&counters->rejects, memory_order_relaxed);
+            stats->filter_false_positives += atomic_load_explicit(&counters->passes, memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Adds the chains below a slot of a linked-list table to the statistics.
+ *
+ * SubBlocks are followed down to their chains. A lookup compares its way 
+ * down a chain, so a chain of n names adds 1 + 2 + ... + n comparisons.
+ *
+ * @param slot The value of a slot: a chain head, a tagged SubBlock or NULL.
+ * @param chains The statistics being gathered.
+ * @param names Incremented by the number of names below the slot.
+ */
+void add_chain_stats(const Node *slot, ChainStats *chains, size_t *names) {
+    if (is_sub_block(slot)) {
+        const SubBlock *sub = as_sub_block(slot);
+        for (unsigned int b = 0; b < SUB_BLOCK_SIZE; b++) {
+            add_chain_stats(sub->slots[b], chains, names);
+        }
+        return;
+    }
+    size_t length = 0;
+    for (const Node *current = slot; current != NULL; current = current->next) {
+        length++;
+    }
+    if (length == 0) return;
+    *names += length;
+    chains->probes += (double)length * (double)(length + 1) / 2.0;
+    add_chain_length(chains, length);
+}
+
+/**
+ * Adds a flat bucket to the statistics.
+ *
+ * A lookup only compares the entries whose fingerprint matches its own, so 
+ * each entry costs one comparison plus one per earlier entry with the same 
+ * fingerprint.
+ *
+ * @param bucket The bucket, or NULL.
+ * @param chains The statistics being gathered.
+ * @param names Incremented by the number of names in the bucket.
+ */
+void add_bucket_stats(const struct FlatBucket *bucket, ChainStats *chains, size_t *names) {
+    if (bucket == NULL || bucket->count == 0) return;
+    uint32_t seen[256] = { 0 };
+    for (uint32_t e = 0; e < bucket->count; e++) {
+        chains->probes += (double)++seen[bucket->tags[e]];
+    }
+    *names += bucket->count;
+    add_chain_length(chains, bucket->count);
+}
+
+/**
+ * Records the length of one chain in the histogram and the list of lengths.
+ *
+ * @param chains The statistics being gathered; failed is set if the list cannot grow.
+ * @param length The number of names in the chain.
+ */
+void add_chain_length(ChainStats *chains, size_t length) {
+    HashTableStats *stats = chains->stats;
+    unsigned int bucket = 0;
+    while (bucket + 1 < HASH_STATS_HISTOGRAM_SIZE && (length >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    stats->chain_histogram[bucket]++;
+
+    if (stats->chains == chains->capacity) {
+        size_t capacity = chains->capacity ? chains->capacity * 2 : 1024;
+        size_t *lengths = (size_t *)realloc(chains->lengths, capacity * sizeof(size_t));
+        if (!lengths) {
+            if (!chains->failed) printf("Memory allocation failed for chain lengths\n");
+            chains->failed = 1;
+            return;
+        }
+        chains->lengths = lengths;
+        chains->capacity = capacity;
+    }
+    chains->lengths[stats->chains++] = length;
+}
+
+/**
+ * Compares two chain lengths for qsort.
  *
- * Memory Management:
- * - The caller is responsible for freeing the memory allocated for the returned 
- *   HashBlocks structure to prevent memory leaks.
- *
- * @return A pointer to the newly created HashBlocks structure, or NULL if 
- *         memory allocation fails.
+ * @param a The first length.
+ * @param b The second length.
+ * @return A negative, zero or positive value.
  */
-HashBlocks* create_hash_blocks() {
-    HashBlocks *blocks = (HashBlocks *)malloc(sizeof(HashBlocks));
-    for (int i = 0; i < SECOND_LEVEL_SIZE; i++) {
-        blocks->second_level[i] = NULL; // Set all elements to NULL
-    }
-    return blocks;
+int compare_lengths(const void *a, const void *b) {
+    size_t x = *(const size_t *)a;
+    size_t y = *(const size_t *)b;
+    return (x > y) - (x < y);
 }
 
 /**
- * Searches for a name in the hierarchical hash structure and displays the result.
- *
- * This function takes an input name, converts it to uppercase for consistent 
- * lookup, and searches for it in the hierarchical hash structure. If the name 
- * is found, the function prints "Found" along with the name. If the name is not 
- * found, it prints "Not Found" and returns an error code.
+ * Returns a percentile of sorted chain lengths, by the nearest-rank method.
  *
- * - The name is converted to uppercase using convert_to_upper for consistency.
- * - The search is performed using the find_name function, which locates the 
- *   node in the hash structure.
+ * @param lengths The sorted lengths.
+ * @param count The number of lengths (at least one).
+ * @param percent The percentile, from 1 to 100.
+ * @return The smallest length that at least percent percent of the chains do not exceed.
+ */
+size_t length_percentile(const size_t *lengths, size_t count, unsigned int percent) {
+    size_t rank = (count * percent + 99) / 100;
+    return lengths[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * Prints the statistics of a table as a JSON object.
  *
- * Memory Management:
- * - A temporary uppercase version of the name is dynamically allocated and 
- *   freed within this function.
+ * Used by the --stats command-line switch. Each second-level bucket is listed 
+ * with the letters that map to it under the table's schema (with the default 
+ * schema, the consonants make up the default bucket), how many HashBlocks 
+ * have a HashBlock for it and how many names it holds. The histogram keys are 
+ * the chain length ranges. "counters" is null unless the table was created 
+ * with HASH_TABLE_COUNTERS.
  *
- * @param input_name The name to search for in the hash structure.
- * @return 0 if the name is found, or 1 if the name is not found or an error occurs.
+ * @param table The table to report on.
+ * @return 0 on success, or 1 if memory allocation fails.
  */
-int find_names(const char *input_name) {
-    char *name = NULL;
-
-    // Convert to uppercase characters
-    if (convert_to_upper(input_name, &name) != 0) {
+int print_hash_table_stats(const HashTable *table) {
+    HashTableStats stats;
+    if (hash_table_stats(table, &stats) != 0) {
         return 1;
     }
+    const HashTableMemoryStats *memory = &stats.memory;
 
-    Node *result = find_name(name);
+    printf("{\n");
+    printf("  \"names\": %zu,\n", memory->names);
+    printf("  \"levels\": {\n");
+    printf("    \"first\": {\"used\": %zu, \"size\": %d},\n", stats.first_level_used, FIRST_LEVEL_SIZE);
+    printf("    \"second\": {\"hash_blocks\": %zu, \"bytes\": %zu},\n",
+           memory->hash_blocks_count, memory->hash_blocks_count * sizeof(HashBlocks));
+    printf("    \"third\": {\"hash_block\": %zu, \"bytes\": %zu, \"slots\": %zu, \"used\": %zu},\n",
+           memory->hash_block_count, memory->hash_block_count * sizeof(HashBlock),
+           stats.third_level_slots, stats.third_level_used);
+    printf("    \"sub_blocks\": {\"count\": %zu, \"bytes\": %zu}\n", memory->sub_blocks, memory->sub_block_bytes);
+    printf("  },\n");
+    printf("  \"memory\": {\"block_bytes\": %zu, \"node_bytes\": %zu, \"name_bytes\": %zu, "
+           "\"arena_bytes\": %zu, \"flat_bytes\": %zu, \"filter_bytes\": %zu},\n",
+           memory->block_bytes, memory->node_bytes, memory->name_bytes, memory->arena_bytes, memory->flat_bytes,
+           memory->filter_bytes);
 
-    if (result == NULL) {
-        printf("Not Found: %s\n", input_name);
-        free(name);
-        return 1;
+    printf("  \"second_level\": [\n");
+    for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
+        char letters[27];
+        size_t count = 0;
+        for (int c = 'A'; c <= 'Z'; c++) {
+            if (table->schema->buckets[1][c] == j) letters[count++] = (char)c;
+        }
+        letters[count] = '\0';
+        printf("    {\"bucket\": %u, \"letters\": \"%s\", \"blocks\": %zu, \"fill\": %.4f, \"names\": %zu}%s\n",
+               j, letters, stats.second_level_blocks[j],
+               memory->hash_blocks_count ? (double)stats.second_level_blocks[j] / (double)memory->hash_blocks_count : 0.0,
+               stats.second_level_names[j], j + 1 < SECOND_LEVEL_SIZE ? "," : "");
     }
+    printf("  ],\n");
 
-    printf("Found: %s\n", result->name);
-    free(name);
+    printf("  \"chains\": {\"count\": %zu, \"p50\": %zu, \"p99\": %zu, \"max\": %zu, \"histogram\": {",
+           stats.chains, stats.chain_p50, stats.chain_p99, stats.chain_max);
+    for (unsigned int b = 0; b < HASH_STATS_HISTOGRAM_SIZE; b++) {
+        size_t low = (size_t)1 << b;
+        if (b + 1 == HASH_STATS_HISTOGRAM_SIZE) {
+            printf("\"%zu+\": %zu", low, stats.chain_histogram[b]);
+        } else if (low == ((size_t)2 << b) - 1) {
+            printf("\"%zu\": %zu, ", low, stats.chain_histogram[b]);
+        } else {
+            printf("\"%zu-%zu\": %zu, ", low, ((size_t)2 << b) - 1, stats.chain_histogram[b]);
+        }
+    }
+    printf("}},\n");
+    printf("  \"probe_depth\": %.3f,\n", stats.probe_depth);
+
+    if (table->flags & HASH_TABLE_FILTER) {
+        size_t tested = stats.filter_rejects + stats.filter_false_positives;
+        printf("  \"filter\": {\"rate\": %.4f, \"bits_per_name\": %u, \"hashes\": %u, \"count\": %zu, "
+               "\"fill\": %.4f, \"estimated_rate\": %.4f",
+               stats.filter_rate, stats.filter_bits, stats.filter_hashes, memory->filters,
+               stats.filter_fill, stats.filter_estimated_rate);
+        if (stats.counters) {
+            printf(", \"rejects\": %zu, \"false_positives\": %zu, \"measured_rate\": %.4f",
+                   stats.filter_rejects, stats.filter_false_positives,
+                   tested ? (double)stats.filter_false_positives / (double)tested : 0.0);
+        }
+        printf("},\n");
+    } else {
+        printf("  \"filter\": null,\n");
+    }
+
+    if (stats.counters) {
+        size_t lookups = stats.hits + stats.misses;
+        printf("  \"counters\": {\"inserts\": %zu, \"hits\": %zu, \"misses\": %zu, \"compares\": %zu, "
+               "\"compares_per_lookup\": %.3f}\n",
+               stats.inserts, stats.hits, stats.misses, stats.compares,
+               lookups ? (double)stats.compares / (double)lookups : 0.0);
+    } else {
+        printf("  \"counters\": null\n");
+    }
+    printf("}\n");
     return 0;
 }
 
 /**
- * Maps a character to an index (A-Z).
+ * Returns the instruction set used by key normalization and flat bucket scans.
  *
- * This function converts an uppercase alphabetical character ('A'-'Z') into its 
- * corresponding zero-based index (0-25). The mapping is calculated by subtracting 
- * the ASCII value of 'A' from the ASCII value of the input character.
+ * The CPU is inspected on first use and the best supported level is kept for 
+ * the rest of the process, unless set_simd_level overrides it.
  *
- * Assumption:
- * - The input character c is expected to be an uppercase letter ('A'-'Z').
- * - No validation is performed to check if the input is within the valid range.
+ * @return The active SIMD level.
+ */
+HashSimdLevel get_simd_level(void) {
+    int level = atomic_load_explicit(&simd_level, memory_order_relaxed);
+    if (level < 0) {
+        level = (int)detect_simd_level();
+        atomic_store_explicit(&simd_level, level, memory_order_relaxed);
+    }
+    return (HashSimdLevel)level;
+}
+
+/**
+ * Selects the instruction set used by key normalization and flat bucket scans.
  *
- * Usage:
- * This mapping is commonly used to index arrays or hash tables based on characters.
+ * Mainly useful for benchmarking and for checking that every level produces 
+ * the same results. Requests above what the CPU supports are lowered.
  *
- * @param c The character to map (assumed to be uppercase).
- * @return The zero-based index corresponding to the character (0-25).
+ * @param level The requested SIMD level.
+ * @return The SIMD level now in use.
  */
-unsigned int char_to_index(char c) {
-    return c - 'A';
+HashSimdLevel set_simd_level(HashSimdLevel level) {
+    HashSimdLevel supported = detect_simd_level();
+    if (level > supported) level = supported;
+    if (level < HASH_SIMD_SCALAR) level = HASH_SIMD_SCALAR;
+    atomic_store_explicit(&simd_level, (int)level, memory_order_relaxed);
+    return level;
 }
 
 /**
- * Maps a vowel or default character to an index.
- *
- * This function takes a character as input and returns a corresponding index 
- * for vowels ('A', 'E', 'I', 'O', 'U', 'Y') or a default bucket for any other character.
- * The mapping is used for organizing items into a hash structure based on the 
- * second-level categorization by vowels.
+ * Returns the best SIMD level supported by the CPU and operating system.
  *
- * - Each vowel is assigned a unique index (0-5).
- * - Any character that is not one of the defined vowels is mapped to the default bucket (index 6).
+ * SSE2 is checked through CPUID leaf 1. AVX2 additionally needs CPUID leaf 7 
+ * and the operating system must save the YMM registers (OSXSAVE and XCR0).
+ * Non-x86 builds always use the scalar kernels.
  *
- * @param c The character to map (assumed to be uppercase).
- * @return The index corresponding to the vowel or the default bucket (0-6).
+ * @return The best supported SIMD level.
  */
-unsigned int vowel_to_index(char c) {
-    switch (c) {
-        case 'A': return 0;
-        case 'E': return 1;
-        case 'I': return 2;
-        case 'O': return 3;
-        case 'U': return 4;
-        case 'Y': return 5;
-        default: return 6; // Default bucket
+HashSimdLevel detect_simd_level(void) {
+#ifdef HB_X86
+    unsigned int regs[4] = { 0 };  // EAX, EBX, ECX, EDX
+#if defined(_MSC_VER) && !defined(__clang__)
+    __cpuid((int *)regs, 1);
+#else
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    if (!(regs[3] & (1u << 26))) return HASH_SIMD_SCALAR;   // SSE2
+
+    int os_avx = 0;
+    if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28))) { // OSXSAVE and AVX
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned int low, high;
+        __asm__ volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        unsigned long long xcr0 = ((unsigned long long)high << 32) | low;
+#endif
+        os_avx = (xcr0 & 6) == 6; // XMM and YMM state enabled
     }
+    if (!os_avx) return HASH_SIMD_SSE2;
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    __cpuidex((int *)regs, 7, 0);
+#else
+    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    return (regs[1] & (1u << 5)) ? HASH_SIMD_AVX2 : HASH_SIMD_SSE2;
+#else
+    return HASH_SIMD_SCALAR;
+#endif
 }
 
 /**
- * Creates a new linked list node for storing a name.
- *
- * This function allocates memory for a new Node structure, initializes it with 
- * the provided name, and sets the next pointer to NULL. The name is dynamically 
- * duplicated using _strdup to ensure the new node has its own copy.
+ * Uppercases and validates a key one byte at a time.
  *
- * - If memory allocation for the Node or its name fails, an error message is 
- *   printed, and NULL is returned to indicate failure.
- * - The caller is responsible for freeing the allocated memory for both the Node 
- *   and its name when the node is no longer needed.
+ * A byte is a letter when it lies in 'A'-'Z' after setting the lowercase bit 
+ * (0x20); clearing that bit then yields the uppercase letter. This is the 
+ * reference the SIMD kernels must match byte for byte.
  *
- * @param name The name to be stored in the new node.
- * @return A pointer to the newly created Node, or NULL if memory allocation fails.
+ * @param dst Receives length uppercase bytes (no terminator).
+ * @param src The key to convert.
+ * @param length The number of bytes to convert.
+ * @return 0 if every byte is a letter, or 1 otherwise.
  */
-Node* create_node(const char *name) {
-    Node *new_node = (Node *)malloc(sizeof(Node));
-    if (!new_node) {
-        printf("Memory allocation failed for Node\n");
-        return NULL;
-    }
-    new_node->name = _strdup(name);
-    if (!new_node->name) {
-        printf("Memory allocation failed for name\n");
-        free(new_node);
-        return NULL;
+int upper_scalar(char *dst, const char *src, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)src[i];
+        if ((unsigned char)((c | 0x20) - 'a') >= 26) {
+            return 1;
+        }
+        dst[i] = (char)(c & ~0x20);
     }
-    new_node->next = NULL;
-    return new_node;
+    return 0;
 }
 
 /**
- * Adds a name to the hierarchical hash structure.
+ * Copies fewer than 16 bytes with a few fixed-size, possibly overlapping moves.
  *
- * This function processes an input name, validates it, converts it to uppercase,
- * and determines the appropriate bucket in the three-level hierarchical hash table.
- * The name is then inserted into a sorted linked list at the third level.
+ * Used to stage short keys for the SIMD kernels without a variable-length 
+ * memcpy call.
  *
- * - The first-level index is determined by the first character of the name.
- * - The second-level index is determined by the first vowel in the name.
- * - The third-level index is determined by the third character of the name.
+ * @param dst The destination.
+ * @param src The source.
+ * @param n The number of bytes to copy (less than 16).
+ */
+static inline void copy_short(char *dst, const char *src, size_t n) {
+    if (n >= 8) {
+        uint64_t head, tail;
+        memcpy(&head, src, 8);
+        memcpy(&tail, src + n - 8, 8);
+        memcpy(dst, &head, 8);
+        memcpy(dst + n - 8, &tail, 8);
+    } else if (n >= 4) {
+        uint32_t head, tail;
+        memcpy(&head, src, 4);
+        memcpy(&tail, src + n - 4, 4);
+        memcpy(dst, &head, 4);
+        memcpy(dst + n - 4, &tail, 4);
+    } else if (n > 0) {
+        char first = src[0], middle = src[n / 2], last = src[n - 1];
+        dst[0] = first;
+        dst[n / 2] = middle;
+        dst[n - 1] = last;
+    }
+}
+
+#ifdef HB_X86
+/**
+ * Uppercases and validates a key 16 bytes at a time with SSE2.
  *
- * If the necessary levels or blocks in the hierarchy do not exist, they are
- * initialized dynamically before the insertion.
+ * Each vector is folded to lowercase with an OR of 0x20 and range-checked 
+ * against 'a'-'z' with two signed compares (bytes of 0x80 and above compare 
+ * as negative and fail). Keys of 16 bytes or more finish with one vector that 
+ * overlaps the previous one. Shorter keys, which covers most names, are 
+ * staged through a 16-byte buffer with fixed-size copies, so they also take 
+ * the vector path without reading or writing past the end of the key.
  *
- * @param input_name The name to be added to the hash structure.
- * @return 0 on success, or 1 on failure (e.g., invalid input or memory issues).
+ * @param dst Receives length uppercase bytes (no terminator).
+ * @param src The key to convert.
+ * @param length The number of bytes to convert.
+ * @return 0 if every byte is a letter, or 1 otherwise.
  */
-int add_name(const char *input_name) {
-    char *name = NULL;
+HB_TARGET_SSE2 int upper_sse2(char *dst, const char *src, size_t length) {
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i below_a = _mm_set1_epi8('a' - 1);
+    const __m128i above_z = _mm_set1_epi8('z' + 1);
 
-    // Convert to uppercase characters
-    if (convert_to_upper(input_name, &name) != 0) {
-        return 1;
+    if (length < 16) {
+        // Stage short keys through a vector-sized buffer padded with letters
+        char staged[16];
+        memset(staged, 'A', sizeof(staged));
+        copy_short(staged, src, length);
+        __m128i bytes = _mm_loadu_si128((const __m128i *)staged);
+        __m128i folded = _mm_or_si128(bytes, case_bit);
+        __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(folded, below_a), _mm_cmplt_epi8(folded, above_z));
+        if (_mm_movemask_epi8(letters) != 0xFFFF) return 1;
+        _mm_storeu_si128((__m128i *)staged, _mm_andnot_si128(case_bit, bytes));
+        copy_short(dst, staged, length);
+        return 0;
     }
 
-    // Calculate indices for hierarchical hashing
-    unsigned int first_index = char_to_index(name[0]);
-    unsigned int second_index = vowel_to_index(name[1]);
-    unsigned int third_index = char_to_index(name[2]);
-
-    // Initialize levels if necessary
-    if (first_level[first_index] == NULL) {
-        first_level[first_index] = create_hash_blocks();
-    }
-    if (first_level[first_index]->second_level[second_index] == NULL) {
-        first_level[first_index]->second_level[second_index] = create_hash_block();
+    // Full vectors, then one final vector that overlaps the previous one
+    for (size_t i = 0;; i += 16) {
+        if (i + 16 > length) i = length - 16;
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i folded = _mm_or_si128(bytes, case_bit);
+        __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(folded, below_a), _mm_cmplt_epi8(folded, above_z));
+        if (_mm_movemask_epi8(letters) != 0xFFFF) return 1;
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_andnot_si128(case_bit, bytes));
+        if (i + 16 == length) return 0;
     }
+}
 
-    // Insert the name into the third-level linked list
-    HashBlock *block = first_level[first_index]->second_level[second_index];
-    if (block->third_level[third_index] == NULL) {
-        block->third_level[third_index] = create_node(name);
-    } else {
-        insert_sorted(&block->third_level[third_index], create_node(name));
+/**
+ * Uppercases and validates a key 32 bytes at a time with AVX2.
+ *
+ * Same algorithm as upper_sse2 on 32-byte vectors. Keys shorter than one 
+ * vector are handed to upper_sse2.
+ *
+ * @param dst Receives length uppercase bytes (no terminator).
+ * @param src The key to convert.
+ * @param length The number of bytes to convert.
+ * @return 0 if every byte is a letter, or 1 otherwise.
+ */
+HB_TARGET_AVX2 int upper_avx2(char *dst, const char *src, size_t length) {
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i below_a = _mm256_set1_epi8('a' - 1);
+    const __m256i above_z = _mm256_set1_epi8('z' + 1);
+
+    if (length < 32) {
+        return upper_sse2(dst, src, length);
     }
 
-    free(name); // Free the temporary copy
-    return 0;
+    // Full vectors, then one final vector that overlaps the previous one
+    for (size_t i = 0;; i += 32) {
+        if (i + 32 > length) i = length - 32;
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i folded = _mm256_or_si256(bytes, case_bit);
+        __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(folded, below_a), _mm256_cmpgt_epi8(above_z, folded));
+        if ((unsigned int)_mm256_movemask_epi8(letters) != 0xFFFFFFFFu) return 1;
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_andnot_si256(case_bit, bytes));
+        if (i + 32 == length) return 0;
+    }
 }
 
 /**
- * Searches for a name in the hierarchical hash structure.
- *
- * This function looks up a name in the three-level hierarchical hash table 
- * using its indices at each level:
- * - First-level index is determined by the first character of the name.
- * - Second-level index is determined by the first vowel in the name.
- * - Third-level index is determined by the third character of the name.
- *
- * It traverses the corresponding linked list in the third-level hash block 
- * to find a node with a matching name. If found, it returns a pointer to the 
- * node. If not found or if any level is missing, the function returns NULL.
+ * Compares 32 fingerprints against a tag with two SSE2 compares.
  *
- * @param name The name to search for in the hash structure.
- * @return A pointer to the Node containing the name, or NULL if not found.
+ * @param tags The first of 32 fingerprints.
+ * @param tag The fingerprint to look for.
+ * @return A bitmask with bit i set when tags[i] equals tag.
  */
-Node* find_name(const char *name) {
-    int first_index = char_to_index(name[0]);
-    int second_index = vowel_to_index(name[1]);
-    int third_index = char_to_index(name[2]);
+HB_TARGET_SSE2 uint32_t match_tags_sse2(const uint8_t *tags, uint8_t tag) {
+    const __m128i needle = _mm_set1_epi8((char)tag);
+    uint32_t low = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)tags), needle));
+    uint32_t high = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(tags + 16)), needle));
+    return low | (high << 16);
+}
 
-    if (first_level[first_index] == NULL) return NULL;
-    if (first_level[first_index]->second_level[second_index] == NULL) return NULL;
+/**
+ * Compares 32 fingerprints against a tag with one AVX2 compare.
+ *
+ * @param tags The first of 32 fingerprints.
+ * @param tag The fingerprint to look for.
+ * @return A bitmask with bit i set when tags[i] equals tag.
+ */
+HB_TARGET_AVX2 uint32_t match_tags_avx2(const uint8_t *tags, uint8_t tag) {
+    const __m256i needle = _mm256_set1_epi8((char)tag);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)tags), needle));
+}
+#else
+// Without x86 SIMD every level falls back to the scalar kernels.
+int upper_sse2(char *dst, const char *src, size_t length) { return upper_scalar(dst, src, length); }
+int upper_avx2(char *dst, const char *src, size_t length) { return upper_scalar(dst, src, length); }
+uint32_t match_tags_sse2(const uint8_t *tags, uint8_t tag) { return match_tags_scalar(tags, tag); }
+uint32_t match_tags_avx2(const uint8_t *tags, uint8_t tag) { return match_tags_scalar(tags, tag); }
+#endif
 
-    HashBlock *block = first_level[first_index]->second_level[second_index];
-    Node *current = block->third_level[third_index];
-    while (current != NULL) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
-        }
-        current = current->next;
+/**
+ * Compares 32 fingerprints against a tag one byte at a time.
+ *
+ * @param tags The first of 32 fingerprints.
+ * @param tag The fingerprint to look for.
+ * @return A bitmask with bit i set when tags[i] equals tag.
+ */
+uint32_t match_tags_scalar(const uint8_t *tags, uint8_t tag) {
+    uint32_t mask = 0;
+    for (unsigned int i = 0; i < FLAT_TAG_ALIGN; i++) {
+        mask |= (uint32_t)(tags[i] == tag) << i;
     }
-    return NULL;
+    return mask;
 }
 
 /**
- * Inserts a node into a sorted linked list while maintaining the sort order.
+ * Returns the index of the lowest set bit of a non-zero mask.
  *
- * This function takes a pointer to the head of a linked list and a new node to insert.
- * It finds the appropriate position in the list for the new node based on its name 
- * field (alphabetical order) and inserts it in such a way that the list remains sorted.
+ * @param mask The mask to inspect (must not be 0).
+ * @return The zero-based bit index.
+ */
+unsigned int lowest_bit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+/**
+ * Returns a timestamp in nanoseconds for the timings the command-line tool prints.
  *
- * - If the list is empty or the new node's name is smaller than the head's name,
- *   the new node becomes the new head.
- * - Otherwise, the function traverses the list to find the correct position for insertion.
+ * @return The current time in nanoseconds.
+ */
+static double now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Splits a comma-separated command-line argument into an array of names.
  *
- * @param head A pointer to the head of the linked list.
- * @param new_node The new node to be inserted into the list.
+ * The list is split in place, each comma becoming a terminator, so the 
+ * returned pointers point into it. Empty tokens are skipped, as strtok does. 
+ * The library is also built without main (HASHBLOCKS_NO_MAIN), so this does 
+ * not rely on strtok_s, which only Windows provides.
+ *
+ * @param list The comma-separated names (modified).
+ * @param count Receives the number of names.
+ * @return A malloc'd array of count pointers, or NULL if memory allocation fails.
  */
-void insert_sorted(Node **head, Node *new_node) {
-    if (*head == NULL || strcmp((*head)->name, new_node->name) > 0) {
-        new_node->next = *head;
-        *head = new_node;
-        return;
+char** split_names(char *list, size_t *count) {
+    size_t capacity = 1;
+    for (const char *p = list; *p; p++) {
+        capacity += *p == ',';
+    }
+    char **names = (char **)malloc(capacity * sizeof(char *));
+    if (names == NULL) {
+        printf("Memory allocation failed for name list\n");
+        return NULL;
     }
 
-    Node *current = *head;
-    while (current->next != NULL && strcmp(current->next->name, new_node->name) < 0) {
-        current = current->next;
+    size_t n = 0;
+    char *name = list;
+    while (name) {
+        char *comma = strchr(name, ',');              // End of this name, or NULL for the last one
+        if (comma) *comma = '\0';
+        if (*name != '\0') names[n++] = name;
+        name = comma ? comma + 1 : NULL;
     }
-    new_node->next = current->next;
-    current->next = new_node;
+    *count = n;
+    return names;
 }
 
 /**
- * Converts a given string to uppercase while validating its content.
+ * Streams newline-delimited names from a file or stdin into a table.
  *
- * This function takes an input string, validates that it meets the required 
- * criteria (non-NULL, at least 3 characters, and only alphabetic characters),
- * and converts all its characters to uppercase. The resulting string is returned 
- * to the caller via an output pointer. If any validation fails, an error message 
- * is printed, and the function returns an error code.
+ * Input is read into one STREAM_BUFFER_SIZE buffer and split into lines in 
+ * place; complete lines are handed to the batch APIs STREAM_BATCH at a time 
+ * and the unfinished last line is moved to the front of the buffer before the 
+ * next read. Nothing is allocated per line and memory stays bounded for 
+ * inputs of any size. A carriage return before the newline is dropped and 
+ * empty lines are skipped; a line longer than the whole buffer is counted as 
+ * failed and skipped.
  *
- * @param input_name The input string to be validated and converted.
- * @param output_name A pointer to a string where the converted uppercase string 
- *                    will be stored. Memory is dynamically allocated and must
- *                    be freed by the caller.
- * @return 0 on success, or 1 on failure (e.g., invalid input or memory allocation issues).
+ * Lookup results are written to stdout through an OutputBuffer as "Found: " 
+ * or "Not Found: " lines. When the input ends, a summary with the number of 
+ * records and records per second goes to stderr, so it never mixes with the 
+ * results.
+ *
+ * @param table The table to add to or search.
+ * @param path The file to read, or "-" for stdin.
+ * @param lookup Non-zero to look the names up, zero to insert them.
+ * @return 0 on success, or 1 if the input cannot be opened or read.
  */
-int convert_to_upper(const char *input_name, char **output_name) {
-    // Validate input to ensure it is non-NULL and has at least 3 characters
-    if (input_name == NULL || strlen(input_name) < 3) {
-        printf("Name must have at least 3 characters: %s\n", input_name);
-        return 1; // Return an error if input is invalid
+int stream_names(HashTable *table, const char *path, int lookup) {
+    int from_stdin = strcmp(path, "-") == 0;
+    FILE *file = from_stdin ? stdin : fopen(path, "rb");
+    if (!file) {
+        printf("Failed to open %s\n", path);
+        return 1;
     }
 
-    // Create a mutable copy of the input string for processing
-    char *name = _strdup(input_name);
-    if (name == NULL) {
-        printf("Memory allocation failed.\n");
-        return 1; // Return an error if memory allocation fails
+    char *buffer = (char *)malloc(STREAM_BUFFER_SIZE + 1); // +1 for a final newline
+    const char **names = (const char **)malloc(STREAM_BATCH * sizeof(char *));
+    const char **found = (const char **)malloc(STREAM_BATCH * sizeof(char *));
+    OutputBuffer out = { stdout, (char *)malloc(OUTPUT_BUFFER_SIZE), 0 };
+    if (!buffer || !names || !found || !out.data) {
+        printf("Memory allocation failed for stream buffers\n");
+        free(buffer); free(names); free(found); free(out.data);
+        if (!from_stdin) fclose(file);
+        return 1;
     }
 
-    // Loop through each character of the string to convert it to uppercase
-    for (int i = 0; i < strlen(name); i++) {
-        // Check if the character is alphabetical
-        if (isalpha((unsigned char)name[i])) {
-            name[i] = toupper(name[i]); // Convert to uppercase
+    size_t records = 0, matched = 0; // matched counts hits for lookups and failures for inserts
+    size_t kept = 0;                 // Bytes of an unfinished line at the front of buffer
+    int skipping = 0;                // Discarding the rest of an overlong line
+    double start = now_ns();
+    for (;;) {
+        size_t got = fread(buffer + kept, 1, STREAM_BUFFER_SIZE - kept, file);
+        size_t end = kept + got;
+        int done = got == 0;
+        if (done && kept > 0 && !skipping) {
+            buffer[end++] = '\n'; // Last line without a newline
+        }
+
+        size_t line = 0, count = 0;
+        char *newline;
+        while ((newline = (char *)memchr(buffer + line, '\n', end - line)) != NULL) {
+            size_t stop = (size_t)(newline - buffer);
+            *newline = '\0';
+            if (stop > line && buffer[stop - 1] == '\r') {
+                buffer[stop - 1] = '\0';
+            }
+            if (skipping) {
+                skipping = 0;
+            } else if (buffer[line] != '\0') {
+                names[count++] = buffer + line;
+                if (count == STREAM_BATCH) {
+                    matched += stream_batch(table, names, count, lookup, found, &out);
+                    records += count;
+                    count = 0;
+                }
+            }
+            line = stop + 1;
+        }
+        if (count > 0) {
+            matched += stream_batch(table, names, count, lookup, found, &out);
+            records += count;
+        }
+        if (done) break;
+
+        kept = end - line;
+        if (kept == STREAM_BUFFER_SIZE) {
+            // One line fills the whole buffer: count it as failed and drop it
+            if (!skipping) {
+                records++;
+                matched += !lookup;
+            }
+            skipping = 1;
+            kept = 0;
         } else {
-            // If the character is invalid, print an error, free memory, and exit
-            printf("Invalid character in name: %s\n", input_name);
-            free(name); // Avoid memory leaks
-            return 1;
+            memmove(buffer, buffer + line, kept);
         }
     }
+    output_flush(&out);
+    fflush(stdout);
 
-    // Pass the converted uppercase string back to the caller via the output pointer
-    *output_name = name;
-    return 0; // Return success
+    int read_error = ferror(file);
+    if (!from_stdin) fclose(file);
+    free(buffer);
+    free(names);
+    free(found);
+    free(out.data);
+    if (read_error) {
+        printf("Failed to read %s\n", path);
+        return 1;
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+    fprintf(stderr, "%s %zu names from %s (%zu %s) in %.3f s, %.0f records/s\n",
+            lookup ? "Looked up" : "Added", records, from_stdin ? "stdin" : path, matched,
+            lookup ? "found" : "failed", seconds, seconds > 0 ? (double)records / seconds : 0);
+    return 0;
 }
 
 /**
- * Frees all allocated memory for the hierarchical hash structure.
- *
- * This function traverses the entire hierarchical hash table and deallocates 
- * all dynamically allocated memory at each level:
- * - Third level: Frees all nodes in the linked lists and their associated names.
- * - Second level: Frees all hash blocks.
- * - First level: Frees the memory for the first-level array of hash blocks.
+ * Processes one batch of streamed names.
  *
- * This ensures that no memory leaks occur and that all resources used by the 
- * hierarchical hash structure are properly released.
+ * Inserts go through hash_table_insert_batch. Lookups go through 
+ * hash_table_lookup_batch and each result is written to the output buffer.
  *
- * Note: This function should be called before the program terminates to clean 
- * up memory allocated for the hash structure.
+ * @param table The table to add to or search.
+ * @param names The names of the batch.
+ * @param count The number of names.
+ * @param lookup Non-zero to look the names up, zero to insert them.
+ * @param found Scratch array of count results for lookups.
+ * @param out The output buffer for lookup results.
+ * @return The number of hits for lookups, or of failed inserts.
  */
-void free_hash_blocks() {
-    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
-        if (first_level[i] != NULL) {
-            for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
-                if (first_level[i]->second_level[j] != NULL) {
-                    HashBlock *block = first_level[i]->second_level[j];
-                    for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
-                        Node *current = block->third_level[k];
-                        while (current != NULL) {
-                            Node *tmp = current;
-                            current = current->next;
-                            free(tmp->name); // Free the name string
-                            free(tmp);       // Free the node
-                        }
-                    }
-                    free(block); // Free the second-level hash block
-                }
-            }
-            free(first_level[i]); // Free the first-level hash block
+size_t stream_batch(HashTable *table, const char **names, size_t count, int lookup,
+                    const char **found, OutputBuffer *out) {
+    if (!lookup) {
+        return hash_table_insert_batch(table, names, count, NULL);
+    }
+
+    size_t hits = hash_table_lookup_batch(table, names, count, found);
+    for (size_t i = 0; i < count; i++) {
+        const char *name = found[i] != NULL ? found[i] : names[i];
+        if (found[i] != NULL) {
+            output_write(out, "Found: ", 7);
+        } else {
+            output_write(out, "Not Found: ", 11);
         }
+        output_write(out, name, strlen(name));
+        output_write(out, "\n", 1);
     }
+    return hits;
 }
 
 /**
- * Prints a visual representation of the hierarchical hash structure.
- *
- * This function traverses the three levels of the hierarchical hash table and 
- * prints the contents of each level, starting from the first level down to the 
- * third level. Each level is labeled for clarity:
- * - The first level uses alphabetical indices (A-Z).
- * - The second level uses vowels (A, E, I, O, U, Y).
- * - The third level uses alphabetical indices (A-Z).
+ * Appends bytes to an output buffer.
  *
- * For each entry in the hash structure, the function prints the names stored 
- * in the third-level linked lists. If a level is empty, it is skipped.
+ * The buffer is flushed when the bytes do not fit; text larger than the 
+ * whole buffer is written directly.
  *
- * This function is primarily used for debugging or visualization purposes.
+ * @param out The output buffer.
+ * @param text The bytes to write.
+ * @param length The number of bytes.
  */
-void print_hash_blocks() {
-    printf("\n");
-    for (unsigned int i = 0; i < FIRST_LEVEL_SIZE; i++) {
-        if (first_level[i] != NULL) {
-            printf("First Level [%c]:\n", 'A' + i);
-            for (unsigned int j = 0; j < SECOND_LEVEL_SIZE; j++) {
-                if (first_level[i]->second_level[j] != NULL) {
-                    // Determine the label for the second level
-                    const char *label;
-                    switch (j) {
-                        case 0: label = "A"; break;
-                        case 1: label = "E"; break;
-                        case 2: label = "I"; break;
-                        case 3: label = "O"; break;
-                        case 4: label = "U"; break;
-                        case 5: label = "Y"; break;
-                        default: label = "Default"; break;
-                    }
-                    printf("  Second Level [%s]:\n", label);
-                    HashBlock *block = first_level[i]->second_level[j];
-                    for (unsigned int k = 0; k < THIRD_LEVEL_SIZE; k++) {
-                        if (block->third_level[k] != NULL) {
-                            printf("    Third Level [%c]:\n", 'A' + k);
-                            Node *current = block->third_level[k];
-                            while (current != NULL) {
-                                printf("      Name: %s\n", current->name);
-                                current = current->next;
-                            }
-                        }
-                    }
-                }
-            }
+void output_write(OutputBuffer *out, const char *text, size_t length) {
+    if (out->used + length > OUTPUT_BUFFER_SIZE) {
+        output_flush(out);
+        if (length > OUTPUT_BUFFER_SIZE) {
+            fwrite(text, 1, length, out->file);
+            return;
         }
     }
+    memcpy(out->data + out->used, text, length);
+    out->used += length;
+}
+
+/**
+ * Writes out everything pending in an output buffer.
+ *
+ * @param out The output buffer.
+ */
+void output_flush(OutputBuffer *out) {
+    if (out->used > 0) {
+        fwrite(out->data, 1, out->used, out->file);
+        out->used = 0;
+    }
 }
@@ -1,7 +1,10 @@
 #ifndef HASHBLOCKS_H
 #define HASHBLOCKS_H
 
+#include <stddef.h>
+
 // Constants defining the sizes of different levels in the Hash Block's structure
+// (what each level represents is set by the table's HashSchema; these are the defaults)
 #define FIRST_LEVEL_SIZE 26  // Represents the first letter of names (A-Z)
 #define SECOND_LEVEL_SIZE 7  // Represents vowels (A, E, I, O, U, Y) and a default bucket
 #define THIRD_LEVEL_SIZE 26  // Represents the third letter of names (A-Z)
@@ -10,11 +13,21 @@
 typedef struct Node {
     char *name;           // Pointer to the name stored as a string
     struct Node *next;    // Pointer to the next node in the case of collisions
+    void *value;          // Payload set by hash_table_put (NULL for names added otherwise)
 } Node;
 
+// Sorted contiguous third-level bucket used instead of a linked list by
+// HASH_TABLE_FLAT tables. The layout is private to hashblocks.c.
+struct FlatBucket;
+struct BlockFilter;
+
 // Structure for the Hash Block's third-level
 typedef struct HashBlock {
-    Node *third_level[THIRD_LEVEL_SIZE];  // Array of linked list heads for third-level hashing
+    union {
+        Node *third_level[THIRD_LEVEL_SIZE];           // Array of linked list heads for third-level hashing
+        struct FlatBucket *buckets[THIRD_LEVEL_SIZE];  // Array of flat buckets (HASH_TABLE_FLAT tables)
+    };
+    struct BlockFilter *filter;  // Bloom filter of the block's names (HASH_TABLE_FILTER tables), or NULL
 } HashBlock;
 
 // Structure for the Hash Block's second-level 
@@ -22,8 +35,781 @@ typedef struct HashBlocks {
     HashBlock *second_level[SECOND_LEVEL_SIZE];  // Array of pointers to HashBlock structures
 } HashBlocks;
 
+// Option flags for create_hash_table_ex
+#define HASH_TABLE_ARENA 0x01  // Bump-allocate nodes and names from per-table pages instead of one malloc each
+#define HASH_TABLE_FLAT  0x02  // Store each third-level slot as a sorted array with fingerprints and a string pool
+#define HASH_TABLE_CONCURRENT 0x04  // Wait-free lookups from any thread, writers locked per first letter (not with ARENA or FLAT)
+#define HASH_TABLE_COUNTERS 0x08  // Count inserts, lookup hits and misses and name comparisons (see hash_table_stats)
+#define HASH_TABLE_UTF8 0x10  // Accept any UTF-8 key without control characters, uppercased with simple case folding
+#define HASH_TABLE_FOLD_ACCENTS 0x20  // Like HASH_TABLE_UTF8, and strip accents from Latin, Greek and Cyrillic letters
+#define HASH_TABLE_FILTER 0x40  // Keep a Bloom filter per HashBlock that answers most misses from one cache line (not with CONCURRENT)
+
+// Number of levels described by a HashSchema, and the last character position a level can read
+#define HASH_SCHEMA_LEVELS 3
+#define HASH_SCHEMA_MAX_POSITION 7
+
+// Level schema of a table: which character of a name each level reads, and the
+// bucket each character maps to at that level. A level reading past the end of a
+// shorter name uses the bucket of the terminator (buckets[level][0]). Buckets must
+// be smaller than the level's size. The default schema reads the first, second
+// and third characters and maps the second one to its vowel bucket.
+typedef struct HashSchema {
+    unsigned char positions[HASH_SCHEMA_LEVELS];     // Character (0 to HASH_SCHEMA_MAX_POSITION) read by each level
+    unsigned char buckets[HASH_SCHEMA_LEVELS][256];  // Bucket of each uppercase character (or UTF-8 byte), per level
+} HashSchema;
+
+// Options used when creating a table. A zero-initialized structure selects the defaults.
+typedef struct HashTableOptions {
+    unsigned int flags;        // Bitwise OR of HASH_TABLE_* flags
+    const HashSchema *schema;  // Level schema (copied), or NULL for the default schema
+    double filter_rate;        // Target false-positive rate of HASH_TABLE_FILTER filters, or 0 for 1%
+} HashTableOptions;
+
+// Memory usage report filled in by hash_table_memory_stats
+typedef struct HashTableMemoryStats {
+    size_t names;              // Number of names currently stored
+    size_t hash_blocks_count;  // Allocated second-level HashBlocks structures
+    size_t hash_block_count;   // Allocated third-level HashBlock structures
+    size_t block_bytes;        // Bytes used by HashBlocks and HashBlock structures
+    size_t node_bytes;         // Bytes requested for Node structures
+    size_t name_bytes;         // Bytes requested for names, including terminators
+    size_t heap_bytes;         // Estimated heap footprint of the nodes and names with one malloc each
+    size_t arena_pages;        // Arena pages allocated (0 without HASH_TABLE_ARENA)
+    size_t arena_bytes;        // Bytes reserved by arena pages (0 without HASH_TABLE_ARENA)
+    size_t arena_saved_bytes;  // How much smaller arena_bytes is than heap_bytes (0 without HASH_TABLE_ARENA)
+    size_t flat_buckets;       // Allocated flat buckets (0 without HASH_TABLE_FLAT)
+    size_t flat_bytes;         // Bytes allocated for flat buckets, their entries and string pools
+    size_t sub_blocks;         // SubBlocks that overfull chains were promoted to
+    size_t sub_block_bytes;    // Bytes allocated for SubBlocks and their prefixes (part of block_bytes)
+    size_t filters;            // Block filters allocated (0 without HASH_TABLE_FILTER)
+    size_t filter_bytes;       // Bytes allocated for block filters
+} HashTableMemoryStats;
+
+// Buckets of the chain length histogram in HashTableStats: bucket b counts chains
+// of 2^b to 2^(b+1)-1 names, and the last bucket also counts every longer chain
+#define HASH_STATS_HISTOGRAM_SIZE 16
+
+// Occupancy and operation report filled in by hash_table_stats
+typedef struct HashTableStats {
+    HashTableMemoryStats memory;                        // Structure counts and bytes, as hash_table_memory_stats reports them
+    size_t first_level_used;                            // First-level buckets holding a HashBlocks
+    size_t second_level_blocks[SECOND_LEVEL_SIZE];      // HashBlock structures allocated for each second-level bucket
+    size_t second_level_names[SECOND_LEVEL_SIZE];       // Names stored below each second-level bucket
+    size_t third_level_slots;                           // Third-level slots of the allocated HashBlock structures
+    size_t third_level_used;                            // Of those, the slots holding at least one name
+    size_t chains;                                      // Non-empty chains or flat buckets, counting each chain below a SubBlock
+    size_t chain_histogram[HASH_STATS_HISTOGRAM_SIZE];  // Chains by length (see HASH_STATS_HISTOGRAM_SIZE)
+    size_t chain_p50;                                   // Median chain length
+    size_t chain_p99;                                   // 99th percentile chain length
+    size_t chain_max;                                   // Longest chain
+    double probe_depth;                                 // Average name comparisons a lookup of each stored name takes
+    int counters;                                       // Non-zero if the table keeps the counters below (HASH_TABLE_COUNTERS)
+    size_t inserts;                                     // Names added since the table was created
+    size_t hits;                                        // Lookups that found their name
+    size_t misses;                                      // Lookups that did not
+    size_t compares;                                    // Names compared by those lookups
+    double filter_rate;                                 // Target false-positive rate of the block filters (0 without HASH_TABLE_FILTER)
+    unsigned int filter_bits;                           // Filter bits per name
+    unsigned int filter_hashes;                         // Bits each name sets in its filter line
+    double filter_fill;                                 // Fraction of the filter bits that are set
+    double filter_estimated_rate;                       // False-positive rate the filters' current fill gives
+    size_t filter_rejects;                              // Lookups the filters answered without a walk (counters)
+    size_t filter_false_positives;                      // Lookups the filters let through that missed (counters)
+} HashTableStats;
+
+// Instruction sets used by key normalization and flat bucket scans
+typedef enum HashSimdLevel {
+    HASH_SIMD_SCALAR = 0,  // Portable byte-at-a-time code
+    HASH_SIMD_SSE2 = 1,    // 16 bytes per step
+    HASH_SIMD_AVX2 = 2     // 32 bytes per step
+} HashSimdLevel;
+
+// How hash_table_put treats a name that is already stored
+typedef enum HashPutMode {
+    HASH_PUT_IF_ABSENT = 0,  // Keep the stored value
+    HASH_PUT_REPLACE = 1     // Overwrite the stored value (upsert)
+} HashPutMode;
+
+// Outcome of hash_table_put
+typedef enum HashPutResult {
+    HASH_PUT_ADDED = 0,   // The name was not stored and has been added with the value
+    HASH_PUT_FOUND = 1,   // The name was already stored
+    HASH_PUT_FAILED = 2   // The name is invalid or memory allocation failed
+} HashPutResult;
+
+// Opaque handle to an independent Hash Blocks table.
+// Each table owns its own first level, so several tables can live in one process,
+// be built on different threads and be freed independently of each other.
+typedef struct HashTable HashTable;
+
+// Read-only table mapped from a file written by hash_table_save.
+typedef struct HashSnapshot HashSnapshot;
+
+// Read-only compact copy of a table made by hash_table_freeze.
+typedef struct HashFrozen HashFrozen;
+
+// Write-ahead log and checkpoint that make a table's inserts and removes survive restarts.
+typedef struct HashLog HashLog;
+
+// Contents detached from a table and freed on background threads.
+typedef struct HashReclaim HashReclaim;
+
+// Longest prefix or range bound a cursor accepts, including the terminator
+#define HASH_CURSOR_KEY_SIZE 64
+
+// Third-level slots a cursor may have to merge: every slot of a table
+#define HASH_CURSOR_WAYS (FIRST_LEVEL_SIZE * SECOND_LEVEL_SIZE * THIRD_LEVEL_SIZE)
+
+// Next name of one third-level slot being merged by a HashCursor
+typedef struct HashCursorWay {
+    const char *name;          // The name
+    union {
+        const Node *node;      // Its node (linked-list tables)
+        size_t index;          // Its entry in the flat bucket (HASH_TABLE_FLAT tables)
+    };
+} HashCursorWay;
+
+// Ordered cursor over the names of a table in a prefix or range. It allocates
+// nothing, but it is large (about 75 KB), so keep it in long-lived storage rather
+// than on a small thread stack. The fields are private.
+typedef struct HashCursor {
+    const HashTable *table;           // Table being walked
+    char low[HASH_CURSOR_KEY_SIZE];   // Inclusive start of the range
+    char high[HASH_CURSOR_KEY_SIZE];  // Exclusive end of the range
+    int bounded;                      // Whether high applies
+    int started;                      // Whether the heap has been filled
+    size_t fixed;                     // Leading characters shared by every name in range
+    size_t ways;                      // Entries of heap in use
+    HashCursorWay heap[HASH_CURSOR_WAYS]; // Min-heap of the slots' next names
+} HashCursor;
+
+// Flags for hash_snapshot_open
+#define HASH_SNAPSHOT_VERIFY 0x01  // Also check the checksum and every entry (reads the whole file)
+
+// Flags for hash_table_freeze_ex
+#define HASH_FROZEN_COMPACT_KEYS 0x01  // Store each name without the characters its slot implies
+
+// Flags for HashLogOptions
+#define HASH_LOG_DURABLE 0x01  // hash_log_insert and hash_log_remove return once their record is on disk
+
+// Returned by hash_log_insert and hash_log_remove when the change was applied to the
+// table, and is visible to readers, but its record could not be made durable
+#define HASH_LOG_NOT_DURABLE 2
+
+// Options used when opening a log. A zero-initialized structure selects the defaults.
+typedef struct HashLogOptions {
+    unsigned int flags;               // Bitwise OR of HASH_LOG_* flags
+    unsigned int commit_interval_ms;  // How often pending records are written and synced (0 for 10 ms)
+    size_t checkpoint_bytes;          // Log size that starts a background checkpoint, or 0 for none
+} HashLogOptions;
+
+/**
+ * Callback invoked by hash_table_iterate for every stored name.
+ *
+ * @param name The stored (uppercase) name.
+ * @param context The caller-supplied context pointer.
+ * @return 0 to continue iterating, or non-zero to stop early.
+ */
+typedef int (*HashTableVisitor)(const char *name, void *context);
+
+// Largest edit distance hash_table_fuzzy accepts
+#define HASH_FUZZY_MAX_EDITS 8
+
+// Size of a code written by hash_soundex, terminator included
+#define HASH_SOUNDEX_SIZE 5
+
+/**
+ * Callback invoked by hash_table_fuzzy for every name within the edit budget.
+ *
+ * @param name The stored (uppercase) name.
+ * @param distance Its edit distance from the searched name.
+ * @param context The caller-supplied context pointer.
+ * @return 0 to continue searching, or non-zero to stop early.
+ */
+typedef int (*HashTableMatchVisitor)(const char *name, unsigned int distance, void *context);
+
+/**
+ * Creates a new, empty Hash Blocks table.
+ *
+ * @return A pointer to the new table, or NULL if memory allocation fails.
+ */
+HashTable* create_hash_table(void);
+
+/**
+ * Creates a new, empty Hash Blocks table with the given options.
+ *
+ * @param options The options to apply, or NULL for the defaults.
+ * @return A pointer to the new table, or NULL if memory allocation fails.
+ */
+HashTable* create_hash_table_ex(const HashTableOptions *options);
+
+/**
+ * Frees a table and every name stored in it.
+ *
+ * @param table The table to destroy. NULL is ignored.
+ */
+void destroy_hash_table(HashTable *table);
+
+/**
+ * Frees a table on background threads and returns without walking it.
+ *
+ * The contents are detached under the table's writer locks and freed by 
+ * worker threads that each take one first-level subtree at a time. In a 
+ * HASH_TABLE_CONCURRENT table lookups already running finish safely: the 
+ * workers wait until no reader can still be inside the table. No thread 
+ * may start using the table once this is called.
+ *
+ * @param table The table to destroy. NULL is ignored.
+ * @param threads Number of worker threads (0 means 1).
+ * @return A handle to pass to hash_reclaim_wait, or NULL if table is NULL or memory 
+ *         allocation fails (the table is then left untouched).
+ */
+HashReclaim* destroy_hash_table_async(HashTable *table, unsigned int threads);
+
+/**
+ * Empties a table at once and frees its former contents on background threads.
+ *
+ * Each first-level bucket is detached with a single store while the writer 
+ * locks are held, so writers see the table go from full to empty in one step 
+ * and the table can be refilled right away. Readers of a HASH_TABLE_CONCURRENT 
+ * table see each bucket either full or empty, and the detached blocks are only 
+ * freed once none of them can still be reading it.
+ *
+ * @param table The table to clear.
+ * @param threads Number of worker threads (0 means 1).
+ * @return A handle to pass to hash_reclaim_wait, or NULL if memory allocation fails 
+ *         (the table is then left untouched).
+ */
+HashReclaim* hash_table_clear_async(HashTable *table, unsigned int threads);
+
+/**
+ * Replaces the contents of a table with those of another table.
+ *
+ * Meant for hot-swapping a freshly built table into one that readers keep 
+ * using: every first-level bucket of table is replaced by the matching bucket 
+ * of fresh with a single store while the writer locks are held, and the old 
+ * contents are freed in the background as in hash_table_clear_async. A lookup 
+ * sees either the old or the new bucket of its name, never a mix. fresh is 
+ * destroyed and must not be in use.
+ *
+ * @param table The table to refill.
+ * @param fresh The table whose contents move into table. It must have been 
+ *              created with the same flags (HASH_TABLE_COUNTERS aside) and schema.
+ * @param threads Number of worker threads (0 means 1).
+ * @return A handle to pass to hash_reclaim_wait, or NULL if the tables do not match 
+ *         or memory allocation fails (both tables are then left untouched).
+ */
+HashReclaim* hash_table_swap(HashTable *table, HashTable *fresh, unsigned int threads);
+
+/**
+ * Waits until a background reclamation has freed everything, then frees its handle.
+ *
+ * Every handle returned by destroy_hash_table_async, hash_table_clear_async or 
+ * hash_table_swap must be passed here once, unless the process exits first.
+ *
+ * @param reclaim The reclamation to wait for. NULL is ignored.
+ */
+void hash_reclaim_wait(HashReclaim *reclaim);
+
+/**
+ * Returns the schema used by tables created without one.
+ *
+ * @return The default schema (first letter, vowel bucket, third letter).
+ */
+const HashSchema* hash_schema_default(void);
+
+/**
+ * Derives a level schema that balances bucket occupancy for a sample of keys.
+ * The character each level reads and its bucket map are chosen level by level to
+ * minimize the average chain length of the sample. Names are read as in a
+ * HASH_TABLE_UTF8 table, so bytes other than letters get buckets of their own
+ * when the sample holds them.
+ *
+ * @param names The sample names.
+ * @param count The number of names.
+ * @param schema Receives the derived schema.
+ * @return 0 on success, or 1 if the sample holds no valid name or memory allocation fails.
+ */
+int hash_schema_from_sample(const char *const *names, size_t count, HashSchema *schema);
+
+/**
+ * Derives a level schema from a file with one name per line.
+ *
+ * @param path The sample file.
+ * @param schema Receives the derived schema.
+ * @return 0 on success, or 1 if the file cannot be read or holds no valid name.
+ */
+int hash_schema_from_file(const char *path, HashSchema *schema);
+
+/**
+ * Prints a schema as a C initializer, so a derived schema can be compiled into a program.
+ *
+ * @param schema The schema to print.
+ * @param name The name of the generated variable.
+ */
+void print_hash_schema(const HashSchema *schema, const char *name);
+
+/**
+ * Returns the level schema of a table.
+ *
+ * @param table The table.
+ * @return The schema, owned by the table.
+ */
+const HashSchema* hash_table_schema(const HashTable *table);
+
+/**
+ * Adds a name to a table.
+ *
+ * @param table The table to add the name to.
+ * @param input_name The name to add to the structure.
+ * @return 0 if the operation is successful, 1 if an error occurs (e.g., invalid input or memory allocation failure).
+ */
+int hash_table_insert(HashTable *table, const char *input_name);
+
+/**
+ * Looks up a name in a table.
+ *
+ * @param table The table to search.
+ * @param input_name The name to search for in the structure.
+ * @return The stored (uppercase) name if found, or NULL if the name is not found or is invalid.
+ *         In HASH_TABLE_FLAT tables the pointer is only valid until the table is next modified.
+ *         In HASH_TABLE_CONCURRENT tables the lookup is wait-free and the pointer stays
+ *         valid until another thread removes the name.
+ */
+const char* hash_table_lookup(const HashTable *table, const char *input_name);
+
+/**
+ * Adds a name with a value, or finds it if it is already stored, in a single traversal.
+ *
+ * Names added by hash_table_insert count as stored with a NULL value. When a name is 
+ * stored more than once, the first occurrence is the one found. Values are opaque to 
+ * the table: they are neither copied nor freed, and snapshots do not store them.
+ *
+ * @param table The table to add the name to.
+ * @param input_name The name.
+ * @param value The value to store.
+ * @param mode Whether a value already stored for the name is kept or replaced.
+ * @param previous If not NULL, receives the value stored before the call (NULL if the name was added).
+ * @return HASH_PUT_ADDED, HASH_PUT_FOUND or HASH_PUT_FAILED.
+ */
+HashPutResult hash_table_put(HashTable *table, const char *input_name, void *value,
+                             HashPutMode mode, void **previous);
+
+/**
+ * Looks up the value stored with a name.
+ *
+ * @param table The table to search.
+ * @param input_name The name to search for.
+ * @param value Receives the value if the name is found (may be NULL).
+ * @return 0 if the name was found, 1 if it was not found or is invalid.
+ */
+int hash_table_get(const HashTable *table, const char *input_name, void **value);
+
+/**
+ * Adds several names to a table.
+ * Keys are processed in small windows with their level lookups interleaved and
+ * prefetched, which overlaps the memory latency of independent inserts.
+ *
+ * @param table The table to add the names to.
+ * @param names The names to add.
+ * @param count The number of names.
+ * @param results Receives 0 or 1 per name, as hash_table_insert would return (may be NULL).
+ * @return The number of names that could not be added.
+ */
+size_t hash_table_insert_batch(HashTable *table, const char *const *names, size_t count, int *results);
+
+/**
+ * Looks up several names in a table.
+ * Keys are processed in small windows with their level lookups interleaved and
+ * prefetched, which overlaps the memory latency of independent lookups.
+ *
+ * @param table The table to search.
+ * @param names The names to search for.
+ * @param count The number of names.
+ * @param results Receives the stored name or NULL per name, as hash_table_lookup would return (may be NULL).
+ * @return The number of names found.
+ */
+size_t hash_table_lookup_batch(const HashTable *table, const char *const *names, size_t count,
+                               const char **results);
+
+/**
+ * Bulk-loads many names into a table on several threads.
+ * Keys are partitioned by first letter and second-level bucket, and each
+ * subtree is sorted and built by one worker with its own allocator. The result
+ * is the same as inserting every name with hash_table_insert. No other thread
+ * may modify the table during the build.
+ *
+ * @param table The table to load.
+ * @param names The names to add.
+ * @param count The number of names.
+ * @param threads The number of worker threads (0 or 1 builds on the calling thread).
+ * @param results Receives 0 or 1 per name, as hash_table_insert would return (may be NULL).
+ * @return The number of names that could not be added.
+ */
+size_t hash_table_build(HashTable *table, const char *const *names, size_t count,
+                        unsigned int threads, int *results);
+
+/**
+ * Bulk-loads a file with one name per line into a table using hash_table_build.
+ *
+ * @param table The table to load.
+ * @param path The file to read.
+ * @param threads The number of worker threads.
+ * @param failures Receives the number of names that could not be added (may be NULL).
+ * @return 0 on success, or 1 if the file cannot be read.
+ */
+int hash_table_build_file(HashTable *table, const char *path, unsigned int threads, size_t *failures);
+
+/**
+ * Writes a table to a pointer-free snapshot file that hash_snapshot_open can map.
+ * The table's schema is stored in the snapshot.
+ *
+ * @param table The table to save.
+ * @param path The file to write; an existing file is replaced.
+ * @return 0 on success, or 1 on failure.
+ */
+int hash_table_save(const HashTable *table, const char *path);
+
+/**
+ * Maps a snapshot file read-only. Opening takes constant time; lookups parse and
+ * allocate nothing, and processes mapping the same file share its pages.
+ *
+ * @param path The snapshot file.
+ * @param flags HASH_SNAPSHOT_* flags.
+ * @return The snapshot, or NULL if the file cannot be mapped or is not a valid snapshot.
+ */
+HashSnapshot* hash_snapshot_open(const char *path, unsigned int flags);
+
 /**
- * Adds a name to the Hash Block
+ * Looks up a name in a snapshot, normalizing it like hash_table_lookup.
+ *
+ * @param snapshot The snapshot to search.
+ * @param input_name The name to search for.
+ * @return The stored name inside the mapping (valid until hash_snapshot_close), or NULL.
+ */
+const char* hash_snapshot_lookup(const HashSnapshot *snapshot, const char *input_name);
+
+/**
+ * Returns the number of names stored in a snapshot.
+ *
+ * @param snapshot The snapshot.
+ * @return The number of names.
+ */
+size_t hash_snapshot_count(const HashSnapshot *snapshot);
+
+/**
+ * Unmaps a snapshot.
+ *
+ * @param snapshot The snapshot to close. NULL is ignored.
+ */
+void hash_snapshot_close(HashSnapshot *snapshot);
+
+/**
+ * Recovers a table from its last checkpoint and write-ahead log, and keeps logging it.
+ * The checkpoint is the snapshot <path>.hb and the log is <path>.log; either may
+ * be missing. A torn record at the end of the log is dropped. Every name of the
+ * checkpoint is loaded into the table, so recovery takes time proportional to the
+ * table's size plus the log. A background thread writes and syncs records as a
+ * group every commit interval.
+ *
+ * @param table An empty table, created with the flags the logged names need.
+ * @param path The path of the checkpoint and log without their extensions.
+ * @param options The options to apply, or NULL for the defaults.
+ * @return The log, or NULL if recovery fails.
+ */
+HashLog* hash_log_open(HashTable *table, const char *path, const HashLogOptions *options);
+
+/**
+ * Adds a name to a logged table, like hash_table_insert, and appends it to the log.
+ *
+ * @param log The log.
+ * @param input_name The name to add.
+ * @return 0 on success, 1 if the name is invalid or the log had already failed, or 
+ *         HASH_LOG_NOT_DURABLE if the change was applied but its record could 
+ *         not be synced (HASH_LOG_DURABLE). The log accepts no further changes.
+ */
+int hash_log_insert(HashLog *log, const char *input_name);
+
+/**
+ * Removes a name from a logged table, like hash_table_remove, and appends it to the log.
+ *
+ * @param log The log.
+ * @param input_name The name to remove.
+ * @return 0 on success, 1 if the name was not found or the log had already failed, or 
+ *         HASH_LOG_NOT_DURABLE if the change was applied but its record could 
+ *         not be synced (HASH_LOG_DURABLE). The log accepts no further changes.
+ */
+int hash_log_remove(HashLog *log, const char *input_name);
+
+/**
+ * Waits until every record appended so far is on disk.
+ *
+ * @param log The log.
+ * @return 0 on success, or 1 if writing or syncing the log failed.
+ */
+int hash_log_sync(HashLog *log);
+
+/**
+ * Writes a new checkpoint of the table and starts an empty log. Writers wait for
+ * it; readers of HASH_TABLE_CONCURRENT tables do not.
+ *
+ * @param log The log.
+ * @return 0 on success, or 1 on failure (the previous checkpoint and log stay valid).
+ */
+int hash_log_checkpoint(HashLog *log);
+
+/**
+ * Syncs the log, stops its background thread and frees it. The table is left open.
+ *
+ * @param log The log to close. NULL is ignored.
+ * @return 0 on success, or 1 if the final sync failed.
+ */
+int hash_log_close(HashLog *log);
+
+/**
+ * Converts a table into a read-only compact form in a single allocation. Each
+ * third-level slot becomes a perfect hash over its names, so a lookup compares
+ * at most one string. Duplicate names are stored once and values are not kept.
+ * The table itself is left unchanged.
+ *
+ * @param table The table to freeze.
+ * @return The frozen table, or NULL on failure.
+ */
+HashFrozen* hash_table_freeze(const HashTable *table);
+
+/**
+ * Converts a table into a read-only compact form, like hash_table_freeze.
+ *
+ * @param table The table to freeze.
+ * @param flags Bitwise OR of HASH_FROZEN_* flags, or 0.
+ * @return The frozen table, or NULL on failure.
+ */
+HashFrozen* hash_table_freeze_ex(const HashTable *table, unsigned int flags);
+
+/**
+ * Looks up a name in a frozen table, normalizing it like hash_table_lookup.
+ *
+ * @param frozen The frozen table to search.
+ * @param input_name The name to search for.
+ * @return The stored name inside the frozen table (valid until hash_frozen_free), or NULL.
+ *         With HASH_FROZEN_COMPACT_KEYS this is the stored key, which lacks the 
+ *         characters the name's slot implies.
+ */
+const char* hash_frozen_lookup(const HashFrozen *frozen, const char *input_name);
+
+/**
+ * Calls a visitor for every name of a frozen table, slot by slot. Names stored
+ * with HASH_FROZEN_COMPACT_KEYS are passed in full.
+ *
+ * @param frozen The frozen table to walk.
+ * @param visitor The callback invoked for each name.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every name was visited, the non-zero value returned by the visitor that stopped the walk, or -1 on failure.
+ */
+int hash_frozen_iterate(const HashFrozen *frozen, HashTableVisitor visitor, void *context);
+
+/**
+ * Returns the number of distinct names stored in a frozen table.
+ *
+ * @param frozen The frozen table.
+ * @return The number of names.
+ */
+size_t hash_frozen_count(const HashFrozen *frozen);
+
+/**
+ * Returns the size of a frozen table's single allocation, names included.
+ *
+ * @param frozen The frozen table.
+ * @return The number of bytes.
+ */
+size_t hash_frozen_bytes(const HashFrozen *frozen);
+
+/**
+ * Frees a frozen table.
+ *
+ * @param frozen The frozen table to free. NULL is ignored.
+ */
+void hash_frozen_free(HashFrozen *frozen);
+
+/**
+ * Removes one occurrence of a name from a table.
+ *
+ * @param table The table to remove the name from.
+ * @param input_name The name to remove.
+ * @return 0 if the name was removed, 1 if the name was not found or is invalid.
+ */
+int hash_table_remove(HashTable *table, const char *input_name);
+
+/**
+ * Removes one occurrence of a name from a table and returns its value.
+ *
+ * @param table The table to remove the name from.
+ * @param input_name The name to remove.
+ * @param value Receives the value of the removed name (may be NULL).
+ * @return 0 if the name was removed, 1 if the name was not found or is invalid.
+ */
+int hash_table_remove_value(HashTable *table, const char *input_name, void **value);
+
+/**
+ * Frees the second- and third-level blocks that removals have left empty.
+ *
+ * Tables without HASH_TABLE_CONCURRENT already free them when their last name is 
+ * removed. HASH_TABLE_CONCURRENT tables keep them until this is called: it waits 
+ * until no reader can still be inside them, so it must not be called from a 
+ * thread that is reading the table (such as from a visitor).
+ *
+ * @param table The table to compact.
+ * @return The number of blocks freed.
+ */
+size_t hash_table_compact(HashTable *table);
+
+/**
+ * Visits every name stored in a table, level by level.
+ *
+ * @param table The table to walk.
+ * @param visitor The callback invoked for each name.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every name was visited, or the non-zero value returned by the visitor that stopped the walk.
+ */
+int hash_table_iterate(const HashTable *table, HashTableVisitor visitor, void *context);
+
+/**
+ * Visits every stored name within an edit distance of a name.
+ *
+ * The distance counts the bytes inserted, deleted or substituted between the 
+ * normalized names. Only the branches of the levels that can still hold a name 
+ * within max_edits are walked, and memory use does not grow with name length. 
+ * The table must not be modified from inside the visitor.
+ *
+ * @param table The table to search.
+ * @param input_name The name to match.
+ * @param max_edits The largest distance accepted, at most HASH_FUZZY_MAX_EDITS.
+ * @param visitor The callback invoked for each name within max_edits.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every match was visited, 1 if the name or max_edits is invalid, 
+ *         or the non-zero value returned by the visitor.
+ */
+int hash_table_fuzzy(const HashTable *table, const char *input_name, unsigned int max_edits,
+                     HashTableMatchVisitor visitor, void *context);
+
+/**
+ * Computes the American Soundex code of a name ("R163" for Robert and Rupert).
+ *
+ * Characters other than ASCII letters are skipped.
+ *
+ * @param name The name.
+ * @param code Receives the code.
+ * @return 0 on success, or 1 if the name has no ASCII letter.
+ */
+int hash_soundex(const char *name, char code[HASH_SOUNDEX_SIZE]);
+
+/**
+ * Visits every stored name with the same Soundex code as a name.
+ *
+ * In tables without HASH_TABLE_UTF8 or HASH_TABLE_FOLD_ACCENTS only the names 
+ * sharing the first letter's buckets are read. The table must not be modified 
+ * from inside the visitor.
+ *
+ * @param table The table to search.
+ * @param input_name The name to match.
+ * @param visitor The callback invoked for each name that sounds alike.
+ * @param context An opaque pointer passed through to the visitor.
+ * @return 0 if every match was visited, 1 if the name is invalid or has no 
+ *         ASCII letter, or the non-zero value returned by the visitor.
+ */
+int hash_table_phonetic(const HashTable *table, const char *input_name, HashTableVisitor visitor,
+                        void *context);
+
+/**
+ * Opens a cursor over the names of a table that start with a prefix.
+ *
+ * Names come out of hash_cursor_next in strcmp order, duplicates included. 
+ * Only the slots the prefix can map to are visited, and nothing is allocated. 
+ * The table must not be modified while the cursor is in use.
+ *
+ * @param cursor The cursor to fill in.
+ * @param table The table to walk.
+ * @param prefix The prefix (normalized like a name, but may be empty or shorter).
+ * @return 0 on success, or 1 if the prefix is invalid or too long.
+ */
+int hash_cursor_prefix(HashCursor *cursor, const HashTable *table, const char *prefix);
+
+/**
+ * Opens a cursor over the names of a table from one bound up to another.
+ *
+ * Behaves like hash_cursor_prefix for the names n with from <= n < to.
+ *
+ * @param cursor The cursor to fill in.
+ * @param table The table to walk.
+ * @param from The inclusive lower bound (normalized like a name), or NULL for no lower bound.
+ * @param to The exclusive upper bound (normalized like a name), or NULL for no upper bound.
+ * @return 0 on success, or 1 if a bound is invalid or too long.
+ */
+int hash_cursor_range(HashCursor *cursor, const HashTable *table, const char *from, const char *to);
+
+/**
+ * Returns the next name of a cursor.
+ *
+ * Stopping early needs no cleanup; the cursor can simply be dropped.
+ *
+ * @param cursor The cursor.
+ * @return The next stored name in order, or NULL once the range is exhausted.
+ */
+const char* hash_cursor_next(HashCursor *cursor);
+
+/**
+ * Reports the memory used by a table.
+ *
+ * @param table The table to inspect.
+ * @param stats Receives the memory usage figures.
+ */
+void hash_table_memory_stats(const HashTable *table, HashTableMemoryStats *stats);
+
+/**
+ * Reports how a table's names are spread over its levels and, for tables 
+ * created with HASH_TABLE_COUNTERS, how its operations went so far.
+ *
+ * @param table The table to inspect.
+ * @param stats Receives the statistics.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+int hash_table_stats(const HashTable *table, HashTableStats *stats);
+
+/**
+ * Prints the statistics of a table as a JSON object.
+ *
+ * @param table The table to report on.
+ * @return 0 on success, or 1 if memory allocation fails.
+ */
+int print_hash_table_stats(const HashTable *table);
+
+/**
+ * Prints the current state of a table.
+ *
+ * @param table The table to print.
+ */
+void print_hash_table(const HashTable *table);
+
+/**
+ * Returns the instruction set used by key normalization and flat bucket scans.
+ * The best level supported by the CPU is selected on first use.
+ *
+ * @return The active SIMD level.
+ */
+HashSimdLevel get_simd_level(void);
+
+/**
+ * Selects the instruction set used by key normalization and flat bucket scans.
+ * Levels the CPU does not support are lowered to the best supported one.
+ * All levels produce byte-identical results.
+ *
+ * @param level The requested SIMD level.
+ * @return The SIMD level now in use.
+ */
+HashSimdLevel set_simd_level(HashSimdLevel level);
+
+/**
+ * Adds a name to the default Hash Block table.
  * 
  * @param input_name The name to add to the structure.
  * @return 0 if the operation is successful, 1 if an error occurs (e.g., invalid input or memory allocation failure).
@@ -31,7 +817,7 @@ typedef struct HashBlocks {
 int add_name(const char *input_name);
 
 /**
- * Searches for a name in the Hash Block.
+ * Searches for a name in the default Hash Block table and prints the result.
  * 
  * @param name The name to search for in the structure.
  * @return 0 if the name is found, 1 if the name is not found.
@@ -39,14 +825,34 @@ int add_name(const char *input_name);
 int find_names(const char *name);
 
 /**
- * Prints the current state of the Hash Block.
+ * Adds several names to the default Hash Block table.
+ *
+ * @param names The names to add.
+ * @param count The number of names.
+ * @return The number of names that could not be added.
+ */
+size_t add_names_batch(const char *const *names, size_t count);
+
+/**
+ * Looks up several names in the default Hash Block table without printing.
+ *
+ * @param names The names to search for.
+ * @param count The number of names.
+ * @param results Receives the stored name or NULL per name (may be NULL).
+ * @return The number of names found.
+ */
+size_t find_names_batch(const char *const *names, size_t count, const char **results);
+
+/**
+ * Prints the current state of the default Hash Block table.
  * Displays the names stored at each level for visualization and debugging purposes.
  */
 void print_hash_blocks();
 
 /**
- * Frees all memory allocated for the Hash Block.
+ * Frees all memory allocated for the default Hash Block table.
  * Ensures there are no memory leaks by deallocating all nodes, blocks, and arrays.
+ * The default table is left empty and can be used again afterwards.
  */
 void free_hash_blocks();
 
@@ -0,0 +1,1182 @@
+/*
+ * Lookup service for Hash Blocks.
+ *
+ * Loads a table once, from a file of names or from a snapshot, and answers
+ * batched lookup and insert requests over a Unix domain socket, so a query no
+ * longer pays for starting a process and building the table. One thread runs
+ * an epoll event loop that owns every socket; a pool of workers runs the
+ * batched table calls. Clients may pipeline: any number of requests can be
+ * sent before the first response arrives. The same program is the client and
+ * a load generator.
+ *
+ * Protocol: every frame starts with a ServerHeader in host byte order (both
+ * ends share the machine). A request carries count names, each as one length
+ * byte followed by that many bytes; its response carries one result byte per
+ * name (1 found or added, 0 not found, invalid or not added). Responses
+ * echo the request id and come back in request order on each connection.
+ *
+ * Build together with the library, leaving out its command-line tool (Linux):
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o hbserver server.c hashblocks.c -lm
+ */
+#ifdef __linux__
+#define _GNU_SOURCE  // accept4, strtok_r and clock_gettime under -std=c17
+#endif
+#include "hashblocks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <threads.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Request operations, carried in ServerHeader.op
+#define SERVER_OP_LOOKUP 1
+#define SERVER_OP_INSERT 2
+
+// Response status, carried in ServerHeader.op
+#define SERVER_OK          0  // One result byte per name follows
+#define SERVER_BAD_REQUEST 1  // Unknown operation or malformed names; no results follow
+#define SERVER_READ_ONLY   2  // Insert into a table served from a snapshot; no results follow
+
+// Largest request payload; a connection sending a larger frame is closed
+#define SERVER_MAX_PAYLOAD (1u << 20)
+
+// Bytes buffered per connection and direction before the server stops reading
+// from it or handing it to the workers, so a client that does not read its
+// responses cannot make the server grow without bound
+#define SERVER_BUFFER_LIMIT (4u << 20)
+
+// Most requests of one connection handed to a worker at a time
+#define SERVER_JOB_FRAMES 64
+
+// Default number of worker threads, and the epoll events read per wait
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_EVENTS 64
+
+// Load generator defaults: connections, requests in flight per connection,
+// names per request and requests per connection
+#define LOAD_CONNECTIONS 4
+#define LOAD_DEPTH 16
+#define LOAD_BATCH 32
+#define LOAD_REQUESTS 10000
+
+// Header of every request and response frame
+typedef struct ServerHeader {
+    uint32_t length;  // Payload bytes after the header
+    uint32_t id;      // Chosen by the client and echoed in the response
+    uint16_t op;      // SERVER_OP_* in requests, SERVER_* status in responses
+    uint16_t count;   // Names in the request, result bytes in the response
+} ServerHeader;
+
+// Client connection, touched only by the event loop thread
+typedef struct Connection {
+    int fd;                        // Non-blocking socket
+    uint32_t events;               // epoll events currently registered
+    int busy;                      // Non-zero while a job of this connection is with the workers
+    int eof;                       // The peer has shut down its side; flush and close
+    int failed;                    // The socket failed; close once no job is out
+    int closed;                    // Closed; freed after the current batch of events
+    unsigned char *in;             // Received bytes not yet handed to a worker
+    size_t in_used, in_size;
+    unsigned char *out;            // Responses not yet sent
+    size_t out_used, out_sent, out_size;
+    struct Connection *prev, *next; // List of open connections
+} Connection;
+
+// Consecutive requests of one connection, served by one worker in order
+typedef struct Job {
+    Connection *connection;        // Connection the requests came from
+    unsigned char *requests;       // Complete request frames; names are unpacked in place
+    size_t request_bytes;
+    unsigned char *responses;      // Response frames, filled in by the worker
+    size_t response_bytes;
+    size_t frames;                 // Requests in the job
+    struct Job *next;
+} Job;
+
+// State shared by the event loop and the workers
+typedef struct Server {
+    HashTable *table;              // Table served, or NULL with a snapshot
+    HashSnapshot *snapshot;        // Snapshot served read-only, or NULL
+    int epoll_fd;
+    int listen_fd;
+    int wake_fd;                   // eventfd the workers signal when a job is done
+    int signal_fd;                 // SIGINT and SIGTERM, to stop the loop
+    mtx_t lock;                    // Guards the two queues and stopping
+    cnd_t ready;                   // Signaled when a job is queued or the server stops
+    Job *pending, *pending_tail;   // Jobs waiting for a worker
+    Job *done, *done_tail;         // Jobs waiting for the event loop
+    int stopping;
+    Connection *connections;       // Open connections
+    Connection *closed;            // Connections closed during the current batch of events
+    size_t requests;               // Requests served, for the exit summary
+} Server;
+
+// Per-worker arrays sized for the largest request
+typedef struct WorkerScratch {
+    const char **names;
+    const char **found;
+    int *added;
+} WorkerScratch;
+
+// One load generator connection and its results
+typedef struct LoadClient {
+    const char *path;              // Socket to connect to
+    const char *const *names;      // Names to look up
+    size_t name_count;
+    unsigned int depth;            // Requests kept in flight
+    unsigned int batch;            // Names per request
+    size_t requests;               // Requests to send
+    uint32_t seed;                 // Picks the names of each request
+    double *latencies;             // Round trip of each request in nanoseconds
+    size_t hits;                   // Names found
+    int failed;                    // Non-zero if the connection failed
+} LoadClient;
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ *
+ * @return The current time in nanoseconds.
+ */
+static double clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Grows a byte buffer to hold at least the given number of bytes.
+ *
+ * @param buffer The buffer; may be moved.
+ * @param size The allocated bytes; updated when the buffer grows.
+ * @param needed The bytes required.
+ * @return 0 on success, or 1 if memory allocation fails (the buffer is left untouched).
+ */
+static int reserve_bytes(unsigned char **buffer, size_t *size, size_t needed) {
+    if (needed <= *size) return 0;
+    size_t grown = *size ? *size : 4096;
+    while (grown < needed) grown *= 2;
+    unsigned char *resized = (unsigned char *)realloc(*buffer, grown);
+    if (!resized) {
+        printf("Memory allocation failed for connection buffer\n");
+        return 1;
+    }
+    *buffer = resized;
+    *size = grown;
+    return 0;
+}
+
+/**
+ * Serves one request frame.
+ *
+ * The names are unpacked in place: each one moves over its length byte and
+ * is terminated where the next length byte was, so the table calls see
+ * ordinary strings without a copy. Lookups go through hash_table_lookup_batch,
+ * which interleaves the level lookups of the whole request.
+ *
+ * @param server The server.
+ * @param header The request header.
+ * @param payload The request payload (modified).
+ * @param scratch The worker's arrays.
+ * @param response Receives the response frame; has room for a header and count bytes.
+ * @return The size of the response frame.
+ */
+static size_t serve_frame(Server *server, const ServerHeader *header, unsigned char *payload,
+                          const WorkerScratch *scratch, unsigned char *response) {
+    ServerHeader reply = { 0, header->id, SERVER_OK, 0 };
+    unsigned char *results = response + sizeof(ServerHeader);
+
+    size_t offset = 0;
+    uint16_t count = 0;
+    while (count < header->count && offset < header->length) {
+        size_t length = payload[offset];
+        if (offset + 1 + length > header->length) break;
+        memmove(payload + offset, payload + offset + 1, length);
+        payload[offset + length] = '\0';
+        scratch->names[count++] = (const char *)(payload + offset);
+        offset += length + 1;
+    }
+
+    if (count != header->count || offset != header->length ||
+        (header->op != SERVER_OP_LOOKUP && header->op != SERVER_OP_INSERT)) {
+        reply.op = SERVER_BAD_REQUEST;
+    } else if (header->op == SERVER_OP_INSERT && server->table == NULL) {
+        reply.op = SERVER_READ_ONLY;
+    } else if (header->op == SERVER_OP_INSERT) {
+        hash_table_insert_batch(server->table, scratch->names, count, scratch->added);
+        for (uint16_t i = 0; i < count; i++) {
+            results[i] = scratch->added[i] == 0;
+        }
+        reply.count = count;
+    } else if (server->table != NULL) {
+        hash_table_lookup_batch(server->table, scratch->names, count, scratch->found);
+        for (uint16_t i = 0; i < count; i++) {
+            results[i] = scratch->found[i] != NULL;
+        }
+        reply.count = count;
+    } else {
+        for (uint16_t i = 0; i < count; i++) {
+            results[i] = hash_snapshot_lookup(server->snapshot, scratch->names[i]) != NULL;
+        }
+        reply.count = count;
+    }
+
+    reply.length = reply.count;
+    memcpy(response, &reply, sizeof(reply));
+    return sizeof(reply) + reply.count;
+}
+
+/**
+ * Worker thread: serves queued jobs until the server stops.
+ *
+ * A response is never larger than its request (one result byte per name
+ * against at least one length byte), so each job's responses fit in an
+ * allocation the size of its requests.
+ *
+ * @param argument The Server.
+ * @return 0 when the server stops, or 1 if memory allocation fails.
+ */
+static int run_worker(void *argument) {
+    Server *server = (Server *)argument;
+    WorkerScratch scratch;
+    scratch.names = (const char **)malloc(UINT16_MAX * sizeof(char *));
+    scratch.found = (const char **)malloc(UINT16_MAX * sizeof(char *));
+    scratch.added = (int *)malloc(UINT16_MAX * sizeof(int));
+    int status = 0;
+    if (!scratch.names || !scratch.found || !scratch.added) {
+        printf("Memory allocation failed for worker\n");
+        status = 1;
+    }
+
+    for (;;) {
+        mtx_lock(&server->lock);
+        while (server->pending == NULL && !server->stopping) {
+            cnd_wait(&server->ready, &server->lock);
+        }
+        Job *job = server->pending;
+        if (job != NULL) {
+            server->pending = job->next;
+            if (server->pending == NULL) server->pending_tail = NULL;
+        }
+        mtx_unlock(&server->lock);
+        if (job == NULL) break;
+
+        job->responses = status == 0 ? (unsigned char *)malloc(job->request_bytes) : NULL;
+        job->response_bytes = 0;
+        for (size_t offset = 0; job->responses != NULL && offset < job->request_bytes;) {
+            ServerHeader header;
+            memcpy(&header, job->requests + offset, sizeof(header));
+            job->response_bytes += serve_frame(server, &header, job->requests + offset + sizeof(header),
+                                               &scratch, job->responses + job->response_bytes);
+            offset += sizeof(header) + header.length;
+        }
+
+        // Hand the job back to the event loop and wake it up
+        job->next = NULL;
+        mtx_lock(&server->lock);
+        if (server->done_tail) server->done_tail->next = job;
+        else server->done = job;
+        server->done_tail = job;
+        mtx_unlock(&server->lock);
+        uint64_t one = 1;
+        if (write(server->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            printf("Failed to wake the event loop: %s\n", strerror(errno));
+        }
+    }
+
+    free(scratch.names);
+    free(scratch.found);
+    free(scratch.added);
+    return status;
+}
+
+/**
+ * Registers the epoll events a connection currently needs.
+ *
+ * It is read while it is open and its input buffer is below the limit, and
+ * watched for writability while responses wait to be sent.
+ *
+ * @param server The server.
+ * @param connection The connection.
+ */
+static void update_events(Server *server, Connection *connection) {
+    uint32_t events = 0;
+    if (!connection->eof && !connection->failed && connection->in_used < SERVER_BUFFER_LIMIT) {
+        events |= EPOLLIN;
+    }
+    if (!connection->failed && connection->out_sent < connection->out_used) {
+        events |= EPOLLOUT;
+    }
+    if (events == connection->events) return;
+
+    struct epoll_event event = { 0 };
+    event.events = events;
+    event.data.ptr = connection;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event) != 0) {
+        connection->failed = 1;
+        return;
+    }
+    connection->events = events;
+}
+
+/**
+ * Hands the complete requests buffered on a connection to the workers.
+ *
+ * Nothing is handed over while an earlier job of the connection is out,
+ * which keeps the requests of a connection, and so its responses, in order.
+ *
+ * @param server The server.
+ * @param connection The connection.
+ */
+static void dispatch_requests(Server *server, Connection *connection) {
+    if (connection->busy || connection->failed) return;
+    if (connection->out_used - connection->out_sent >= SERVER_BUFFER_LIMIT) return;
+
+    size_t bytes = 0, frames = 0;
+    while (frames < SERVER_JOB_FRAMES && connection->in_used - bytes >= sizeof(ServerHeader)) {
+        ServerHeader header;
+        memcpy(&header, connection->in + bytes, sizeof(header));
+        if (header.length > SERVER_MAX_PAYLOAD) {
+            printf("Closing a connection that sent a %u byte request\n", header.length);
+            connection->failed = 1;
+            return;
+        }
+        if (connection->in_used - bytes - sizeof(header) < header.length) break;
+        bytes += sizeof(header) + header.length;
+        frames++;
+    }
+    if (frames == 0) return;
+
+    Job *job = (Job *)calloc(1, sizeof(Job));
+    unsigned char *requests = (unsigned char *)malloc(bytes);
+    if (!job || !requests) {
+        printf("Memory allocation failed for job\n");
+        free(job);
+        free(requests);
+        connection->failed = 1;
+        return;
+    }
+    memcpy(requests, connection->in, bytes);
+    memmove(connection->in, connection->in + bytes, connection->in_used - bytes);
+    connection->in_used -= bytes;
+    job->connection = connection;
+    job->requests = requests;
+    job->request_bytes = bytes;
+    job->frames = frames;
+    connection->busy = 1;
+
+    mtx_lock(&server->lock);
+    if (server->pending_tail) server->pending_tail->next = job;
+    else server->pending = job;
+    server->pending_tail = job;
+    cnd_signal(&server->ready);
+    mtx_unlock(&server->lock);
+}
+
+/**
+ * Sends as much of a connection's pending responses as the socket takes.
+ *
+ * @param connection The connection.
+ */
+static void flush_responses(Connection *connection) {
+    while (!connection->failed && connection->out_sent < connection->out_used) {
+        ssize_t sent = send(connection->fd, connection->out + connection->out_sent,
+                            connection->out_used - connection->out_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection->out_sent += (size_t)sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Keep the unsent tail at the start of the buffer
+            if (connection->out_sent >= connection->out_used / 2) {
+                memmove(connection->out, connection->out + connection->out_sent,
+                        connection->out_used - connection->out_sent);
+                connection->out_used -= connection->out_sent;
+                connection->out_sent = 0;
+            }
+            return;
+        } else {
+            connection->failed = 1;
+        }
+    }
+    connection->out_sent = connection->out_used = 0;
+}
+
+/**
+ * Reads everything a connection has received so far.
+ *
+ * @param connection The connection.
+ */
+static void receive_requests(Connection *connection) {
+    while (!connection->eof && !connection->failed && connection->in_used < SERVER_BUFFER_LIMIT) {
+        if (reserve_bytes(&connection->in, &connection->in_size, connection->in_used + 65536) != 0) {
+            connection->failed = 1;
+            return;
+        }
+        ssize_t received = recv(connection->fd, connection->in + connection->in_used,
+                                connection->in_size - connection->in_used, 0);
+        if (received > 0) {
+            connection->in_used += (size_t)received;
+        } else if (received == 0) {
+            connection->eof = 1;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else {
+            connection->failed = 1;
+        }
+    }
+}
+
+/**
+ * Closes a connection. It is freed by free_closed, since events for it may 
+ * still be waiting in the batch being handled.
+ *
+ * @param server The server.
+ * @param connection The connection; no job of it may be out.
+ */
+static void close_connection(Server *server, Connection *connection) {
+    if (connection->prev) connection->prev->next = connection->next;
+    else server->connections = connection->next;
+    if (connection->next) connection->next->prev = connection->prev;
+    close(connection->fd);
+    connection->closed = 1;
+    connection->next = server->closed;
+    server->closed = connection;
+}
+
+/**
+ * Frees the connections closed since the last call.
+ *
+ * @param server The server.
+ */
+static void free_closed(Server *server) {
+    while (server->closed != NULL) {
+        Connection *connection = server->closed;
+        server->closed = connection->next;
+        free(connection->in);
+        free(connection->out);
+        free(connection);
+    }
+}
+
+/**
+ * Moves a connection forward after it was read from, written to or had a job
+ * completed: hands over new requests, sends responses, updates its events
+ * and closes it once it has failed, or once the peer has shut down and
+ * every request has been answered. Complete frames are always handed over
+ * first, so bytes left then are a frame the peer cut short; they are
+ * dropped, since the hung-up socket would otherwise stay readable forever.
+ *
+ * @param server The server.
+ * @param connection The connection.
+ */
+static void progress_connection(Server *server, Connection *connection) {
+    dispatch_requests(server, connection);
+    flush_responses(connection);
+    if (!connection->busy && (connection->failed ||
+        (connection->eof && connection->out_sent == connection->out_used))) {
+        close_connection(server, connection);
+        return;
+    }
+    update_events(server, connection);
+}
+
+/**
+ * Accepts every pending client of the listening socket.
+ *
+ * @param server The server.
+ */
+static void accept_clients(Server *server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                printf("Failed to accept a client: %s\n", strerror(errno));
+            }
+            return;
+        }
+        Connection *connection = (Connection *)calloc(1, sizeof(Connection));
+        if (!connection) {
+            printf("Memory allocation failed for connection\n");
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        struct epoll_event event = { 0 };
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            printf("Failed to watch a client: %s\n", strerror(errno));
+            close(fd);
+            free(connection);
+            continue;
+        }
+        connection->next = server->connections;
+        if (server->connections) server->connections->prev = connection;
+        server->connections = connection;
+    }
+}
+
+/**
+ * Collects the jobs the workers have finished and queues their responses.
+ *
+ * @param server The server.
+ */
+static void complete_jobs(Server *server) {
+    uint64_t wakes;
+    if (read(server->wake_fd, &wakes, sizeof(wakes)) < 0 && errno != EAGAIN) {
+        printf("Failed to read the wake counter: %s\n", strerror(errno));
+    }
+    mtx_lock(&server->lock);
+    Job *job = server->done;
+    server->done = server->done_tail = NULL;
+    mtx_unlock(&server->lock);
+
+    while (job != NULL) {
+        Job *next = job->next;
+        Connection *connection = job->connection;
+        connection->busy = 0;
+        if (job->responses == NULL) {
+            connection->failed = 1;
+        } else if (!connection->failed) {
+            if (reserve_bytes(&connection->out, &connection->out_size,
+                              connection->out_used + job->response_bytes) != 0) {
+                connection->failed = 1;
+            } else {
+                memcpy(connection->out + connection->out_used, job->responses, job->response_bytes);
+                connection->out_used += job->response_bytes;
+            }
+        }
+        server->requests += job->frames;
+        progress_connection(server, connection);
+        free(job->requests);
+        free(job->responses);
+        free(job);
+        job = next;
+    }
+}
+
+/**
+ * Creates the listening socket, replacing a stale socket file at the path.
+ *
+ * @param path The socket path.
+ * @return The socket, or -1 on failure.
+ */
+static int listen_on(const char *path) {
+    struct sockaddr_un address = { 0 };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        printf("Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        printf("Failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Adds a descriptor of the server itself to the epoll set.
+ *
+ * @param server The server.
+ * @param fd The descriptor; its address is the event's tag.
+ * @return 0 on success, or 1 on failure.
+ */
+static int watch_fd(Server *server, int *fd) {
+    struct epoll_event event = { 0 };
+    event.events = EPOLLIN;
+    event.data.ptr = fd;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, *fd, &event) != 0) {
+        printf("Failed to watch descriptor: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Runs the lookup service until SIGINT or SIGTERM.
+ *
+ * The calling thread runs the event loop; the workers serve the jobs it
+ * queues. On shutdown the workers finish the jobs already queued, and every
+ * connection is closed.
+ *
+ * @param server The server, with its table or snapshot loaded.
+ * @param path The socket path; the socket file is removed on exit.
+ * @param workers The number of worker threads.
+ * @return 0 on a clean shutdown, or 1 on failure.
+ */
+static int run_server(Server *server, const char *path, unsigned int workers) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server->signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    server->listen_fd = listen_on(path);
+    if (server->epoll_fd < 0 || server->wake_fd < 0 || server->signal_fd < 0 || server->listen_fd < 0 ||
+        watch_fd(server, &server->listen_fd) != 0 || watch_fd(server, &server->wake_fd) != 0 ||
+        watch_fd(server, &server->signal_fd) != 0) {
+        if (server->listen_fd >= 0) unlink(path);
+        return 1;
+    }
+
+    thrd_t *threads = (thrd_t *)malloc(workers * sizeof(thrd_t));
+    unsigned int started = 0;
+    if (threads != NULL) {
+        for (; started < workers; started++) {
+            if (thrd_create(&threads[started], run_worker, server) != thrd_success) break;
+        }
+    }
+    int status = started == workers ? 0 : 1;
+    if (status == 0) {
+        HashTableMemoryStats stats = { 0 };
+        if (server->table) hash_table_memory_stats(server->table, &stats);
+        printf("Serving %zu names on %s with %u workers\n",
+               server->table ? stats.names : hash_snapshot_count(server->snapshot), path, workers);
+        fflush(stdout);
+    } else {
+        printf("Failed to start the workers\n");
+    }
+
+    // Event loop
+    int running = status == 0;
+    while (running) {
+        struct epoll_event events[SERVER_EVENTS];
+        int ready = epoll_wait(server->epoll_fd, events, SERVER_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            printf("Failed to wait for events: %s\n", strerror(errno));
+            status = 1;
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &server->listen_fd) {
+                accept_clients(server);
+            } else if (tag == &server->wake_fd) {
+                complete_jobs(server);
+            } else if (tag == &server->signal_fd) {
+                running = 0;
+            } else {
+                Connection *connection = (Connection *)tag;
+                if (connection->closed) continue;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) receive_requests(connection);
+                if (events[i].events & EPOLLERR) connection->failed = 1;
+                progress_connection(server, connection);
+            }
+        }
+        free_closed(server);
+    }
+
+    // Let the workers drain the queue, then drop the connections
+    mtx_lock(&server->lock);
+    server->stopping = 1;
+    cnd_broadcast(&server->ready);
+    mtx_unlock(&server->lock);
+    for (unsigned int i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    free(threads);
+    while (server->done != NULL) {
+        Job *job = server->done;
+        server->done = job->next;
+        free(job->requests);
+        free(job->responses);
+        free(job);
+    }
+    while (server->connections != NULL) {
+        close_connection(server, server->connections);
+    }
+    free_closed(server);
+    printf("Served %zu requests\n", server->requests);
+
+    close(server->listen_fd);
+    close(server->wake_fd);
+    close(server->signal_fd);
+    close(server->epoll_fd);
+    unlink(path);
+    return status;
+}
+
+/**
+ * Connects to a running server.
+ *
+ * @param path The socket path.
+ * @return A blocking socket, or -1 on failure.
+ */
+static int connect_to(const char *path) {
+    struct sockaddr_un address = { 0 };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        printf("Failed to connect to %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Sends a whole buffer on a blocking socket.
+ *
+ * @param fd The socket.
+ * @param data The bytes to send.
+ * @param size The number of bytes.
+ * @return 0 on success, or 1 on failure.
+ */
+static int send_all(int fd, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return 1;
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * Receives exactly the given number of bytes from a blocking socket.
+ *
+ * @param fd The socket.
+ * @param data Receives the bytes.
+ * @param size The number of bytes.
+ * @return 0 on success, or 1 if the socket fails or is closed first.
+ */
+static int receive_all(int fd, unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t received = recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return 1;
+        data += received;
+        size -= (size_t)received;
+    }
+    return 0;
+}
+
+/**
+ * Writes a request frame.
+ *
+ * @param frame Receives the frame; needs room for a header and 256 bytes per name.
+ * @param id The request id.
+ * @param op SERVER_OP_LOOKUP or SERVER_OP_INSERT.
+ * @param names The names.
+ * @param count The number of names (at most UINT16_MAX).
+ * @return The size of the frame, or 0 if a name is longer than 255 bytes.
+ */
+static size_t write_request(unsigned char *frame, uint32_t id, uint16_t op, const char *const *names,
+                            size_t count) {
+    size_t used = sizeof(ServerHeader);
+    for (size_t i = 0; i < count; i++) {
+        size_t length = strlen(names[i]);
+        if (length > UINT8_MAX) {
+            printf("Name too long for a request: %s\n", names[i]);
+            return 0;
+        }
+        frame[used++] = (unsigned char)length;
+        memcpy(frame + used, names[i], length);
+        used += length;
+    }
+    ServerHeader header = { (uint32_t)(used - sizeof(ServerHeader)), id, op, (uint16_t)count };
+    memcpy(frame, &header, sizeof(header));
+    return used;
+}
+
+/**
+ * Receives one response frame.
+ *
+ * @param fd The socket.
+ * @param header Receives the header.
+ * @param results Receives the result bytes; room for UINT16_MAX bytes.
+ * @return 0 on success, or 1 if the socket fails or the response is malformed.
+ */
+static int read_response(int fd, ServerHeader *header, unsigned char *results) {
+    unsigned char bytes[sizeof(ServerHeader)];
+    if (receive_all(fd, bytes, sizeof(bytes)) != 0) return 1;
+    memcpy(header, bytes, sizeof(*header));
+    if (header->length != header->count) return 1;
+    return receive_all(fd, results, header->length);
+}
+
+/**
+ * Sends a comma-separated list of names in one request and prints each result.
+ *
+ * @param path The socket path.
+ * @param op SERVER_OP_LOOKUP or SERVER_OP_INSERT.
+ * @param list The names, separated by commas (modified).
+ * @return 0 on success, or 1 on failure.
+ */
+static int run_client(const char *path, uint16_t op, char *list) {
+    const char **names = (const char **)malloc(UINT16_MAX * sizeof(char *));
+    size_t count = 0;
+    char *context = NULL;
+    for (char *name = names ? strtok_r(list, ",", &context) : NULL; name && count < UINT16_MAX;
+         name = strtok_r(NULL, ",", &context)) {
+        names[count++] = name;
+    }
+
+    unsigned char *frame = (unsigned char *)malloc(sizeof(ServerHeader) + count * (UINT8_MAX + 1));
+    unsigned char *results = (unsigned char *)malloc(UINT16_MAX);
+    int fd = names && frame && results ? connect_to(path) : -1;
+    size_t size = fd >= 0 ? write_request(frame, 1, op, names, count) : 0;
+    ServerHeader header;
+    int status = 1;
+    if (size != 0 && send_all(fd, frame, size) == 0 && read_response(fd, &header, results) == 0) {
+        status = 0;
+        if (header.op == SERVER_READ_ONLY) {
+            printf("The server is read-only\n");
+            status = 1;
+        } else if (header.op != SERVER_OK || header.count != count) {
+            printf("The server rejected the request\n");
+            status = 1;
+        }
+        for (size_t i = 0; status == 0 && i < count; i++) {
+            if (op == SERVER_OP_INSERT) {
+                printf(results[i] ? "Added: %s\n" : "Failed to add name: %s\n", names[i]);
+            } else {
+                printf(results[i] ? "Found: %s\n" : "Not Found: %s\n", names[i]);
+            }
+        }
+    } else if (fd >= 0 && size != 0) {
+        printf("Connection to %s failed\n", path);
+    }
+    if (fd >= 0) close(fd);
+    free(names);
+    free(frame);
+    free(results);
+    return status;
+}
+
+/**
+ * Load generator thread: keeps depth lookup requests in flight on one
+ * connection until every request has been answered.
+ *
+ * @param argument The LoadClient.
+ * @return 0 on success, or 1 on failure.
+ */
+static int run_load_client(void *argument) {
+    LoadClient *client = (LoadClient *)argument;
+    double *sent_at = (double *)malloc(client->depth * sizeof(double));
+    const char **names = (const char **)malloc(client->batch * sizeof(char *));
+    unsigned char *frame = (unsigned char *)malloc(sizeof(ServerHeader) + client->batch * (UINT8_MAX + 1));
+    unsigned char *results = (unsigned char *)malloc(UINT16_MAX);
+    int fd = sent_at && names && frame && results ? connect_to(client->path) : -1;
+    client->failed = fd < 0;
+
+    size_t sent = 0, answered = 0;
+    while (!client->failed && answered < client->requests) {
+        // Top up the requests in flight
+        while (sent < client->requests && sent - answered < client->depth) {
+            for (unsigned int i = 0; i < client->batch; i++) {
+                client->seed = client->seed * 1664525u + 1013904223u;
+                names[i] = client->names[(client->seed >> 8) % client->name_count];
+            }
+            size_t size = write_request(frame, (uint32_t)sent, SERVER_OP_LOOKUP, names, client->batch);
+            sent_at[sent % client->depth] = clock_ns();
+            if (size == 0 || send_all(fd, frame, size) != 0) {
+                client->failed = 1;
+                break;
+            }
+            sent++;
+        }
+
+        ServerHeader header;
+        if (client->failed || read_response(fd, &header, results) != 0 ||
+            header.op != SERVER_OK || header.id != answered) {
+            client->failed = 1;
+            break;
+        }
+        client->latencies[answered] = clock_ns() - sent_at[answered % client->depth];
+        for (uint16_t i = 0; i < header.count; i++) {
+            client->hits += results[i];
+        }
+        answered++;
+    }
+
+    if (fd >= 0) close(fd);
+    free(sent_at);
+    free(names);
+    free(frame);
+    free(results);
+    return client->failed;
+}
+
+/**
+ * Orders latencies for qsort.
+ *
+ * @param a The first latency.
+ * @param b The second latency.
+ * @return A negative, zero or positive value.
+ */
+static int compare_latency(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Reads a file with one name per line, skipping empty lines.
+ *
+ * @param path The file.
+ * @param names Receives the names, pointing into the returned text.
+ * @param count Receives the number of names.
+ * @return The text holding the names (free it and *names), or NULL on failure.
+ */
+static char* load_names(const char *path, const char ***names, size_t *count) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Failed to open %s\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = size >= 0 ? (char *)malloc((size_t)size + 1) : NULL;
+    size_t lines = 0;
+    if (text != NULL) {
+        size_t read = fread(text, 1, (size_t)size, file);
+        text[read] = '\0';
+        for (size_t i = 0; i < read; i++) lines += text[i] == '\n';
+    }
+    fclose(file);
+    *names = text ? (const char **)malloc((lines + 1) * sizeof(char *)) : NULL;
+    if (*names == NULL) {
+        printf("Memory allocation failed for names\n");
+        free(text);
+        return NULL;
+    }
+
+    *count = 0;
+    char *context = NULL;
+    for (char *line = strtok_r(text, "\r\n", &context); line; line = strtok_r(NULL, "\r\n", &context)) {
+        (*names)[(*count)++] = line;
+    }
+    return text;
+}
+
+/**
+ * Drives a running server with pipelined lookups from several connections
+ * and prints the throughput and round-trip latency percentiles.
+ *
+ * @param path The socket path.
+ * @param names_path File of names to look up, one per line.
+ * @param connections The number of connections, one thread each.
+ * @param depth The requests kept in flight per connection.
+ * @param batch The names per request.
+ * @param requests The requests sent per connection.
+ * @return 0 on success, or 1 on failure.
+ */
+static int run_load(const char *path, const char *names_path, unsigned int connections, unsigned int depth,
+                    unsigned int batch, size_t requests) {
+    const char **names = NULL;
+    size_t name_count = 0;
+    char *text = load_names(names_path, &names, &name_count);
+    if (text == NULL) return 1;
+    if (name_count == 0 || connections == 0 || depth == 0 || batch == 0 || batch > UINT16_MAX || requests == 0) {
+        printf("Nothing to send\n");
+        free(names);
+        free(text);
+        return 1;
+    }
+
+    LoadClient *clients = (LoadClient *)calloc(connections, sizeof(LoadClient));
+    thrd_t *threads = (thrd_t *)malloc(connections * sizeof(thrd_t));
+    double *latencies = (double *)malloc(connections * requests * sizeof(double));
+    int status = clients && threads && latencies ? 0 : 1;
+    unsigned int started = 0;
+    double start = clock_ns();
+    for (; status == 0 && started < connections; started++) {
+        LoadClient *client = &clients[started];
+        client->path = path;
+        client->names = names;
+        client->name_count = name_count;
+        client->depth = depth;
+        client->batch = batch;
+        client->requests = requests;
+        client->seed = 0x9E3779B9u * (started + 1);
+        client->latencies = latencies + started * requests;
+        if (thrd_create(&threads[started], run_load_client, client) != thrd_success) {
+            printf("Failed to start load thread\n");
+            status = 1;
+            break;
+        }
+    }
+    size_t hits = 0;
+    for (unsigned int i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+        status |= clients[i].failed;
+        hits += clients[i].hits;
+    }
+    double elapsed = clock_ns() - start;
+
+    if (status == 0) {
+        size_t total = (size_t)connections * requests;
+        qsort(latencies, total, sizeof(double), compare_latency);
+        printf("%zu requests of %u names on %u connections, %u in flight each: %.0f requests/s, %.0f names/s\n",
+               total, batch, connections, depth, total / (elapsed / 1e9), total * batch / (elapsed / 1e9));
+        printf("Round trip p50 %.1f us, p99 %.1f us, p99.9 %.1f us; %.1f%% of names found\n",
+               latencies[total / 2] / 1e3, latencies[(size_t)(total * 0.99)] / 1e3,
+               latencies[(size_t)(total * 0.999)] / 1e3, 100.0 * hits / ((double)total * batch));
+    } else if (clients && threads && latencies) {
+        printf("Load run failed\n");
+    } else {
+        printf("Memory allocation failed for load run\n");
+    }
+    free(clients);
+    free(threads);
+    free(latencies);
+    free(names);
+    free(text);
+    return status;
+}
+#endif // __linux__
+
+/**
+ * Main function of the lookup service.
+ *
+ * Command-line Arguments:
+ * -S socket          : Serve the table on a Unix domain socket until SIGINT or SIGTERM.
+ * -b file            : Build the served table from a file with one name per line.
+ * -l file            : Serve a snapshot file read-only instead of building a table.
+ * -w workers         : Number of worker threads (default 4).
+ * -u                 : Accept UTF-8 names in the built table (HASH_TABLE_UTF8).
+ * -U                 : Accept UTF-8 names and strip their accents (HASH_TABLE_FOLD_ACCENTS).
+ * -C socket          : Act as a client of the server listening on socket.
+ * -o name1,name2,... : With -C, look up the names in one request.
+ * -n name1,name2,... : With -C, add the names in one request.
+ * -g file            : With -C, generate load from the names in a file, one per line.
+ * -c connections     : Load generator connections (default 4).
+ * -d depth           : Requests in flight per connection (default 16).
+ * -k names           : Names per request (default 32).
+ * -q requests        : Requests per connection (default 10000).
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @return 0 on success, or 1 if an error occurs.
+ */
+int main(int argc, char *argv[]) {
+#ifdef __linux__
+    const char *serve_path = NULL, *client_path = NULL, *build_path = NULL, *load_path = NULL;
+    const char *generate_path = NULL;
+    char *find_list = NULL, *add_list = NULL;
+    unsigned int workers = SERVER_DEFAULT_WORKERS;
+    unsigned int key_flags = 0;
+    unsigned int connections = LOAD_CONNECTIONS, depth = LOAD_DEPTH, batch = LOAD_BATCH;
+    size_t requests = LOAD_REQUESTS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            build_path = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            load_path = argv[++i];
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            workers = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-u") == 0) {
+            key_flags |= HASH_TABLE_UTF8;
+        } else if (strcmp(argv[i], "-U") == 0) {
+            key_flags |= HASH_TABLE_FOLD_ACCENTS;
+        } else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+            client_path = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            find_list = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            add_list = argv[++i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            generate_path = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            connections = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            depth = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            batch = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            requests = strtoul(argv[++i], NULL, 10);
+        } else {
+            serve_path = client_path = NULL;
+            break;
+        }
+    }
+
+    if (client_path) {
+        if (add_list && run_client(client_path, SERVER_OP_INSERT, add_list) != 0) return 1;
+        if (find_list && run_client(client_path, SERVER_OP_LOOKUP, find_list) != 0) return 1;
+        if (generate_path) return run_load(client_path, generate_path, connections, depth, batch, requests);
+        return 0;
+    }
+    if (!serve_path) {
+        printf("Usage: %s -S socket [-b file [-u | -U] | -l snapshot] [-w workers]\n"
+               "       %s -C socket [-n names] [-o names] [-g file [-c connections] [-d depth] [-k names] [-q requests]]\n",
+               argv[0], argv[0]);
+        return 1;
+    }
+
+    // Load the table once; several workers need a table that allows concurrent access
+    Server server;
+    memset(&server, 0, sizeof(server));
+    if (workers == 0) workers = 1;
+    if (load_path) {
+        server.snapshot = hash_snapshot_open(load_path, HASH_SNAPSHOT_VERIFY);
+        if (server.snapshot == NULL) return 1;
+    } else {
+        HashTableOptions options = { .flags = (workers > 1 ? HASH_TABLE_CONCURRENT : 0) | key_flags };
+        server.table = create_hash_table_ex(&options);
+        if (server.table == NULL) return 1;
+        size_t failures = 0;
+        if (build_path && hash_table_build_file(server.table, build_path, 1, &failures) != 0) {
+            destroy_hash_table(server.table);
+            return 1;
+        }
+    }
+
+    int status = 1;
+    if (mtx_init(&server.lock, mtx_plain) == thrd_success) {
+        if (cnd_init(&server.ready) == thrd_success) {
+            status = run_server(&server, serve_path, workers);
+            cnd_destroy(&server.ready);
+        }
+        mtx_destroy(&server.lock);
+    }
+    destroy_hash_table(server.table);
+    hash_snapshot_close(server.snapshot);
+    return status;
+#else
+    (void)argc;
+    (void)argv;
+    printf("The lookup service needs Linux (epoll and Unix domain sockets)\n");
+    return 1;
+#endif
+}
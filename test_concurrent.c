@@ -0,0 +1,219 @@
+/*
+ * Tests for HASH_TABLE_CONCURRENT tables.
+ *
+ * Reader threads look up names while writer threads insert and remove other
+ * names and compact the table, so blocks are freed under the readers. A name
+ * that stays in the table must always be found as itself and every write must
+ * succeed. Afterwards the table must hold exactly the stable names, and once
+ * those are removed too, compaction must free every block. Exits non-zero on
+ * the first failed check.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_concurrent test_concurrent.c hashblocks.c -lm
+ */
+#include "hashblocks.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Names that stay in the table and names the writers churn, and the threads of each kind
+#define STABLE_COUNT 2000
+#define CHURN_COUNT 1000
+#define NAME_SIZE 12
+#define READERS 4
+#define WRITERS 2
+
+// State shared by the reader and writer threads
+typedef struct SharedRun {
+    HashTable *table;
+    char stable[STABLE_COUNT][NAME_SIZE];  // Start with A to M
+    char churn[CHURN_COUNT][NAME_SIZE];    // Start with N to Z, so their blocks empty out
+    _Atomic int stop;                      // Set when the threads should finish
+    _Atomic size_t errors;                 // Missing stable names and failed writes
+    _Atomic size_t freed;                  // Blocks freed by the writers' compactions
+} SharedRun;
+
+// Argument of one thread
+typedef struct Worker {
+    SharedRun *run;
+    unsigned int id;  // Index among the threads of the same kind
+} Worker;
+
+static int failures = 0;
+static SharedRun shared;
+
+/**
+ * Fills a buffer with a pseudo-random name of 4 to 10 letters.
+ *
+ * @param state The xorshift state, advanced by the call.
+ * @param first The first letter allowed.
+ * @param letters The number of letters allowed first, from first on.
+ * @param name Receives the name.
+ */
+static void make_name(uint32_t *state, char first, unsigned int letters, char name[NAME_SIZE]) {
+    *state ^= *state << 13; *state ^= *state >> 17; *state ^= *state << 5;
+    size_t length = 4 + *state % 7;
+    name[0] = (char)(first + (*state >> 8) % letters);
+    for (size_t i = 1; i < length; i++) {
+        *state ^= *state << 13; *state ^= *state >> 17; *state ^= *state << 5;
+        name[i] = (char)('A' + (*state >> 8) % 26);
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Reader thread: looks up stable and churn names until told to stop.
+ *
+ * A churn hit is not compared, since a writer may remove the name, and the
+ * stored string with it, as soon as the lookup returns.
+ *
+ * @param argument The thread's Worker.
+ * @return Always 0.
+ */
+static int reader(void *argument) {
+    Worker *worker = (Worker *)argument;
+    SharedRun *run = worker->run;
+    uint32_t state = 2463534242u ^ (worker->id * 2654435761u);
+    size_t errors = 0;
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        for (int i = 0; i < 256; i++) {
+            state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+            if (state & 1) {
+                const char *name = run->stable[(state >> 1) % STABLE_COUNT];
+                const char *found = hash_table_lookup(run->table, name);
+                errors += found == NULL || strcmp(found, name) != 0;
+            } else {
+                hash_table_lookup(run->table, run->churn[(state >> 1) % CHURN_COUNT]);
+            }
+        }
+    }
+    atomic_fetch_add(&run->errors, errors);
+    return 0;
+}
+
+/**
+ * Writer thread: inserts and then removes its share of the churn names, and
+ * compacts the table, until told to stop.
+ *
+ * @param argument The thread's Worker.
+ * @return Always 0.
+ */
+static int writer(void *argument) {
+    Worker *worker = (Worker *)argument;
+    SharedRun *run = worker->run;
+    size_t errors = 0, freed = 0;
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        for (size_t i = worker->id; i < CHURN_COUNT; i += WRITERS) {
+            errors += hash_table_insert(run->table, run->churn[i]) != 0;
+        }
+        for (size_t i = worker->id; i < CHURN_COUNT; i += WRITERS) {
+            errors += hash_table_remove(run->table, run->churn[i]) != 0;
+        }
+        freed += hash_table_compact(run->table);
+    }
+    atomic_fetch_add(&run->errors, errors);
+    atomic_fetch_add(&run->freed, freed);
+    return 0;
+}
+
+/**
+ * Visitor that counts the names of a table.
+ */
+static int count_name(const char *name, void *context) {
+    (void)name;
+    (*(size_t *)context)++;
+    return 0;
+}
+
+/**
+ * Runs the concurrency tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    HashTableOptions options = { .flags = HASH_TABLE_CONCURRENT | HASH_TABLE_ARENA };
+    CHECK(create_hash_table_ex(&options) == NULL);
+    options.flags = HASH_TABLE_CONCURRENT;
+    shared.table = create_hash_table_ex(&options);
+    CHECK(shared.table != NULL);
+    if (shared.table == NULL) return 1;
+
+    // Distinct names, so every insert and remove of the writers must succeed
+    uint32_t state = 88172645u;
+    size_t stable = 0;
+    while (stable < STABLE_COUNT) {
+        make_name(&state, 'A', 13, shared.stable[stable]);
+        if (hash_table_lookup(shared.table, shared.stable[stable]) == NULL) {
+            CHECK(hash_table_insert(shared.table, shared.stable[stable]) == 0);
+            stable++;
+        }
+    }
+    for (size_t churn = 0; churn < CHURN_COUNT; churn++) {
+        int unique;
+        do {
+            make_name(&state, 'N', 13, shared.churn[churn]);
+            unique = 1;
+            for (size_t i = 0; i < churn && unique; i++) {
+                unique = strcmp(shared.churn[i], shared.churn[churn]) != 0;
+            }
+        } while (!unique);
+    }
+
+    thrd_t threads[READERS + WRITERS];
+    Worker workers[READERS + WRITERS];
+    unsigned int started = 0;
+    for (; started < READERS + WRITERS; started++) {
+        int is_reader = started < READERS;
+        workers[started].run = &shared;
+        workers[started].id = is_reader ? started : started - READERS;
+        if (thrd_create(&threads[started], is_reader ? reader : writer, &workers[started]) != thrd_success) {
+            break;
+        }
+    }
+    CHECK(started == READERS + WRITERS);
+    struct timespec duration = { 0, 300000000L };
+    thrd_sleep(&duration, NULL);
+    atomic_store(&shared.stop, 1);
+    for (unsigned int i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    CHECK(shared.errors == 0);
+    CHECK(shared.freed > 0);
+
+    // Writers stop between full passes, so only the stable names are left
+    size_t count = 0;
+    CHECK(hash_table_iterate(shared.table, count_name, &count) == 0);
+    CHECK(count == STABLE_COUNT);
+    for (size_t i = 0; i < CHURN_COUNT; i++) {
+        CHECK(hash_table_lookup(shared.table, shared.churn[i]) == NULL);
+    }
+
+    // Empty blocks stay linked until a compaction frees them all
+    for (size_t i = 0; i < STABLE_COUNT; i++) {
+        CHECK(hash_table_remove(shared.table, shared.stable[i]) == 0);
+    }
+    HashTableMemoryStats stats;
+    hash_table_memory_stats(shared.table, &stats);
+    CHECK(stats.names == 0 && stats.hash_block_count > 0);
+    CHECK(hash_table_compact(shared.table) > 0);
+    hash_table_memory_stats(shared.table, &stats);
+    CHECK(stats.hash_blocks_count == 0 && stats.hash_block_count == 0);
+    CHECK(hash_table_lookup(shared.table, shared.stable[0]) == NULL);
+
+    destroy_hash_table(shared.table);
+    if (failures == 0) {
+        printf("All concurrency checks passed\n");
+    }
+    return failures != 0;
+}
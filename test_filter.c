@@ -0,0 +1,140 @@
+/*
+ * Tests for the per-block Bloom filters of HASH_TABLE_FILTER tables.
+ *
+ * Runs inserts, removals and re-inserts against filtered tables of each
+ * layout and an unfiltered table side by side, and checks that both always
+ * give the same answers, so the filters never hide a stored name. With
+ * HASH_TABLE_COUNTERS the filters must reject most misses, within a margin
+ * of the configured false-positive rate. Invalid rates and the combination
+ * with HASH_TABLE_CONCURRENT are refused. Exits non-zero on the first failed
+ * check.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_filter test_filter.c hashblocks.c -lm
+ */
+#include "hashblocks.h"
+#include <stdio.h>
+#include <string.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Names drawn per run, and the size of each with its terminator
+#define NAME_COUNT 20000
+#define NAME_SIZE 12
+
+static int failures = 0;
+static char names[NAME_COUNT][NAME_SIZE];
+
+/**
+ * Fills a buffer with a pseudo-random uppercase name of 4 to 10 letters.
+ *
+ * @param state The generator state, advanced by the call.
+ * @param name Receives the name.
+ */
+static void make_name(unsigned long *state, char name[NAME_SIZE]) {
+    *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+    size_t length = 4 + (*state >> 33) % 7;
+    for (size_t i = 0; i < length; i++) {
+        *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+        name[i] = (char)('A' + (*state >> 33) % 26);
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Checks that two tables agree on every generated name.
+ *
+ * @param filtered The table with filters.
+ * @param plain The table without.
+ */
+static void check_same(const HashTable *filtered, const HashTable *plain) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        mismatches += (hash_table_lookup(filtered, names[i]) != NULL) != (hash_table_lookup(plain, names[i]) != NULL);
+    }
+    CHECK(mismatches == 0);
+}
+
+/**
+ * Runs the same changes against a filtered table and a plain one.
+ *
+ * @param flags The layout flags of both tables.
+ */
+static void check_filter(unsigned int flags) {
+    HashTableOptions options = { .flags = flags | HASH_TABLE_FILTER | HASH_TABLE_COUNTERS, .filter_rate = 0.01 };
+    HashTable *filtered = create_hash_table_ex(&options);
+    options.flags = flags;
+    HashTable *plain = create_hash_table_ex(&options);
+    CHECK(filtered != NULL && plain != NULL);
+    if (filtered == NULL || plain == NULL) {
+        destroy_hash_table(filtered);
+        destroy_hash_table(plain);
+        return;
+    }
+
+    // The first half goes in; the second half only serves as misses
+    for (size_t i = 0; i < NAME_COUNT / 2; i++) {
+        CHECK(hash_table_insert(filtered, names[i]) == 0);
+        CHECK(hash_table_insert(plain, names[i]) == 0);
+    }
+    check_same(filtered, plain);
+
+    HashTableStats stats;
+    CHECK(hash_table_stats(filtered, &stats) == 0);
+    CHECK(stats.memory.filters > 0 && stats.memory.filter_bytes > 0);
+    CHECK(stats.filter_rate == 0.01 && stats.filter_fill > 0 && stats.filter_fill < 1);
+    size_t misses = stats.misses, rejects = stats.filter_rejects, passed = stats.filter_false_positives;
+    CHECK(misses > 0 && rejects + passed == misses);
+    CHECK(passed < misses / 20);
+
+    // Removing most names rebuilds the filters; removed names must miss
+    for (size_t i = 0; i < NAME_COUNT / 2; i++) {
+        if (i % 4 != 0) {
+            CHECK(hash_table_remove(filtered, names[i]) == hash_table_remove(plain, names[i]));
+        }
+    }
+    check_same(filtered, plain);
+
+    // Names added back after the rebuilds are found again
+    for (size_t i = 0; i < NAME_COUNT / 2; i += 3) {
+        CHECK(hash_table_insert(filtered, names[i]) == 0);
+        CHECK(hash_table_insert(plain, names[i]) == 0);
+    }
+    check_same(filtered, plain);
+
+    destroy_hash_table(filtered);
+    destroy_hash_table(plain);
+}
+
+/**
+ * Runs the filter tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    unsigned long state = 11;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        make_name(&state, names[i]);
+    }
+    check_filter(0);
+    check_filter(HASH_TABLE_ARENA);
+    check_filter(HASH_TABLE_FLAT);
+
+    HashTableOptions options = { .flags = HASH_TABLE_FILTER, .filter_rate = 1.5 };
+    CHECK(create_hash_table_ex(&options) == NULL);
+    options.flags = HASH_TABLE_FILTER | HASH_TABLE_CONCURRENT;
+    options.filter_rate = 0;
+    CHECK(create_hash_table_ex(&options) == NULL);
+
+    if (failures == 0) {
+        printf("All filter checks passed\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Tests for frozen Hash Blocks tables.
+ *
+ * Freezes generated tables and checks that the frozen form, once its source
+ * is destroyed, holds every distinct name once and answers misses. Then
+ * freezes a table with the default schema using HASH_FROZEN_COMPACT_KEYS and
+ * checks the key stored for each name, that every name is found and names of
+ * the same slots are not, that iteration gives back the full names, and that
+ * the compact table is smaller than the plain one. Exits non-zero on the
+ * first failed check.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_frozen test_frozen.c hashblocks.c -lm
+ */
+#include "hashblocks.h"
+#include <stdio.h>
+#include <string.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// A name and the key the default schema stores for it: the first and third
+// letters are always implied, and the second one unless it is a consonant,
+// which shares the Misc bucket
+typedef struct CompactCase {
+    const char *name;
+    const char *key;
+} CompactCase;
+
+static const CompactCase compact_cases[] = {
+    { "ALICE", "LCE" },
+    { "KAREN", "EN" },
+    { "TRACY", "RCY" },
+    { "BOBBY", "BY" },
+    { "ANA", "N" },
+    { "AYA", "" },
+    { "MARIA", "IA" },
+};
+
+#define CASE_COUNT (sizeof(compact_cases) / sizeof(compact_cases[0]))
+
+// Names drawn for the generated tables, and the size of each with its terminator
+#define NAME_COUNT 20000
+#define NAME_SIZE 12
+
+static int failures = 0;
+static char names[NAME_COUNT][NAME_SIZE];
+
+/**
+ * Fills a buffer with a pseudo-random uppercase name of 3 to 10 letters.
+ *
+ * Letters are drawn from the first ten, so that names repeat.
+ *
+ * @param state The generator state, advanced by the call.
+ * @param name Receives the name.
+ */
+static void make_name(unsigned long *state, char name[NAME_SIZE]) {
+    *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+    size_t length = 3 + (*state >> 33) % 8;
+    for (size_t i = 0; i < length; i++) {
+        *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+        name[i] = (char)('A' + (*state >> 33) % 10);
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Visitor that checks that a frozen name is in a table.
+ *
+ * @param name The full name.
+ * @param context The table the frozen form was made from.
+ * @return 0 to continue.
+ */
+static int check_frozen_name(const char *name, void *context) {
+    CHECK(hash_table_lookup((const HashTable *)context, name) != NULL);
+    return 0;
+}
+
+/**
+ * Visitor that counts the names it is given.
+ */
+static int count_name(const char *name, void *context) {
+    (void)name;
+    (*(size_t *)context)++;
+    return 0;
+}
+
+/**
+ * Freezes a table of generated names, some of them repeated, and checks the
+ * frozen form against a second table holding each of them once.
+ *
+ * @param flags The HASH_TABLE_* flags of the source table.
+ * @param frozen_flags The HASH_FROZEN_* flags to freeze with.
+ */
+static void check_frozen_lookups(unsigned int flags, unsigned int frozen_flags) {
+    HashTableOptions options = { .flags = flags };
+    HashTable *table = create_hash_table_ex(&options);
+    HashTable *distinct = create_hash_table();
+    CHECK(table != NULL && distinct != NULL);
+    if (table == NULL || distinct == NULL) {
+        destroy_hash_table(table);
+        destroy_hash_table(distinct);
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < NAME_COUNT; i += 2) {
+        CHECK(hash_table_insert(table, names[i]) == 0);
+        if (hash_table_lookup(distinct, names[i]) == NULL) {
+            CHECK(hash_table_insert(distinct, names[i]) == 0);
+            count++;
+        }
+    }
+
+    // The frozen form does not depend on its source
+    HashFrozen *frozen = hash_table_freeze_ex(table, frozen_flags);
+    destroy_hash_table(table);
+    CHECK(frozen != NULL);
+    if (frozen == NULL) {
+        destroy_hash_table(distinct);
+        return;
+    }
+
+    CHECK(hash_frozen_count(frozen) == count);
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        const char *found = hash_frozen_lookup(frozen, names[i]);
+        CHECK((found != NULL) == (hash_table_lookup(distinct, names[i]) != NULL));
+        if (found != NULL && !(frozen_flags & HASH_FROZEN_COMPACT_KEYS)) {
+            CHECK(strcmp(found, names[i]) == 0);
+        }
+    }
+    CHECK(hash_frozen_lookup(frozen, "AB") == NULL);
+    CHECK(hash_frozen_lookup(frozen, "ZZZ") == NULL);
+    size_t visited = 0;
+    CHECK(hash_frozen_iterate(frozen, count_name, &visited) == 0);
+    CHECK(visited == count);
+    CHECK(hash_frozen_iterate(frozen, check_frozen_name, distinct) == 0);
+
+    hash_frozen_free(frozen);
+    destroy_hash_table(distinct);
+}
+
+/**
+ * Visitor that marks each iterated name in the case list.
+ *
+ * @param name The full name.
+ * @param context The array of CASE_COUNT seen flags.
+ * @return 0 to continue.
+ */
+static int mark_name(const char *name, void *context) {
+    int *seen = (int *)context;
+    int known = 0;
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        if (strcmp(name, compact_cases[i].name) == 0) {
+            seen[i]++;
+            known = 1;
+        }
+    }
+    CHECK(known);
+    return 0;
+}
+
+/**
+ * Runs the frozen table tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    unsigned long state = 3;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        make_name(&state, names[i]);
+    }
+    check_frozen_lookups(0, 0);
+    check_frozen_lookups(HASH_TABLE_FLAT, 0);
+    check_frozen_lookups(HASH_TABLE_ARENA, HASH_FROZEN_COMPACT_KEYS);
+
+    HashTable *table = create_hash_table();
+    if (table == NULL) return 1;
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        CHECK(hash_table_insert(table, compact_cases[i].name) == 0);
+    }
+
+    HashFrozen *plain = hash_table_freeze(table);
+    HashFrozen *compact = hash_table_freeze_ex(table, HASH_FROZEN_COMPACT_KEYS);
+    CHECK(plain != NULL && compact != NULL);
+    if (plain == NULL || compact == NULL) {
+        hash_frozen_free(plain);
+        hash_frozen_free(compact);
+        destroy_hash_table(table);
+        return 1;
+    }
+
+    // Each name keeps only the characters its slot does not imply
+    CHECK(hash_frozen_count(compact) == CASE_COUNT);
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        const char *key = hash_frozen_lookup(compact, compact_cases[i].name);
+        CHECK(key != NULL && strcmp(key, compact_cases[i].key) == 0);
+        if (key != NULL && strcmp(key, compact_cases[i].key) != 0) {
+            fprintf(stderr, "  %s stored as \"%s\", expected \"%s\"\n",
+                    compact_cases[i].name, key, compact_cases[i].key);
+        }
+    }
+
+    // Names reaching the same slots, and names differing only in implied letters
+    CHECK(hash_frozen_lookup(compact, "ALICX") == NULL);
+    CHECK(hash_frozen_lookup(compact, "ALIC") == NULL);
+    CHECK(hash_frozen_lookup(compact, "ALICEE") == NULL);
+    CHECK(hash_frozen_lookup(compact, "AYE") == NULL);
+    CHECK(hash_frozen_lookup(compact, "ENA") == NULL);
+    CHECK(hash_frozen_lookup(compact, "alice") != NULL);
+
+    // Iteration puts the implied characters back
+    int seen[CASE_COUNT] = { 0 };
+    CHECK(hash_frozen_iterate(compact, mark_name, seen) == 0);
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        CHECK(seen[i] == 1);
+    }
+
+    CHECK(hash_frozen_bytes(compact) < hash_frozen_bytes(plain));
+
+    hash_frozen_free(plain);
+    hash_frozen_free(compact);
+    destroy_hash_table(table);
+    if (failures == 0) {
+        printf("All frozen table checks passed\n");
+    }
+    return failures != 0;
+}
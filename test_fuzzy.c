@@ -0,0 +1,253 @@
+/*
+ * Tests for fuzzy and phonetic search.
+ *
+ * Compares hash_table_fuzzy with a brute-force edit distance over every
+ * stored name, for linked-list, flat and UTF-8 tables and budgets of 0 to 3
+ * edits: each name within the budget must be visited exactly once, with its
+ * distance, and no other. hash_soundex is checked on known codes and
+ * hash_table_phonetic against a scan of the table. Exits non-zero on the
+ * first failed check.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_fuzzy test_fuzzy.c hashblocks.c -lm
+ */
+#include "hashblocks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Distinct names per table, queries per budget, and the size of a name with its terminator
+#define NAME_COUNT 3000
+#define QUERY_COUNT 200
+#define NAME_SIZE 12
+
+// Matches gathered by a search
+typedef struct Matches {
+    size_t count;
+    const char *names[NAME_COUNT];
+    unsigned int distances[NAME_COUNT];
+    int overflow;
+} Matches;
+
+static int failures = 0;
+static char names[NAME_COUNT][NAME_SIZE];
+static Matches found;
+
+/**
+ * Fills a buffer with a pseudo-random uppercase name of 3 to 8 letters.
+ *
+ * Letters are drawn from the first eight, so that many names are a few edits apart.
+ *
+ * @param state The generator state, advanced by the call.
+ * @param name Receives the name.
+ */
+static void make_name(unsigned long *state, char name[NAME_SIZE]) {
+    *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+    size_t length = 3 + (*state >> 33) % 6;
+    for (size_t i = 0; i < length; i++) {
+        *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+        name[i] = (char)('A' + (*state >> 33) % 8);
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Computes the Levenshtein distance between two names with a full table.
+ */
+static unsigned int edit_distance(const char *a, const char *b) {
+    size_t m = strlen(a), n = strlen(b);
+    unsigned int row[NAME_SIZE + 1];
+    for (size_t j = 0; j <= n; j++) row[j] = (unsigned int)j;
+    for (size_t i = 1; i <= m; i++) {
+        unsigned int diagonal = row[0];
+        row[0] = (unsigned int)i;
+        for (size_t j = 1; j <= n; j++) {
+            unsigned int above = row[j];
+            unsigned int best = diagonal + (a[i - 1] != b[j - 1]);
+            if (above + 1 < best) best = above + 1;
+            if (row[j - 1] + 1 < best) best = row[j - 1] + 1;
+            row[j] = best;
+            diagonal = above;
+        }
+    }
+    return row[n];
+}
+
+/**
+ * Visitor that gathers the matches of a fuzzy search.
+ */
+static int gather_match(const char *name, unsigned int distance, void *context) {
+    Matches *matches = (Matches *)context;
+    if (matches->count == NAME_COUNT) {
+        matches->overflow = 1;
+        return 1;
+    }
+    matches->names[matches->count] = name;
+    matches->distances[matches->count++] = distance;
+    return 0;
+}
+
+/**
+ * Visitor that gathers the matches of a phonetic search.
+ */
+static int gather_name(const char *name, void *context) {
+    return gather_match(name, 0, context);
+}
+
+/**
+ * Visitor that stops a search at its first match.
+ */
+static int stop_match(const char *name, unsigned int distance, void *context) {
+    (void)name;
+    (void)distance;
+    (void)context;
+    return 7;
+}
+
+/**
+ * Returns the index of a name in the gathered matches, or -1.
+ */
+static long find_match(const Matches *matches, const char *name) {
+    for (size_t i = 0; i < matches->count; i++) {
+        if (strcmp(matches->names[i], name) == 0) return (long)i;
+    }
+    return -1;
+}
+
+/**
+ * Compares fuzzy searches of a table with brute force over its names.
+ *
+ * @param flags The HASH_TABLE_* flags of the table.
+ */
+static void check_fuzzy(unsigned int flags) {
+    HashTableOptions options = { .flags = flags };
+    HashTable *table = create_hash_table_ex(&options);
+    CHECK(table != NULL);
+    if (table == NULL) return;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        CHECK(hash_table_insert(table, names[i]) == 0);
+    }
+
+    unsigned long state = 5;
+    for (unsigned int edits = 0; edits <= 3; edits++) {
+        size_t mismatches = 0, total = 0;
+        for (size_t q = 0; q < QUERY_COUNT; q++) {
+            // Half the queries are stored names, half are new ones
+            char query[NAME_SIZE];
+            if (q % 2) {
+                memcpy(query, names[q * 7 % NAME_COUNT], NAME_SIZE);
+            } else {
+                make_name(&state, query);
+            }
+            memset(&found, 0, sizeof(found));
+            CHECK(hash_table_fuzzy(table, query, edits, gather_match, &found) == 0);
+            CHECK(!found.overflow);
+
+            size_t expected = 0;
+            for (size_t i = 0; i < NAME_COUNT; i++) {
+                unsigned int distance = edit_distance(query, names[i]);
+                if (distance > edits) continue;
+                expected++;
+                long index = find_match(&found, names[i]);
+                mismatches += index < 0 || found.distances[index] != distance;
+            }
+            mismatches += found.count != expected;
+            total += expected;
+        }
+        CHECK(mismatches == 0);
+        CHECK(total >= QUERY_COUNT / 2);  // At least the stored queries match themselves
+    }
+
+    CHECK(hash_table_fuzzy(table, names[0], 1, stop_match, NULL) == 7);
+    CHECK(hash_table_fuzzy(table, names[0], HASH_FUZZY_MAX_EDITS + 1, gather_match, &found) == 1);
+    CHECK(hash_table_fuzzy(table, "A1", 1, gather_match, &found) == 1);
+    destroy_hash_table(table);
+}
+
+/**
+ * Checks Soundex codes and phonetic search.
+ */
+static void check_phonetic(void) {
+    static const char *const codes[][2] = {
+        { "Robert", "R163" }, { "Rupert", "R163" }, { "Rubin", "R150" }, { "Ashcraft", "A261" },
+        { "Tymczak", "T522" }, { "Pfister", "P236" }, { "Honeyman", "H555" }, { "Lee", "L000" },
+    };
+    char code[HASH_SOUNDEX_SIZE];
+    for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+        CHECK(hash_soundex(codes[i][0], code) == 0 && strcmp(code, codes[i][1]) == 0);
+    }
+    CHECK(hash_soundex("123", code) == 1);
+
+    HashTable *table = create_hash_table();
+    CHECK(table != NULL);
+    if (table == NULL) return;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        CHECK(hash_table_insert(table, names[i]) == 0);
+    }
+    size_t mismatches = 0;
+    for (size_t q = 0; q < QUERY_COUNT; q++) {
+        const char *query = names[q * 13 % NAME_COUNT];
+        char query_code[HASH_SOUNDEX_SIZE];
+        CHECK(hash_soundex(query, query_code) == 0);
+        memset(&found, 0, sizeof(found));
+        CHECK(hash_table_phonetic(table, query, gather_name, &found) == 0);
+        size_t expected = 0;
+        for (size_t i = 0; i < NAME_COUNT; i++) {
+            CHECK(hash_soundex(names[i], code) == 0);
+            if (strcmp(code, query_code) != 0) continue;
+            expected++;
+            mismatches += find_match(&found, names[i]) < 0;
+        }
+        mismatches += found.count != expected;
+    }
+    CHECK(mismatches == 0);
+    destroy_hash_table(table);
+}
+
+/**
+ * Orders two names for qsort.
+ */
+static int compare_names(const void *a, const void *b) {
+    return strcmp((const char *)a, (const char *)b);
+}
+
+/**
+ * Runs the fuzzy and phonetic search tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    // Distinct names, so brute force and the table count each name once
+    unsigned long state = 1;
+    size_t count = 0;
+    while (count < NAME_COUNT) {
+        for (size_t i = count; i < NAME_COUNT; i++) {
+            make_name(&state, names[i]);
+        }
+        qsort(names, NAME_COUNT, sizeof(names[0]), compare_names);
+        count = 0;
+        for (size_t i = 0; i < NAME_COUNT; i++) {
+            if (count == 0 || strcmp(names[count - 1], names[i]) != 0) {
+                memmove(names[count++], names[i], NAME_SIZE);
+            }
+        }
+    }
+
+    check_fuzzy(0);
+    check_fuzzy(HASH_TABLE_FLAT);
+    check_fuzzy(HASH_TABLE_UTF8);
+    check_phonetic();
+    if (failures == 0) {
+        printf("All fuzzy search checks passed\n");
+    }
+    return failures != 0;
+}
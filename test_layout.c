@@ -0,0 +1,187 @@
+/*
+ * Tests for the third-level layouts of Hash Blocks tables.
+ *
+ * Runs the same inserts, lookups, value updates and removals against a table
+ * with linked-list chains, one with HASH_TABLE_ARENA and one with
+ * HASH_TABLE_FLAT, and checks each against a sorted reference list: every
+ * stored name is found, names that were never added or were removed are not,
+ * and a cursor over the whole table returns exactly the reference list in
+ * order. Exits non-zero on the first failed check.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_layout test_layout.c hashblocks.c -lm
+ */
+#include "hashblocks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Names generated per table, and the length of the longest one with its terminator
+#define NAME_COUNT 4000
+#define NAME_SIZE 12
+
+static int failures = 0;
+static HashCursor cursor;  // Large; kept off the stack
+
+/**
+ * Fills a buffer with a pseudo-random uppercase name of 3 to 10 letters.
+ *
+ * Half the names start with "MAR" so that some slots hold long chains.
+ *
+ * @param state The generator state, advanced by the call.
+ * @param name Receives the name.
+ */
+static void make_name(unsigned long *state, char name[NAME_SIZE]) {
+    *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+    unsigned long bits = *state >> 16;
+    size_t length = 3 + bits % 8, i = 0;
+    bits /= 8;
+    if (bits % 2) {
+        memcpy(name, "MAR", 3);
+        i = 3;
+    }
+    for (; i < length; i++) {
+        *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+        name[i] = (char)('A' + (*state >> 33) % 26);
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Orders two names for qsort.
+ */
+static int compare_names(const void *a, const void *b) {
+    return strcmp((const char *)a, (const char *)b);
+}
+
+/**
+ * Checks that a cursor over the whole table returns the reference names in order.
+ *
+ * @param table The table.
+ * @param names The sorted reference names.
+ * @param kept Flags marking the names still stored.
+ * @param count The number of reference names.
+ */
+static void check_order(const HashTable *table, char (*names)[NAME_SIZE], const int *kept, size_t count) {
+    CHECK(hash_cursor_prefix(&cursor, table, "") == 0);
+    size_t i = 0;
+    int ordered = 1;
+    for (const char *name = hash_cursor_next(&cursor); name != NULL; name = hash_cursor_next(&cursor)) {
+        while (i < count && !kept[i]) i++;
+        if (i == count || strcmp(name, names[i]) != 0) {
+            ordered = 0;
+            break;
+        }
+        i++;
+    }
+    while (i < count && !kept[i]) i++;
+    CHECK(ordered && i == count);
+}
+
+/**
+ * Runs the layout checks against a table created with the given flags.
+ *
+ * @param flags The HASH_TABLE_* flags of the table.
+ * @param names The sorted, distinct reference names.
+ * @param count The number of reference names.
+ */
+static void check_layout(unsigned int flags, char (*names)[NAME_SIZE], size_t count) {
+    HashTableOptions options = { .flags = flags };
+    HashTable *table = create_hash_table_ex(&options);
+    CHECK(table != NULL);
+    if (table == NULL) return;
+    int *kept = (int *)calloc(count, sizeof(*kept));
+    if (kept == NULL) {
+        destroy_hash_table(table);
+        return;
+    }
+
+    // Every other name goes in first, then the rest in reverse, so slots fill out of order
+    for (size_t i = 0; i < count; i += 2) {
+        CHECK(hash_table_insert(table, names[i]) == 0);
+        kept[i] = 1;
+    }
+    for (size_t i = count - 1 - (count % 2 == 0 ? 0 : 1); i < count; i -= 2) {
+        CHECK(hash_table_insert(table, names[i]) == 0);
+        kept[i] = 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *found = hash_table_lookup(table, names[i]);
+        CHECK(found != NULL && strcmp(found, names[i]) == 0);
+    }
+    CHECK(hash_table_lookup(table, "marco") == hash_table_lookup(table, "MARCO"));
+    CHECK(hash_table_lookup(table, "AB") == NULL);
+    CHECK(hash_table_insert(table, "A1C") == 1);
+    check_order(table, names, kept, count);
+
+    // Values: a replace hands back the old value, an if-absent put keeps it
+    static int one, two;
+    void *value = NULL;
+    CHECK(hash_table_put(table, names[0], &one, HASH_PUT_REPLACE, &value) == HASH_PUT_FOUND && value == NULL);
+    CHECK(hash_table_put(table, names[0], &two, HASH_PUT_IF_ABSENT, &value) == HASH_PUT_FOUND && value == &one);
+    CHECK(hash_table_get(table, names[0], &value) == 0 && value == &one);
+    CHECK(hash_table_put(table, "ZZZZZZZZZZZ", &two, HASH_PUT_IF_ABSENT, &value) == HASH_PUT_ADDED && value == NULL);
+    CHECK(hash_table_remove_value(table, "ZZZZZZZZZZZ", &value) == 0 && value == &two);
+
+    // Remove two names in three, then check what is left
+    for (size_t i = 0; i < count; i++) {
+        if (i % 3 != 0) {
+            CHECK(hash_table_remove(table, names[i]) == 0);
+            kept[i] = 0;
+        }
+    }
+    CHECK(hash_table_remove(table, names[1]) == 1);
+    for (size_t i = 0; i < count; i++) {
+        CHECK((hash_table_lookup(table, names[i]) != NULL) == kept[i]);
+    }
+    check_order(table, names, kept, count);
+
+    HashTableMemoryStats stats;
+    hash_table_memory_stats(table, &stats);
+    CHECK(stats.names == (count + 2) / 3);
+    CHECK((stats.arena_pages != 0) == ((flags & HASH_TABLE_ARENA) != 0));
+    CHECK((stats.flat_buckets != 0) == ((flags & HASH_TABLE_FLAT) != 0));
+
+    free(kept);
+    destroy_hash_table(table);
+}
+
+/**
+ * Runs the layout tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    char (*names)[NAME_SIZE] = (char (*)[NAME_SIZE])malloc(NAME_COUNT * sizeof(*names));
+    if (names == NULL) return 1;
+    unsigned long state = 1;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        make_name(&state, names[i]);
+    }
+    qsort(names, NAME_COUNT, sizeof(*names), compare_names);
+    size_t count = 0;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        if (count == 0 || strcmp(names[count - 1], names[i]) != 0) {
+            memcpy(names[count++], names[i], NAME_SIZE);
+        }
+    }
+
+    check_layout(0, names, count);
+    check_layout(HASH_TABLE_ARENA, names, count);
+    check_layout(HASH_TABLE_FLAT, names, count);
+
+    free(names);
+    if (failures == 0) {
+        printf("All layout checks passed\n");
+    }
+    return failures != 0;
+}
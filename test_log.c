@@ -0,0 +1,109 @@
+/*
+ * Failure tests for the Hash Blocks write-ahead log.
+ *
+ * Injects a write failure into a HASH_LOG_DURABLE log by lowering the file
+ * size limit to the log's current size, and checks that the change whose
+ * record could not be synced is reported as HASH_LOG_NOT_DURABLE, that it is
+ * visible in the table, that the log refuses further changes, and that
+ * recovery only restores the changes that were durable. Exits non-zero on
+ * the first failed check (POSIX only).
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_log test_log.c hashblocks.c -lm
+ */
+#define _POSIX_C_SOURCE 200809L  // mkdtemp and setrlimit under -std=c17
+#include "hashblocks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+/**
+ * Returns the size of a file, or -1 if it cannot be read.
+ */
+static long file_size(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0 ? (long)info.st_size : -1;
+}
+
+/**
+ * Runs the failure tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    char directory[] = "/tmp/hashblocks-test-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[64], log_path[80], snapshot_path[80], temporary_path[80];
+    snprintf(path, sizeof(path), "%s/table", directory);
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s.hb", path);
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+
+    // A durable change that is synced
+    HashLogOptions options = { .flags = HASH_LOG_DURABLE };
+    HashTable *table = create_hash_table();
+    HashLog *log = table ? hash_log_open(table, path, &options) : NULL;
+    CHECK(log != NULL);
+    if (log == NULL) return 1;
+    CHECK(hash_log_insert(log, "Alpha") == 0);
+
+    // Writes past the current end of the log now fail with EFBIG instead of a signal
+    struct rlimit saved, limit;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    limit = saved;
+    limit.rlim_cur = (rlim_t)file_size(log_path);
+    signal(SIGXFSZ, SIG_IGN);
+    CHECK(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+    // The change is applied, and readers see it, but it is not durable
+    CHECK(hash_log_insert(log, "Bravo") == HASH_LOG_NOT_DURABLE);
+    CHECK(hash_table_lookup(table, "Bravo") != NULL);
+
+    // A failed log accepts no further changes
+    CHECK(hash_log_insert(log, "Charlie") == 1);
+    CHECK(hash_table_lookup(table, "Charlie") == NULL);
+    CHECK(hash_log_remove(log, "Alpha") == 1);
+    CHECK(hash_table_lookup(table, "Alpha") != NULL);
+
+    setrlimit(RLIMIT_FSIZE, &saved);
+    CHECK(hash_log_close(log) == 1);
+    destroy_hash_table(table);
+
+    // Recovery restores the durable change only
+    table = create_hash_table();
+    log = table ? hash_log_open(table, path, &options) : NULL;
+    CHECK(log != NULL);
+    if (log != NULL) {
+        CHECK(hash_table_lookup(table, "Alpha") != NULL);
+        CHECK(hash_table_lookup(table, "Bravo") == NULL);
+        CHECK(hash_log_close(log) == 0);
+    }
+    destroy_hash_table(table);
+
+    remove(log_path);
+    remove(snapshot_path);
+    remove(temporary_path);
+    rmdir(directory);
+    if (failures == 0) {
+        printf("All log failure checks passed\n");
+    }
+    return failures != 0;
+}
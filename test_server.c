@@ -0,0 +1,185 @@
+/*
+ * Connection handling tests for the Hash Blocks lookup service.
+ *
+ * Starts the server built from server.c on a temporary socket, checks that a
+ * lookup is answered, and checks that a client that sends a header and only
+ * part of its payload before shutting down has its connection closed, with
+ * the server idle afterwards instead of spinning on the hung-up socket.
+ * Exits non-zero on the first failed check (Linux only).
+ *
+ * Build the server first, then this test, and pass it the server's path:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o hbserver server.c hashblocks.c -lm
+ * clang -std=c17 -O2 -o test_server test_server.c
+ * ./test_server ./hbserver
+ */
+#define _GNU_SOURCE  // kill, mkdtemp and nanosleep under -std=c17
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Frame header of the service protocol (see server.c)
+typedef struct ServerHeader {
+    uint32_t length;
+    uint32_t id;
+    uint16_t op;
+    uint16_t count;
+} ServerHeader;
+
+static int failures = 0;
+
+/**
+ * Sleeps for a number of milliseconds.
+ */
+static void sleep_ms(long milliseconds) {
+    struct timespec duration = { milliseconds / 1000, (milliseconds % 1000) * 1000000L };
+    nanosleep(&duration, NULL);
+}
+
+/**
+ * Connects to the server, retrying while it starts.
+ *
+ * @return The socket, or -1 if the server never accepted.
+ */
+static int connect_server(const char *path) {
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+            return fd;
+        }
+        if (fd >= 0) close(fd);
+        sleep_ms(20);
+    }
+    return -1;
+}
+
+/**
+ * Waits until a socket is readable and reads from it.
+ *
+ * @return The bytes read, 0 at end of stream, or -1 on timeout or error.
+ */
+static ssize_t read_within(int fd, void *buffer, size_t size, int milliseconds) {
+    struct pollfd waiting = { fd, POLLIN, 0 };
+    if (poll(&waiting, 1, milliseconds) != 1) return -1;
+    return read(fd, buffer, size);
+}
+
+/**
+ * Returns the CPU time a process has used, in clock ticks.
+ */
+static long cpu_ticks(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+    long user = -1, system = -1;
+    // Fields 14 and 15 are utime and stime; the name in field 2 has no spaces here
+    int fields = fscanf(file, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %ld %ld", &user, &system);
+    fclose(file);
+    return fields == 2 ? user + system : -1;
+}
+
+/**
+ * Runs the connection tests against the server at argv[1].
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(int argc, char *argv[]) {
+    const char *server = argc > 1 ? argv[1] : "./hbserver";
+    char directory[] = "/tmp/hashblocks-test-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char names_path[64], socket_path[64];
+    snprintf(names_path, sizeof(names_path), "%s/names.txt", directory);
+    snprintf(socket_path, sizeof(socket_path), "%s/sock", directory);
+    FILE *names = fopen(names_path, "w");
+    if (names == NULL) return 1;
+    fputs("ALICE\nBOBBY\nCAROL\n", names);
+    fclose(names);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stdout);
+        execl(server, server, "-S", socket_path, "-b", names_path, "-w", "1", (char *)NULL);
+        _exit(127);
+    }
+    int fd = connect_server(socket_path);
+    CHECK(fd >= 0);
+
+    // A complete lookup of one present and one absent name
+    if (fd >= 0) {
+        unsigned char request[sizeof(ServerHeader) + 12];
+        ServerHeader header = { 12, 7, 1, 2 };
+        memcpy(request, &header, sizeof(header));
+        memcpy(request + sizeof(header), "\x05" "ALICE" "\x05" "DAVID", 12);
+        CHECK(write(fd, request, sizeof(request)) == (ssize_t)sizeof(request));
+        unsigned char response[sizeof(ServerHeader) + 2];
+        size_t got = 0;
+        while (got < sizeof(response)) {
+            ssize_t n = read_within(fd, response + got, sizeof(response) - got, 2000);
+            if (n <= 0) break;
+            got += (size_t)n;
+        }
+        CHECK(got == sizeof(response));
+        memcpy(&header, response, sizeof(header));
+        CHECK(header.id == 7 && header.count == 2);
+        CHECK(response[sizeof(header)] == 1 && response[sizeof(header) + 1] == 0);
+        close(fd);
+    }
+
+    // A header announcing 100 bytes, 10 of them, then a hang-up
+    fd = connect_server(socket_path);
+    CHECK(fd >= 0);
+    if (fd >= 0) {
+        unsigned char request[sizeof(ServerHeader) + 10];
+        ServerHeader header = { 100, 8, 1, 10 };
+        memset(request, 'A', sizeof(request));
+        memcpy(request, &header, sizeof(header));
+        CHECK(write(fd, request, sizeof(request)) == (ssize_t)sizeof(request));
+        shutdown(fd, SHUT_WR);
+        char byte;
+        CHECK(read_within(fd, &byte, 1, 2000) == 0); // Closed without a response
+        close(fd);
+
+        // An idle server uses almost no CPU over half a second
+        long before = cpu_ticks(pid);
+        sleep_ms(500);
+        long after = cpu_ticks(pid);
+        CHECK(before >= 0 && after - before < sysconf(_SC_CLK_TCK) / 10);
+    }
+
+    kill(pid, SIGTERM);
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    remove(names_path);
+    remove(socket_path);
+    rmdir(directory);
+    if (failures == 0) {
+        printf("All server connection checks passed\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Round-trip tests for Hash Blocks snapshots.
+ *
+ * Saves linked-list, flat and UTF-8 tables, maps each snapshot and checks
+ * that it holds exactly the table's names, that a corrupted file is refused
+ * when HASH_SNAPSHOT_VERIFY is set, and that truncated or missing files are
+ * refused. Exits non-zero on the first failed check (POSIX only).
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_snapshot test_snapshot.c hashblocks.c -lm
+ */
+#define _POSIX_C_SOURCE 200809L  // mkdtemp and truncate under -std=c17
+#include "hashblocks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Names generated per table, and the length of the longest one with its terminator
+#define NAME_COUNT 3000
+#define NAME_SIZE 12
+
+static int failures = 0;
+
+// Context of check_snapshot_name
+typedef struct SnapshotCheck {
+    const HashSnapshot *snapshot;
+    size_t names;
+} SnapshotCheck;
+
+/**
+ * Fills a buffer with a pseudo-random uppercase name of 3 to 10 letters.
+ *
+ * @param state The generator state, advanced by the call.
+ * @param name Receives the name.
+ */
+static void make_name(unsigned long *state, char name[NAME_SIZE]) {
+    *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+    size_t length = 3 + (*state >> 33) % 8;
+    for (size_t i = 0; i < length; i++) {
+        *state = *state * 6364136223846793005ul + 1442695040888963407ul;
+        name[i] = (char)('A' + (*state >> 33) % 26);
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Visitor that looks up every name of a table in its snapshot.
+ */
+static int check_snapshot_name(const char *name, void *context) {
+    SnapshotCheck *check = (SnapshotCheck *)context;
+    const char *found = hash_snapshot_lookup(check->snapshot, name);
+    CHECK(found != NULL && strcmp(found, name) == 0);
+    check->names++;
+    return 0;
+}
+
+/**
+ * Saves a table, maps the snapshot and compares the two.
+ *
+ * @param table The table to save.
+ * @param path The snapshot file to write.
+ * @param misses Names that are not in the table.
+ * @param miss_count The number of misses.
+ */
+static void check_round_trip(const HashTable *table, const char *path, const char *const *misses,
+                             size_t miss_count) {
+    CHECK(hash_table_save(table, path) == 0);
+    HashSnapshot *snapshot = hash_snapshot_open(path, HASH_SNAPSHOT_VERIFY);
+    CHECK(snapshot != NULL);
+    if (snapshot == NULL) return;
+
+    SnapshotCheck check = { snapshot, 0 };
+    CHECK(hash_table_iterate(table, check_snapshot_name, &check) == 0);
+    CHECK(hash_snapshot_count(snapshot) == check.names);
+    for (size_t i = 0; i < miss_count; i++) {
+        CHECK(hash_snapshot_lookup(snapshot, misses[i]) == NULL);
+    }
+    hash_snapshot_close(snapshot);
+}
+
+/**
+ * Runs the snapshot tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    char directory[] = "/tmp/hashblocks-test-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/table.hb", directory);
+
+    // Names of even draws go in, names of odd draws serve as misses
+    static char names[NAME_COUNT][NAME_SIZE];
+    static const char *misses[NAME_COUNT / 2];
+    unsigned long state = 7;
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        make_name(&state, names[i]);
+    }
+    HashTable *plain = create_hash_table();
+    HashTableOptions options = { .flags = HASH_TABLE_FLAT };
+    HashTable *flat = create_hash_table_ex(&options);
+    options.flags = HASH_TABLE_UTF8;
+    HashTable *utf8 = create_hash_table_ex(&options);
+    CHECK(plain != NULL && flat != NULL && utf8 != NULL);
+    if (plain == NULL || flat == NULL || utf8 == NULL) return 1;
+    for (size_t i = 0; i < NAME_COUNT; i += 2) {
+        CHECK(hash_table_insert(plain, names[i]) == 0);
+        CHECK(hash_table_insert(flat, names[i]) == 0);
+    }
+    size_t miss_count = 0;
+    for (size_t i = 1; i < NAME_COUNT; i += 2) {
+        if (hash_table_lookup(plain, names[i]) == NULL) misses[miss_count++] = names[i];
+    }
+
+    check_round_trip(plain, path, misses, miss_count);
+    check_round_trip(flat, path, misses, miss_count);
+
+    // Names that only a UTF-8 table accepts keep their key mode in the snapshot
+    const char *utf8_names[] = { "Zoë", "O'Brien", "Jean-Luc", "москва", "R2D2" };
+    for (size_t i = 0; i < sizeof(utf8_names) / sizeof(utf8_names[0]); i++) {
+        CHECK(hash_table_insert(utf8, utf8_names[i]) == 0);
+    }
+    const char *utf8_misses[] = { "ZOE", "OBRIEN" };
+    check_round_trip(utf8, path, utf8_misses, 2);
+    HashSnapshot *snapshot = hash_snapshot_open(path, 0);
+    CHECK(snapshot != NULL && hash_snapshot_lookup(snapshot, "zoË") != NULL);
+    hash_snapshot_close(snapshot);
+
+    // An empty table round-trips too
+    HashTable *empty = create_hash_table();
+    CHECK(empty != NULL);
+    if (empty != NULL) {
+        check_round_trip(empty, path, misses, miss_count);
+        destroy_hash_table(empty);
+    }
+
+    // A flipped byte in the string pool is caught by the checksum
+    CHECK(hash_table_save(plain, path) == 0);
+    FILE *file = fopen(path, "r+b");
+    CHECK(file != NULL);
+    if (file != NULL) {
+        CHECK(fseek(file, -2, SEEK_END) == 0);
+        int byte = fgetc(file);
+        CHECK(fseek(file, -2, SEEK_END) == 0);
+        fputc(byte ^ 0x01, file);
+        fclose(file);
+    }
+    CHECK(hash_snapshot_open(path, HASH_SNAPSHOT_VERIFY) == NULL);
+
+    // A file cut short, and no file at all
+    CHECK(truncate(path, 64) == 0);
+    CHECK(hash_snapshot_open(path, 0) == NULL);
+    remove(path);
+    CHECK(hash_snapshot_open(path, 0) == NULL);
+
+    destroy_hash_table(plain);
+    destroy_hash_table(flat);
+    destroy_hash_table(utf8);
+    rmdir(directory);
+    if (failures == 0) {
+        printf("All snapshot checks passed\n");
+    }
+    return failures != 0;
+}
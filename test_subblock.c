@@ -0,0 +1,165 @@
+/*
+ * Tests for the promotion of overfull chains into sub-blocks.
+ *
+ * Fills one third-level slot with names that share a long prefix, checks
+ * that the chain is promoted (and a crowded bucket promoted again) while
+ * every name stays findable and in order, then removes names until the
+ * sub-blocks are flattened back into a chain. Flat and concurrent tables
+ * must never promote. Exits non-zero on the first failed check.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_subblock test_subblock.c hashblocks.c -lm
+ */
+#include "hashblocks.h"
+#include <stdio.h>
+#include <string.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Names stored in the crowded slot, and the size of each with its terminator
+#define NAME_COUNT 300
+#define NAME_SIZE 12
+
+static int failures = 0;
+static HashCursor cursor;  // Large; kept off the stack
+static char names[NAME_COUNT][NAME_SIZE];
+
+/**
+ * Builds the names of the crowded slot, in sorted order: "MAR" itself, then
+ * MARIA followed by up to two letters, so that one bucket of the first
+ * sub-block overflows in turn, then MAR followed by other letters.
+ *
+ * @return The number of names built.
+ */
+static size_t make_names(void) {
+    size_t count = 0;
+    strcpy(names[count++], "MAR");
+    for (char c = 'A'; c <= 'Z' && count < NAME_COUNT; c++) {
+        snprintf(names[count++], NAME_SIZE, "MAR%c", c);
+        if (c != 'I') continue;
+        strcpy(names[count++], "MARIA");
+        for (char d = 'A'; d <= 'Z'; d++) {
+            snprintf(names[count++], NAME_SIZE, "MARIA%c", d);
+            for (char e = 'A'; e <= 'E'; e++) {
+                snprintf(names[count++], NAME_SIZE, "MARIA%c%c", d, e);
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * Returns the number of sub-blocks of a table.
+ */
+static size_t sub_blocks(const HashTable *table) {
+    HashTableMemoryStats stats;
+    hash_table_memory_stats(table, &stats);
+    return stats.sub_blocks;
+}
+
+/**
+ * Checks that a table holds exactly the kept names, found by lookup and in order by a cursor.
+ *
+ * @param table The table.
+ * @param kept Flags marking the names still stored.
+ * @param count The number of names.
+ */
+static void check_names(const HashTable *table, const int *kept, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const char *found = hash_table_lookup(table, names[i]);
+        CHECK(kept[i] ? found != NULL && strcmp(found, names[i]) == 0 : found == NULL);
+    }
+    CHECK(hash_table_lookup(table, "MARIAZZ") == NULL);
+    CHECK(hash_table_lookup(table, "MARIAAAA") == NULL);
+    CHECK(hash_cursor_prefix(&cursor, table, "MAR") == 0);
+    size_t i = 0;
+    int ordered = 1;
+    for (const char *name = hash_cursor_next(&cursor); name != NULL; name = hash_cursor_next(&cursor)) {
+        while (i < count && !kept[i]) i++;
+        if (i == count || strcmp(name, names[i]) != 0) {
+            ordered = 0;
+            break;
+        }
+        i++;
+    }
+    while (i < count && !kept[i]) i++;
+    CHECK(ordered && i == count);
+}
+
+/**
+ * Fills and empties the crowded slot of a table.
+ *
+ * @param flags The HASH_TABLE_* flags of the table.
+ * @param count The number of names.
+ */
+static void check_promotion(unsigned int flags, size_t count) {
+    HashTableOptions options = { .flags = flags };
+    HashTable *table = create_hash_table_ex(&options);
+    CHECK(table != NULL);
+    if (table == NULL) return;
+    int promotes = !(flags & (HASH_TABLE_FLAT | HASH_TABLE_CONCURRENT));
+    int kept[NAME_COUNT] = { 0 };
+
+    // 32 names fit in a chain; the 33rd promotes it
+    for (size_t i = 0; i < 32; i++) {
+        CHECK(hash_table_insert(table, names[i]) == 0);
+        kept[i] = 1;
+    }
+    CHECK(sub_blocks(table) == 0);
+    CHECK(hash_table_insert(table, names[32]) == 0);
+    kept[32] = 1;
+    CHECK((sub_blocks(table) > 0) == promotes);
+    check_names(table, kept, count);
+
+    // The MARIA bucket overflows and is promoted in turn; later inserts go in reverse
+    for (size_t i = count - 1; i > 32; i--) {
+        CHECK(hash_table_insert(table, names[i]) == 0);
+        kept[i] = 1;
+    }
+    CHECK((sub_blocks(table) > 1) == promotes);
+    check_names(table, kept, count);
+    HashTableStats stats;
+    CHECK(hash_table_stats(table, &stats) == 0);
+    CHECK(promotes ? stats.chain_max <= 32 : stats.chain_max == count);
+
+    // A duplicate lands next to its name, and one removal takes out one copy
+    CHECK(hash_table_insert(table, "MARIAB") == 0);
+    CHECK(hash_table_remove(table, "MARIAB") == 0);
+    check_names(table, kept, count);
+
+    // Removing all but a few names flattens the sub-blocks again
+    for (size_t i = 0; i < count; i++) {
+        if (i % 50 != 0) {
+            CHECK(hash_table_remove(table, names[i]) == 0);
+            kept[i] = 0;
+        }
+    }
+    CHECK(sub_blocks(table) == 0);
+    check_names(table, kept, count);
+
+    destroy_hash_table(table);
+}
+
+/**
+ * Runs the sub-block tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    size_t count = make_names();
+    check_promotion(0, count);
+    check_promotion(HASH_TABLE_ARENA, count);
+    check_promotion(HASH_TABLE_FLAT, count);
+    check_promotion(HASH_TABLE_CONCURRENT, count);
+    if (failures == 0) {
+        printf("All sub-block checks passed\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Tests for background teardown, bulk clear and hot swap of tables.
+ *
+ * Clears tables of every layout and refills them before the old contents
+ * are freed, swaps a fresh table into one that a reader thread keeps using
+ * (names present on both sides must never go missing), checks that swapping
+ * tables with different flags is refused, and destroys tables on background
+ * threads. Exits non-zero on the first failed check.
+ *
+ * Build together with the library, leaving out its command-line tool:
+ * clang -std=c17 -O2 -DHASHBLOCKS_NO_MAIN -o test_teardown test_teardown.c hashblocks.c -lm
+ */
+#include "hashblocks.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+// Reports a failed check and counts it
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Names per table, and the size of each with its terminator
+#define NAME_COUNT 5000
+#define NAME_SIZE 12
+
+// State shared with the reader thread of the swap test
+typedef struct SwapRun {
+    HashTable *table;
+    _Atomic int stop;
+    _Atomic size_t lookups;
+    _Atomic size_t errors;
+} SwapRun;
+
+static int failures = 0;
+static char names[NAME_COUNT][NAME_SIZE];
+
+/**
+ * Writes the i-th generated name: four letters spelling i in base 26, then a
+ * letter for the table the name belongs to.
+ *
+ * @param i The index of the name.
+ * @param tag The last letter.
+ * @param name Receives the name.
+ */
+static void make_name(size_t i, char tag, char name[NAME_SIZE]) {
+    for (int p = 3; p >= 0; p--) {
+        name[p] = (char)('A' + i % 26);
+        i /= 26;
+    }
+    name[4] = tag;
+    name[5] = '\0';
+}
+
+/**
+ * Fills a table with the names of one tag.
+ *
+ * @param table The table.
+ * @param tag The last letter of the names.
+ */
+static void fill(HashTable *table, char tag) {
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        make_name(i, tag, names[i]);
+        CHECK(hash_table_insert(table, names[i]) == 0);
+    }
+}
+
+/**
+ * Returns the number of names a table reports.
+ */
+static size_t name_count(const HashTable *table) {
+    HashTableMemoryStats stats;
+    hash_table_memory_stats(table, &stats);
+    return stats.names;
+}
+
+/**
+ * Clears a table, refills it while the old contents may still be freed, and
+ * destroys it on background threads.
+ *
+ * @param flags The HASH_TABLE_* flags of the table.
+ */
+static void check_clear(unsigned int flags) {
+    HashTableOptions options = { .flags = flags };
+    HashTable *table = create_hash_table_ex(&options);
+    CHECK(table != NULL);
+    if (table == NULL) return;
+    fill(table, 'A');
+
+    HashReclaim *reclaim = hash_table_clear_async(table, 3);
+    CHECK(reclaim != NULL);
+    CHECK(name_count(table) == 0);
+    CHECK(hash_table_lookup(table, "AAAAA") == NULL);
+    fill(table, 'B');
+    hash_reclaim_wait(reclaim);
+    CHECK(name_count(table) == NAME_COUNT);
+    CHECK(hash_table_lookup(table, "AAAAB") != NULL && hash_table_lookup(table, "AAAAA") == NULL);
+
+    hash_reclaim_wait(destroy_hash_table_async(table, 2));
+}
+
+/**
+ * Reader thread of the swap test: looks up names that both tables hold.
+ *
+ * @param argument The SwapRun.
+ * @return Always 0.
+ */
+static int swap_reader(void *argument) {
+    SwapRun *run = (SwapRun *)argument;
+    size_t lookups = 0, errors = 0;
+    char name[NAME_SIZE];
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        make_name(lookups % NAME_COUNT, 'S', name);
+        errors += hash_table_lookup(run->table, name) == NULL;
+        lookups++;
+    }
+    atomic_store(&run->lookups, lookups);
+    atomic_store(&run->errors, errors);
+    return 0;
+}
+
+/**
+ * Swaps fresh tables into a concurrent table that a reader keeps using.
+ */
+static void check_swap(void) {
+    HashTableOptions options = { .flags = HASH_TABLE_CONCURRENT };
+    static SwapRun run;
+    run.table = create_hash_table_ex(&options);
+    CHECK(run.table != NULL);
+    if (run.table == NULL) return;
+    fill(run.table, 'S');
+    fill(run.table, 'A');
+
+    thrd_t reader;
+    int started = thrd_create(&reader, swap_reader, &run) == thrd_success;
+    CHECK(started);
+    for (int round = 0; round < 4; round++) {
+        HashTable *fresh = create_hash_table_ex(&options);
+        CHECK(fresh != NULL);
+        if (fresh == NULL) break;
+        char tag = round % 2 ? 'A' : 'B';
+        fill(fresh, 'S');
+        fill(fresh, tag);
+        HashReclaim *reclaim = hash_table_swap(run.table, fresh, 2);
+        CHECK(reclaim != NULL);
+        CHECK(name_count(run.table) == 2 * NAME_COUNT);
+        CHECK(hash_table_lookup(run.table, tag == 'A' ? "AAAAB" : "AAAAA") == NULL);
+        CHECK(hash_table_lookup(run.table, tag == 'A' ? "AAAAA" : "AAAAB") != NULL);
+        hash_reclaim_wait(reclaim);
+    }
+    atomic_store(&run.stop, 1);
+    if (started) thrd_join(reader, NULL);
+    CHECK(run.lookups > 0 && run.errors == 0);
+
+    // A fresh table created with other flags is refused and left alone
+    HashTable *flat = create_hash_table_ex(&(HashTableOptions){ .flags = HASH_TABLE_FLAT });
+    CHECK(flat != NULL);
+    if (flat != NULL) {
+        CHECK(hash_table_insert(flat, "ZELDA") == 0);
+        CHECK(hash_table_swap(run.table, flat, 1) == NULL);
+        CHECK(hash_table_lookup(flat, "ZELDA") != NULL);
+        CHECK(name_count(run.table) == 2 * NAME_COUNT);
+        destroy_hash_table(flat);
+    }
+
+    hash_reclaim_wait(destroy_hash_table_async(run.table, 0));
+}
+
+/**
+ * Runs the teardown tests.
+ *
+ * @return 0 if every check passed, or 1.
+ */
+int main(void) {
+    check_clear(0);
+    check_clear(HASH_TABLE_ARENA);
+    check_clear(HASH_TABLE_FLAT);
+    check_clear(HASH_TABLE_CONCURRENT);
+    check_clear(HASH_TABLE_FILTER);
+    check_swap();
+
+    CHECK(destroy_hash_table_async(NULL, 1) == NULL);
+    hash_reclaim_wait(NULL);
+    if (failures == 0) {
+        printf("All teardown checks passed\n");
+    }
+    return failures != 0;
+}